@@ -0,0 +1,95 @@
+/*
+ *  arrow_ipc.h
+ *	Reader and writer of Apache Arrow IPC files (Feather version 2) with flat columns of numbers and strings
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#if !defined( _ARROW_IPC_ )
+#define _ARROW_IPC_
+
+#include <stddef.h>
+
+#define ARROW_MAX_NAME_LEN 256     //maximum length of a column name
+#define ARROW_BATCH_ROWS 1048576   //number of rows in a record batch written
+
+#define ARROW_TYPE_OTHER 0         //column of a type not read by the tools
+#define ARROW_TYPE_INT 1           //integers; written as 32 bit signed integers
+#define ARROW_TYPE_FLOAT 2         //floating point numbers; written as doubles
+#define ARROW_TYPE_UTF8 3          //strings, possibly dictionary encoded; written from arrays of characters terminated by 0
+
+typedef struct
+{
+	char name[ARROW_MAX_NAME_LEN]; //name of the column
+	int type;                      //ARROW_TYPE_INT, ARROW_TYPE_FLOAT, ARROW_TYPE_UTF8 or ARROW_TYPE_OTHER
+	int bitWidth;                  //bits of an integer or floating point value, or of the offsets of strings
+	int isSigned;                  //1 if integers are signed
+	int bufferNum;                 //number of buffers of the column in a record batch
+	long dictionaryId;             //id of the dictionary, -1 if the column is not dictionary encoded
+	int indexBitWidth;             //bits of the dictionary indices
+	long dictNum;                  //number of strings in the dictionary
+	const char *dictOffsets;       //offsets of the strings of the dictionary, of bitWidth bits
+	const char *dictData;          //characters of the strings of the dictionary
+} ARROW_COLUMN;
+
+typedef struct
+{
+	long length;                   //number of values
+	long nullCount;                //number of null values
+	const char *values;            //values, dictionary indices, or offsets of strings
+	const char *data;              //characters of strings
+} ARROW_ARRAY;
+
+typedef struct
+{
+	char *map;                     //file mapped in memory
+	size_t size;                   //size of the file
+	int columnNum;                 //number of columns
+	ARROW_COLUMN *columns;         //columns of the schema
+	int batchNum;                  //number of record batches
+	const char **batchMeta;        //RecordBatch table of each batch
+	const char **batchBody;        //body of each batch
+	long rowNum;                   //number of rows in all batches
+} ARROW_FILE;
+
+typedef struct
+{
+	const char *name;              //name of the column
+	int type;                      //ARROW_TYPE_INT for int, ARROW_TYPE_FLOAT for double, ARROW_TYPE_UTF8 for char[]
+	const char *base;              //value of the first row
+	long stride;                   //bytes from the value of a row to the value of the next row
+} ARROW_OUT_COLUMN;
+
+//Return 1 if the file starts with the magic bytes of an Arrow IPC file. Standard input "-" is never an Arrow file
+int IsArrowFile(const char *fileName);
+
+//Return 1 if the file name ends with .arrow or .feather, for results written as Arrow
+int IsArrowName(const char *fileName);
+
+//Map an Arrow IPC file and read its schema, dictionaries and record batch index. Return NULL if failure
+ARROW_FILE *ArrowOpen(const char *fileName);
+
+//Locate the arrays of all columns of record batch batchIndex, in place in the mapped file. Return the number of rows, or -1 if failure
+long ArrowReadBatch(ARROW_FILE *file, int batchIndex, ARROW_ARRAY *arrays);
+
+//Convert the numbers of an array of an integer or floating point column to doubles. Return 1 if success, -1 if the column is not numeric
+int ArrowToDoubles(const ARROW_COLUMN *column, const ARROW_ARRAY *array, double *values);
+
+//Copy the dictionary indices of an array of a dictionary encoded column to ints. Return 1 if success, -1 if the column is not dictionary encoded
+int ArrowToIndices(const ARROW_COLUMN *column, const ARROW_ARRAY *array, int *indices);
+
+//Return string row of an array of a string column, not terminated by 0, and its length in *len. Dictionaries are resolved
+const char *ArrowString(const ARROW_COLUMN *column, const ARROW_ARRAY *array, long row, long *len);
+
+//Return string index of the dictionary of a column, and its length in *len. Return NULL if out of range
+const char *ArrowDictString(const ARROW_COLUMN *column, long index, long *len);
+
+//Unmap the file and free it
+void ArrowClose(ARROW_FILE *file);
+
+//Write rowNum rows of columns to an Arrow IPC file, in record batches of ARROW_BATCH_ROWS rows. Return 1 if success, -1 if failure
+int ArrowWriteFile(const char *fileName, const ARROW_OUT_COLUMN *columns, int columnNum, long rowNum);
+
+#endif
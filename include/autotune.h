@@ -0,0 +1,49 @@
+/*
+ *  autotune.h
+ *	Calibration of the execution parameters on the host, cached per host in a small config file
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#if !defined( _AUTOTUNE_ )
+#define _AUTOTUNE_
+
+#include <stdio.h>
+
+#define TUNE_FILE_NAME ".crispr_tune"  //cache of tuned parameters in the home directory, one line per host
+#define TUNE_MAX_LINE 1024         //maximum length of a line or a file name
+#define TUNE_MAX_HOST_LEN 256      //maximum length of a host name
+#define TUNE_BENCH_ITEMS 131072    //items of the synthetic data of the calibration
+#define TUNE_BENCH_WINDOW 200      //window size of the calibration of AdjustMR
+#define TUNE_BENCH_SEED 123456     //seed of the synthetic data
+#define TUNE_MIN_GAIN 0.05         //fraction of time a candidate must save to replace a smaller one
+
+typedef struct
+{
+	char host[TUNE_MAX_HOST_LEN];  //host name
+	int cpuNum;                    //number of online CPUs when tuned
+	int threadNum;                 //number of worker threads
+	int normChunkRows;             //items adjusted by one task of AdjustMR
+	int outChunkRows;              //rows formatted into one output chunk
+	int fromCache;                 //1 if read from the cache, 0 if calibrated by this run
+	char fileName[TUNE_MAX_LINE];  //cache file, empty if there is none
+} TUNE_PARAMS;
+
+//Find the parameters of this host in the cache fileName, or in TUNE_FILE_NAME of the home directory if fileName is NULL.
+//A host is matched by its name and number of CPUs; if it is not found, the parameters are calibrated and added to the cache.
+//Return 1 if success, -1 if failure
+int TuneLoad(const char *fileName, TUNE_PARAMS *params);
+
+//Run the calibration microbenchmarks on synthetic data: AdjustMR for each number of threads and chunk size, then
+//formatted output for each chunk size with the best number of threads. Return 1 if success, -1 if failure
+int TuneCalibrate(TUNE_PARAMS *params);
+
+//Set the chunk sizes of the parameters. The number of threads is given to ThreadPoolCreate by the caller
+void TuneApply(const TUNE_PARAMS *params);
+
+//Print the parameters in use and where they came from
+void TuneReport(FILE *fh, const TUNE_PARAMS *params);
+
+#endif
@@ -0,0 +1,57 @@
+/*
+ *  block_reader.h
+ *	Line reader of files or standard input, prefetched by a reader thread into double-buffered blocks
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#if !defined( _BLOCK_READER_ )
+#define _BLOCK_READER_
+
+#include <stdio.h>
+#include <pthread.h>
+
+#define READER_BLOCK_SIZE 1048576  //size of a block read at once
+#define READER_BLOCK_NUM 2         //number of blocks: one parsed while the other is filled
+
+typedef struct
+{
+	FILE *fh;                      //input file, or stdin
+	char *blocks[READER_BLOCK_NUM];  //blocks of input
+	long blockLen[READER_BLOCK_NUM];   //number of bytes in each block
+	int blockFull[READER_BLOCK_NUM];   //1 if a block is filled and not parsed yet
+	int blockLast[READER_BLOCK_NUM];   //1 if a block is the last of the input
+	int readIndex;                 //block being parsed
+	long readPos;                  //position of the next line in the block being parsed
+	int holding;                   //1 if the parser holds block readIndex
+	int finished;                  //1 when the parser consumed the last block
+	int atEnd;                     //1 when the last line returned reached the end of input, as feof after fgets
+	int error;                     //1 if reading failed
+	int stopping;                  //1 when the reader thread is asked to exit
+	char *line;                    //line spanning two blocks
+	long lineSize;                 //allocated size of line
+	pthread_t thread;              //reader thread
+	pthread_mutex_t mutex;
+	pthread_cond_t blockFilled;    //signaled when a block is filled
+	pthread_cond_t blockEmptied;   //signaled when a block is parsed
+} READER_STRUCT;
+
+//Return 1 if fileName means standard input or standard output
+int IsStdStream(const char *fileName);
+
+//Open a file for reading, "-" for standard input, and start the reader thread. Return NULL if failure
+READER_STRUCT *ReaderOpen(const char *fileName);
+
+//Return the next line, terminated by 0 and without its newline, or NULL at the end of input.
+//The line stays valid until the next call
+char *ReaderGetLine(READER_STRUCT *reader);
+
+//Return 1 if the last line returned reached the end of input, as feof does after fgets. A final line without newline sets it
+int ReaderAtEnd(READER_STRUCT *reader);
+
+//Stop the reader thread, close the input and free the reader. Return 1 if the input was read without error, -1 otherwise
+int ReaderClose(READER_STRUCT *reader);
+
+#endif
@@ -0,0 +1,48 @@
+/*
+ *  checkpoint.h
+ *	Checkpoint and resume of long random simulations
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#if !defined( _CHECKPOINT_ )
+#define _CHECKPOINT_
+
+#include <time.h>
+
+#define CHECKPOINT_RNG_STREAMS 256    //number of random number streams in rngs.c
+
+typedef struct
+{
+	char fileName[1000];           //checkpoint file
+	int interval;                  //minimum number of seconds between two checkpoints
+	int resume;                    //1 to resume from the checkpoint file if it exists
+	time_t lastSaveTime;           //time of the last checkpoint
+} CHECKPOINT_STRUCT;
+
+//Hash a block of bytes into a running 64-bit key (FNV-1a). Start with key = 0
+unsigned long long CheckpointKey(unsigned long long key, const void *data, long size);
+
+//Return 1 if a checkpoint is due, either because the interval has passed or because the program was asked to terminate
+int CheckpointDue(CHECKPOINT_STRUCT *ckpt);
+
+//Save the progress of a simulation: number of passes done, the states of all random number streams and the values
+//simulated so far. key identifies the simulation. The file is replaced atomically. Return 1 if success, -1 if failure
+int SaveCheckpoint(CHECKPOINT_STRUCT *ckpt, unsigned long long key, int passDone, const double *values, long valueNum);
+
+//Load a checkpoint saved with the same key. Restore the random number streams and copy at most maxValueNum values.
+//Return 1 if loaded, 0 if there is no checkpoint file, -1 if the checkpoint is for another simulation or cannot be read
+int LoadCheckpoint(CHECKPOINT_STRUCT *ckpt, unsigned long long key, int *passDone, double *values, long maxValueNum, long *valueNum);
+
+//Remove the checkpoint file after the simulation completed
+void RemoveCheckpoint(CHECKPOINT_STRUCT *ckpt);
+
+//Catch SIGTERM and SIGINT, so that a simulation can save a checkpoint before it is preempted
+void CatchTerminateSignals(void);
+
+//Return 1 if SIGTERM or SIGINT was received
+int TerminateRequested(void);
+
+#endif
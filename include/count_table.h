@@ -0,0 +1,59 @@
+/*
+ *  count_table.h
+ *	Table of sgRNA counts in many samples, read from text in a single pass into columns
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#if !defined( _COUNT_TABLE_ )
+#define _COUNT_TABLE_
+
+#define COUNT_NAME_LEN 255         //maximum length of an sgRNA, gene or sample name
+#define COUNT_MAX_SAMPLES 1000     //maximum number of samples
+
+typedef struct
+{
+	char sgName[COUNT_NAME_LEN];     //name of the sgRNA
+	char geneName[COUNT_NAME_LEN];   //name of the gene
+} COUNT_ITEM;
+
+typedef struct
+{
+	COUNT_ITEM *items;               //names of the sgRNAs
+	double *counts;                  //counts by column: counts[j*itemNum+i] for sgRNA i in sample j
+	char (*sampleNames)[COUNT_NAME_LEN];  //names of the samples, from the header
+	int itemNum;                     //number of sgRNAs
+	int sampleNum;                   //number of samples
+} COUNT_TABLE;
+
+typedef struct
+{
+	COUNT_ITEM *items;               //names of the sgRNAs, the rows
+	char (*sampleNames)[COUNT_NAME_LEN];  //names of the samples, the columns
+	long *rowStart;                  //itemNum+1 offsets: the nonzero counts of sgRNA i are rowStart[i] to rowStart[i+1]-1
+	int *columns;                    //sample of each nonzero count
+	double *values;                  //nonzero counts
+	long nonzeroNum;                 //number of nonzero counts
+	int itemNum;                     //number of sgRNAs
+	int sampleNum;                   //number of samples
+} SPARSE_COUNT_TABLE;
+
+//Read a count table, "-" for standard input, in a single pass. File Format: <sgRNA id> <gene id> <count in sample 1> ... <count in sample n>,
+//with a header naming the samples. Each column of counts grows in place as rows are read. Return the number of sgRNAs, or -1 if failure
+int ReadCountTable(const char *fileName, COUNT_TABLE *table);
+
+//Free the names and counts of table
+void FreeCountTable(COUNT_TABLE *table);
+
+//Read a sparse count table from a Matrix Market coordinate file, "-" for standard input, with sgRNAs as rows and samples as columns, into rows
+//of nonzero counts (CSR). The row names are read from rowFileName, <sgRNA id> <gene id> per line, and the sample names from columnFileName,
+//one per line, in the order of the matrix. Zero entries are dropped, and each sgRNA and sample should have one entry at most.
+//Memory grows with the nonzero counts. Return the number of sgRNAs, or -1 if failure
+int ReadSparseCountTable(const char *fileName, const char *rowFileName, const char *columnFileName, SPARSE_COUNT_TABLE *table);
+
+//Free the names and counts of table
+void FreeSparseCountTable(SPARSE_COUNT_TABLE *table);
+
+#endif
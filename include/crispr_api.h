@@ -0,0 +1,52 @@
+/*
+ *  crispr_api.h
+ *	C interface to run normalization and RRA on columns held in memory by the caller, as built into libcrispr.so
+ *
+ *  Input columns are read in place and never copied; results are written into arrays allocated by the caller.
+ *  The functions use the random number generator of rngs.c and are not reentrant: calls must not overlap.
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#if !defined( _CRISPR_API_ )
+#define _CRISPR_API_
+
+#define CRISPR_API_VERSION 2       //incremented when a function of the interface changes
+
+#if defined( __cplusplus )
+extern "C" {
+#endif
+
+//Return CRISPR_API_VERSION of the library
+int CrisprApiVersion(void);
+
+//Return the message of the last failure, or an empty string
+const char *CrisprApiError(void);
+
+//Normalize itemNum sgRNAs measured in two libraries, x1 and x2, as CrisprNorm does with window size winSize, on threadNum threads.
+//The log-means, log-ratios and adjusted log-ratios are written to m, r and adjustedR, each of itemNum values.
+//The normalized measures of CrisprNorm are m-adjustedR/2 and m+adjustedR/2. Return 1 if success, -1 if failure
+int CrisprNormColumns(const double *x1, const double *x2, int itemNum, int winSize, int threadNum,
+					  double *m, double *r, double *adjustedR);
+
+//Run RRA as RRA does on itemNum items, given by their value, the index of their group from 0 to groupNum-1 and the index of
+//their list from 0 to listNum-1. The lo-value and false discovery rate of each group are written to loValue and fdr, each of
+//groupNum values. Groups numbered in order of first appearance give the same results as RRA on the same input.
+//A group without items gets a lo-value and a false discovery rate of 1. Return 1 if success, -1 if failure
+int RRAColumns(const double *values, const int *groupIds, const int *listIds, int itemNum, int groupNum, int listNum,
+			   double maxPercentile, double *loValue, double *fdr);
+
+//CDF of the non-central beta distribution on a grid of rowNum rows of parameters a, b and lambda by xNum values x, as BetaNoncentralCdf gives
+//with the error of RRA, into values[r*xNum+i] for row r and value x[i], for power and calibration studies. Each row computes its log beta
+//function and Poisson weights once and advances all x together; rows run in parallel on threadNum threads, each with its own work array.
+//Return 1 if success, -1 if failure
+int BetaNoncentralGridColumns(const double *a, const double *b, const double *lambda, int rowNum, const double *x, int xNum, int threadNum,
+							  double *values);
+
+#if defined( __cplusplus )
+}
+#endif
+
+#endif
@@ -0,0 +1,37 @@
+/*
+ *  dict.h
+ *	Dictionary of names, mapping each distinct name to a dense index
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#if !defined( _DICT_ )
+#define _DICT_
+
+typedef struct
+{
+	char **names;                  //names in the order of insertion. The index of a name is its position here
+	int num;                       //number of names in the dictionary
+	int capacity;                  //allocated length of names
+	int *table;                    //open-addressing hash table, storing index+1 of a name, 0 if the slot is empty
+	int tableSize;                 //number of slots in table, always a power of 2
+} DICT_STRUCT;
+
+//Create an empty dictionary. initCapacity is a hint of the number of names. Return NULL if failure
+DICT_STRUCT *DictCreate(int initCapacity);
+
+//Free a dictionary
+void DictFree(DICT_STRUCT *dict);
+
+//Look up a name. Return its index, or -1 if the name is not in the dictionary
+int DictLookup(DICT_STRUCT *dict, const char *name);
+
+//Insert a name if it is not in the dictionary yet. Return the index of the name, or -1 if failure
+int DictInsert(DICT_STRUCT *dict, const char *name);
+
+//Hash value of a string (FNV-1a)
+unsigned int DictHash(const char *name);
+
+#endif
@@ -0,0 +1,53 @@
+/*
+ *  exec_ctx.h
+ *	Execution context: NUMA topology, pinning of worker threads, interleaving and huge pages for large buffers
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#if !defined( _EXEC_CTX_ )
+#define _EXEC_CTX_
+
+#include <stdio.h>
+#include "thread_pool.h"
+
+#define HUGE_PAGES_OFF 0           //large buffers come from malloc. The default: huge pages are opt-in, like --numa
+#define HUGE_PAGES_THP 1           //large buffers are mapped and advised to use transparent huge pages
+#define HUGE_PAGES_EXPLICIT 2      //large buffers are mapped from the explicit huge page pool, falling back to transparent huge pages
+
+#define EXEC_LARGE_BUFFER 2097152  //buffers of at least this size are mapped separately, one huge page
+#define EXEC_MAX_NODE_NUM 64       //maximum number of NUMA nodes
+#define EXEC_MAX_REGION_NUM 1024   //maximum number of large buffers tracked for the placement report
+#define EXEC_SAMPLE_PAGES 256      //number of pages sampled in a buffer to find their nodes
+
+//Detect the NUMA topology and set the options. With numa, worker threads are pinned and large buffers read by all workers are
+//interleaved over the nodes. hugePages is one of HUGE_PAGES_OFF, HUGE_PAGES_THP or HUGE_PAGES_EXPLICIT. With report, the placement of
+//large buffers is sampled for ExecReport. Return 1 if success, -1 if failure
+int ExecInit(int numa, int hugePages, int report);
+
+//Parse the value of --huge-pages: off, thp or explicit. Return -1 if unknown
+int ParseHugePages(const char *value);
+
+//Return the number of NUMA nodes
+int ExecNodeNum(void);
+
+//Pin the calling worker thread to a CPU. Workers are spread over the nodes in turn. Does nothing unless numa is on
+void ExecPinWorker(int workerIndex);
+
+//Interleave the pages of a buffer over the NUMA nodes, for a buffer that is read by all workers wherever they are. Call before the
+//buffer is written: pages already placed stay where they are. Does nothing unless numa is on and there are several nodes
+void ExecInterleave(void *ptr, size_t size);
+
+//Map a large buffer backed by huge pages as set by ExecInit. subsystem is recorded for the report. Return NULL if large buffers
+//are not mapped (HUGE_PAGES_OFF) or if failure
+void *ExecMapLarge(size_t size, int subsystem);
+
+//Unmap a buffer mapped by ExecMapLarge
+void ExecUnmapLarge(void *ptr, size_t size);
+
+//Print the topology, the options and where the pages of the large buffers of each subsystem were placed
+void ExecReport(FILE *fh, const char **subsystemNames, int subsystemNum);
+
+#endif
@@ -0,0 +1,91 @@
+/*
+ *  extsort.h
+ *	External sort of fixed-size records, for data sets larger than memory
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#if !defined( _EXTSORT_ )
+#define _EXTSORT_
+
+#include <stdio.h>
+
+#define EXTSORT_MIN_RUN_BUFFER 65536  //minimum size in bytes of the read buffer of a run during merging
+
+//comparison function of two records, in the convention of qsort
+typedef int (*EXTSORT_COMPARE)(const void *, const void *);
+
+typedef struct
+{
+	int recordSize;                //size of a record in bytes
+	EXTSORT_COMPARE compare;       //comparison function of records
+	long memBudget;                //memory budget of the sorter in bytes
+	char tmpDir[1000];             //directory of temporary files
+	char *buffer;                  //in-memory buffer of records, sorted and spilled to a run when full
+	long bufferCapacity;           //number of records the buffer can hold
+	long bufferNum;                //number of records in the buffer
+	FILE **runs;                   //sorted runs spilled to temporary files
+	int runNum;                    //number of runs
+	int runCapacity;               //allocated length of runs
+	long totalNum;                 //total number of records added
+	int merging;                   //0: adding records; 1: reading records in sorted order
+	long bufferPos;                //read position in buffer, if no run was spilled
+	char *heads;                   //current record of each run in merging
+	int *heap;                     //min-heap of run indices, ordered by their current records
+	int heapSize;                  //number of runs in heap
+	char **runBuffers;             //read buffers of the runs in merging
+	long *runBufferPos;            //read position in each run buffer, in bytes
+	long *runBufferLen;            //number of valid bytes in each run buffer
+	long runBufferSize;            //size of each run buffer in bytes
+} EXTSORT_STRUCT;
+
+typedef struct
+{
+	int recordSize;                //size of a record in bytes
+	char *buffer;                  //in-memory part of the records
+	long bufferCapacity;           //number of records the buffer can hold
+	long num;                      //number of records stored
+	long readPos;                  //read position
+	FILE *overflow;                //temporary file storing records beyond the buffer, NULL if not used
+	char tmpDir[1000];             //directory of temporary files
+} SPILL_BUFFER;
+
+//Create a sorter of records. memBudget is in bytes. tmpDir is the directory of temporary files, NULL to use $TMPDIR or /tmp. Return NULL if failure
+EXTSORT_STRUCT *ExtSortCreate(int recordSize, EXTSORT_COMPARE compare, long memBudget, const char *tmpDir);
+
+//Add a record to the sorter. Return 1 if success, -1 if failure
+int ExtSortAdd(EXTSORT_STRUCT *sorter, const void *record);
+
+//Finish adding records and prepare to read them in sorted order. Merge the runs with k-way merges. Return 1 if success, -1 if failure
+int ExtSortFinish(EXTSORT_STRUCT *sorter);
+
+//Read the next record in sorted order. Return 1 if a record is read, 0 if no record is left, -1 if failure
+int ExtSortNext(EXTSORT_STRUCT *sorter, void *record);
+
+//Free a sorter and remove its temporary files
+void ExtSortFree(EXTSORT_STRUCT *sorter);
+
+//Open an unnamed temporary file in tmpDir (NULL for the default directory). The file is removed when closed. Return NULL if failure
+FILE *OpenTempFile(const char *tmpDir);
+
+//Create a buffer of records that keeps up to memBudget bytes in memory and spills the rest to a temporary file. Return NULL if failure
+SPILL_BUFFER *SpillBufferCreate(int recordSize, long memBudget, const char *tmpDir);
+
+//Append a record. Return 1 if success, -1 if failure
+int SpillBufferAdd(SPILL_BUFFER *spill, const void *record);
+
+//Start reading the records from the beginning. Return 1 if success, -1 if failure
+int SpillBufferRewind(SPILL_BUFFER *spill);
+
+//Read the next record. Return 1 if a record is read, 0 if no record is left, -1 if failure
+int SpillBufferNext(SPILL_BUFFER *spill, void *record);
+
+//Remove all records
+void SpillBufferClear(SPILL_BUFFER *spill);
+
+//Free a spill buffer
+void SpillBufferFree(SPILL_BUFFER *spill);
+
+#endif
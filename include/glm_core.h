@@ -0,0 +1,46 @@
+/*
+ *  glm_core.h
+ *	Per-gene negative binomial regression of sgRNA counts on a sparse design of the samples
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#if !defined( _GLM_CORE_ )
+#define _GLM_CORE_
+
+#include "thread_pool.h"
+#include "nb_test.h"
+
+#define GLM_MAX_ITER 50            //maximum number of Newton iterations of a gene
+#define GLM_TOLERANCE 1E-8         //largest change of a coefficient at convergence
+#define GLM_RIDGE 1E-8             //added to the diagonal of the information, so that a covariate absent from the samples of a gene gets 0
+#define GLM_MAX_STEP 5.0           //largest change of a coefficient in one iteration, in log scale
+#define GLM_MAX_ETA 40.0           //largest log-mean of a count, so that a diverging fit does not overflow
+#define GLM_BATCH_GENES 64         //maximum number of genes of one batch, all with the same number of guides
+
+typedef struct
+{
+	int sampleNum;                 //number of samples, the rows of the design
+	int covariateNum;              //number of covariates, the columns of the design
+	int *rowStart;                 //sampleNum+1 offsets: the entries of sample j are rowStart[j] to rowStart[j+1]-1
+	int *columns;                  //covariate of each entry
+	double *values;                //value of each entry
+} GLM_DESIGN;
+
+typedef struct
+{
+	double *beta;                  //effect of each covariate on each gene, beta[g*covariateNum+c]
+	double *stdErr;                //standard error of each effect
+	int *iterations;               //Newton iterations of each gene, GLM_MAX_ITER+1 if the fit did not converge
+} GLM_RESULT;
+
+//Fit log(mean count of guide i of gene g in sample j) = log(sizeFactors[j])+alpha_i+sum over c of design(j,c)*beta_gc for each of geneNum genes,
+//whose guides are guides[geneStart[g]] to guides[geneStart[g+1]-1], rows of counts by column (counts[j*itemNum+i]), with the variance of the trend.
+//The guide intercepts alpha take the place of an intercept of the design. Genes are fitted by Newton iterations in batches of genes with the same
+//number of guides, each worker of the pool in its own workspace allocated beforehand. Results are allocated by the caller. Return 1 if success, -1 if failure
+int GLMFitGenes(const double *counts, int itemNum, const double *sizeFactors, const NB_TREND *trend, const GLM_DESIGN *design,
+				const int *guides, const int *geneStart, int geneNum, THREAD_POOL_STRUCT *pool, GLM_RESULT *results);
+
+#endif
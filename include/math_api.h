@@ -7,6 +7,12 @@
  *
  */
 
+#if !defined( _MATH_API_ )
+#define _MATH_API_
+
+#define BETA_MAX_LANES 8           //maximum number of values of one call of BetaIncompleteLanes
+#define REPRO_BLOCK 256            //values summed by the inner loop of ReproSum and ReproDot, the leaves of their reduction tree
+
 typedef struct
 {
 	double value;
@@ -40,5 +46,38 @@ double PartialCorrel(double *a, double *b, double *control, int dim);
 //Randomly permute an array of float values
 void PermuteFloatArrays(double *a, int size);
 
+//Incomplete beta function ratio of laneNum values x sharing the parameters p and q and beta, the log of the beta function of p and q.
+//The lanes run the series of betain in lockstep and each stops when it converges, so that values[i] is what betain returns for x[i]
+void BetaIncompleteLanes(const double *x, int laneNum, double p, double q, double beta, double *values);
+
+//Sum of n values in a fixed order: blocks of REPRO_BLOCK values are summed in 4 interleaved lanes, and the block sums pairwise.
+//The result depends only on the values and n, not on how the caller splits the work
+double ReproSum(const double *a, int n);
+
+//Sum of (a[i]-centerA)*(b[i]-centerB) over n values, in the order of ReproSum. ReproDot(a, a, n, mean, mean) is a sum of squared deviations
+double ReproDot(const double *a, const double *b, int n, double centerA, double centerB);
+
+//Combine the sums of consecutive blocks of REPRO_BLOCK values pairwise, as ReproSum does. Threads that sum whole blocks with ReproSum
+//or ReproDot and combine them here get the same result as one ReproSum over all values, for any number of threads
+double ReproCombine(const double *blockSums, int blockNum);
+
+//Compute logarithm of Gamma function. flag=0, no error; flag=1, x<=0
+double LogGamma(double x, int *flag);
+
+//Logarithm of the Gamma function of n values x into values, by the series of LogGamma. The argument is shifted by a fixed 7 rather than
+//up to 7, so that the loop has no branch on the values and compilers can vectorize it. Values of x not positive give 0
+void LogGammaArray(const double *x, int n, double *values);
+
+//Compute incomplete beta function ratio of x with parameters p and q, and beta, the log of the beta function of p and q.
+//ifault=0, no error; ifault=1, p or q not positive; ifault=2, x out of [0,1]
+double betain(double x, double p, double q, double beta, int *ifault);
+
 //Compute CDF of a non-central beta distribution. when lambda is 0.0, it's cpf of beta distribution
 double BetaNoncentralCdf(double a, double b, double lambda, double x, double error_max);
+
+//CDF of the non-central beta distribution of a, b and lambda at xNum values x into values, each what BetaNoncentralCdf returns for x[i].
+//The log of the beta function and the Poisson weights are computed once for all x, the incomplete beta ratios start in lanes of
+//BetaIncompleteLanes, and each term of the series advances all x in one loop without branches. work holds 2*xNum values
+void BetaNoncentralRow(double a, double b, double lambda, const double *x, int xNum, double error_max, double *work, double *values);
+
+#endif
@@ -0,0 +1,55 @@
+/*
+ *  mem_acct.h
+ *	Accounting of memory allocations by subsystem, with an optional memory limit
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#if !defined( _MEM_ACCT_ )
+#define _MEM_ACCT_
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define MEM_INPUT 0                //input records, names and dictionaries
+#define MEM_GROUPS 1               //groups and their items
+#define MEM_LISTS 2                //sorted values of lists
+#define MEM_NULL 3                 //null distribution for false discovery rate
+#define MEM_SORT 4                 //sort and merge buffers, including out-of-core runs
+#define MEM_WORK 5                 //temporary working arrays
+#define MEM_OUTPUT 6               //formatted output waiting to be written
+#define MEM_SUBSYSTEM_NUM 7        //number of subsystems
+
+//Set the memory limit in bytes. 0 means no limit
+void SetMemLimit(long limit);
+
+//Return the memory limit in bytes. 0 means no limit
+long GetMemLimit(void);
+
+//Return the number of bytes currently allocated through the accounting layer
+long GetMemInUse(void);
+
+//Return the number of bytes that can still be allocated under the limit. Return a large number if there is no limit
+long GetMemAvailable(void);
+
+//Allocate memory charged to a subsystem. Return NULL if failure or if the allocation would exceed the memory limit
+void *MemAlloc(int subsystem, size_t size);
+
+//Allocate zero-initialized memory charged to a subsystem. Return NULL if failure or if the allocation would exceed the memory limit
+void *MemCalloc(int subsystem, size_t num, size_t size);
+
+//Resize memory allocated by MemAlloc, MemCalloc or MemRealloc. ptr can be NULL. Return NULL if failure, in which case ptr is left unchanged
+void *MemRealloc(int subsystem, void *ptr, size_t size);
+
+//Free memory allocated by MemAlloc, MemCalloc or MemRealloc. ptr can be NULL
+void MemFree(void *ptr);
+
+//Return the peak resident set size of the process in bytes
+long GetPeakRSS(void);
+
+//Print the current and peak memory of each subsystem and the peak resident set size
+void PrintMemReport(FILE *fh);
+
+#endif
@@ -0,0 +1,40 @@
+/*
+ *  nb_test.h
+ *	Negative binomial test of sgRNA counts of replicate samples, ranking sgRNAs for RRA
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#if !defined( _NB_TEST_ )
+#define _NB_TEST_
+
+#include "thread_pool.h"
+
+#define NB_CHUNK_ROWS 4096         //number of sgRNAs tested by one task
+#define NB_MIN_FIT_NUM 10          //minimum number of over-dispersed sgRNAs to fit the mean-variance trend
+#define NB_MIN_MEAN 0.5            //smallest control mean tested, so that sgRNAs absent from the control still get a distribution
+
+typedef struct
+{
+	double intercept;              //log(variance-mean) = intercept+slope*log(mean)
+	double slope;                  //slope of the trend in log scale
+	int fitNum;                    //number of sgRNAs the trend was fitted on
+} NB_TREND;
+
+//Median-ratio size factor of each of the sampleNum samples of the counts of itemNum sgRNAs, counts[j*itemNum+i] for sgRNA i in sample j, as in COUNT_TABLE,
+//into sizeFactors. Only the sgRNAs counted in all samples take part. Return 1 if success, -1 if failure
+int NBSizeFactors(const double *counts, int itemNum, int sampleNum, double *sizeFactors);
+
+//Fit the trend of the variance of the normalized counts on their mean across sgRNAs, over the controlNum control samples, the first ones,
+//or over all samples if there is a single control. Only sgRNAs whose variance is above the mean are fitted. Return 1 if success, -1 if failure
+int NBFitTrend(const double *counts, int itemNum, int sampleNum, int controlNum, const double *sizeFactors, NB_TREND *trend);
+
+//Test the mean normalized count of the treatment samples of each sgRNA against a negative binomial distribution of the mean of its
+//control samples and the variance of the trend. The probabilities of a count as low and as high are written to pLow and pHigh, each of
+//itemNum values. Chunks of NB_CHUNK_ROWS sgRNAs are tested on the thread pool, the log-gamma values of a chunk in one batch. Return 1 if success, -1 if failure
+int NBTestGuides(const double *counts, int itemNum, int sampleNum, int controlNum, const double *sizeFactors, const NB_TREND *trend,
+				 THREAD_POOL_STRUCT *pool, double *pLow, double *pHigh);
+
+#endif
@@ -0,0 +1,69 @@
+/*
+ *  norm_core.h
+ *	Normalization of Crispr measures on columns of values: MA transform, adjustment of the log-ratio in a sliding window, copy-number correction and slopes of time courses
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#if !defined( _NORM_CORE_ )
+#define _NORM_CORE_
+
+#include "math_api.h"
+#include "thread_pool.h"
+
+#define NORM_CHUNK_ROWS 16384      //default number of items adjusted by one task
+#define NORM_WORK_BYTES (sizeof(INDEXED_FLOAT)+2*sizeof(double))   //bytes of work memory per item in AdjustMR
+#define NORM_CN_CHROM_STRIDE 4294967296.0   //sort key of position p on chromosome c is c*NORM_CN_CHROM_STRIDE+p
+
+//Called by the worker that adjusted items start to end-1, chunk number chunkIndex
+typedef void (*NORM_CHUNK_FUNC)(void *arg, int chunkIndex, int start, int end);
+
+//Set the number of items adjusted by one task of AdjustMR, NORM_CHUNK_ROWS by default
+void SetNormChunkRows(int itemNum);
+
+//Return the number of chunks of AdjustMR for itemNum items
+int NormChunkNum(int itemNum);
+
+//transform to log mean-ratio. m = x1'+x2', r = x2'-x1', x' = log2(x/median+0.01), 0.01 is the pseudo-count.
+//m and r have itemNum values, allocated by the caller. Return 1 if success, -1 if failure
+int ComputeMR(const double *x1, const double *x2, int itemNum, double *m, double *r);
+
+//Size factors of sampleNum columns of itemNum values, x[j*itemNum+i] for item i in column j: the median of each column as in ComputeMR,
+//divided by the geometric mean of the medians so that normalized values keep the scale of counts. Return 1 if success, -1 if failure
+int MedianSizeFactors(const double *x, int itemNum, int sampleNum, double *sizeFactors);
+
+//Size factors of sampleNum columns of a sparse matrix of itemNum rows, whose nonzero values of row i are values[rowStart[i]] to values[rowStart[i+1]-1]
+//in columns columns[rowStart[i]] to columns[rowStart[i+1]-1]. The median of a column that is mostly zeros is zero, so each column takes instead the median,
+//over its nonzero values, of the value divided by the geometric mean of its row, in which zeros count as 1 (the "poscounts" estimator of DESeq2),
+//then divided by the geometric mean of the columns as in MedianSizeFactors. Values should not be negative. Return 1 if success, -1 if failure
+int SparseMedianSizeFactors(const long *rowStart, const int *columns, const double *values, int itemNum, int sampleNum, double *sizeFactors);
+
+//Adjust r using z-transform within a window sliding on items sorted by m, into adjustedR allocated by the caller.
+//Chunks of items set by SetNormChunkRows are adjusted on the thread pool; if chunkDone is not NULL, it is called for each chunk as soon as
+//the chunk is adjusted, so that the caller can use it while the others are computed. Return 1 if success, -1 if failure
+int AdjustMR(const double *m, const double *r, int itemNum, int winSize, THREAD_POOL_STRUCT *pool, double *adjustedR,
+			 NORM_CHUNK_FUNC chunkDone, void *arg);
+
+//Least-squares slope of x' = log2(x/sizeFactor+1) on the times of sampleNum columns of itemNum values, x[j*itemNum+i] for item i in column j,
+//and the variance of its residuals, into slopes and variances of itemNum values allocated by the caller; 1 is the pseudo-count on the scale of counts.
+//Chunks of items set by SetNormChunkRows are fitted on the thread pool. Return 1 if success, -1 if failure
+int TimeCourseSlopes(const double *x, int itemNum, int sampleNum, const double *times, const double *sizeFactors, THREAD_POOL_STRUCT *pool,
+					 double *slopes, double *variances);
+
+//Slopes and residual variances of TimeCourseSlopes for a sparse matrix of itemNum rows, whose nonzero values of row i are values[rowStart[i]] to
+//values[rowStart[i+1]-1] in columns columns[rowStart[i]] to columns[rowStart[i+1]-1]. Zeros are implicit: log2(0+1) is 0, so only the nonzero values
+//are transformed and summed, and no work memory grows with the items. Return 1 if success, -1 if failure
+int SparseTimeCourseSlopes(const long *rowStart, const int *columns, const double *values, int itemNum, int sampleNum, const double *times,
+						   const double *sizeFactors, THREAD_POOL_STRUCT *pool, double *slopes, double *variances);
+
+//Subtract from r of each item the median of r over the items of its chromosome within halfWindow of its position, into correctedR allocated by
+//the caller. chromosomes numbers the chromosome of each item, -1 for an item of unknown position, which is copied. Items are sorted by chromosome
+//and position once, and the log-ratios of each chromosome by value; the window is kept as a count of the ranks of its log-ratios as it slides, from
+//which its exact median is selected, so each chromosome is corrected in O(n log n), chromosomes in parallel on the thread pool. Return 1 if success,
+//-1 if failure
+int CorrectCopyNumber(const double *r, const int *chromosomes, const long *positions, int itemNum, long halfWindow, THREAD_POOL_STRUCT *pool,
+					  double *correctedR);
+
+#endif
@@ -0,0 +1,84 @@
+/*
+ *  out_writer.h
+ *	Output formatted in chunks by several threads and written in order by a writer thread
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#if !defined( _OUT_WRITER_ )
+#define _OUT_WRITER_
+
+#include <stdio.h>
+#include <pthread.h>
+#include "thread_pool.h"
+
+#define OUT_CHUNK_ROWS 16384       //default number of rows formatted into one chunk
+#define OUT_PENDING_PER_THREAD 2   //chunks of OutWriterFormat per worker thread that may wait for the writer
+
+typedef struct
+{
+	char *data;                    //formatted text
+	long len;                      //length of the text
+	long size;                     //allocated size of data
+} OUT_BUFFER;
+
+//Format row number row of data into buffer. Return 1 if success, -1 if failure
+typedef int (*OUT_FORMAT_FUNC)(OUT_BUFFER *buffer, void *data, int row);
+
+typedef struct
+{
+	FILE *fh;                      //output file
+	int chunkNum;                  //number of chunks of the whole output
+	OUT_BUFFER *chunks;            //chunks put and not written yet
+	char *ready;                   //1 if a chunk was put
+	int nextChunk;                 //index of the next chunk to write
+	int status;                    //1, or -1 after a failure
+	pthread_t thread;              //writer thread
+	pthread_mutex_t mutex;
+	pthread_cond_t chunkReady;     //signaled when a chunk is put
+	pthread_cond_t chunkWritten;   //signaled when a chunk is written
+} OUT_WRITER_STRUCT;
+
+//Empty a buffer
+void OutBufferInit(OUT_BUFFER *buffer);
+
+//Append formatted text to a buffer, growing it as needed. Return 1 if success, -1 if failure
+int OutBufferPrintf(OUT_BUFFER *buffer, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+//Free the text of a buffer
+void OutBufferFree(OUT_BUFFER *buffer);
+
+//Set the number of rows formatted into one chunk, OUT_CHUNK_ROWS by default. Call before any output is opened
+void SetOutChunkRows(int rowNum);
+
+//Return the number of chunks of rowNum rows
+int OutChunkNum(int rowNum);
+
+//Return the number of rows formatted into one chunk
+int GetOutChunkRows(void);
+
+//Return the number of chunks that OutWriterFormat keeps formatted or being formatted ahead of the writer with threadNum threads
+int OutPendingChunkNum(int threadNum);
+
+//Keep standard output for the data written to "-" and send messages printed to stdout to stderr instead.
+//Call before printing anything. Return 1 if success, -1 if failure
+int OutUseStdout(void);
+
+//Create the output file, "-" for standard output, and start the writer thread for an output of chunkNum chunks. Return NULL if failure
+OUT_WRITER_STRUCT *OutWriterOpen(const char *fileName, int chunkNum);
+
+//Hand chunk chunkIndex to the writer thread. The writer takes the text of the buffer, which is left empty.
+//Chunks may be put in any order and from any thread; they are written in the order of their index. Return 1 if success, -1 if failure
+int OutWriterPut(OUT_WRITER_STRUCT *writer, int chunkIndex, OUT_BUFFER *buffer);
+
+//Format rowNum rows of data in chunks of rows set by SetOutChunkRows on the thread pool and put them as chunks firstChunk, firstChunk+1, ...
+//A chunk is submitted only when it is fewer than OutPendingChunkNum chunks ahead of the writer, so that the chunks waiting in memory are
+//bounded whatever the size of the output. Chunks before firstChunk must have been put or submitted. Return 1 if all tasks were submitted, -1 if failure. data must stay valid until the pool is idle
+int OutWriterFormat(OUT_WRITER_STRUCT *writer, THREAD_POOL_STRUCT *pool, int firstChunk, int rowNum, OUT_FORMAT_FUNC format, void *data);
+
+//Wait until all chunks are written, stop the writer thread and close the file. Return 1 if success, -1 if any chunk failed
+int OutWriterClose(OUT_WRITER_STRUCT *writer);
+
+#endif
@@ -0,0 +1,52 @@
+/*
+ *  perf_counters.h
+ *	Hardware performance counters around pipeline stages, collected with perf_event_open
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#if !defined( _PERF_COUNTERS_ )
+#define _PERF_COUNTERS_
+
+#include <stdio.h>
+
+#define PERF_EVENT_NUM 4           //number of counters read around a stage
+#define PERF_MAX_STAGE_LEN 64      //maximum length of a stage name
+
+typedef struct
+{
+	double wallTime;               //wall time in seconds when the stage began
+	unsigned long long values[PERF_EVENT_NUM];  //counter values when the stage began
+	int mode;                      //counters in use, see perf_counters.c. 0 if counting is off
+	double taskSeconds;            //wall time of the tasks of worker threads when the stage began
+	unsigned long long taskValues[PERF_EVENT_NUM];  //counts of the tasks of worker threads when the stage began
+} PERF_SAMPLE;
+
+//Turn collection on or off. When on, each thread opens its counters on first use
+void PerfInit(int enabled);
+
+//Return 1 if collection is on
+int PerfEnabled(void);
+
+//Mark the beginning of a stage in the calling thread
+void PerfBegin(PERF_SAMPLE *sample);
+
+//Mark the end of a stage in the calling thread, and add the counts since PerfBegin to the stage. The counts of the tasks
+//that worker threads finished in the meantime are added to the stage as thread "workers"
+void PerfEnd(PERF_SAMPLE *sample, const char *stage);
+
+//Mark the beginning of a task in a worker thread
+void PerfTaskBegin(PERF_SAMPLE *sample);
+
+//Mark the end of a task in a worker thread, and add its counts to the tasks of all workers
+void PerfTaskEnd(PERF_SAMPLE *sample);
+
+//Close the counters of the calling thread. Call before a worker thread exits
+void PerfThreadExit(void);
+
+//Print counts per stage and per thread, the tasks of worker threads summed in one row per stage, with IPC and misses per thousand instructions
+void PerfReport(FILE *fh);
+
+#endif
@@ -0,0 +1,103 @@
+/*
+ *  result_store.h
+ *	Indexed store of the results of many RRA runs, with a gene name index and metadata of each screen
+ *
+ *  A store is one file: a header, one segment of columns per screen, then a catalog of the screens,
+ *  the gene dictionary and its hash table, and a fixed trailer giving the catalog. Appending a screen
+ *  writes its segment over the old catalog and writes the catalog again after it.
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#if !defined( _RESULT_STORE_ )
+#define _RESULT_STORE_
+
+#include <stddef.h>
+
+#define STORE_MAGIC "CRRSTORE"     //first and last bytes of a result store
+#define STORE_VERSION 2            //version of the file layout
+#define STORE_HEADER_SIZE 16       //magic and version at the start of the file
+#define STORE_MAX_NAME_LEN 256     //maximum length of a screen name or source file name
+
+typedef struct
+{
+	char name[STORE_MAX_NAME_LEN];   //name of the screen, unique in the store
+	char source[STORE_MAX_NAME_LEN]; //input file of the screen
+	long created;                    //time the screen was appended, in seconds since the epoch
+	double maxPercentile;            //maximum percentile of the RRA run
+	int itemNum;                     //number of items of the RRA run
+	int listNum;                     //number of lists of the RRA run
+	int groupNum;                    //number of groups, which are the rows of the segment
+	int geneNum;                     //number of genes in the dictionary when the screen was appended
+	long offset;                     //offset of the segment of the screen in the file
+} STORE_SCREEN;
+
+typedef struct
+{
+	long catalogOffset;              //offset of the catalog
+	long nameBytes;                  //bytes of the gene names in the catalog
+	int screenNum;                   //number of screens
+	int geneNum;                     //number of genes in the dictionary
+	int tableSize;                   //number of slots of the hash table of gene names
+	int version;                     //STORE_VERSION
+	char magic[8];                   //STORE_MAGIC
+} STORE_TRAILER;
+
+typedef struct
+{
+	const char *name;                //name of the group
+	int itemNum;                     //number of items in the group
+	double loValue;                  //lo-value in RRA
+	double fdr;                      //false discovery rate
+} STORE_RESULT;
+
+typedef struct
+{
+	const int *geneIds;              //gene of each row. Rows are in the order of the output of RRA, by lo-value, so the rank of a row is its index plus one
+	const int *itemNums;             //number of items of each row
+	const double *loValues;          //lo-value of each row
+	const double *fdrs;              //false discovery rate of each row
+	const double *percentiles;       //percentile of the lo-value of each row among the rows, with ties at mid-rank
+	const int *rowOfGene;            //row of each gene of the dictionary up to geneNum of the screen, -1 if the gene is not in the screen
+} STORE_SEGMENT;
+
+typedef struct
+{
+	int fd;                          //file descriptor, locked shared while the store is open
+	char *map;                       //file mapped in memory
+	size_t size;                     //size of the file
+	STORE_TRAILER trailer;           //trailer of the file
+	const STORE_SCREEN *screens;     //metadata of the screens
+	const long *nameOffsets;         //offset of each gene name in names, and the end of the last one
+	const char *names;               //gene names, each terminated by 0
+	const int *table;                //open-addressing hash table of gene names, storing gene id+1, 0 if the slot is empty
+} RESULT_STORE;
+
+//Append the results of one screen, in order of lo-value, to a store, created if it does not exist. screen gives the name, source, maxPercentile, itemNum and listNum;
+//the other fields are filled. Appends are serialized by a lock on the file. Return 1 if success, -1 if failure
+int StoreAppend(const char *fileName, STORE_SCREEN *screen, const STORE_RESULT *results, int resultNum);
+
+//Map a store in memory for queries. Appends wait until it is closed. Return NULL if failure
+RESULT_STORE *StoreOpen(const char *fileName);
+
+//Close a store
+void StoreClose(RESULT_STORE *store);
+
+//Return the id of a gene, or -1 if the gene is in no screen
+int StoreFindGene(const RESULT_STORE *store, const char *name);
+
+//Return the name of gene geneId
+const char *StoreGeneName(const RESULT_STORE *store, int geneId);
+
+//Return the index of a screen, or -1 if there is no screen of this name
+int StoreFindScreen(const RESULT_STORE *store, const char *name);
+
+//Locate the columns of screen screenIndex in the mapped file. Return 1 if success, -1 if failure
+int StoreSegment(const RESULT_STORE *store, int screenIndex, STORE_SEGMENT *segment);
+
+//Return the row of gene geneId in a segment of screen screenIndex, or -1 if the gene is not in the screen
+int StoreGeneRow(const RESULT_STORE *store, int screenIndex, const STORE_SEGMENT *segment, int geneId);
+
+#endif
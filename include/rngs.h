@@ -10,6 +10,8 @@
 #define _RNGS_
 
 double Random(void);
+double RandomR(long *state);
+long   JumpSeed(long x, int jumps);
 void   PlantSeeds(long x);
 void   GetSeed(long *x);
 void   PutSeed(long x);
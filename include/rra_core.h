@@ -0,0 +1,83 @@
+/*
+ *  rra_core.h
+ *	Robust Rank Aggregation on arrays of values: percentiles in sorted lists, lo-values and false discovery rates
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#if !defined( _RRA_CORE_ )
+#define _RRA_CORE_
+
+#define CDF_MAX_ERROR 1E-10        //maximum error in Cumulative Distribution Function estimation in beta statistics
+#define RAND_PASS_NUM 100          //number of passes in random simulation for computing FDR
+#define RAND_SEED 123456           //seed of the random simulation for computing FDR
+#define LO_BATCH_LANES 4           //groups of the same size whose lo-values are computed together
+#define LO_INSERTION_SORT_MAX 16   //percentiles of a group up to which insertion sort is used
+
+#define AGG_RRA 0                  //lo-value of RRA: smallest beta probability of the ranks up to the maximum percentile, and of the first
+#define AGG_ALPHA_RRA 1            //alpha-RRA: smallest beta probability of the ranks up to the maximum percentile, 1 if there is none
+#define AGG_RANK_PRODUCT 2         //geometric mean of the percentiles
+#define AGG_SECOND_BEST 3          //second smallest percentile, the only one of a group of one item
+#define AGG_MEDIAN 4               //median percentile
+#define AGG_KERNEL_NUM 5           //number of aggregators
+
+typedef struct
+{
+	int num;                       //number of percentiles of each group of the class
+	int laneNum;                   //number of groups waiting
+	double *percentiles;           //percentiles of the waiting groups, num per group
+	double *loValues[LO_BATCH_LANES];  //where the lo-value of each waiting group is stored
+	double *betaLogs;              //log of the beta function of the order statistic of each rank, shared by all groups of the class, NULL if the aggregator does not use it
+} LO_SIZE_CLASS;
+
+//Score each of the laneNum groups waiting in a size class, lane l holding the num percentiles of group l. Smaller scores are
+//more significant. A kernel may reorder the percentiles of a lane
+typedef void (*AGG_KERNEL_FUNC)(LO_SIZE_CLASS *sizeClass, double maxPercentile, double *scores);
+
+typedef struct
+{
+	int aggregator;                //AGG_ id of the scores
+	double maxPercentile;          //maximum percentile
+	int maxNum;                    //largest number of percentiles of a group
+	LO_SIZE_CLASS **classes;       //class of each number of percentiles, allocated when first used
+} LO_BATCH_STRUCT;
+
+//Compute lo-value based on an array of percentiles. Return 1 if success, -1 if failure
+int ComputeLoValue(double *percentiles,     //array of percentiles
+				   int num,                 //length of array
+				   double *loValue,         //pointer to the output lo-value
+				   double maxPercentile);   //maximum percentile, computation stops when maximum percentile is reached
+
+//Create a batch of scores of aggregator for groups of at most maxNum percentiles. Return NULL if failure
+LO_BATCH_STRUCT *LoBatchCreate(int aggregator, int maxNum, double maxPercentile);
+
+//Queue the score of a group of num percentiles, which are copied. Groups are bucketed by size, and the scores of
+//LO_BATCH_LANES groups of the same size are computed together, each lane holding the percentiles of one group. *loValue is
+//set when the batch of the group is computed, at the latest by LoBatchFlush; for AGG_RRA, to what ComputeLoValue gives. Return 1 if success, -1 if failure
+int LoBatchAdd(LO_BATCH_STRUCT *batch, const double *percentiles, int num, double *loValue);
+
+//Compute the scores of all waiting groups. Return 1 if success, -1 if failure
+int LoBatchFlush(LO_BATCH_STRUCT *batch);
+
+//Free a batch. Waiting groups are dropped
+void LoBatchFree(LO_BATCH_STRUCT *batch);
+
+//Return the aggregator of a name, or -1 if there is none of this name
+int ParseAggregator(const char *name);
+
+//Return the name of an aggregator
+const char *AggregatorName(int aggregator);
+
+//Percentile of value in a list of num values sorted in ascending order. Tied values share their mid-rank
+double ListPercentile(double value, double *sortedValues, int num);
+
+//Fraction of nullNum null lo-values, sorted in ascending order, below loValue. Tied null lo-values count for half
+double NullPValue(double loValue, double *sortedNull, int nullNum);
+
+//False discovery rate of the group of rank rank, from 0, among groupNum groups sorted by lo-value, given nullNum null lo-values
+//sorted in ascending order. Before the correction that makes the rates monotone
+double NullRankFDR(double loValue, int rank, int groupNum, double *sortedNull, int nullNum);
+
+#endif
@@ -0,0 +1,62 @@
+/*
+ *  rra_grouping.h
+ *	Scores of several groupings of the same ranked items, such as genes, exons and domains, in one run
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#if !defined( _RRA_GROUPING_ )
+#define _RRA_GROUPING_
+
+#include "dict.h"
+#include "thread_pool.h"
+
+#define MAX_GROUPING_NUM 16        //maximum number of groupings of one run
+#define GROUPING_NAME_LEN 256      //maximum length of the name of a grouping
+#define GROUPING_ID_LEN 255        //maximum length of an item id, a group id, a list id or an input group id in a mapping file
+#define GROUPING_CHUNK 1024        //groups scored by one task
+#define GROUPING_NULL_BLOCK 1000   //null scores simulated by one task, from its own random stream
+
+typedef struct
+{
+	DICT_STRUCT *idDict;           //ids of the ranked items
+	int *idStart;                  //idDict->num+1 offsets: the items of id k are idItems[idStart[k]] to idItems[idStart[k+1]-1]
+	int *idItems;                  //index of each item in the item array, by id
+	int *itemLists;                //list of each item, an index of listDict
+	int *itemGroups;               //input group of each item, an index of groupDict
+	DICT_STRUCT *listDict;         //names of the lists, in the order of the lists
+	DICT_STRUCT *groupDict;        //names of the input groups, in the order of the groups
+} GROUPING_ITEMS;
+
+typedef struct
+{
+	char name[GROUPING_NAME_LEN];  //name of the grouping, the mapping file name without directory and extension
+	DICT_STRUCT *groupDict;        //names of the groups, in the order of the mapping file
+	int groupNum;                  //number of groups
+	int *groupStart;               //groupNum+1 offsets: the items of group g are members[groupStart[g]] to members[groupStart[g+1]-1]
+	int *members;                  //index of each item of each group in the item array
+	int unmatchedNum;              //number of rows of the mapping file whose item, list or input group is not in the input
+	double *loValues;              //score of each group, 1 for a group without items
+	double *pValues;               //fraction of the null scores of groups of the same size below the score
+	double *fdr;                   //false discovery rate of the score by its rank among the groups with items, as ComputeFDR computes it
+} GROUPING;
+
+//Read a grouping of items from a mapping file, "-" for standard input. File Format: <item id> <group id> [<list id> [<input group id>]], with a header.
+//An item id may be in several groups; a group holds the item of the id in each list and input group, or only in the list and the input group of the row
+//if the file has these columns. A row that matches two items of the same list cannot tell which one it groups, and fails the file. Rows whose id, list or
+//input group is not in the input are counted in unmatchedNum. Return the number of groups, or -1 if failure
+int ReadGrouping(const char *fileName, const GROUPING_ITEMS *items, GROUPING *grouping);
+
+//Score the groups of groupingNum groupings by aggregator, from the percentiles of the items, all groupings in the same tasks of the thread pool.
+//Groups of the same size share one null distribution across groupings, of RAND_PASS_NUM scores per group of this size in the grouping with most
+//of them, rounded up to blocks of GROUPING_NULL_BLOCK that each draw from their own random stream, so that results do not depend on the
+//number of threads. False discovery rates are computed as ComputeFDR does, against the null of the sizes of the groups of each grouping.
+//Return 1 if success, -1 if failure
+int ScoreGroupings(const double *percentiles, GROUPING *groupings, int groupingNum, int aggregator, double maxPercentile, THREAD_POOL_STRUCT *pool);
+
+//Free the index and the scores of a grouping
+void FreeGrouping(GROUPING *grouping);
+
+#endif
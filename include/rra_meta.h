@@ -0,0 +1,35 @@
+/*
+ *  rra_meta.h
+ *	Meta-analysis of the screens of a result store by a second-level RRA of the ranks of each gene across screens
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#if !defined( _RRA_META_ )
+#define _RRA_META_
+
+#include "result_store.h"
+#include "thread_pool.h"
+
+#define META_NULL_NUM 10000        //default number of null lo-values simulated for each number of screens
+#define META_NULL_BLOCK 500        //null lo-values simulated by one task, from its own random stream
+#define META_GENE_CHUNK 256        //genes aggregated by one task
+
+typedef struct
+{
+	int screenNum;                 //number of screens with the gene
+	double loValue;                //lo-value of the percentiles of the gene in its screens
+	double pValue;                 //fraction of the null lo-values of the same number of screens below loValue
+	double fdr;                    //false discovery rate of the p-value among all genes (Benjamini-Hochberg)
+} META_RESULT;
+
+//Aggregate each gene of a store over the screens it is in. The percentile of a gene in a screen is the mid-rank of its lo-value
+//among the groups of the screen; the lo-value of the percentiles is computed as ComputeLoValue does for items in lists.
+//One null distribution of nullNum lo-values, rounded up to blocks of META_NULL_BLOCK, is simulated for each number of screens that genes have, and shared by these genes.
+//Genes and null blocks run on the thread pool; results do not depend on the number of threads. results has one entry per gene
+//of the store dictionary. Return 1 if success, -1 if failure
+int MetaAggregate(const RESULT_STORE *store, double maxPercentile, int nullNum, THREAD_POOL_STRUCT *pool, META_RESULT *results);
+
+#endif
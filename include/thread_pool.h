@@ -0,0 +1,65 @@
+/*
+ *  thread_pool.h
+ *	Fixed pool of worker threads running submitted tasks
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#if !defined( _THREAD_POOL_ )
+#define _THREAD_POOL_
+
+#include <pthread.h>
+
+typedef void (*TASK_FUNC)(void *arg);
+
+//Function run once by every worker; workerIndex is from 0 to workerNum-1
+typedef void (*BROADCAST_FUNC)(void *arg, int workerIndex, int workerNum);
+
+typedef struct
+{
+	TASK_FUNC func;                //function of the task
+	void *arg;                     //argument of the function
+} TASK_STRUCT;
+
+typedef struct
+{
+	pthread_t *threads;            //worker threads
+	int threadNum;                 //number of worker threads. 0 if tasks run in the submitting thread
+	TASK_STRUCT *tasks;            //circular queue of tasks waiting to run
+	int taskCapacity;              //size of the queue
+	int taskHead;                  //position of the next task to run
+	int taskNum;                   //number of tasks in the queue
+	int activeNum;                 //number of tasks running
+	int stopping;                  //1 when the workers are asked to exit
+	int startedNum;                //number of workers started, used to give each worker its index
+	BROADCAST_FUNC broadcastFunc;  //function run by every worker
+	void *broadcastArg;            //argument of the broadcast function
+	int broadcastRound;            //incremented for each broadcast
+	int broadcastLeft;             //number of workers yet to run the current broadcast
+	pthread_mutex_t mutex;
+	pthread_cond_t taskReady;      //signaled when a task is queued or the pool stops
+	pthread_cond_t taskDone;       //signaled when the pool becomes idle
+} THREAD_POOL_STRUCT;
+
+//Return the number of online CPUs, at least 1
+int GetCPUNum(void);
+
+//Create a pool of threadNum workers. With threadNum<=1 no thread is created and tasks run when submitted. Return NULL if failure
+THREAD_POOL_STRUCT *ThreadPoolCreate(int threadNum);
+
+//Queue a task. Return 1 if success, -1 if failure
+int ThreadPoolSubmit(THREAD_POOL_STRUCT *pool, TASK_FUNC func, void *arg);
+
+//Run func once on every worker, each with its own index, and wait until all have finished. Without workers func runs
+//in the calling thread as worker 0 of 1. Used to give each worker its own state for the tasks it runs
+void ThreadPoolBroadcast(THREAD_POOL_STRUCT *pool, BROADCAST_FUNC func, void *arg);
+
+//Wait until all submitted tasks have finished
+void ThreadPoolWait(THREAD_POOL_STRUCT *pool);
+
+//Wait for the submitted tasks, stop the workers and free the pool
+void ThreadPoolDestroy(THREAD_POOL_STRUCT *pool);
+
+#endif
@@ -0,0 +1,34 @@
+/*
+ *  trace.h
+ *	Timeline of spans recorded in per-thread ring buffers and exported as Chrome/Perfetto trace JSON
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#if !defined( _TRACE_ )
+#define _TRACE_
+
+#define TRACE_BUFFER_EVENTS 65536  //number of events kept per thread. Older events are overwritten
+#define TRACE_CHUNK_SIZE 65536     //number of lines, items or groups covered by one span of a batch
+
+//Turn recording on and write the trace to fileName when the program exits. Recording stays off if fileName is NULL
+void TraceInit(const char *fileName);
+
+//Return 1 if recording is on
+int TraceEnabled(void);
+
+//Begin a span in the calling thread. name must be a string constant
+void TraceBegin(const char *name);
+
+//End the span begun last with the same name in the calling thread
+void TraceEnd(const char *name);
+
+//Name the calling thread in the timeline. name must be a string constant
+void TraceSetThreadName(const char *name);
+
+//Write the events of all threads to a Chrome/Perfetto trace file. Return 1 if success, -1 if failure
+int TraceWrite(const char *fileName);
+
+#endif
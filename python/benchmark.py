@@ -0,0 +1,128 @@
+"""
+benchmark.py
+	Compare the in-memory API with the command line tools on the same input, for time and results
+
+	usage: python3 benchmark.py [count file] [repeat]
+	Default count file: ../bin/WANG_HL60_KBM7.txt
+
+	Created by Han Xu on 18/10/26.
+	Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+"""
+
+import array
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+import crispr
+
+binDir = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "bin")
+
+
+def ReadCounts(fileName):
+	names, genes = [], []
+	x1, x2 = array.array("d"), array.array("d")
+
+	with open(fileName) as fh:
+		fh.readline()
+		for line in fh:
+			words = line.split()
+			if len(words) != 4:
+				break
+			names.append(words[0])
+			genes.append(words[1])
+			x1.append(float(words[2]))
+			x2.append(float(words[3]))
+
+	return names, genes, x1, x2
+
+
+def Timed(func, repeat):
+	start = time.perf_counter()
+	for i in range(repeat):
+		result = func()
+	return result, (time.perf_counter() - start) / repeat
+
+
+def RunTools(names, genes, x1, x2, tmpDir):
+	"""Write the counts as text, run CrisprNorm and RRA, and parse the outputs"""
+	countFile = os.path.join(tmpDir, "counts.txt")
+	normFile = os.path.join(tmpDir, "norm.txt")
+	rraInput = os.path.join(tmpDir, "rra_input.txt")
+	rraFile = os.path.join(tmpDir, "rra.txt")
+
+	with open(countFile, "w") as fh:
+		fh.write("sgRNA\tgene\tlib1\tlib2\n")
+		for i in range(len(names)):
+			fh.write("%s\t%s\t%d\t%d\n" % (names[i], genes[i], x1[i], x2[i]))
+
+	subprocess.run([os.path.join(binDir, "CrisprNorm"), "-i", countFile, "-o", normFile], check=True, stdout=subprocess.DEVNULL)
+
+	adjusted = []
+	with open(normFile) as fh, open(rraInput, "w") as out:
+		fh.readline()
+		out.write("sgRNA_id gene_id list adjusted_ratio\n")
+		for line in fh:
+			words = line.split("\t")
+			adjusted.append(float(words[8]))
+			out.write("%s %s list %s\n" % (words[0], words[1], words[8].strip()))
+
+	subprocess.run([os.path.join(binDir, "RRA"), "-i", rraInput, "-o", rraFile, "-p", "0.1"], check=True, stdout=subprocess.DEVNULL)
+
+	groups = {}
+	with open(rraFile) as fh:
+		fh.readline()
+		for line in fh:
+			words = line.split()
+			groups[words[0]] = (float(words[2]), float(words[3]))
+
+	return adjusted, groups
+
+
+def RunApi(genes, x1, x2):
+	"""Normalize and run RRA on the columns in memory, with genes numbered in order of first appearance"""
+	norm = crispr.normalize(x1, x2)
+
+	# RRA reads the values as printed by CrisprNorm
+	values = array.array("d", (float("%f" % v) for v in norm["adjusted_r"]))
+	geneIndex = {}
+	groupIds = array.array("i", (geneIndex.setdefault(gene, len(geneIndex)) for gene in genes))
+	listIds = array.array("i", bytes(4 * len(genes)))
+
+	result = crispr.rra(values, groupIds, listIds, len(geneIndex))
+
+	return norm, geneIndex, result
+
+
+def main():
+	countFile = sys.argv[1] if len(sys.argv) > 1 else os.path.join(binDir, "WANG_HL60_KBM7.txt")
+	repeat = int(sys.argv[2]) if len(sys.argv) > 2 else 3
+
+	names, genes, x1, x2 = ReadCounts(countFile)
+	print("%d sgRNAs, %d genes" % (len(names), len(set(genes))))
+
+	with tempfile.TemporaryDirectory() as tmpDir:
+		(adjusted, groups), toolTime = Timed(lambda: RunTools(names, genes, x1, x2, tmpDir), repeat)
+
+	normOnly, normTime = Timed(lambda: crispr.normalize(x1, x2), repeat)
+	(norm, geneIndex, result), apiTime = Timed(lambda: RunApi(genes, x1, x2), repeat)
+
+	print("command line tools, text in and out: %.3f s" % toolTime)
+	print("API, normalization only:             %.3f s" % normTime)
+	print("API, normalization and RRA:          %.3f s" % apiTime)
+
+	normDiff = sum(1 for i in range(len(adjusted)) if "%f" % norm["adjusted_r"][i] != "%f" % adjusted[i])
+	rraDiff = 0
+	for gene, index in geneIndex.items():
+		loValue, fdr = groups[gene]
+		if ("%.4e" % result["lo_value"][index] != "%.4e" % loValue) or ("%f" % result["fdr"][index] != "%f" % fdr):
+			rraDiff += 1
+
+	print("sgRNAs with a different adjusted ratio: %d" % normDiff)
+	print("genes with a different lo-value or FDR: %d" % rraDiff)
+
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,134 @@
+"""
+crispr.py
+	Python interface to libcrispr.so: normalization, RRA and non-central beta grids on buffers held in memory
+
+	Columns are passed as objects supporting the buffer protocol, such as array.array,
+	numpy arrays or memoryview, without copying: values are C doubles ('d') and group and
+	list indices are C ints ('i'). Writable buffers are handed to the library in place; a
+	read-only buffer is copied once. Results are returned in new array.array objects, or
+	written into the buffers given as out.
+
+	The library is found through $CRISPR_LIB, or in ../lib/libcrispr.so built by make.
+
+	Created by Han Xu on 18/10/26.
+	Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+"""
+
+import array
+import ctypes
+import os
+
+API_VERSION = 2
+
+_libPath = os.environ.get("CRISPR_LIB", os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "lib", "libcrispr.so"))
+_lib = ctypes.CDLL(_libPath)
+
+_doubleP = ctypes.POINTER(ctypes.c_double)
+_intP = ctypes.POINTER(ctypes.c_int)
+
+_lib.CrisprApiVersion.restype = ctypes.c_int
+_lib.CrisprApiVersion.argtypes = []
+_lib.CrisprApiError.restype = ctypes.c_char_p
+_lib.CrisprApiError.argtypes = []
+_lib.CrisprNormColumns.restype = ctypes.c_int
+_lib.CrisprNormColumns.argtypes = [_doubleP, _doubleP, ctypes.c_int, ctypes.c_int, ctypes.c_int, _doubleP, _doubleP, _doubleP]
+_lib.RRAColumns.restype = ctypes.c_int
+_lib.RRAColumns.argtypes = [_doubleP, _intP, _intP, ctypes.c_int, ctypes.c_int, ctypes.c_int, ctypes.c_double, _doubleP, _doubleP]
+_lib.BetaNoncentralGridColumns.restype = ctypes.c_int
+_lib.BetaNoncentralGridColumns.argtypes = [_doubleP, _doubleP, _doubleP, ctypes.c_int, _doubleP, ctypes.c_int, ctypes.c_int, _doubleP]
+
+if _lib.CrisprApiVersion() != API_VERSION:
+	raise ImportError("%s has API version %d, expected %d" % (_libPath, _lib.CrisprApiVersion(), API_VERSION))
+
+
+class CrisprError(Exception):
+	pass
+
+
+def _column(buffer, code, length, name, writable=False):
+	"""Return a ctypes pointer to a contiguous buffer of length items of type code, and the object keeping it alive"""
+	view = memoryview(buffer)
+
+	if (view.format.lstrip("@=") != code) or (not view.c_contiguous) or (view.nbytes != length * view.itemsize):
+		raise CrisprError("%s should be a contiguous buffer of %d values of type '%s'" % (name, length, code))
+
+	cType = ctypes.c_double if code == "d" else ctypes.c_int
+
+	if view.readonly:
+		if writable:
+			raise CrisprError("%s should be writable" % name)
+		# ctypes can only point into writable memory
+		holder = (cType * length).from_buffer_copy(view)
+	else:
+		holder = (cType * length).from_buffer(view.cast("B"))
+
+	return ctypes.cast(holder, ctypes.POINTER(cType)), holder
+
+
+def _output(out, key, length, name):
+	"""Return the output buffer named key in out, or a new one"""
+	if (out is not None) and (key in out):
+		return out[key]
+
+	return array.array("d", bytes(8 * length))
+
+
+def normalize(x1, x2, winSize=200, threadNum=0, out=None):
+	"""Normalize two libraries of counts as CrisprNorm does.
+	Return a dict of m, r and adjusted_r; the normalized measures are m-adjusted_r/2 and m+adjusted_r/2"""
+	itemNum = len(memoryview(x1))
+	result = {key: _output(out, key, itemNum, key) for key in ("m", "r", "adjusted_r")}
+
+	pX1, keep1 = _column(x1, "d", itemNum, "x1")
+	pX2, keep2 = _column(x2, "d", itemNum, "x2")
+	pM, keepM = _column(result["m"], "d", itemNum, "m", True)
+	pR, keepR = _column(result["r"], "d", itemNum, "r", True)
+	pA, keepA = _column(result["adjusted_r"], "d", itemNum, "adjusted_r", True)
+
+	if _lib.CrisprNormColumns(pX1, pX2, itemNum, winSize, threadNum, pM, pR, pA) <= 0:
+		raise CrisprError(_lib.CrisprApiError().decode())
+
+	del keep1, keep2, keepM, keepR, keepA
+
+	return result
+
+
+def rra(values, groupIds, listIds, groupNum, listNum=1, maxPercentile=0.1, out=None):
+	"""Run RRA on items given by value, group index and list index, as RRA does.
+	Return a dict of lo_value and fdr, one value per group"""
+	itemNum = len(memoryview(values))
+	result = {key: _output(out, key, groupNum, key) for key in ("lo_value", "fdr")}
+
+	pValues, keepV = _column(values, "d", itemNum, "values")
+	pGroups, keepG = _column(groupIds, "i", itemNum, "groupIds")
+	pLists, keepL = _column(listIds, "i", itemNum, "listIds")
+	pLo, keepLo = _column(result["lo_value"], "d", groupNum, "lo_value", True)
+	pFdr, keepFdr = _column(result["fdr"], "d", groupNum, "fdr", True)
+
+	if _lib.RRAColumns(pValues, pGroups, pLists, itemNum, groupNum, listNum, maxPercentile, pLo, pFdr) <= 0:
+		raise CrisprError(_lib.CrisprApiError().decode())
+
+	del keepV, keepG, keepL, keepLo, keepFdr
+
+	return result
+
+
+def beta_grid(a, b, lam, x, threadNum=0, out=None):
+	"""CDF of the non-central beta distribution of each row of parameters a, b and lam at each value of x.
+	Return a dict of cdf, len(a)*len(x) values with the values of row r at r*len(x)"""
+	rowNum = len(memoryview(a))
+	xNum = len(memoryview(x))
+	result = {"cdf": _output(out, "cdf", rowNum * xNum, "cdf")}
+
+	pA, keepA = _column(a, "d", rowNum, "a")
+	pB, keepB = _column(b, "d", rowNum, "b")
+	pLam, keepLam = _column(lam, "d", rowNum, "lam")
+	pX, keepX = _column(x, "d", xNum, "x")
+	pCdf, keepCdf = _column(result["cdf"], "d", rowNum * xNum, "cdf", True)
+
+	if _lib.BetaNoncentralGridColumns(pA, pB, pLam, rowNum, pX, xNum, threadNum, pCdf) <= 0:
+		raise CrisprError(_lib.CrisprApiError().decode())
+
+	del keepA, keepB, keepLam, keepX, keepCdf
+
+	return result
@@ -0,0 +1,650 @@
+/*
+ *  CrisprGLM.c
+ *  Estimate gene effects of multi-condition Crispr screens jointly across samples, by a negative binomial regression of each gene
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <math.h>
+#include "math_api.h"
+#include "words.h"
+#include "dict.h"
+#include "mem_acct.h"
+#include "perf_counters.h"
+#include "trace.h"
+#include "thread_pool.h"
+#include "out_writer.h"
+#include "block_reader.h"
+#include "exec_ctx.h"
+#include "norm_core.h"
+#include "count_table.h"
+#include "nb_test.h"
+#include "glm_core.h"
+
+#define MAX_NAME_LEN 255           //maximum length of a gene, sample or covariate name
+#define MAX_COVARIATE_NUM 1000     //maximum number of covariates
+
+typedef struct
+{
+	char name[MAX_NAME_LEN];       //name of the gene
+	int guideNum;                  //number of guides of the gene
+} GENE_STRUCT;
+
+typedef struct
+{
+	GENE_STRUCT *genes;            //genes in order of first appearance
+	int geneNum;                   //number of genes
+	char (*covariateNames)[MAX_NAME_LEN];  //names of the covariates
+	int covariateNum;              //number of covariates
+	GLM_RESULT results;            //effects of the genes
+} GLM_OUTPUT;
+
+//Read the design of the samples of table, "-" for standard input. File Format: <sample id> <covariate id> <value>, with a header, one line
+//for each nonzero value. Samples without a line are baselines. The covariates are named in *pNames in order of first appearance.
+//Return the number of covariates, or -1 if failure
+int ReadDesign(char *fileName, COUNT_TABLE *table, GLM_DESIGN *design, char (**pNames)[MAX_NAME_LEN]);
+
+//Group the guides of table by gene, in order of first appearance: the guides of gene g are guides[geneStart[g]] to guides[geneStart[g+1]-1].
+//Genes are allocated in *pGenes, the indices in *pGuides and *pGeneStart. Return the number of genes, or -1 if failure
+int GroupGuides(COUNT_TABLE *table, GENE_STRUCT **pGenes, int **pGuides, int **pGeneStart);
+
+//Save the effects of the genes to output file. Format: <gene id> <number of guides> and, for each covariate, <effect> <standard error> <p-value>
+//Rows are formatted in chunks on the thread pool and written in order by a writer thread. Return 1 if success, -1 if failure
+int SaveGeneEffects(char *fileName, GLM_OUTPUT *output, THREAD_POOL_STRUCT *pool);
+
+//Free the design
+void FreeDesign(GLM_DESIGN *design);
+
+//print the usage of Command
+void PrintCommandUsage(const char *command);
+
+//Read the design of the samples of table, "-" for standard input. File Format: <sample id> <covariate id> <value>, with a header, one line
+//for each nonzero value. Samples without a line are baselines. The covariates are named in *pNames in order of first appearance.
+//Return the number of covariates, or -1 if failure
+int ReadDesign(char *fileName, COUNT_TABLE *table, GLM_DESIGN *design, char (**pNames)[MAX_NAME_LEN])
+{
+	READER_STRUCT *reader;
+	DICT_STRUCT *sampleDict, *covariateDict;
+	char **words, *line;
+	char (*names)[MAX_NAME_LEN];
+	int *samples, *tmpSamples, *columns, *tmpColumns;
+	double *values, *tmpValues;
+	int i, j, c, wordNum, entryNum, entryCapacity, flag;
+
+	memset(design, 0, sizeof(GLM_DESIGN));
+
+	words = AllocWords(MAX_NAME_LEN, MAX_NAME_LEN+1);
+	reader = words?ReaderOpen(fileName):NULL;
+
+	if (!reader)
+	{
+		if (words)
+		{
+			FreeWords(words, MAX_NAME_LEN);
+		}
+		return -1;
+	}
+
+	entryCapacity = 1024;
+	entryNum = 0;
+	samples = (int *)MemAlloc(MEM_INPUT, entryCapacity*sizeof(int));
+	columns = (int *)MemAlloc(MEM_INPUT, entryCapacity*sizeof(int));
+	values = (double *)MemAlloc(MEM_INPUT, entryCapacity*sizeof(double));
+	names = (char (*)[MAX_NAME_LEN])MemAlloc(MEM_INPUT, MAX_COVARIATE_NUM*MAX_NAME_LEN);
+	sampleDict = DictCreate(table->sampleNum);
+	covariateDict = DictCreate(16);
+
+	flag = ((samples)&&(columns)&&(values)&&(names)&&(sampleDict)&&(covariateDict))?1:-1;
+
+	//samples are numbered as the columns of the count table
+	for (j=0;(j<table->sampleNum)&&(flag>0);j++)
+	{
+		flag = DictInsert(sampleDict, table->sampleNames[j])==j?1:-1;
+	}
+
+	if (flag<0)
+	{
+		printf("sample names of the count table should be different\n");
+	}
+
+	//skip the header
+	line = flag>0?ReaderGetLine(reader):NULL;
+	line = line?ReaderGetLine(reader):NULL;
+	wordNum = line?StringToWords(words, line, MAX_NAME_LEN+1, MAX_NAME_LEN, " \t\r\n\v\f"):0;
+
+	while ((flag>0)&&(wordNum==3)&&(!ReaderAtEnd(reader)))
+	{
+		j = DictLookup(sampleDict, words[0]);
+		c = DictInsert(covariateDict, words[1]);
+
+		if ((j<0)||(c<0)||(c>=MAX_COVARIATE_NUM))
+		{
+			printf(j<0?"sample %s of the design is not in the count table\n":"too many covariates at sample %s\n", words[0]);
+			flag = -1;
+			break;
+		}
+
+		if (c==covariateDict->num-1)
+		{
+			strcpy(names[c], words[1]);
+		}
+
+		if (entryNum>=entryCapacity)
+		{
+			tmpSamples = (int *)MemRealloc(MEM_INPUT, samples, 2*entryCapacity*sizeof(int));
+			samples = tmpSamples?tmpSamples:samples;
+			tmpColumns = (int *)MemRealloc(MEM_INPUT, columns, 2*entryCapacity*sizeof(int));
+			columns = tmpColumns?tmpColumns:columns;
+			tmpValues = (double *)MemRealloc(MEM_INPUT, values, 2*entryCapacity*sizeof(double));
+			values = tmpValues?tmpValues:values;
+
+			if ((!tmpSamples)||(!tmpColumns)||(!tmpValues))
+			{
+				flag = -1;
+				break;
+			}
+
+			entryCapacity *= 2;
+		}
+
+		samples[entryNum] = j;
+		columns[entryNum] = c;
+		values[entryNum] = atof(words[2]);
+		entryNum++;
+
+		line = ReaderGetLine(reader);
+		wordNum = line?StringToWords(words, line, MAX_NAME_LEN+1, MAX_NAME_LEN, " \t\r\n\v\f"):0;
+	}
+
+	flag = ReaderClose(reader)<0?-1:flag;
+	FreeWords(words, MAX_NAME_LEN);
+
+	if ((flag>0)&&(covariateDict->num==0))
+	{
+		printf("Design file format: <sample id> <covariate id> <value>, with a header, one line for each nonzero value\n");
+		flag = -1;
+	}
+
+	//entries are put in rows of samples, in the order of the file within a sample
+	design->sampleNum = table->sampleNum;
+	design->covariateNum = flag>0?covariateDict->num:0;
+	design->rowStart = flag>0?(int *)MemAlloc(MEM_INPUT, (table->sampleNum+1)*sizeof(int)):NULL;
+	design->columns = flag>0?(int *)MemAlloc(MEM_INPUT, (entryNum+1)*sizeof(int)):NULL;
+	design->values = flag>0?(double *)MemAlloc(MEM_INPUT, (entryNum+1)*sizeof(double)):NULL;
+
+	flag = ((design->rowStart)&&(design->columns)&&(design->values))?flag:-1;
+
+	if (flag>0)
+	{
+		memset(design->rowStart, 0, (table->sampleNum+1)*sizeof(int));
+
+		for (i=0;i<entryNum;i++)
+		{
+			design->rowStart[samples[i]+1]++;
+		}
+
+		for (j=0;j<table->sampleNum;j++)
+		{
+			design->rowStart[j+1] += design->rowStart[j];
+		}
+
+		//rowStart[j] is moved to the end of row j as entries are placed, then back
+		for (i=0;i<entryNum;i++)
+		{
+			design->columns[design->rowStart[samples[i]]] = columns[i];
+			design->values[design->rowStart[samples[i]]] = values[i];
+			design->rowStart[samples[i]]++;
+		}
+
+		for (j=table->sampleNum;j>0;j--)
+		{
+			design->rowStart[j] = design->rowStart[j-1];
+		}
+
+		design->rowStart[0] = 0;
+	}
+
+	if (sampleDict)
+	{
+		DictFree(sampleDict);
+	}
+
+	if (covariateDict)
+	{
+		DictFree(covariateDict);
+	}
+
+	MemFree(samples);
+	MemFree(columns);
+	MemFree(values);
+
+	if (flag<0)
+	{
+		MemFree(names);
+		FreeDesign(design);
+		return -1;
+	}
+
+	printf("%d nonzero values of %d covariates\n", entryNum, design->covariateNum);
+
+	*pNames = names;
+
+	return design->covariateNum;
+}
+
+//Free the design
+void FreeDesign(GLM_DESIGN *design)
+{
+	MemFree(design->rowStart);
+	MemFree(design->columns);
+	MemFree(design->values);
+
+	memset(design, 0, sizeof(GLM_DESIGN));
+}
+
+//Group the guides of table by gene, in order of first appearance: the guides of gene g are guides[geneStart[g]] to guides[geneStart[g+1]-1].
+//Genes are allocated in *pGenes, the indices in *pGuides and *pGeneStart. Return the number of genes, or -1 if failure
+int GroupGuides(COUNT_TABLE *table, GENE_STRUCT **pGenes, int **pGuides, int **pGeneStart)
+{
+	DICT_STRUCT *geneDict;
+	GENE_STRUCT *genes;
+	int *geneIds, *guides, *geneStart;
+	int i, g, geneNum;
+
+	geneDict = DictCreate(1024);
+	geneIds = (int *)MemAlloc(MEM_WORK, table->itemNum*sizeof(int));
+
+	if ((!geneDict)||(!geneIds))
+	{
+		MemFree(geneIds);
+		return -1;
+	}
+
+	for (i=0;i<table->itemNum;i++)
+	{
+		geneIds[i] = DictInsert(geneDict, table->items[i].geneName);
+
+		if (geneIds[i]<0)
+		{
+			printf("Cannot allocate memory for gene names\n");
+			DictFree(geneDict);
+			MemFree(geneIds);
+			return -1;
+		}
+	}
+
+	geneNum = geneDict->num;
+
+	genes = (GENE_STRUCT *)MemAlloc(MEM_GROUPS, geneNum*sizeof(GENE_STRUCT));
+	guides = (int *)MemAlloc(MEM_GROUPS, table->itemNum*sizeof(int));
+	geneStart = (int *)MemAlloc(MEM_GROUPS, (geneNum+1)*sizeof(int));
+
+	if ((!genes)||(!guides)||(!geneStart))
+	{
+		DictFree(geneDict);
+		MemFree(geneIds);
+		MemFree(genes);
+		MemFree(guides);
+		MemFree(geneStart);
+		return -1;
+	}
+
+	for (g=0;g<geneNum;g++)
+	{
+		strcpy(genes[g].name, geneDict->names[g]);
+		genes[g].guideNum = 0;
+	}
+
+	for (i=0;i<table->itemNum;i++)
+	{
+		genes[geneIds[i]].guideNum++;
+	}
+
+	//guides of a gene are in the order of the table; geneIds is reused as the next free place of each gene
+	geneStart[0] = 0;
+
+	for (g=0;g<geneNum;g++)
+	{
+		geneStart[g+1] = geneStart[g]+genes[g].guideNum;
+	}
+
+	for (i=0;i<table->itemNum;i++)
+	{
+		g = geneIds[i];
+		geneIds[i] = geneStart[g+1]-genes[g].guideNum;
+		genes[g].guideNum--;
+		guides[geneIds[i]] = i;
+	}
+
+	for (g=0;g<geneNum;g++)
+	{
+		genes[g].guideNum = geneStart[g+1]-geneStart[g];
+	}
+
+	DictFree(geneDict);
+	MemFree(geneIds);
+
+	*pGenes = genes;
+	*pGuides = guides;
+	*pGeneStart = geneStart;
+
+	return geneNum;
+}
+
+//Format one row of the output. Return 1 if success, -1 if failure
+static int FormatGeneRow(OUT_BUFFER *buffer, void *data, int row)
+{
+	GLM_OUTPUT *output = (GLM_OUTPUT *)data;
+	double beta, stdErr;
+	int c;
+
+	if (OutBufferPrintf(buffer, "%s\t%d", output->genes[row].name, output->genes[row].guideNum)<0)
+	{
+		return -1;
+	}
+
+	//two-sided p-value of the Wald statistic
+	for (c=0;c<output->covariateNum;c++)
+	{
+		beta = output->results.beta[(long)row*output->covariateNum+c];
+		stdErr = output->results.stdErr[(long)row*output->covariateNum+c];
+
+		if (OutBufferPrintf(buffer, "\t%f\t%f\t%10.4e", beta, stdErr, erfc(fabs(beta/stdErr)/sqrt(2.0)))<0)
+		{
+			return -1;
+		}
+	}
+
+	return OutBufferPrintf(buffer, "\n");
+}
+
+//Save the effects of the genes to output file. Format: <gene id> <number of guides> and, for each covariate, <effect> <standard error> <p-value>
+//Rows are formatted in chunks on the thread pool and written in order by a writer thread. Return 1 if success, -1 if failure
+int SaveGeneEffects(char *fileName, GLM_OUTPUT *output, THREAD_POOL_STRUCT *pool)
+{
+	OUT_WRITER_STRUCT *writer;
+	OUT_BUFFER header;
+	int c, flag;
+
+	//chunk 0 is the header, followed by the chunks of rows
+	writer = OutWriterOpen(fileName, 1+OutChunkNum(output->geneNum));
+
+	if (!writer)
+	{
+		return -1;
+	}
+
+	OutBufferInit(&header);
+	OutBufferPrintf(&header, "gene_id\t#_guides");
+
+	for (c=0;c<output->covariateNum;c++)
+	{
+		OutBufferPrintf(&header, "\t%s_effect\t%s_se\t%s_p", output->covariateNames[c], output->covariateNames[c], output->covariateNames[c]);
+	}
+
+	OutBufferPrintf(&header, "\n");
+	OutWriterPut(writer, 0, &header);
+
+	flag = OutWriterFormat(writer, pool, 1, output->geneNum, FormatGeneRow, output);
+
+	ThreadPoolWait(pool);
+
+	if ((OutWriterClose(writer)<0)||(flag<0))
+	{
+		return -1;
+	}
+
+	return 1;
+}
+
+int main (int argc, const char * argv[])
+{
+	int i, flag;
+	COUNT_TABLE table;
+	GLM_DESIGN design;
+	GLM_OUTPUT output;
+	NB_TREND trend;
+	double *sizeFactors;
+	int *guides, *geneStart;
+	int controlNum, failedNum;
+	char inputFileName[1000], designFileName[1000], outputFileName[1000], traceFileName[1000];
+	PERF_SAMPLE perf;
+	int threadNum;
+	THREAD_POOL_STRUCT *pool;
+
+	//Parse the command line
+	if (argc == 1)
+	{
+		PrintCommandUsage(argv[0]);
+		return -1;
+	}
+
+	inputFileName[0] = 0;
+	designFileName[0] = 0;
+	outputFileName[0] = 0;
+	traceFileName[0] = 0;
+	controlNum = 0;
+	threadNum = GetCPUNum();
+
+	for (i=1;i<argc;i++)
+	{
+		if (strcmp(argv[i], "--perf")==0)
+		{
+			PerfInit(1);
+		}
+	}
+
+	for (i=2;i<argc;i++)
+	{
+		if (strcmp(argv[i-1], "-i")==0)
+		{
+			strcpy(inputFileName, argv[i]);
+		}
+		if (strcmp(argv[i-1], "-d")==0)
+		{
+			strcpy(designFileName, argv[i]);
+		}
+		if (strcmp(argv[i-1], "-o")==0)
+		{
+			strcpy(outputFileName, argv[i]);
+		}
+		if (strcmp(argv[i-1], "-c")==0)
+		{
+			controlNum = atoi(argv[i]);
+		}
+		if (strcmp(argv[i-1], "-t")==0)
+		{
+			threadNum = atoi(argv[i]);
+		}
+		if (strcmp(argv[i-1], "--trace")==0)
+		{
+			strcpy(traceFileName, argv[i]);
+		}
+	}
+
+	if ((inputFileName[0]==0)||(designFileName[0]==0)||(outputFileName[0]==0))
+	{
+		printf("Command error!\n");
+		PrintCommandUsage(argv[0]);
+		return -1;
+	}
+
+	//with the output on standard output, messages go to standard error so that the tool can be used in a pipe
+	if ((IsStdStream(outputFileName))&&(OutUseStdout()<0))
+	{
+		return -1;
+	}
+
+	if (threadNum<1)
+	{
+		printf("number of threads should be at least 1\n");
+		printf("program exit!\n");
+		return -1;
+	}
+
+	if (controlNum<0)
+	{
+		printf("number of control samples should not be negative\n");
+		printf("program exit!\n");
+		return -1;
+	}
+
+	TraceInit(traceFileName[0]?traceFileName:NULL);
+
+	pool = ThreadPoolCreate(threadNum);
+
+	if (!pool)
+	{
+		printf("program exit!\n");
+		return -1;
+	}
+
+	printf("read input file...");
+	PerfBegin(&perf);
+	flag = ReadCountTable(inputFileName, &table);
+	PerfEnd(&perf, "ReadCountTable");
+
+	if ((flag<=0)||(controlNum>table.sampleNum))
+	{
+		printf("\nfailed.\n");
+		printf("program exit!\n");
+
+		return -1;
+	}
+	else
+	{
+		printf("done.\n%d sgRNAs\n%d samples\n", table.itemNum, table.sampleNum);
+	}
+
+	printf("read design file...");
+
+	if (ReadDesign(designFileName, &table, &design, &output.covariateNames)<=0)
+	{
+		printf("\nfailed.\n");
+		printf("program exit!\n");
+
+		return -1;
+	}
+	else
+	{
+		printf("done.\n");
+	}
+
+	output.covariateNum = design.covariateNum;
+	output.geneNum = GroupGuides(&table, &output.genes, &guides, &geneStart);
+
+	printf("normalizing...");
+
+	//counts are scaled by the median of their sample, and the variance of the controls, or of all samples, is fitted as a trend of the mean
+	sizeFactors = (double *)MemAlloc(MEM_WORK, table.sampleNum*sizeof(double));
+
+	PerfBegin(&perf);
+	flag = ((output.geneNum>0)&&(sizeFactors))?MedianSizeFactors(table.counts, table.itemNum, table.sampleNum, sizeFactors):-1;
+	flag = flag>0?NBFitTrend(table.counts, table.itemNum, table.sampleNum, controlNum>0?controlNum:table.sampleNum, sizeFactors, &trend):-1;
+	PerfEnd(&perf, "NBFitTrend");
+
+	if (flag<=0)
+	{
+		printf("\nfailed.\n");
+		printf("program exit!\n");
+
+		return -1;
+	}
+	else
+	{
+		printf("done.\nvariance = mean+%g*mean^%g, fitted on %d sgRNAs\n", exp(trend.intercept), trend.slope, trend.fitNum);
+	}
+
+	printf("fitting %d genes...", output.geneNum);
+
+	output.results.beta = (double *)MemAlloc(MEM_OUTPUT, (long)output.geneNum*design.covariateNum*sizeof(double));
+	output.results.stdErr = (double *)MemAlloc(MEM_OUTPUT, (long)output.geneNum*design.covariateNum*sizeof(double));
+	output.results.iterations = (int *)MemAlloc(MEM_OUTPUT, output.geneNum*sizeof(int));
+
+	PerfBegin(&perf);
+	flag = ((output.results.beta)&&(output.results.stdErr)&&(output.results.iterations))?1:-1;
+	flag = flag>0?GLMFitGenes(table.counts, table.itemNum, sizeFactors, &trend, &design, guides, geneStart, output.geneNum, pool, &output.results):-1;
+	PerfEnd(&perf, "GLMFitGenes");
+
+	if (flag<=0)
+	{
+		printf("\nfailed.\n");
+		printf("program exit!\n");
+
+		return -1;
+	}
+
+	failedNum = 0;
+
+	for (i=0;i<output.geneNum;i++)
+	{
+		failedNum += output.results.iterations[i]>GLM_MAX_ITER;
+	}
+
+	printf("done.\n%d genes did not converge in %d iterations\n", failedNum, GLM_MAX_ITER);
+
+	printf("save to output file...");
+
+	PerfBegin(&perf);
+	TraceBegin("output");
+	flag = SaveGeneEffects(outputFileName, &output, pool);
+	TraceEnd("output");
+	PerfEnd(&perf, "SaveGeneEffects");
+
+	if (flag<=0)
+	{
+		printf("\nfailed.\n");
+		printf("program exit!\n");
+
+		return -1;
+	}
+	else
+	{
+		printf("done.\n");
+	}
+
+	printf("finished.\n");
+
+	ThreadPoolDestroy(pool);
+
+	PerfReport(stdout);
+
+	FreeCountTable(&table);
+	FreeDesign(&design);
+	MemFree(output.covariateNames);
+	MemFree(output.genes);
+	MemFree(output.results.beta);
+	MemFree(output.results.stdErr);
+	MemFree(output.results.iterations);
+	MemFree(guides);
+	MemFree(geneStart);
+	MemFree(sizeFactors);
+
+	return 0;
+
+}
+
+//print the usage of Command
+void PrintCommandUsage(const char *command)
+{
+	//print the options of the command
+	printf("%s - Gene effects of multi-condition Crispr screens by negative binomial regression.\n", command);
+	printf("usage:\n");
+	printf("-i <count file>, - for standard input. Format: <sgRNA id> <gene id> <count in sample 1> ... <count in sample n>, with a header naming the samples\n");
+	printf("-d <design file>. Format: <sample id> <covariate id> <value>, with a header, one line for each nonzero value. Samples without a line are baselines. ");
+	printf("Each guide has its own intercept, so the design has no intercept column\n");
+	printf("-o <output file>, - for standard output. Messages are then printed to standard error. Format: <gene id> <number of guides> and, for each covariate, ");
+	printf("<effect> <standard error> <p-value>. Effects are in natural log scale\n");
+	printf("-c <number of control samples>. The first samples, replicates of one condition, on which the mean-variance trend is fitted. Default: all samples\n");
+	printf("-t <number of threads>. Default: number of online CPUs\n");
+	printf("--perf. Report cycles, instructions, cache misses and branch misses of each stage and thread at exit, the tasks of worker threads summed per stage\n");
+	printf("--trace <trace file>. Record a timeline of ingest chunks, batches of genes and output, and write it at exit in Chrome/Perfetto trace format\n");
+	printf("example:\n");
+	printf("%s -i counts.txt -d design.txt -o effects.txt -c 2\n", command);
+
+}
@@ -18,6 +18,18 @@
 #include "words.h"
 #include "rvgs.h"
 #include "rngs.h"
+#include "mem_acct.h"
+#include "perf_counters.h"
+#include "trace.h"
+#include "thread_pool.h"
+#include "out_writer.h"
+#include "block_reader.h"
+#include "exec_ctx.h"
+#include "norm_core.h"
+#include "arrow_ipc.h"
+#include "autotune.h"
+#include "count_table.h"
+#include "dict.h"
 
 #define MAX_NAME_LEN 255           //maximum length of item name, group name or list name
 #define MAX_WORD_IN_LINE 255	   //maximum number of words in a line
@@ -26,36 +38,124 @@ typedef struct
 {
 	char sgName[MAX_NAME_LEN];       //name of the sgRNA
 	char geneName[MAX_NAME_LEN];	 //name of the gene
-	double x1;                       //value of first measure
-	double x2;						 //value of second measure
-	double m;                        //log-mean
-	double r;                        //log-ratio
-	double adjustedR;                //adjusted log-ratio
 } ITEM_STRUCT;
 
+typedef struct
+{
+	ITEM_STRUCT *items;              //names of the sgRNAs
+	double *x1;                      //values of first measure
+	double *x2;                      //values of second measure
+	double *m;                       //log-means
+	double *r;                       //log-ratios
+	double *adjustedR;               //adjusted log-ratios
+	int *chromosomes;                //chromosome of each sgRNA, -1 if its position is unknown. NULL without copy-number correction
+	long *positions;                 //genomic position of each sgRNA
+	double *correctedR;              //adjusted log-ratios corrected for copy number
+	int itemNum;                     //number of sgRNAs
+OUT_WRITER_STRUCT *writer;       //output of the adjusted sgRNAs
+} NORM_TABLE;
+
+typedef struct
+{
+	COUNT_TABLE counts;              //names and counts of the sgRNAs at each time
+	SPARSE_COUNT_TABLE sparse;       //names and nonzero counts of the sgRNAs, for a Matrix Market input
+	COUNT_ITEM *items;               //names of the sgRNAs, of either table
+	int itemNum;                     //number of sgRNAs
+double *sizeFactors;             //size factor of each time
+	double *slopes;                  //slope of the normalized log count of each sgRNA over time
+	double *variances;               //variance of the residuals of each slope
+} SLOPE_TABLE;
+
+
+//Read input file, "-" for standard input, in a single pass. File Format: <sgRNA id> <gene id> <measure in library 1> <measure in library 2>.
+//Names and measures are read into table, which also gets the columns of results. Return the number of items in the file
+int ReadFile(char *fileName, NORM_TABLE *table);
 
-//Read input file. File Format: <sgRNA id> <gene id> <measure in library 1> <measure in library 2>. Return the number of items in the file
-int ReadFile(char *fileName, ITEM_STRUCT **pItems);
+//Read an Arrow IPC file mapped in memory, with the columns <sgRNA id> <gene id> <measure in library 1> <measure in library 2> in this order.
+//Called by ReadFile. Return the number of items in the file
+int ReadArrowFile(char *fileName, NORM_TABLE *table);
 
-//transform to log mean-ratio. m = x1'+x2', r = x2'-x1', x' = log2(x/median+pseudo-count), pseudo-count = <median of all values in a library>*0.01
-int ComputeMR(ITEM_STRUCT *items, int itemNum);
+//Read the genomic positions of the sgRNAs of table for the copy-number correction. File Format: <sgRNA id> <chromosome> <position>, with a header.
+//sgRNAs not in the file are not corrected. Return the number of sgRNAs with a position, or -1 if failure
+int ReadPositions(char *fileName, NORM_TABLE *table);
 
-//QuickSort items by log-mean
-void QuickSortItemByM(ITEM_STRUCT *items, int lo, int hi);
+//Open the output file for the items of table and write the header. Rows are handed over as AdjustMR adjusts them. Return 1 if success, -1 if failure
+//Output files named .arrow or .feather are written as Arrow by SaveToOuput once all rows are adjusted; table->writer is then NULL
+int OpenOutput(char *fileName, NORM_TABLE *table);
 
-//Adjust r using z-transform within a window sliding on items sorted by m
-int AdjustMR(ITEM_STRUCT *items, int itemNum, int winSize);
+//Wait until all results are written and close the output file, or write the Arrow output. Return 1 if success, -1 if failure
+int SaveToOuput(char *fileName, NORM_TABLE *table);
+
+//Free the names, measures and results of table
+void FreeTable(NORM_TABLE *table);
 
 //print the usage of Command
 void PrintCommandUsage(const char *command);
 
-//Read input file. File Format: <sgRNA id> <gene id> <measure in library 1> <measure in library 2>. Return the number of items in the file
-int ReadFile(char *fileName, ITEM_STRUCT **pItems)
+//Parse a comma separated list of times into times. Return the number of times, or -1 if a time is not a number
+int ParseTimes(const char *text, double *times);
+
+//Read the count table of a time course with timeNum columns, normalize all columns by their median at once and fit the slope of each sgRNA
+//over the times on the thread pool. If rowFileName is not empty, the counts are a sparse Matrix Market file whose rows and columns are named
+//by rowFileName and columnFileName, and zeros are never expanded. Return the number of sgRNAs, or -1 if failure
+int FitTimeCourse(char *fileName, char *rowFileName, char *columnFileName, const double *times, int timeNum, THREAD_POOL_STRUCT *pool, SLOPE_TABLE *table);
+
+//Write the slopes and residual variances of table to fileName and, if listFileName is not empty, the slopes as an input list of RRA.
+//Return 1 if success, -1 if failure
+int SaveSlopes(char *fileName, char *listFileName, SLOPE_TABLE *table, THREAD_POOL_STRUCT *pool);
+
+//Free the counts and slopes of table
+void FreeSlopeTable(SLOPE_TABLE *table);
+
+//Allocate the columns of results of the itemNum sgRNAs of table, after checking that they fit with the work arrays of AdjustMR. Return 1 if success, -1 if failure
+static int AllocResults(NORM_TABLE *table, int itemNum)
+{
+	long workBytes;
+	
+	//plan memory before normalizing: the three columns of results, the work arrays of AdjustMR and one working array of values
+	workBytes = (long)itemNum*(3*sizeof(double)+NORM_WORK_BYTES+sizeof(double));
+	
+	if ((GetMemLimit()>0)&&(workBytes>GetMemAvailable()))
+	{
+		printf("%d sgRNAs need %.1f MB, more than the memory limit of %.1f MB\n", itemNum,
+			   (workBytes+GetMemInUse())/1048576.0, GetMemLimit()/1048576.0);
+		return -1;
+	}
+	
+	table->itemNum = itemNum;
+	
+	if (itemNum>0)
+	{
+		table->m = (double *)MemAlloc(MEM_WORK, itemNum*sizeof(double));
+		table->r = (double *)MemAlloc(MEM_WORK, itemNum*sizeof(double));
+		table->adjustedR = (double *)MemAlloc(MEM_WORK, itemNum*sizeof(double));
+		
+		if ((!table->m)||(!table->r)||(!table->adjustedR))
+		{
+			return -1;
+		}
+	}
+	
+	return 1;
+}
+
+//Read input file, "-" for standard input, in a single pass. File Format: <sgRNA id> <gene id> <measure in library 1> <measure in library 2>.
+//Names and measures are read into table, which also gets the columns of results. Arrow IPC files are read by ReadArrowFile. Return the number of items in the file
+int ReadFile(char *fileName, NORM_TABLE *table)
 {
-	FILE *fh;
-	char **words, tmpS[MAX_WORD_IN_LINE*MAX_NAME_LEN];
+	READER_STRUCT *reader;
+	char **words, *line;
 	int wordNum;
-	int totalItemNum;
+	int totalItemNum, itemCapacity;
+	ITEM_STRUCT *tmpItems;
+	double *tmpX1, *tmpX2;
+	
+	memset(table, 0, sizeof(NORM_TABLE));
+	
+	if (IsArrowFile(fileName))
+	{
+		return ReadArrowFile(fileName, table);
+	}
 	
 	words = AllocWords(MAX_WORD_IN_LINE, MAX_NAME_LEN+1);
 	
@@ -66,292 +166,707 @@ int ReadFile(char *fileName, ITEM_STRUCT **pItems)
 		return -1;
 	}
 	
-	fh = (FILE *)fopen(fileName, "r");
+	reader = ReaderOpen(fileName);
 	
-	if (!fh)
+	if (!reader)
 	{
-		printf("Cannot open file %s\n", fileName);
+		FreeWords(words, MAX_WORD_IN_LINE);
 		return -1;
 	}
 	
 	//Read the header row to get the sample number
-	fgets(tmpS, MAX_WORD_IN_LINE*MAX_NAME_LEN, fh);
+	line = ReaderGetLine(reader);
 	
-	wordNum = StringToWords(words, tmpS, MAX_NAME_LEN+1, MAX_WORD_IN_LINE, " \t\r\n\v\f");
+	wordNum = line?StringToWords(words, line, MAX_NAME_LEN+1, MAX_WORD_IN_LINE, " \t\r\n\v\f"):0;
 	
 	assert(wordNum == 4);
 	
 	if (wordNum != 4)
 	{
 		printf("Input file format: <sgRNA id> <gene id> <measure in library 1> <measure in library 2>.\n");
+		ReaderClose(reader);
+		FreeWords(words, MAX_WORD_IN_LINE);
 		return -1;
 	}
 	
-	//read records of items
+	//read records of items. The input is read once, so the names and the columns of measures grow as they are read
 	
 	totalItemNum = 0;
+	itemCapacity = 1024;
+	table->items = (ITEM_STRUCT *)MemAlloc(MEM_INPUT, itemCapacity*sizeof(ITEM_STRUCT));
+	table->x1 = (double *)MemAlloc(MEM_INPUT, itemCapacity*sizeof(double));
+	table->x2 = (double *)MemAlloc(MEM_INPUT, itemCapacity*sizeof(double));
+	
+	if ((!table->items)||(!table->x1)||(!table->x2))
+	{
+		FreeTable(table);
+		ReaderClose(reader);
+		FreeWords(words, MAX_WORD_IN_LINE);
+		return -1;
+	}
 	
-	fgets(tmpS, 255*(MAX_NAME_LEN+1)*sizeof(char), fh);
-	wordNum = StringToWords(words, tmpS, MAX_NAME_LEN+1, MAX_WORD_IN_LINE, " \t\r\n\v\f");
+	line = ReaderGetLine(reader);
+	wordNum = line?StringToWords(words, line, MAX_NAME_LEN+1, MAX_WORD_IN_LINE, " \t\r\n\v\f"):0;
 	
-	while ((wordNum==4)&&(!feof(fh)))
-	{		
+	TraceBegin("ingest chunk");
+	
+	while ((wordNum==4)&&(!ReaderAtEnd(reader)))
+	{
+		if (totalItemNum>=itemCapacity)
+		{
+			tmpItems = (ITEM_STRUCT *)MemRealloc(MEM_INPUT, table->items, 2*(long)itemCapacity*sizeof(ITEM_STRUCT));
+			
+			if (tmpItems)
+			{
+				table->items = tmpItems;
+			}
+			
+			tmpX1 = (double *)MemRealloc(MEM_INPUT, table->x1, 2*(long)itemCapacity*sizeof(double));
+			
+			if (tmpX1)
+			{
+				table->x1 = tmpX1;
+			}
+			
+			tmpX2 = (double *)MemRealloc(MEM_INPUT, table->x2, 2*(long)itemCapacity*sizeof(double));
+			
+			if (tmpX2)
+			{
+				table->x2 = tmpX2;
+			}
+			
+			if ((!tmpItems)||(!tmpX1)||(!tmpX2))
+			{
+				printf("%d sgRNAs read, no memory for more\n", totalItemNum);
+				TraceEnd("ingest chunk");
+				FreeTable(table);
+				ReaderClose(reader);
+				FreeWords(words, MAX_WORD_IN_LINE);
+				return -1;
+			}
+			
+			itemCapacity *= 2;
+		}
+		
+		strcpy(table->items[totalItemNum].sgName, words[0]);
+		strcpy(table->items[totalItemNum].geneName, words[1]);
+		table->x1[totalItemNum] = atof(words[2]);
+		table->x2[totalItemNum] = atof(words[3]);
 		totalItemNum++;
 		
-		fgets(tmpS, 255*(MAX_NAME_LEN+1)*sizeof(char), fh);
-		wordNum = StringToWords(words, tmpS, MAX_NAME_LEN+1, MAX_WORD_IN_LINE, " \t\r\n\v\f");
+		if (totalItemNum%TRACE_CHUNK_SIZE==0)
+		{
+			TraceEnd("ingest chunk");
+			TraceBegin("ingest chunk");
+		}
+		
+		line = ReaderGetLine(reader);
+		wordNum = line?StringToWords(words, line, MAX_NAME_LEN+1, MAX_WORD_IN_LINE, " \t\r\n\v\f"):0;
 	}
 	
-	fclose(fh);	
-	
-	*pItems = (ITEM_STRUCT *)malloc(totalItemNum*sizeof(ITEM_STRUCT));
+	TraceEnd("ingest chunk");
 	
-	assert(pItems!=NULL);
+	FreeWords(words, MAX_WORD_IN_LINE);
 	
-	fh = (FILE *)fopen(fileName, "r");
+	if (ReaderClose(reader)<0)
+	{
+		FreeTable(table);
+		return -1;
+	}
 	
-	if (!fh)
+	if (AllocResults(table, totalItemNum)<0)
 	{
-		printf("Cannot open file %s\n", fileName);
+		FreeTable(table);
 		return -1;
 	}
 	
-	//Read the header row to get the sample number
-	fgets(tmpS, MAX_WORD_IN_LINE*(MAX_NAME_LEN+1)*sizeof(char), fh);
+	printf("%d sgRNAs read.\n", totalItemNum);
 	
-	wordNum = StringToWords(words, tmpS, MAX_NAME_LEN+1, MAX_WORD_IN_LINE, " \t\r\n\v\f");
+	return totalItemNum;
+}
+
+//Read an Arrow IPC file mapped in memory, with the columns <sgRNA id> <gene id> <measure in library 1> <measure in library 2> in this order.
+//Called by ReadFile. Return the number of items in the file
+int ReadArrowFile(char *fileName, NORM_TABLE *table)
+{
+	ARROW_FILE *file;
+	ARROW_ARRAY *arrays;
+	int batchIndex, itemNum, flag;
+	long i, row, rowNum, len;
+	const char *s;
 	
-	assert(wordNum == 4);
+	file = ArrowOpen(fileName);
 	
-	//read records of items
+	if (!file)
+	{
+		return -1;
+	}
 	
-	totalItemNum = 0;
+	if ((file->columnNum<4)||(file->columns[0].type!=ARROW_TYPE_UTF8)||(file->columns[1].type!=ARROW_TYPE_UTF8)||(file->rowNum>=0x7fffffff))
+	{
+		printf("Input file format: <sgRNA id> <gene id> <measure in library 1> <measure in library 2>.\n");
+		ArrowClose(file);
+		return -1;
+	}
+	
+	//the number of rows is known, so the names and the columns of measures are allocated once
+	itemNum = (int)file->rowNum;
+	
+	table->items = (ITEM_STRUCT *)MemAlloc(MEM_INPUT, (itemNum+1)*sizeof(ITEM_STRUCT));
+	table->x1 = (double *)MemAlloc(MEM_INPUT, (itemNum+1)*sizeof(double));
+	table->x2 = (double *)MemAlloc(MEM_INPUT, (itemNum+1)*sizeof(double));
+	arrays = (ARROW_ARRAY *)MemAlloc(MEM_INPUT, file->columnNum*sizeof(ARROW_ARRAY));
 	
-	fgets(tmpS, MAX_WORD_IN_LINE*(MAX_NAME_LEN+1)*sizeof(char), fh);
-	wordNum = StringToWords(words, tmpS, MAX_NAME_LEN+1, MAX_WORD_IN_LINE, " \t\r\n\v\f");
+	flag = ((table->items)&&(table->x1)&&(table->x2)&&(arrays))?1:-1;
+	row = 0;
 	
-	while ((wordNum==4)&&(!feof(fh)))
+	TraceBegin("ingest chunk");
+	
+	for (batchIndex=0;(batchIndex<file->batchNum)&&(flag>0);batchIndex++)
 	{
-		strcpy((*pItems)[totalItemNum].sgName, words[0]);
-		strcpy((*pItems)[totalItemNum].geneName, words[1]);
-		(*pItems)[totalItemNum].x1 = atof(words[2]);
-		(*pItems)[totalItemNum].x2 = atof(words[3]);
-		totalItemNum++;
+		rowNum = ArrowReadBatch(file, batchIndex, arrays);
 		
-		fgets(tmpS, 255*(MAX_NAME_LEN+1)*sizeof(char), fh);
-		wordNum = StringToWords(words, tmpS, MAX_NAME_LEN+1, MAX_WORD_IN_LINE, " \t\r\n\v\f");
+		if ((rowNum<0)||(arrays[0].nullCount>0)||(arrays[1].nullCount>0)||(arrays[2].nullCount>0)||(arrays[3].nullCount>0)
+			||(ArrowToDoubles(file->columns+2, arrays+2, table->x1+row)<0)||(ArrowToDoubles(file->columns+3, arrays+3, table->x2+row)<0))
+		{
+			printf("Input file format: <sgRNA id> <gene id> <measure in library 1> <measure in library 2>, without null values.\n");
+			flag = -1;
+			break;
+		}
+		
+		for (i=0;(i<rowNum)&&(flag>0);i++)
+		{
+			s = ArrowString(file->columns, arrays, i, &len);
+			flag = s?1:-1;
+			
+			if (s)
+			{
+				len = len<MAX_NAME_LEN-1?len:MAX_NAME_LEN-1;
+				memcpy(table->items[row+i].sgName, s, len);
+				table->items[row+i].sgName[len] = 0;
+				
+				s = ArrowString(file->columns+1, arrays+1, i, &len);
+				flag = s?1:-1;
+			}
+			
+			if (s)
+			{
+				len = len<MAX_NAME_LEN-1?len:MAX_NAME_LEN-1;
+				memcpy(table->items[row+i].geneName, s, len);
+				table->items[row+i].geneName[len] = 0;
+			}
+		}
+		
+		row += rowNum;
 	}
 	
-	fclose(fh);	
+	TraceEnd("ingest chunk");
 	
-	FreeWords(words, MAX_WORD_IN_LINE);
+	MemFree(arrays);
+	ArrowClose(file);
 	
-	printf("%d sgRNAs read.\n", totalItemNum);
+	if ((flag<0)||(AllocResults(table, itemNum)<0))
+	{
+		FreeTable(table);
+		return -1;
+	}
 	
-	return totalItemNum;
+	printf("%d sgRNAs read.\n", itemNum);
+	
+	return itemNum;
 }
 
-//transform to log mean-ratio. m = x1'+x2', r = x2'-x1', x' = log2(x/median+0.01), 0.01 is the pseudo-count
-int ComputeMR(ITEM_STRUCT *items, int itemNum)
+//Read the genomic positions of the sgRNAs of table for the copy-number correction. File Format: <sgRNA id> <chromosome> <position>, with a header.
+//sgRNAs not in the file are not corrected. Return the number of sgRNAs with a position, or -1 if failure
+int ReadPositions(char *fileName, NORM_TABLE *table)
 {
-	double *tmpF;
-	int i;
-	double median1, median2,x1ba, x2ba;
+	READER_STRUCT *reader;
+	DICT_STRUCT *sgDict, *chromosomeDict;
+	char **words, *line;
+	int i, wordNum, placedNum, flag;
+	
+	table->chromosomes = (int *)MemAlloc(MEM_INPUT, table->itemNum*sizeof(int));
+	table->positions = (long *)MemAlloc(MEM_INPUT, table->itemNum*sizeof(long));
+	table->correctedR = (double *)MemAlloc(MEM_WORK, table->itemNum*sizeof(double));
+	sgDict = DictCreate(table->itemNum);
+	chromosomeDict = DictCreate(64);
+	words = AllocWords(MAX_WORD_IN_LINE, MAX_NAME_LEN+1);
 	
-	assert(itemNum>0);
+	flag = ((table->chromosomes)&&(table->positions)&&(table->correctedR)&&(sgDict)&&(chromosomeDict)&&(words))?1:-1;
 	
-	tmpF = (double *)malloc(itemNum*sizeof(double));
+	//sgRNAs are found by name; a repeated name gets the position of its first row
+	for (i=0;(i<table->itemNum)&&(flag>0);i++)
+	{
+		table->chromosomes[i] = -1;
+		table->positions[i] = 0;
+		flag = DictInsert(sgDict, table->items[i].sgName)>=0?1:-1;
+	}
+	
+	reader = flag>0?ReaderOpen(fileName):NULL;
+	flag = reader?flag:-1;
+	placedNum = 0;
 	
-	assert(tmpF!=NULL);
+	//skip the header
+	line = flag>0?ReaderGetLine(reader):NULL;
+	line = line?ReaderGetLine(reader):NULL;
+	wordNum = line?StringToWords(words, line, MAX_NAME_LEN+1, MAX_WORD_IN_LINE, " \t\r\n\v\f"):0;
 	
-	for (i=0;i<itemNum;i++)
+	while ((flag>0)&&(wordNum==3)&&(!ReaderAtEnd(reader)))
 	{
-		tmpF[i] = items[i].x1;
+		i = DictLookup(sgDict, words[0]);
+		
+		if ((i>=0)&&(table->chromosomes[i]<0))
+		{
+			table->chromosomes[i] = DictInsert(chromosomeDict, words[1]);
+			table->positions[i] = atol(words[2]);
+			flag = table->chromosomes[i]>=0?1:-1;
+			placedNum++;
+		}
+		
+		line = ReaderGetLine(reader);
+		wordNum = line?StringToWords(words, line, MAX_NAME_LEN+1, MAX_WORD_IN_LINE, " \t\r\n\v\f"):0;
 	}
 	
-	QuicksortF(tmpF, 0, itemNum-1);
-	
-	median1 = tmpF[(itemNum+1)/2];
+	if ((reader)&&(ReaderClose(reader)<0))
+	{
+		flag = -1;
+	}
 	
-	for (i=0;i<itemNum; i++)
+	if (words)
 	{
-		tmpF[i] =items[i].x2;
+		FreeWords(words, MAX_WORD_IN_LINE);
 	}
 	
-	QuicksortF(tmpF, 0, itemNum-1);
+	if (sgDict)
+	{
+		DictFree(sgDict);
+	}
 	
-	median2 = tmpF[(itemNum+1)/2];
+	if (chromosomeDict)
+	{
+		DictFree(chromosomeDict);
+	}
 	
-	for (i=0;i<itemNum;i++)
+	if (flag<0)
 	{
-		x1ba = log2(items[i].x1/median1+0.01);
-		x2ba = log2(items[i].x2/median2+0.01);
-		
-		items[i].m = x1ba + x2ba;
-		items[i].r = x2ba - x1ba;
+		printf("Position file format: <sgRNA id> <chromosome> <position>, with a header.\n");
+		return -1;
 	}
 	
-	free(tmpF);
+	printf("%d sgRNAs have a position.\n", placedNum);
 	
-	return 1;
+	return placedNum;
 }
 
-//QuickSort items by log-mean
-void QuickSortItemByM(ITEM_STRUCT *items, int lo, int hi)
+//Free the names, measures and results of table
+void FreeTable(NORM_TABLE *table)
 {
-	int i=lo, j=hi;
-	ITEM_STRUCT h;
-	double x=items[(lo+hi)/2].m;
+	MemFree(table->items);
+	MemFree(table->x1);
+	MemFree(table->x2);
+	MemFree(table->m);
+	MemFree(table->r);
+	MemFree(table->adjustedR);
+	MemFree(table->chromosomes);
+	MemFree(table->positions);
+	MemFree(table->correctedR);
+	
+	memset(table, 0, sizeof(NORM_TABLE));
+}
+
+//Format one row of the output. Return 1 if success, -1 if failure
+static int FormatItemRow(OUT_BUFFER *buffer, void *data, int row)
+{
+	NORM_TABLE *table = (NORM_TABLE *)data;
 	
-	if (hi<lo)
+	if (table->correctedR)
 	{
-		return;
+		return OutBufferPrintf(buffer, "%s\t%s\t%f\t%f\t%f\t%f\t%f\t%f\t%f\t%f\n",
+							   table->items[row].sgName,
+							   table->items[row].geneName,
+							   table->x1[row],
+							   table->x2[row],
+							   table->m[row]-table->adjustedR[row]/2,
+							   table->m[row]+table->adjustedR[row]/2,
+							   table->m[row],
+							   table->r[row],
+							   table->adjustedR[row],
+							   table->correctedR[row]);
 	}
 	
-    //  partition
-    while (i<=j)
-    {    
-		while ((items[i].m<x)&&(i<=j))
-		{
-			i++;
-		}
-		while ((items[j].m>x)&&(i<=j))
+	return OutBufferPrintf(buffer, "%s\t%s\t%f\t%f\t%f\t%f\t%f\t%f\t%f\n",
+						   table->items[row].sgName,
+						   table->items[row].geneName,
+						   table->x1[row],
+						   table->x2[row],
+						   table->m[row]-table->adjustedR[row]/2,
+						   table->m[row]+table->adjustedR[row]/2,
+						   table->m[row],
+						   table->r[row],
+						   table->adjustedR[row]);
+}
+
+//Format the rows of a chunk adjusted by AdjustMR and hand them to the writer. Runs on the worker that adjusted the chunk
+static void PutAdjustedChunk(void *arg, int chunkIndex, int start, int end)
+{
+	NORM_TABLE *table = (NORM_TABLE *)arg;
+	OUT_BUFFER buffer;
+	int i;
+	
+	TraceBegin("format chunk");
+	
+	OutBufferInit(&buffer);
+	
+	for (i=start;i<end;i++)
+	{
+		if (FormatItemRow(&buffer, table, i)<0)
 		{
-			j--;
+			//an empty chunk is still handed over so that the writer does not wait for it
+			OutBufferFree(&buffer);
+			table->writer->status = -1;
+			break;
 		}
-        if (i<=j)
-        {
-			memcpy(&h,items+i,sizeof(ITEM_STRUCT));
-			memcpy(items+i,items+j,sizeof(ITEM_STRUCT));
-			memcpy(items+j,&h,sizeof(ITEM_STRUCT));
-            i++; j--;
-        }
-    } 
+	}
 	
-    //  recursion
-    if (lo<j) QuickSortItemByM(items, lo, j);
-    if (i<hi) QuickSortItemByM(items, i, hi);	
+	//chunk 0 of the output is the header
+	OutWriterPut(table->writer, chunkIndex+1, &buffer);
+	
+	TraceEnd("format chunk");
 }
 
-//Adjust r using z-transform within a window sliding on items sorted by m
-int AdjustMR(ITEM_STRUCT *items, int itemNum, int winSize)
+//Open the output file for the items of table and write the header. Rows are handed over as AdjustMR adjusts them. Return 1 if success, -1 if failure
+//Format: <sgRNA id> <gene id> <measure in library 1> <measure in library 2> <normalized measure in library 1> <normalized measure in library 2> <mean> <ratio> <adjusted ratio>,
+//followed by <corrected ratio> with the copy-number correction, whose rows are formatted once all are corrected.
+//Output files named .arrow or .feather are written as Arrow by SaveToOuput once all rows are adjusted; table->writer is then NULL
+int OpenOutput(char *fileName, NORM_TABLE *table)
 {
-	int i,j;
-	double tmpMean, tmpStdev;
-	int index1, index2, tmpRange;
-	ITEM_STRUCT *tmpItems;
-	double *tmpM;
+	OUT_BUFFER header;
 	
-	assert(itemNum>0);
-	assert(winSize>0);
+	if (IsArrowName(fileName))
+	{
+		table->writer = NULL;
+		return 1;
+	}
 	
-	tmpItems = (ITEM_STRUCT *)malloc(itemNum*sizeof(ITEM_STRUCT));
-	tmpM = (double *)malloc(itemNum*sizeof(double));
+	//chunk 0 is the header, followed by one chunk per chunk of AdjustMR, or per chunk of output rows with the copy-number correction
+	table->writer = OutWriterOpen(fileName, 1+(table->correctedR?OutChunkNum(table->itemNum):NormChunkNum(table->itemNum)));
 	
-	assert(tmpItems!=NULL);
-	assert(tmpM!=NULL);
+	if (!table->writer)
+	{
+		return -1;
+	}
 	
-	memcpy(tmpItems, items, itemNum*sizeof(ITEM_STRUCT));
-							
-	QuickSortItemByM(items, 0, itemNum);
+	OutBufferInit(&header);
+	OutBufferPrintf(&header, "sgRNA_id\tgene_id\tmeasure_lib1\tmeasure_lib2\tnorm_measure_lib1\tnorm_measure_lib2\tmean\tratio\tadjusted_ratio%s\n",
+					table->correctedR?"\tcorrected_ratio":"");
+	OutWriterPut(table->writer, 0, &header);
 	
-	for (i=0;i<itemNum;i++)
+	return 1;
+}
+
+//Wait until all results are written and close the output file, or write the Arrow output. Return 1 if success, -1 if failure
+int SaveToOuput(char *fileName, NORM_TABLE *table)
+{
+	ARROW_OUT_COLUMN columns[10];
+	double *norm1, *norm2;
+	int i, columnNum, flag;
+	
+	if (table->writer)
 	{
-		tmpM[i] = items[i].m;
+		return OutWriterClose(table->writer);
 	}
 	
-	for (i=0;i<itemNum;i++)
+	//Arrow columns are written from the columns of the table in place; only the normalized measures are computed
+	norm1 = (double *)MemAlloc(MEM_OUTPUT, (table->itemNum+1)*sizeof(double));
+	norm2 = (double *)MemAlloc(MEM_OUTPUT, (table->itemNum+1)*sizeof(double));
+	
+	if ((!norm1)||(!norm2))
 	{
-		index1 = bTreeSearchingF(tmpItems[i].m-0.000000001, tmpM, 0, itemNum-1);
-		index2 = bTreeSearchingF(tmpItems[i].m+0.000000001, tmpM, 0, itemNum-1);
-		
-		tmpRange = index2-index1+1;
-		
-		if (tmpRange<winSize)
-		{
-			index1 = index1-(winSize-tmpRange+1)/2;
-			index2 = index2+(winSize-tmpRange+1)/2;
-			
-			index1 = index1>=0?index1:0;
-			index2 = index2<itemNum?index2:itemNum-1;
-		}
-		
-		index1 = bTreeSearchingF(tmpM[index1]-0.000000001, tmpM, 0, itemNum-1);
-		index2 = bTreeSearchingF(tmpM[index2]+0.000000001, tmpM, 0, itemNum-1);
-		
-		assert(index1>=0);
-		assert(index2<itemNum);
-		
-		tmpMean = 0.0;
+		MemFree(norm1);
+		MemFree(norm2);
+		return -1;
+	}
+	
+	for (i=0;i<table->itemNum;i++)
+	{
+		norm1[i] = table->m[i]-table->adjustedR[i]/2;
+		norm2[i] = table->m[i]+table->adjustedR[i]/2;
+	}
+	
+	columns[0].name = "sgRNA_id";
+	columns[0].base = table->items[0].sgName;
+	columns[1].name = "gene_id";
+	columns[1].base = table->items[0].geneName;
+	columns[2].name = "measure_lib1";
+	columns[2].base = (char *)table->x1;
+	columns[3].name = "measure_lib2";
+	columns[3].base = (char *)table->x2;
+	columns[4].name = "norm_measure_lib1";
+	columns[4].base = (char *)norm1;
+	columns[5].name = "norm_measure_lib2";
+	columns[5].base = (char *)norm2;
+	columns[6].name = "mean";
+	columns[6].base = (char *)table->m;
+	columns[7].name = "ratio";
+	columns[7].base = (char *)table->r;
+	columns[8].name = "adjusted_ratio";
+	columns[8].base = (char *)table->adjustedR;
+	columns[9].name = "corrected_ratio";
+	columns[9].base = (char *)table->correctedR;
+	columnNum = table->correctedR?10:9;
+	
+	for (i=0;i<columnNum;i++)
+	{
+		columns[i].type = i<2?ARROW_TYPE_UTF8:ARROW_TYPE_FLOAT;
+		columns[i].stride = i<2?sizeof(ITEM_STRUCT):sizeof(double);
+	}
+	
+	flag = ArrowWriteFile(fileName, columns, columnNum, table->itemNum);
+	
+	MemFree(norm1);
+	MemFree(norm2);
+	
+	return flag;
+}
+
+//Parse a comma separated list of times into times. Return the number of times, or -1 if a time is not a number
+int ParseTimes(const char *text, double *times)
+{
+	const char *start;
+	char *end;
+	int timeNum;
+	
+	timeNum = 0;
+	start = text;
+	
+	while (timeNum<COUNT_MAX_SAMPLES)
+	{
+		times[timeNum] = strtod(start, &end);
 		
-		for (j=index1;j<=index2;j++)
+		if ((end==start)||((*end!=',')&&(*end!=0)))
 		{
-			tmpMean += items[j].r;
+			return -1;
 		}
 		
-		tmpMean = tmpMean/(index2-index1+1);
+		timeNum++;
 		
-		tmpStdev = 0.0;
-		
-		for (j=index1;j<index2;j++)
+		if (*end==0)
 		{
-			tmpStdev += (items[j].r-tmpMean)*(items[j].r-tmpMean);
+			return timeNum;
 		}
 		
-		tmpStdev = sqrt(tmpStdev/(index2-index1+1));
-		
-		tmpItems[i].adjustedR = (tmpItems[i].r-tmpMean)/(tmpStdev+0.000000001);
+		start = end+1;
 	}
 	
-	memcpy(items, tmpItems, itemNum*sizeof(ITEM_STRUCT));
+	return -1;
+}
+
+//Read the count table of a time course with timeNum columns, normalize all columns by their median at once and fit the slope of each sgRNA
+//over the times on the thread pool. If rowFileName is not empty, the counts are a sparse Matrix Market file whose rows and columns are named
+//by rowFileName and columnFileName, and zeros are never expanded. Return the number of sgRNAs, or -1 if failure
+int FitTimeCourse(char *fileName, char *rowFileName, char *columnFileName, const double *times, int timeNum, THREAD_POOL_STRUCT *pool, SLOPE_TABLE *table)
+{
+	int itemNum, sampleNum, flag;
+	PERF_SAMPLE perf;
 	
-	free(tmpItems);
-	free(tmpM);
+	memset(table, 0, sizeof(SLOPE_TABLE));
 	
-	return 1;
+	PerfBegin(&perf);
+	
+	if (rowFileName[0])
+	{
+		itemNum = ReadSparseCountTable(fileName, rowFileName, columnFileName, &table->sparse);
+		sampleNum = table->sparse.sampleNum;
+		table->items = table->sparse.items;
+	}
+	else
+	{
+		itemNum = ReadCountTable(fileName, &table->counts);
+		sampleNum = table->counts.sampleNum;
+		table->items = table->counts.items;
+	}
+	
+	PerfEnd(&perf, "ReadCountTable");
+	
+	if (itemNum<=0)
+	{
+		FreeSlopeTable(table);
+		return -1;
+	}
+	
+	if (sampleNum!=timeNum)
+	{
+		printf("%d times are given for %d columns of counts\n", timeNum, sampleNum);
+		FreeSlopeTable(table);
+		return -1;
+	}
+	
+	table->itemNum = itemNum;
+	
+	if (rowFileName[0])
+	{
+		printf("%d sgRNAs read at %d times, %ld nonzero counts.\n", itemNum, timeNum, table->sparse.nonzeroNum);
+	}
+	else
+	{
+		printf("%d sgRNAs read at %d times.\n", itemNum, timeNum);
+	}
+	
+	table->sizeFactors = (double *)MemAlloc(MEM_WORK, timeNum*sizeof(double));
+	table->slopes = (double *)MemAlloc(MEM_WORK, itemNum*sizeof(double));
+	table->variances = (double *)MemAlloc(MEM_WORK, itemNum*sizeof(double));
+	
+	if ((!table->sizeFactors)||(!table->slopes)||(!table->variances))
+	{
+		FreeSlopeTable(table);
+		return -1;
+	}
+	
+	//all columns are normalized together, rather than one pair of times at a time
+	PerfBegin(&perf);
+	
+	if (rowFileName[0])
+	{
+		flag = SparseMedianSizeFactors(table->sparse.rowStart, table->sparse.columns, table->sparse.values, itemNum, timeNum, table->sizeFactors);
+	}
+	else
+	{
+		flag = MedianSizeFactors(table->counts.counts, itemNum, timeNum, table->sizeFactors);
+	}
+	
+	if (flag<0)
+	{
+		FreeSlopeTable(table);
+		return -1;
+	}
+	
+	PerfEnd(&perf, "MedianSizeFactors");
+	
+	PerfBegin(&perf);
+	
+	if (rowFileName[0])
+	{
+		flag = SparseTimeCourseSlopes(table->sparse.rowStart, table->sparse.columns, table->sparse.values, itemNum, timeNum, times, table->sizeFactors,
+									  pool, table->slopes, table->variances);
+	}
+	else
+	{
+		flag = TimeCourseSlopes(table->counts.counts, itemNum, timeNum, times, table->sizeFactors, pool, table->slopes, table->variances);
+	}
+	
+	if (flag<0)
+	{
+		FreeSlopeTable(table);
+		return -1;
+	}
+	
+	PerfEnd(&perf, "TimeCourseSlopes");
+	
+	return itemNum;
 }
 
-//Save results to file. Format: <sgRNA id> <gene id> <measure in library 1> <measure in library 2> <normalized measure in library 1> <normalized measure in library 2> <mean> <ratio> <adjusted ratio>
-int SaveToOuput(char *fileName, ITEM_STRUCT *items, int itemNum)
+//Format one row of the slopes. Return 1 if success, -1 if failure
+static int FormatSlopeRow(OUT_BUFFER *buffer, void *data, int row)
 {
-	FILE *fh;
-	int i;
+	SLOPE_TABLE *table = (SLOPE_TABLE *)data;
+	
+	return OutBufferPrintf(buffer, "%s\t%s\t%f\t%f\n",
+						   table->items[row].sgName,
+						   table->items[row].geneName,
+						   table->slopes[row],
+						   table->variances[row]);
+}
+
+//Format one row of the input list of RRA. Return 1 if success, -1 if failure
+static int FormatListRow(OUT_BUFFER *buffer, void *data, int row)
+{
+	SLOPE_TABLE *table = (SLOPE_TABLE *)data;
 	
-	fh = (FILE *)fopen(fileName, "w");
+	return OutBufferPrintf(buffer, "%s\t%s\tslope\t%f\n",
+						   table->items[row].sgName,
+						   table->items[row].geneName,
+						   table->slopes[row]);
+}
+
+//Write the rows of table to fileName with a header, formatted in chunks on the thread pool. Return 1 if success, -1 if failure
+static int WriteSlopeFile(char *fileName, const char *headerText, OUT_FORMAT_FUNC format, SLOPE_TABLE *table, THREAD_POOL_STRUCT *pool)
+{
+	OUT_WRITER_STRUCT *writer;
+	OUT_BUFFER header;
+	int flag;
+	
+	//chunk 0 is the header, followed by the chunks of rows
+	writer = OutWriterOpen(fileName, 1+OutChunkNum(table->itemNum));
 	
-	if (!fh)
+	if (!writer)
 	{
-		printf("Cannot open %s.\n", fileName);
 		return -1;
 	}
 	
-	fprintf(fh, "sgRNA_id\tgene_id\tmeasure_lib1\tmeasure_lib2\tnorm_measure_lib1\tnorm_measure_lib2\tmean\tratio\tadjusted_ratio\n");
+	OutBufferInit(&header);
+	OutBufferPrintf(&header, "%s", headerText);
+	OutWriterPut(writer, 0, &header);
+	
+	flag = OutWriterFormat(writer, pool, 1, table->itemNum, format, table);
 	
-	for (i=0;i<itemNum;i++)
+	ThreadPoolWait(pool);
+	
+	if ((OutWriterClose(writer)<0)||(flag<0))
 	{
-		fprintf(fh, "%s\t%s\t%f\t%f\t%f\t%f\t%f\t%f\t%f\n",
-				items[i].sgName,
-				items[i].geneName,
-				items[i].x1,
-				items[i].x2,
-				items[i].m-items[i].adjustedR/2,
-				items[i].m+items[i].adjustedR/2,
-				items[i].m,
-				items[i].r,
-				items[i].adjustedR);
+		return -1;
 	}
 	
-	fclose(fh);
+	return 1;
+}
+
+//Write the slopes and residual variances of table to fileName and, if listFileName is not empty, the slopes as an input list of RRA.
+//Format: <sgRNA id> <gene id> <slope> <residual variance>, and <sgRNA id> <gene id> <list id> <slope> for RRA. Return 1 if success, -1 if failure
+int SaveSlopes(char *fileName, char *listFileName, SLOPE_TABLE *table, THREAD_POOL_STRUCT *pool)
+{
+	if (WriteSlopeFile(fileName, "sgRNA_id\tgene_id\tslope\tresidual_variance\n", FormatSlopeRow, table, pool)<0)
+	{
+		return -1;
+	}
+	
+	if ((listFileName[0])&&(WriteSlopeFile(listFileName, "sgRNA_id\tgene_id\tlist_id\tvalue\n", FormatListRow, table, pool)<0))
+	{
+		return -1;
+	}
 	
 	return 1;
 }
 
+//Free the counts and slopes of table
+void FreeSlopeTable(SLOPE_TABLE *table)
+{
+	FreeCountTable(&table->counts);
+	FreeSparseCountTable(&table->sparse);
+MemFree(table->sizeFactors);
+	MemFree(table->slopes);
+	MemFree(table->variances);
+	
+	memset(table, 0, sizeof(SLOPE_TABLE));
+}
+
 int main (int argc, const char * argv[]) 
 {
 	int i, winSize;
-	ITEM_STRUCT *items;
+	NORM_TABLE table;
+	SLOPE_TABLE slopeTable;
 	int itemNum;
-	char inputFileName[1000], outputFileName[1000];
+	char inputFileName[1000], outputFileName[1000], traceFileName[1000], tuneFileName[1000], listFileName[1000], positionFileName[1000];
+	char rowFileName[1000], columnFileName[1000];
+	long cnWindow;
+	double times[COUNT_MAX_SAMPLES];
+	int timeNum;
+	long memLimit;
+	int memReport;
+	int numa, hugePages;
+	int flag;
+	PERF_SAMPLE perf;
+	int threadNum, threadSet, autotune;
+	TUNE_PARAMS tune;
+	THREAD_POOL_STRUCT *pool;
 	
 	//Parse the command line
 	if (argc == 1)
@@ -362,7 +877,42 @@ int main (int argc, const char * argv[])
 	
 	inputFileName[0] = 0;
 	outputFileName[0] = 0;
+	traceFileName[0] = 0;
+	tuneFileName[0] = 0;
+	listFileName[0] = 0;
+	positionFileName[0] = 0;
+	rowFileName[0] = 0;
+	columnFileName[0] = 0;
+cnWindow = 2000000;
+	timeNum = 0;
 	winSize = 200;
+	memLimit = 0;
+	memReport = 0;
+	numa = 0;
+	hugePages = HUGE_PAGES_OFF;
+	threadNum = GetCPUNum();
+	threadSet = 0;
+	autotune = 0;
+	
+	for (i=1;i<argc;i++)
+	{
+		if (strcmp(argv[i], "--mem-report")==0)
+		{
+			memReport = 1;
+		}
+		if (strcmp(argv[i], "--perf")==0)
+		{
+			PerfInit(1);
+		}
+		if (strcmp(argv[i], "--numa")==0)
+		{
+			numa = 1;
+		}
+		if (strcmp(argv[i], "--autotune")==0)
+		{
+			autotune = 1;
+		}
+	}
 	
 	for (i=2;i<argc;i++)
 	{
@@ -378,6 +928,52 @@ int main (int argc, const char * argv[])
 		{
 			winSize = atoi(argv[i]);
 		}
+		if (strcmp(argv[i-1], "-t")==0)
+		{
+			threadNum = atoi(argv[i]);
+			threadSet = 1;
+		}
+		if (strcmp(argv[i-1], "--mem-limit")==0)
+		{
+			memLimit = atol(argv[i])*1024*1024;
+		}
+		if (strcmp(argv[i-1], "--trace")==0)
+		{
+			strcpy(traceFileName, argv[i]);
+		}
+		if (strcmp(argv[i-1], "--huge-pages")==0)
+		{
+			hugePages = ParseHugePages(argv[i]);
+		}
+		if (strcmp(argv[i-1], "--tune-file")==0)
+		{
+			strcpy(tuneFileName, argv[i]);
+			autotune = 1;
+		}
+		if (strcmp(argv[i-1], "--time")==0)
+		{
+			timeNum = ParseTimes(argv[i], times);
+		}
+		if (strcmp(argv[i-1], "--rra-list")==0)
+		{
+			strcpy(listFileName, argv[i]);
+		}
+		if (strcmp(argv[i-1], "--positions")==0)
+		{
+			strcpy(positionFileName, argv[i]);
+		}
+		if (strcmp(argv[i-1], "--cn-window")==0)
+		{
+			cnWindow = atol(argv[i]);
+		}
+		if (strcmp(argv[i-1], "--mtx-rows")==0)
+		{
+			strcpy(rowFileName, argv[i]);
+		}
+		if (strcmp(argv[i-1], "--mtx-cols")==0)
+		{
+			strcpy(columnFileName, argv[i]);
+		}
 	}
 	
 	if ((inputFileName[0]==0)||(outputFileName[0]==0))
@@ -387,8 +983,151 @@ int main (int argc, const char * argv[])
 		return -1;
 	}
 	
+	//with the output on standard output, messages go to standard error so that the tool can be used in a pipe
+	if ((IsStdStream(outputFileName))&&(OutUseStdout()<0))
+	{
+		return -1;
+	}
+	
+	if (memLimit<0)
+	{
+		printf("memory limit should be positive\n");
+		printf("program exit!\n");
+		return -1;
+	}
+	
+	if (threadNum<1)
+	{
+		printf("number of threads should be at least 1\n");
+		printf("program exit!\n");
+		return -1;
+	}
+	
+	if (hugePages<0)
+	{
+		printf("--huge-pages should be off, thp or explicit\n");
+		printf("program exit!\n");
+		return -1;
+	}
+	
+	if (timeNum<0)
+	{
+		printf("--time should be a comma separated list of at most %d times\n", COUNT_MAX_SAMPLES);
+		printf("program exit!\n");
+		return -1;
+	}
+	
+	if (cnWindow<=0)
+	{
+		printf("--cn-window should be positive\n");
+		printf("program exit!\n");
+		return -1;
+	}
+	
+	if ((positionFileName[0])&&(timeNum>0))
+	{
+		printf("--positions cannot be used with --time\n");
+		printf("program exit!\n");
+		return -1;
+	}
+	
+	if (((rowFileName[0])||(columnFileName[0]))&&((!rowFileName[0])||(!columnFileName[0])||(timeNum==0)))
+	{
+		printf("--mtx-rows and --mtx-cols name the rows and columns of a count matrix together, with --time\n");
+		printf("program exit!\n");
+		return -1;
+	}
+	
+	if ((listFileName[0])&&(timeNum==0))
+	{
+		printf("--rra-list needs the times of a time course given by --time\n");
+		printf("program exit!\n");
+		return -1;
+	}
+	
+	if (ExecInit(numa, hugePages, (memLimit>0)||(memReport)||(numa))<0)
+	{
+		printf("program exit!\n");
+		return -1;
+	}
+	
+	SetMemLimit(memLimit);
+	TraceInit(traceFileName[0]?traceFileName:NULL);
+	
+	//parameters tuned for this host, calibrated on first use. -t still sets the number of threads
+	if (autotune)
+	{
+		printf("loading parameters tuned for this host...");
+		
+		if (TuneLoad(tuneFileName[0]?tuneFileName:NULL, &tune)<0)
+		{
+			printf("\nfailed.\n");
+			printf("program exit!\n");
+			return -1;
+		}
+		
+		printf("done.\n");
+		
+		TuneApply(&tune);
+		threadNum = threadSet?threadNum:tune.threadNum;
+		tune.threadNum = threadNum;
+	}
+	
+	pool = ThreadPoolCreate(threadNum);
+	
+	if (!pool)
+	{
+		printf("program exit!\n");
+		return -1;
+	}
+	
+	//time course: slopes of all columns instead of the MA normalization of two
+	if (timeNum>0)
+	{
+		printf("fitting time course slopes...");
+		
+		if (FitTimeCourse(inputFileName, rowFileName, columnFileName, times, timeNum, pool, &slopeTable)<=0)
+		{
+			printf("\nfailed.\n");
+			printf("program exit!\n");
+			return -1;
+		}
+		
+		printf("done.\n");
+		printf("save to output file...");
+		
+		PerfBegin(&perf);
+		TraceBegin("output");
+		flag = SaveSlopes(outputFileName, listFileName, &slopeTable, pool);
+		TraceEnd("output");
+		PerfEnd(&perf, "SaveSlopes");
+		
+		if (flag<=0)
+		{
+			printf("\nfailed.\n");
+			printf("program exit!\n");
+			return -1;
+		}
+		
+		printf("done.\n");
+		printf("finished.\n");
+		
+		if ((memLimit>0)||(memReport)||(numa))
+		{
+			PrintMemReport(stdout);
+		}
+		
+		ThreadPoolDestroy(pool);
+		PerfReport(stdout);
+		FreeSlopeTable(&slopeTable);
+		
+		return 0;
+	}
+	
 	printf("read input file...");
-	itemNum = ReadFile(inputFileName, &items);
+	PerfBegin(&perf);
+	itemNum = ReadFile(inputFileName, &table);
+	PerfEnd(&perf, "ReadFile");
 	
 	if (itemNum<=0)
 	{
@@ -402,9 +1141,19 @@ int main (int argc, const char * argv[])
 		printf("done.\n");
 	}
 	
+	if ((positionFileName[0])&&(ReadPositions(positionFileName, &table)<0))
+	{
+		printf("program exit!\n");
+		return -1;
+	}
+	
 	printf("normalizing...");
 	
-	if (ComputeMR(items, itemNum)<=0)
+	PerfBegin(&perf);
+	flag = ComputeMR(table.x1, table.x2, itemNum, table.m, table.r);
+	PerfEnd(&perf, "ComputeMR");
+	
+	if (flag<=0)
 	{
 		printf("\nfailed.\n");
 		printf("program exit!\n");
@@ -412,21 +1161,61 @@ int main (int argc, const char * argv[])
 		return -1;
 	}
 	
-	if (AdjustMR(items, itemNum, winSize)<=0)
+	//the output is opened before adjusting, so that adjusted chunks are written while the others are computed
+	flag = OpenOutput(outputFileName, &table);
+	
+	if (flag<=0)
 	{
 		printf("\nfailed.\n");
 		printf("program exit!\n");
 		
 		return -1;
 	}
-	else
+	
+	PerfBegin(&perf);
+	flag = AdjustMR(table.m, table.r, itemNum, winSize, pool, table.adjustedR, (table.writer)&&(!table.correctedR)?PutAdjustedChunk:NULL, &table);
+	PerfEnd(&perf, "AdjustMR");
+	
+	if (flag<=0)
 	{
-		printf("done.\n");
+		printf("\nfailed.\n");
+		printf("program exit!\n");
+		
+		return -1;
 	}
 	
+	//the median of the adjusted ratios of the guides around each guide on its chromosome is taken as the bias of its copy number
+	if (table.correctedR)
+	{
+		PerfBegin(&perf);
+		flag = CorrectCopyNumber(table.adjustedR, table.chromosomes, table.positions, itemNum, cnWindow/2, pool, table.correctedR);
+		PerfEnd(&perf, "CorrectCopyNumber");
+		
+		if ((flag>0)&&(table.writer))
+		{
+			flag = OutWriterFormat(table.writer, pool, 1, itemNum, FormatItemRow, &table);
+		}
+		
+		if (flag<=0)
+		{
+			printf("\nfailed.\n");
+			printf("program exit!\n");
+			
+			return -1;
+		}
+	}
+	
+	printf("done.\n");
+	
 	printf("save to output file...");
 	
-	if (SaveToOuput(outputFileName, items, itemNum)<=0)
+	PerfBegin(&perf);
+	TraceBegin("output");
+	flag = SaveToOuput(outputFileName, &table);
+	TraceEnd("output");
+	PerfEnd(&perf, "SaveToOutput");
+	
+	if (flag<=0)
 	{
 		printf("\nfailed.\n");
 		printf("program exit!\n");
@@ -440,7 +1229,21 @@ int main (int argc, const char * argv[])
 	
 	printf("finished.\n");
 	
-	free(items);
+	if ((memLimit>0)||(memReport)||(numa))
+	{
+		PrintMemReport(stdout);
+	}
+	
+	ThreadPoolDestroy(pool);
+	
+	if (autotune)
+	{
+		TuneReport(stdout, &tune);
+	}
+	
+	PerfReport(stdout);
+	
+	FreeTable(&table);
 	
 	return 0;
 	
@@ -452,10 +1255,30 @@ void PrintCommandUsage(const char *command)
 	//print the options of the command
 	printf("%s - Crispr data normalization.\n", command);
 	printf("usage:\n");
-	printf("-i <input data file>. Format: <sgRNA id> <gene id> <measure in library 1> <measure in library 2>\n");
-	printf("-o <output file>. Format: <sgRNA id> <gene id> <measure in library 1> <measure in library 2> <normalized measure in library 1> <normalized measure in library 2> <mean> <ratio> <adjusted ratio>\n");
+	printf("-i <input data file>, - for standard input. Format: <sgRNA id> <gene id> <measure in library 1> <measure in library 2>. Arrow IPC (Feather) files with these four columns are mapped in memory. Only uncompressed Arrow files are read: pyarrow compresses with LZ4 unless compression=\"uncompressed\" is given\n");
+	printf("-o <output file>, - for standard output. Messages are then printed to standard error. Format: <sgRNA id> <gene id> <measure in library 1> <measure in library 2> <normalized measure in library 1> <normalized measure in library 2> <mean> <ratio> <adjusted ratio>. Written as Arrow if the name ends with .arrow or .feather\n");
 	printf("-w <window size>. Default:200\n");
+	printf("-t <number of threads>. Default: number of online CPUs\n");
+	printf("--mem-limit <memory limit in MB>. Fail early if the input does not fit in the limit. Default: no limit\n");
+	printf("--mem-report. Report the peak memory of each subsystem at exit, and the placement of large buffers if they are mapped with --huge-pages. Always reported with --mem-limit or --numa\n");
+	printf("--numa. Pin worker threads to CPUs spread over the NUMA nodes and interleave the work arrays that all workers read over the nodes\n");
+	printf("--huge-pages <off|thp|explicit>. Back buffers of 2 MB or more with transparent huge pages (thp), or with the explicit huge page pool, falling back to thp. Default: off\n");
+	printf("--perf. Report cycles, instructions, cache misses and branch misses of each stage and thread at exit, the tasks of worker threads summed per stage. Falls back to software counters where hardware counters are unavailable\n");
+	printf("--trace <trace file>. Record a timeline of ingest chunks, sorts, window batches and output, and write it at exit in Chrome/Perfetto trace format\n");
+	printf("--autotune. Use the number of threads and chunk sizes tuned for this host, calibrated by short benchmarks on first use and cached in $HOME/%s. -t overrides the number of threads. The choices are reported at exit\n", TUNE_FILE_NAME);
+	printf("--tune-file <tuning cache file>. Cache of tuned parameters used instead of $HOME/%s. Implies --autotune\n", TUNE_FILE_NAME);
+	printf("--time <t1,t2,...,tn>. Time course mode: the input is <sgRNA id> <gene id> <count at time 1> ... <count at time n> with a header, and the times of its columns are given here. ");
+	printf("All columns are normalized by their median at once and the output is <sgRNA id> <gene id> <slope> <residual variance>, the least-squares slope of log2(normalized count+1) over time\n");
+	printf("--positions <position file>. Correct the adjusted ratios for copy number: the median adjusted ratio of the sgRNAs within the window around each sgRNA on its chromosome is subtracted, into a column <corrected ratio> added to the output. ");
+	printf("Format: <sgRNA id> <chromosome> <position>, with a header. sgRNAs without a position are not corrected\n");
+	printf("--cn-window <window size in bp>. Width of the window of the copy-number correction. Default: 2000000\n");
+	printf("--mtx-rows <row file> and --mtx-cols <column file>. With --time, the input is a sparse Matrix Market coordinate matrix of counts, sgRNAs by times, for screens where most counts are zero. ");
+	printf("The row file names its rows, <sgRNA id> <gene id> per line, and the column file its columns, one per line. Zeros are implicit, so memory grows with the nonzero counts. ");
+	printf("As the median of a column that is mostly zeros is zero, each column is normalized instead by the median over its nonzero counts of the count divided by the geometric mean of its row, zeros counted as 1 (DESeq2 poscounts)\n");
+	printf("--rra-list <list file>. With --time, also write the slopes as an input of RRA: <sgRNA id> <gene id> <list id> <slope>\n");
 	printf("example:\n");
 	printf("%s -i input.txt -o output.txt -w 200\n", command);
+	printf("%s -i - -o - < input.txt | cut -f 1,2,9 > ratio.txt\n", command);
+	printf("%s -i timecourse.txt -o slopes.txt --time 0,3,7,14 --rra-list slope_list.txt\n", command);
 	
 }
@@ -10,6 +10,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <memory.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <time.h>
 
 #define NDEBUG
 #include <assert.h>
@@ -17,12 +20,35 @@
 #include "words.h"
 #include "rvgs.h"
 #include "rngs.h"
+#include "dict.h"
+#include "extsort.h"
+#include "mem_acct.h"
+#include "checkpoint.h"
+#include "perf_counters.h"
+#include "trace.h"
+#include "thread_pool.h"
+#include "out_writer.h"
+#include "block_reader.h"
+#include "exec_ctx.h"
+#include "rra_core.h"
+#include "arrow_ipc.h"
+#include "result_store.h"
+#include "rra_meta.h"
+#include "autotune.h"
+#include "count_table.h"
+#include "nb_test.h"
+#include "rra_grouping.h"
 
 #define MAX_NAME_LEN 255           //maximum length of item name, group name or list name
-#define CDF_MAX_ERROR 1E-10        //maximum error in Cumulative Distribution Function estimation in beta statistics
-#define MAX_GROUP_NUM 100000       //maximum number of groups
 #define MAX_LIST_NUM 1000          //maximum number of list 
-#define RAND_PASS_NUM 100          //number of passes in random simulation for computing FDR
+#define NULL_SKETCH_DECADES 330    //the null sketch covers lo-values from 1E-330 to 1
+#define MAX_SKETCH_BINS 1000       //maximum number of null sketch bins per decade
+#define MIN_SKETCH_BINS 10         //minimum number of null sketch bins per decade
+#define PLAN_SAMPLE_LINES 1000     //number of input lines sampled to estimate the input size
+#define PLAN_OUT_ROW_BYTES 64      //buffer planned for one formatted output row of a typical group id, with the headroom of buffer growth
+#define STATE_MAGIC "RRASTAT1"     //first bytes of a state file
+#define RANK_SHIFT_MARGIN 1E-8     //margin around a changed range of values, wider than the tolerance of ties in ListPercentile
+#define LIST_CACHE_MAGIC "RRALST02" //first bytes of a list cache file
 
 typedef struct
 {
@@ -37,7 +63,8 @@ typedef struct
 	char name[MAX_NAME_LEN];       //name of the group
 	ITEM_STRUCT *items;            //items in the group
 	int itemNum;                   //number of items in the group
-	double loValue;                //lo-value in RRA
+	int index;                     //index of the group in the order of input, kept when groups are sorted
+	double loValue;                //lo-value in RRA, or the score of the aggregator being reported
 	double fdr;                    //false discovery rate
 } GROUP_STRUCT;
 
@@ -48,30 +75,184 @@ typedef struct
 	int itemNum;                   //number of items in the list
 } LIST_STRUCT;
 
-//Read input file. File Format: <item id> <group id> <list id> <value>. Return 1 if success, -1 if failure
-int ReadFile(char *fileName, GROUP_STRUCT *groups, int maxGroupNum, int *groupNum, LIST_STRUCT *lists, int maxListNum, int *listNum);
+typedef struct
+{
+	double value;                  //value of measurement
+	int listIndex;                 //index of list storing the item
+	int groupIndex;                //index of group containing the item
+} OOC_VALUE_RECORD;
+
+typedef struct
+{
+	double percentile;             //percentile of the item in its list
+	int groupIndex;                //index of group containing the item
+	int reserved;                  //padding to 16 bytes
+} OOC_PERCENTILE_RECORD;
+
+typedef struct
+{
+	long memLimit;                 //memory limit in bytes, 0 if no limit
+	long estimatedItemNum;         //number of items estimated from the size of the input file
+	long estimatedGroupNum;        //number of groups estimated from the size of the input file
+	long inMemoryBytes;            //estimated memory to process the input in memory
+	long oocBudget;                //memory budget of the out-of-core sorters in bytes, 0 to process the input in memory
+	int sketchBins;                //number of null sketch bins per decade of lo-value, 0 to keep every null lo-value
+	long nullBytes;                //memory of the null distribution
+	int threadNum;                 //number of threads, each with its own working memory
+	long threadBytes;              //working memory: output chunks of the threads waiting for the writer, and the lo-value batch of ComputeFDR once groups are known
+} RUN_PLAN;
+
+typedef struct
+{
+	const RESULT_STORE *store;     //result store of the screens
+	META_RESULT *results;          //result of each gene of the store
+	INDEXED_FLOAT *order;          //genes in the order of output
+} META_OUTPUT;
+
+typedef struct
+{
+	int binsPerDecade;             //number of bins per decade of lo-value
+	int binNum;                    //number of bins
+	double *counts;                //number of null lo-values in each bin
+	long total;                    //number of null lo-values
+} NULL_SKETCH;
+
+typedef struct
+{
+	int listIndex;                 //list of the changed value
+	double lo;                     //smallest of the old and new values
+	double hi;                     //largest of the old and new values
+} RANK_SHIFT;
+
+typedef struct
+{
+	int group;                     //group of the item, -1 if the item was dropped
+	int position;                  //position of the item in the group
+} ITEM_REF;
+
+//Read input file, "-" for standard input, in a single pass. File Format: <item id> <group id> <list id> <value>. Return 1 if success, -1 if failure
+//Groups are allocated in *pGroups and grow with the input
+int ReadFile(char *fileName, GROUP_STRUCT **pGroups, int *groupNum, LIST_STRUCT *lists, int maxListNum, int *listNum);
+
+//Read an Arrow IPC file mapped in memory, with the columns <item id> <group id> <list id> <value> in this order.
+//Dictionary encoded group and list ids are used through their indices. Called by ReadFile. Return the number of items, or -1 if failure
+int ReadArrowFile(char *fileName, GROUP_STRUCT **pGroups, int *groupNum, LIST_STRUCT *lists, int maxListNum, int *listNum);
+
+//Read a count table, "-" for standard input, by ReadCountTable. File Format: <item id> <group id> <count in sample 1> ... <count in sample n>, the first
+//controlNum samples being the controls. Each item is tested by NBTestGuides; its probability of a count as low, or as high if enriched is 1, is its value in a
+//single list. Groups are allocated in *pGroups. Return the number of items, or -1 if failure
+int ReadCountFile(char *fileName, int controlNum, int enriched, THREAD_POOL_STRUCT *pool, GROUP_STRUCT **pGroups, int *groupNum, LIST_STRUCT *lists, int *listNum);
 
 //Save group information to output file. Format <group id> <number of items in the group> <lo-value> <false discovery rate>
-int SaveGroupInfo(char *fileName, GROUP_STRUCT *groups, int groupNum);
+//Rows are formatted in chunks on the thread pool and written in order by a writer thread. Output files named .arrow or .feather are written as Arrow
+int SaveGroupInfo(char *fileName, GROUP_STRUCT *groups, int groupNum, THREAD_POOL_STRUCT *pool);
+
+//Process groups by computing percentiles for each item and the score of each of the aggregatorNum aggregators for each group. The score of the first
+//aggregator is the loValue of the group; those of the others are allocated in *pScores, groupNum per aggregator in the order of input, NULL if there is only one.
+//If ranked is 1, the lists are sorted and the percentiles of the items are known already, as loaded by LoadListCache, and only the scores are computed
+int ProcessGroups(GROUP_STRUCT *groups, int groupNum, LIST_STRUCT *lists, int listNum, double maxPercentile, const int *aggregators, int aggregatorNum, int ranked, double **pScores);
+
+//Hash of the content of the lists: the list id and value of every item, in any order and whatever the item ids and groups. Used as the key of a list cache
+unsigned long ListContentHash(LIST_STRUCT *lists, int listNum);
+
+//Load the sorted lists from a list cache saved by SaveListCache with the same hash, and set the percentile of every item from the percentiles of the sorted
+//values, so that runs on the same lists under other groups skip sorting and ranking. Return 1 if loaded, 0 if the cache does not exist or does not match the input
+int LoadListCache(char *fileName, unsigned long hash, GROUP_STRUCT *groups, int groupNum, LIST_STRUCT *lists, int listNum);
+
+//Save the sorted lists and the percentile of each of their values to a list cache keyed by hash, after ProcessGroups. The file is replaced atomically.
+//Return 1 if success, -1 if failure
+int SaveListCache(char *fileName, unsigned long hash, LIST_STRUCT *lists, int listNum);
+
+//Out-of-core replacement of ReadFile and ProcessGroups for inputs larger than memory. Stream the input once, sort (list, value) and (group, percentile) records
+//externally within memBudget bytes, and compute the scores of the aggregators group by group, stored as ProcessGroups does. Groups are allocated in *pGroups.
+//Return the number of items, or -1 if failure
+int ProcessFileOutOfCore(char *fileName, GROUP_STRUCT **pGroups, int *groupNum, int *listNum, double maxPercentile, const int *aggregators, int aggregatorNum,
+						 double **pScores, long memBudget, const char *tmpDir);
+
+//Order groups by index, which is the order of input
+int CompareGroupIndex(const void *a, const void *b);
+
+//Score the groups of each of the groupingNum mapping files of groupFileNames, <item id> <group id> [<list id> [<input group id>]] with a header, by aggregator from the
+//percentiles of the items computed by ProcessGroups, each item ranked once for all groupings. Each grouping is saved as SaveGroupInfo does, to outputFileName
+//with .<grouping name> inserted before the extension. Groups without items in the input are not saved. Return 1 if success, -1 if failure
+int ScoreGroupFiles(char (*groupFileNames)[1000], int groupingNum, GROUP_STRUCT *groups, int groupNum, LIST_STRUCT *lists, int listNum, int aggregator,
+					double maxPercentile, char *outputFileName, THREAD_POOL_STRUCT *pool);
 
-//Process groups by computing percentiles for each item and lo-values for each group
-int ProcessGroups(GROUP_STRUCT *groups, int groupNum, LIST_STRUCT *lists, int listNum, double maxPercentile);
+//Save the state of an RRA run for later updates: the sorted lists, the groups in the order of input with their items and lo-values,
+//and the sorted null distribution. Groups may be in any order; they are written by index. The file is replaced atomically. Return 1 if success, -1 if failure
+int SaveState(char *fileName, GROUP_STRUCT *groups, int groupNum, LIST_STRUCT *lists, int listNum, int aggregator, double maxPercentile,
+			  double *sortedNull, int nullNum);
+
+//Load the state of an RRA run saved by SaveState. Groups are allocated in *pGroups in the order of input, and the null distribution in *pSortedNull.
+//Return the number of items, or -1 if failure
+int LoadState(char *fileName, GROUP_STRUCT **pGroups, int *groupNum, LIST_STRUCT *lists, int maxListNum, int *listNum, int *aggregator,
+			  double *maxPercentile, double **pSortedNull, int *nullNum);
+
+//Apply a patch of changed rows, in the input format with a header, to the groups and sorted lists of a state. A row replaces the value of
+//the item of the same id, group and list, adds the item to its group if it is new, or drops the item if the value is NA. Percentiles are
+//recomputed only for the items whose rank can shift: those within the range of a changed value, or all items of a list that changed size.
+//Groups whose score can change are flagged in *pRescore, allocated with one flag per group: those with a dropped item, or with a changed
+//percentile up to cutoff before or after the change, or with a changed percentile and none up to cutoff. cutoff is the maximum percentile
+//for RRA, whose lo-values ignore larger percentiles, and 1 for the other aggregators. Groups left without items are removed.
+//Return the number of rows applied, or -1 if failure
+int ApplyPatch(char *fileName, GROUP_STRUCT **pGroups, int *groupNum, LIST_STRUCT *lists, int listNum, double cutoff, char **pRescore);
+
+//Recompute the score of aggregator of the groups flagged in rescore, from the percentiles of their items. Return 1 if success, -1 if failure
+int RescoreGroups(GROUP_STRUCT *groups, int groupNum, const char *rescore, int aggregator, double maxPercentile);
+
+//Sort groups by lo-value and compute their false discovery rates against a null distribution of nullNum lo-values sorted in ascending order
+void RankFDR(GROUP_STRUCT *groups, int groupNum, double *sortedNull, int nullNum);
 
 //QuickSort groups by loValue
 void QuickSortGroupByLoValue(GROUP_STRUCT *groups, int start, int end);
 
-//Compute False Discovery Rate based on uniform distribution
-int ComputeFDR(GROUP_STRUCT *groups, int groupNum, double maxPercentile, int numOfRandPass);
+//Compute False Discovery Rate of the loValue of groups, scored by aggregator, based on uniform distribution. If sketchBins>0, the null lo-values are counted in a histogram with sketchBins bins
+//per decade instead of being stored. If ckpt is not NULL, the simulation is checkpointed periodically and can be resumed from the checkpoint.
+//If pSortedNull is not NULL and the null lo-values are stored, they are handed over sorted in *pSortedNull, with their number in *nullNum
+int ComputeFDR(GROUP_STRUCT *groups, int groupNum, double maxPercentile, int aggregator, int numOfRandPass, int sketchBins, CHECKPOINT_STRUCT *ckpt,
+			   double **pSortedNull, int *nullNum);
+
+//Parse a comma separated list of aggregator names into aggregators. Return the number of aggregators, or -1 if a name is unknown or repeated
+int ParseAggregatorList(const char *text, int *aggregators);
+
+//Copy fileName to result, with .<name> inserted before the extension if name is not NULL
+void AggregatorFileName(const char *fileName, const char *name, char *result, int size);
+
+//Plan how to process the input under the memory limit: in memory, or out of core with a sort budget. Return 1 if success, -1 if failure
+int PlanInput(char *fileName, RUN_PLAN *plan);
+
+//Plan the null distribution under the memory left: exact array of lo-values, or a sketch with as many bins as fit. Return 1 if success, -1 if failure
+int PlanNull(GROUP_STRUCT *groups, int groupNum, int numOfRandPass, RUN_PLAN *plan);
+
+//Return the memory of the output chunks of rowNum rows, -1 if unknown, that may wait for the writer with threadNum threads
+long PlanOutputBytes(long rowNum, int threadNum);
+
+//Append the results of groups to a result store, as screen screenName read from inputFileName. Return 1 if success, -1 if failure
+int AppendToStore(char *storeFileName, char *screenName, char *inputFileName, GROUP_STRUCT *groups, int groupNum, int itemNum, int listNum, double maxPercentile);
+
+//Subcommand query: print one gene across all screens of a result store, the top hits of one screen, or the screens. Return 0 if success, -1 if failure
+//argv[1] is "query"
+int QueryMain(int argc, const char *argv[]);
+
+//Subcommand meta: aggregate the ranks of each gene across the screens of a result store by a second-level RRA. Return 0 if success, -1 if failure
+//argv[1] is "meta"
+int MetaMain(int argc, const char *argv[]);
+
+//Subcommand update: apply a patch to the state of an earlier run, rescore the affected groups and compute false discovery rates against
+//the null distribution of the state. Return 0 if success, -1 if failure. argv[1] is "update"
+int UpdateMain(int argc, const char *argv[]);
 
 //print the usage of Command
 void PrintCommandUsage(const char *command);
 
+//print the usage of subcommand meta
+void PrintMetaUsage(const char *command);
+
+//print the usage of subcommand query
+void PrintQueryUsage(const char *command);
 
-//Compute lo-value based on an array of percentiles
-int ComputeLoValue(double *percentiles,     //array of percentiles
-				   int num,                 //length of array
-				   double *loValue,         //pointer to the output lo-value
-				   double maxPercentile);   //maximum percentile, computation stops when maximum percentile is reached
+//print the usage of subcommand update
+void PrintUpdateUsage(const char *command);
 
 int main (int argc, const char * argv[]) 
 {
@@ -80,8 +261,31 @@ int main (int argc, const char * argv[])
 	int groupNum;
 	LIST_STRUCT *lists;
 	int listNum;
-	char inputFileName[1000], outputFileName[1000];
+	char inputFileName[1000], outputFileName[1000], tmpDir[1000], traceFileName[1000];
+	char storeFileName[1000], screenName[1000], tuneFileName[1000];
+	int itemNum;
 	double maxPercentile;
+	long memBudget;
+	int memReport;
+	int numa, hugePages;
+	RUN_PLAN plan;
+	CHECKPOINT_STRUCT ckpt;
+	PERF_SAMPLE perf;
+	int threadNum, threadSet, autotune;
+	TUNE_PARAMS tune;
+	THREAD_POOL_STRUCT *pool;
+	int aggregators[AGG_KERNEL_NUM];
+	int aggregatorNum, k;
+	double *scores;
+	char aggregatorFileName[1000], ckptFileName[1000], stateFileName[1000];
+	double *sortedNull;
+	int nullNum;
+	int nbControlNum, nbEnriched;
+	char listCacheFileName[1000];
+	unsigned long listHash;
+	int ranked;
+	char groupFileNames[MAX_GROUPING_NUM][1000];
+	int groupingNum;
 	
 	//Parse the command line
 	if (argc == 1)
@@ -90,9 +294,74 @@ int main (int argc, const char * argv[])
 		return -1;
 	}
 	
+	if (strcmp(argv[1], "query")==0)
+	{
+		return QueryMain(argc, argv);
+	}
+	
+	if (strcmp(argv[1], "meta")==0)
+	{
+		return MetaMain(argc, argv);
+	}
+	
+	if (strcmp(argv[1], "update")==0)
+	{
+		return UpdateMain(argc, argv);
+	}
+
 	inputFileName[0] = 0;
 	outputFileName[0] = 0;
+	tmpDir[0] = 0;
+	traceFileName[0] = 0;
+	storeFileName[0] = 0;
+	screenName[0] = 0;
+	tuneFileName[0] = 0;
+	stateFileName[0] = 0;
+	listCacheFileName[0] = 0;
+	groupingNum = 0;
 	maxPercentile = 0.1;
+	memBudget = 0;
+	memReport = 0;
+	numa = 0;
+	hugePages = HUGE_PAGES_OFF;
+	memset(&plan, 0, sizeof(RUN_PLAN));
+	memset(&ckpt, 0, sizeof(CHECKPOINT_STRUCT));
+	ckpt.interval = 300;
+	threadNum = GetCPUNum();
+	threadSet = 0;
+	autotune = 0;
+	aggregators[0] = AGG_RRA;
+	aggregatorNum = 1;
+	nbControlNum = 0;
+	nbEnriched = 0;
+	
+	for (i=1;i<argc;i++)
+	{
+		if (strcmp(argv[i], "--mem-report")==0)
+		{
+			memReport = 1;
+		}
+		if (strcmp(argv[i], "--resume")==0)
+		{
+			ckpt.resume = 1;
+		}
+		if (strcmp(argv[i], "--perf")==0)
+		{
+			PerfInit(1);
+		}
+		if (strcmp(argv[i], "--numa")==0)
+		{
+			numa = 1;
+		}
+		if (strcmp(argv[i], "--autotune")==0)
+		{
+			autotune = 1;
+		}
+		if (strcmp(argv[i], "--nb-enriched")==0)
+		{
+			nbEnriched = 1;
+		}
+	}
 	
 	for (i=2;i<argc;i++)
 	{
@@ -104,10 +373,84 @@ int main (int argc, const char * argv[])
 		{
 			strcpy(outputFileName, argv[i]);
 		}
+		if (strcmp(argv[i-1], "--nb-control")==0)
+		{
+			nbControlNum = atoi(argv[i]);
+		}
 		if (strcmp(argv[i-1], "-p")==0)
 		{
 			maxPercentile = atof(argv[i]);
 		}
+		if (strcmp(argv[i-1], "-m")==0)
+		{
+			memBudget = atol(argv[i])*1024*1024;
+		}
+		if (strcmp(argv[i-1], "-T")==0)
+		{
+			strcpy(tmpDir, argv[i]);
+		}
+		if (strcmp(argv[i-1], "-t")==0)
+		{
+			threadNum = atoi(argv[i]);
+			threadSet = 1;
+		}
+		if (strcmp(argv[i-1], "-a")==0)
+		{
+			aggregatorNum = ParseAggregatorList(argv[i], aggregators);
+		}
+		if (strcmp(argv[i-1], "--mem-limit")==0)
+		{
+			plan.memLimit = atol(argv[i])*1024*1024;
+		}
+		if (strcmp(argv[i-1], "--checkpoint")==0)
+		{
+			strcpy(ckpt.fileName, argv[i]);
+		}
+		if (strcmp(argv[i-1], "--checkpoint-interval")==0)
+		{
+			ckpt.interval = atoi(argv[i]);
+		}
+		if (strcmp(argv[i-1], "--trace")==0)
+		{
+			strcpy(traceFileName, argv[i]);
+		}
+		if (strcmp(argv[i-1], "--huge-pages")==0)
+		{
+			hugePages = ParseHugePages(argv[i]);
+		}
+		if (strcmp(argv[i-1], "--store")==0)
+		{
+			strcpy(storeFileName, argv[i]);
+		}
+		if (strcmp(argv[i-1], "--screen")==0)
+		{
+			strcpy(screenName, argv[i]);
+		}
+		if (strcmp(argv[i-1], "--tune-file")==0)
+		{
+			strcpy(tuneFileName, argv[i]);
+			autotune = 1;
+		}
+		if (strcmp(argv[i-1], "--save-state")==0)
+		{
+			strcpy(stateFileName, argv[i]);
+		}
+		if (strcmp(argv[i-1], "--list-cache")==0)
+		{
+			strcpy(listCacheFileName, argv[i]);
+		}
+		if (strcmp(argv[i-1], "--group-file")==0)
+		{
+			if (groupingNum>=MAX_GROUPING_NUM)
+			{
+				printf("at most %d mapping files can be given by --group-file\n", MAX_GROUPING_NUM);
+				printf("program exit!\n");
+				return -1;
+			}
+			
+			strcpy(groupFileNames[groupingNum], argv[i]);
+			groupingNum++;
+		}
 	}
 	
 	if ((inputFileName[0]==0)||(outputFileName[0]==0))
@@ -117,499 +460,3820 @@ int main (int argc, const char * argv[])
 		return -1;
 	}
 	
-	if ((maxPercentile>1.0)||(maxPercentile<0.0))
+	//with the output on standard output, messages go to standard error so that the tool can be used in a pipe
+	if ((IsStdStream(outputFileName))&&(OutUseStdout()<0))
 	{
-		printf("maxPercentile should be within 0.0 and 1.0\n");
-		printf("program exit!\n");
 		return -1;
 	}
 	
-	groups = (GROUP_STRUCT *)malloc(MAX_GROUP_NUM*sizeof(GROUP_STRUCT));
-	lists = (LIST_STRUCT *)malloc(MAX_LIST_NUM*sizeof(LIST_STRUCT));
-	assert(groups!=NULL);
-	assert(lists!=NULL);
-	
-	printf("reading input file...");
-	
-	flag = ReadFile(inputFileName, groups, MAX_GROUP_NUM, &groupNum, lists, MAX_LIST_NUM, &listNum);
-	
-	if (flag<=0)
+	if (aggregatorNum<=0)
 	{
-		printf("\nfailed.\n");
+		printf("-a should list different aggregators among rra, alpha-rra, rank-product, second-best and median\n");
 		printf("program exit!\n");
-		
 		return -1;
 	}
-	else
+	
+	if ((aggregatorNum>1)&&(IsStdStream(outputFileName)))
 	{
-		printf("done.\n");
+		printf("several aggregators need an output file, not standard output\n");
+		printf("program exit!\n");
+		return -1;
 	}
 	
-	printf("computing lo-values for each group...");
-	
-	if (ProcessGroups(groups, groupNum, lists, listNum, maxPercentile)<=0)
+	if ((screenName[0])&&(storeFileName[0]==0))
 	{
-		printf("\nfailed.\n");
+		printf("--screen needs a result store given by --store\n");
 		printf("program exit!\n");
-		
 		return -1;
 	}
-	else
+	
+	if ((maxPercentile>1.0)||(maxPercentile<0.0))
 	{
-		printf("done.\n");
+		printf("maxPercentile should be within 0.0 and 1.0\n");
+		printf("program exit!\n");
+		return -1;
 	}
 	
-	printf("computing false discovery rate...");
-	
-	if (ComputeFDR(groups, groupNum, maxPercentile, RAND_PASS_NUM*groupNum)<=0)
+	if (threadNum<1)
 	{
-		printf("\nfailed.\n");
+		printf("number of threads should be at least 1\n");
 		printf("program exit!\n");
-		
 		return -1;
 	}
-	else
+	
+	if ((ckpt.resume)&&(ckpt.fileName[0]==0))
 	{
-		printf("done.\n");
+		printf("--resume needs a checkpoint file given by --checkpoint\n");
+		printf("program exit!\n");
+		return -1;
 	}
 	
-	printf("save to output file...");
+	if (ckpt.fileName[0])
+	{
+		CatchTerminateSignals();
+	}
 	
-	if (SaveGroupInfo(outputFileName, groups, groupNum)<=0)
+	if (hugePages<0)
 	{
-		printf("\nfailed.\n");
+		printf("--huge-pages should be off, thp or explicit\n");
 		printf("program exit!\n");
-		
 		return -1;
 	}
-	else
+	
+	if (ExecInit(numa, hugePages, (plan.memLimit>0)||(memReport)||(numa))<0)
 	{
-		printf("done.\n");
+		printf("program exit!\n");
+		return -1;
 	}
 	
-	printf("finished.\n");
-	
-	free(groups);
+	TraceInit(traceFileName[0]?traceFileName:NULL);
 	
-	for (i=0;i<listNum;i++)
+	//parameters tuned for this host, calibrated on first use. -t still sets the number of threads
+	if (autotune)
 	{
-		free(lists[i].values);
+		printf("loading parameters tuned for this host...");
+		
+		if (TuneLoad(tuneFileName[0]?tuneFileName:NULL, &tune)<0)
+		{
+			printf("\nfailed.\n");
+			printf("program exit!\n");
+			return -1;
+		}
+		
+		printf("done.\n");
+		
+		TuneApply(&tune);
+		threadNum = threadSet?threadNum:tune.threadNum;
+		tune.threadNum = threadNum;
 	}
-	free(lists);
-
-	return 0;
-
-}
-
-//print the usage of Command
-void PrintCommandUsage(const char *command)
-{
-	//print the options of the command
-	printf("%s - Robust Rank Aggreation.\n", command);
-	printf("usage:\n");
-	printf("-i <input data file>. Format: <item id> <group id> <list id> <value>\n");
-	printf("-o <output file>. Format: <group id> <number of items in the group> <lo-value> <false discovery rate>\n");
-	printf("-p <maximum percentile>. RRA only consider the items with percentile smaller than this parameter. Default=0.1\n");
-	printf("example:\n");
-	printf("%s -i input.txt -o output.txt -p 0.1 \n", command);
-	
-}
-
-//Read input file. File Format: <item id> <group id> <list id> <value>. Return 1 if success, -1 if failure
-
-int ReadFile(char *fileName, GROUP_STRUCT *groups, int maxGroupNum, int *groupNum, LIST_STRUCT *lists, int maxListNum, int *listNum)
-{
-	FILE *fh;
-	int i,j;
-	char **words, *tmpS;
-	int wordNum;
-	int totalItemNum;
-	int tmpGroupNum, tmpListNum;
-	char tmpGroupName[MAX_NAME_LEN], tmpListName[MAX_NAME_LEN], tmpItemName[MAX_NAME_LEN];
-	double tmpValue;
-	
-	words = AllocWords(255, MAX_NAME_LEN+1);
-	
-	assert(words!=NULL);
 	
-	if (words == NULL)
+	if ((memBudget<0)||(plan.memLimit<0))
 	{
+		printf("memory budget should be positive\n");
+		printf("program exit!\n");
 		return -1;
 	}
 	
-	tmpS = (char *)malloc(255*(MAX_NAME_LEN+1)*sizeof(char));
-	
-	assert(tmpS!=NULL);
-	
-	fh = (FILE *)fopen(fileName, "r");
-	
-	if (!fh)
+	if ((stateFileName[0])&&((memBudget>0)||(plan.memLimit>0)))
 	{
-		printf("Cannot open file %s\n", fileName);
+		printf("--save-state keeps the items and the whole null distribution, and cannot be used with -m or --mem-limit\n");
+		printf("program exit!\n");
 		return -1;
 	}
 	
-	//Read the header row to get the sample number
-	fgets(tmpS, 255*(MAX_NAME_LEN+1)*sizeof(char), fh);
-	
-	wordNum = StringToWords(words, tmpS, MAX_NAME_LEN+1, 255, " \t\r\n\v\f");
-	
-	assert(wordNum == 4);
+	if ((listCacheFileName[0])&&((memBudget>0)||(plan.memLimit>0)))
+	{
+		printf("--list-cache keeps the sorted lists and the percentiles of all items, and cannot be used with -m or --mem-limit\n");
+		printf("program exit!\n");
+		return -1;
+	}
 	
-	if (wordNum != 4)
+	if ((groupingNum>0)&&((memBudget>0)||(plan.memLimit>0)))
 	{
-		free(tmpS);
-		FreeWords(words,255);
-		printf("Input file format: <item id> <group id> <list id> <value>\n");
+		printf("--group-file groups the percentiles of all items kept in memory, and cannot be used with -m or --mem-limit\n");
+		printf("program exit!\n");
 		return -1;
 	}
 	
-	//read records of items
+	if ((nbEnriched)&&(nbControlNum<=0))
+	{
+		printf("--nb-enriched needs the number of control samples given by --nb-control\n");
+		printf("program exit!\n");
+		return -1;
+	}
 	
-	tmpGroupNum = 0;
-	tmpListNum = 0;
-	totalItemNum = 0;
+	if ((nbControlNum>0)&&((memBudget>0)||(plan.memLimit>0)||(IsArrowFile(inputFileName))))
+	{
+		printf("count tables of --nb-control are read from text input in memory, not with -m or --mem-limit\n");
+		printf("program exit!\n");
+		return -1;
+	}
 	
-	fgets(tmpS, 255*(MAX_NAME_LEN+1)*sizeof(char), fh);
-	wordNum = StringToWords(words, tmpS, MAX_NAME_LEN+1, 255, " \t\r\n\v\f");
+	if ((memBudget>0)&&(IsArrowFile(inputFileName)))
+	{
+		printf("out-of-core processing with -m reads text input only\n");
+		printf("program exit!\n");
+		return -1;
+	}
 	
-	while ((wordNum==4)&&(!feof(fh)))
+	if (plan.memLimit>0)
 	{
-		strcpy(tmpItemName, words[0]);
-		strcpy(tmpGroupName, words[1]);
-		strcpy(tmpListName, words[2]);
+		SetMemLimit(plan.memLimit);
 		
-		for (i=0;i<tmpGroupNum;i++)
+		if (memBudget>plan.memLimit)
 		{
-			if (!strcmp(tmpGroupName, groups[i].name))
-			{
-				break;
-			} 
+			printf("memory budget of -m should not be larger than --mem-limit\n");
+			printf("program exit!\n");
+			return -1;
 		}
 		
-		if (i>=tmpGroupNum)
-		{
-			strcpy(groups[tmpGroupNum].name, tmpGroupName);
-			groups[tmpGroupNum].itemNum = 1;
-			tmpGroupNum ++;
-			if (tmpGroupNum >= maxGroupNum)
-			{
-				printf("too many groups. maxGroupNum = %d\n", maxGroupNum);
-				return -1;
-			}
-		}
-		else
-		{
-			groups[i].itemNum++;
-		}
+		plan.threadNum = threadNum;
 		
-		for (i=0;i<tmpListNum;i++)
+		if ((memBudget==0)&&(PlanInput(inputFileName, &plan)<=0))
 		{
-			if (!strcmp(tmpListName, lists[i].name))
-			{
-				break;
-			}
+			printf("program exit!\n");
+			return -1;
 		}
 		
-		if (i>=tmpListNum)
-		{
-			strcpy(lists[tmpListNum].name, tmpListName);
-			lists[tmpListNum].itemNum = 1;
-			tmpListNum ++;
-			if (tmpListNum >= maxListNum)
-			{
-				printf("too many lists. maxListNum = %d\n", maxListNum);
-				return -1;
-			}
-		}
-		else
+		if (memBudget==0)
 		{
-			lists[i].itemNum++;
+			memBudget = plan.oocBudget;
 		}
-		
-		totalItemNum++;
-		
-		fgets(tmpS, 255*(MAX_NAME_LEN+1)*sizeof(char), fh);
-		wordNum = StringToWords(words, tmpS, MAX_NAME_LEN+1, 255, " \t\r\n\v\f");
 	}
 	
-	fclose(fh);
+	pool = ThreadPoolCreate(threadNum);
 	
-	for (i=0;i<tmpGroupNum;i++)
+	if (!pool)
 	{
-		groups[i].items = (ITEM_STRUCT *)malloc(groups[i].itemNum*sizeof(ITEM_STRUCT));
-		groups[i].itemNum = 0;
+		printf("program exit!\n");
+		return -1;
+	}
+	
+	lists = NULL;
+	listNum = 0;
+	scores = NULL;
+	sortedNull = NULL;
+	nullNum = 0;
+	ranked = 0;
+	listHash = 0;
+
+	if (memBudget>0)
+	{
+		printf("reading input file and computing lo-values out of core...");
+		
+		PerfBegin(&perf);
+		flag = ProcessFileOutOfCore(inputFileName, &groups, &groupNum, &listNum, maxPercentile, aggregators, aggregatorNum, &scores, memBudget, tmpDir[0]?tmpDir:NULL);
+		PerfEnd(&perf, "ProcessFileOutOfCore");
+		itemNum = flag;
+		
+		if (flag<=0)
+		{
+			printf("\nfailed.\n");
+			printf("program exit!\n");
+			
+			return -1;
+		}
+		else
+		{
+			printf("done.\n");
+		}
+	}
+	else
+	{
+		lists = (LIST_STRUCT *)MemAlloc(MEM_LISTS, MAX_LIST_NUM*sizeof(LIST_STRUCT));
+		assert(lists!=NULL);
+		
+		printf("reading input file...");
+		
+		PerfBegin(&perf);
+		
+		if (nbControlNum>0)
+		{
+			//the items are ranked by the test of their counts, computed in memory
+			flag = ReadCountFile(inputFileName, nbControlNum, nbEnriched, pool, &groups, &groupNum, lists, &listNum);
+		}
+		else
+		{
+			flag = ReadFile(inputFileName, &groups, &groupNum, lists, MAX_LIST_NUM, &listNum);
+		}
+		
+		PerfEnd(&perf, "ReadFile");
+		itemNum = flag;
+		
+		if (flag<=0)
+		{
+			printf("\nfailed.\n");
+			printf("program exit!\n");
+			
+			return -1;
+		}
+		else
+		{
+			printf("done.\n");
+		}
+		
+		//lists ranked in an earlier run on the same content are not sorted again
+		if (listCacheFileName[0])
+		{
+			PerfBegin(&perf);
+			TraceBegin("load list cache");
+			listHash = ListContentHash(lists, listNum);
+			ranked = LoadListCache(listCacheFileName, listHash, groups, groupNum, lists, listNum);
+			TraceEnd("load list cache");
+			PerfEnd(&perf, "LoadListCache");
+			
+			printf(ranked?"sorted lists and percentiles loaded from %s\n":"list cache %s not used, lists are sorted\n", listCacheFileName);
+		}
+		
+		printf("computing lo-values for each group...");
+		
+		PerfBegin(&perf);
+		flag = ProcessGroups(groups, groupNum, lists, listNum, maxPercentile, aggregators, aggregatorNum, ranked, &scores);
+		PerfEnd(&perf, "ProcessGroups");
+		
+		if (flag<=0)
+		{
+			printf("\nfailed.\n");
+			printf("program exit!\n");
+			
+			return -1;
+		}
+		else
+		{
+			printf("done.\n");
+		}
+		
+		//a cache that cannot be written only costs the next run its sort
+		if ((listCacheFileName[0])&&(!ranked)&&(SaveListCache(listCacheFileName, listHash, lists, listNum)<=0))
+		{
+			printf("list cache %s not saved\n", listCacheFileName);
+		}
 	}
 	
-	for (i=0;i<tmpListNum;i++)
+	if ((plan.memLimit>0)&&(PlanNull(groups, groupNum, RAND_PASS_NUM*groupNum, &plan)<=0))
 	{
-		lists[i].values = (double *)malloc(lists[i].itemNum*sizeof(double));
-		lists[i].itemNum = 0;
+		printf("program exit!\n");
+		return -1;
 	}
 	
-	fh = (FILE *)fopen(fileName, "r");
+	strcpy(ckptFileName, ckpt.fileName);
 	
-	if (!fh)
+	//each aggregator has its own null distribution, checkpoint and output. The first one is written to the output file and
+	//the result store, the others to files named after them
+	for (k=0;k<aggregatorNum;k++)
 	{
-		printf("Cannot open file %s\n", fileName);
+		//groups are put back in the order of input, so that each null distribution is drawn as in a run of its aggregator alone
+		if (k>0)
+		{
+			qsort(groups, groupNum, sizeof(GROUP_STRUCT), CompareGroupIndex);
+			
+			for (i=0;i<groupNum;i++)
+			{
+				groups[i].loValue = scores[(long)(k-1)*groupNum+i];
+			}
+		}
+		
+		AggregatorFileName(ckptFileName, k>0?AggregatorName(aggregators[k]):NULL, ckpt.fileName, sizeof(ckpt.fileName));
+		AggregatorFileName(outputFileName, k>0?AggregatorName(aggregators[k]):NULL, aggregatorFileName, sizeof(aggregatorFileName));
+		
+		if (aggregatorNum>1)
+		{
+			printf("computing false discovery rate of %s...", AggregatorName(aggregators[k]));
+		}
+		else
+		{
+			printf("computing false discovery rate...");
+		}
+		
+		if (ComputeFDR(groups, groupNum, maxPercentile, aggregators[k], RAND_PASS_NUM*groupNum, plan.sketchBins, ckpt.fileName[0]?&ckpt:NULL,
+					   ((k==0)&&(stateFileName[0]))?&sortedNull:NULL, &nullNum)<=0)
+		{
+			printf("\nfailed.\n");
+			printf("program exit!\n");
+			
+			return -1;
+		}
+		else
+		{
+			printf("done.\n");
+		}
+		
+		printf("save to output file...");
+		
+		PerfBegin(&perf);
+		TraceBegin("output");
+		flag = SaveGroupInfo(aggregatorFileName, groups, groupNum, pool);
+		TraceEnd("output");
+		PerfEnd(&perf, "SaveGroupInfo");
+		
+		if (flag<=0)
+		{
+			printf("\nfailed.\n");
+			printf("program exit!\n");
+			
+			return -1;
+		}
+		else
+		{
+			printf("done.\n");
+		}
+		
+		if ((k==0)&&(storeFileName[0]))
+		{
+			printf("append to result store...");
+			
+			if (AppendToStore(storeFileName, screenName[0]?screenName:inputFileName, inputFileName, groups, groupNum, itemNum, listNum, maxPercentile)<=0)
+			{
+				printf("\nfailed.\n");
+				printf("program exit!\n");
+				
+				return -1;
+			}
+			else
+			{
+				printf("done.\n");
+			}
+		}
+		
+		if ((k==0)&&(stateFileName[0]))
+		{
+			printf("save state...");
+			
+			if (SaveState(stateFileName, groups, groupNum, lists, listNum, aggregators[0], maxPercentile, sortedNull, nullNum)<=0)
+			{
+				printf("\nfailed.\n");
+				printf("program exit!\n");
+				
+				return -1;
+			}
+			else
+			{
+				printf("done.\n");
+			}
+		}
+	}
+	
+	//the other groupings are scored by the first aggregator from the same percentiles, after the groups of the input
+	if (groupingNum>0)
+	{
+		printf("computing lo-values and false discovery rates of %d other grouping%s...", groupingNum, groupingNum>1?"s":"");
+		
+		PerfBegin(&perf);
+		flag = ScoreGroupFiles(groupFileNames, groupingNum, groups, groupNum, lists, listNum, aggregators[0], maxPercentile, outputFileName, pool);
+		PerfEnd(&perf, "ScoreGroupFiles");
+		
+		if (flag<=0)
+		{
+			printf("\nfailed.\n");
+			printf("program exit!\n");
+			
+			return -1;
+		}
+		else
+		{
+			printf("done.\n");
+		}
+	}
+	
+	for (k=0;(ckptFileName[0])&&(k<aggregatorNum);k++)
+	{
+		AggregatorFileName(ckptFileName, k>0?AggregatorName(aggregators[k]):NULL, ckpt.fileName, sizeof(ckpt.fileName));
+		RemoveCheckpoint(&ckpt);
+	}
+	
+	printf("finished.\n");
+	
+	if ((plan.memLimit>0)||(memReport)||(numa))
+	{
+		PrintMemReport(stdout);
+	}
+	
+	ThreadPoolDestroy(pool);
+	
+	if (autotune)
+	{
+		TuneReport(stdout, &tune);
+	}
+	
+	PerfReport(stdout);
+	
+	for (i=0;i<groupNum;i++)
+	{
+		MemFree(groups[i].items);
+	}
+	MemFree(groups);
+	MemFree(scores);
+	MemFree(sortedNull);
+	
+	if (lists)
+	{
+		for (i=0;i<listNum;i++)
+		{
+			MemFree(lists[i].values);
+		}
+		MemFree(lists);
+	}
+
+	return 0;
+
+}
+
+//print the usage of Command
+void PrintCommandUsage(const char *command)
+{
+	//print the options of the command
+	printf("%s - Robust Rank Aggreation.\n", command);
+	printf("usage:\n");
+	printf("-i <input data file>, - for standard input. Format: <item id> <group id> <list id> <value>. Arrow IPC (Feather) files with these four columns are mapped in memory; dictionary encoded group and list ids are used directly. Only uncompressed Arrow files are read: pyarrow compresses with LZ4 unless compression=\"uncompressed\" is given\n");
+	printf("-o <output file>, - for standard output. Messages are then printed to standard error. Format: <group id> <number of items in the group> <lo-value> <false discovery rate>. Written as Arrow if the name ends with .arrow or .feather\n");
+	printf("-p <maximum percentile>. RRA only consider the items with percentile smaller than this parameter. Default=0.1\n");
+	printf("-m <memory budget in MB>. Process the input out of core, for inputs larger than memory. Sorted runs are spilled to temporary files. Default: in memory\n");
+	printf("-t <number of threads>. Default: number of online CPUs\n");
+	printf("-a <aggregators>. Comma separated list of rra, alpha-rra (RRA of the items within the maximum percentile only), rank-product (geometric mean of the percentiles), second-best (second smallest percentile) and median. ");
+	printf("The items are read and ranked once for all of them, and each has its own null distribution. The first is written to the output file and the result store, ");
+	printf("each other to the output file name with .<aggregator> inserted before the extension, and its checkpoint to the checkpoint file name likewise. Default: rra\n");
+	printf("-T <directory of temporary files>. Used with -m. Default: $TMPDIR or /tmp\n");
+	printf("--nb-control <number of control samples>. The input is a table of counts: <item id> <group id> <count in sample 1> ... <count in sample n>, the controls first. ");
+	printf("Counts are normalized by median ratios, the variance of the controls is fitted as a trend of their mean across items, and each item is ranked by the negative binomial ");
+	printf("probability of its mean treatment count given its control mean, as low for depletion. Not with -m or --mem-limit\n");
+	printf("--nb-enriched. With --nb-control, rank the items by the probability of a count as high, for enrichment\n");
+	printf("--mem-limit <memory limit in MB>. Plan buffers to fit the limit: switch to out-of-core processing and a sketch of the null distribution when needed. Default: no limit\n");
+	printf("--mem-report. Report the peak memory of each subsystem at exit, and the placement of large buffers if they are mapped with --huge-pages. Always reported with --mem-limit or --numa\n");
+	printf("--numa. Pin worker threads to CPUs spread over the NUMA nodes\n");
+	printf("--huge-pages <off|thp|explicit>. Back buffers of 2 MB or more, such as the lists and the null distribution, with transparent huge pages (thp), or with the explicit huge page pool, falling back to thp. Default: off\n");
+	printf("--checkpoint <checkpoint file>. Save the progress of the false discovery rate simulation periodically and on SIGTERM. Removed when the run completes\n");
+	printf("--checkpoint-interval <seconds>. Minimum time between two checkpoints. Default: 300\n");
+	printf("--perf. Report cycles, instructions, cache misses and branch misses of each stage and thread at exit, the tasks of worker threads summed per stage. Falls back to software counters where hardware counters are unavailable\n");
+	printf("--trace <trace file>. Record a timeline of ingest chunks, sorts, batches, simulation passes and output, and write it at exit in Chrome/Perfetto trace format\n");
+	printf("--resume. Continue the simulation from the checkpoint file, if it exists. The result is identical to an uninterrupted run\n");
+	printf("--store <result store file>. Append the results to an indexed store of many screens, created if needed. Query it with %s query\n", command);
+	printf("--screen <screen name>. Name of the screen in the result store. Default: the input file name\n");
+	printf("--autotune. Use the number of threads and chunk sizes tuned for this host, calibrated by short benchmarks on first use and cached in $HOME/%s. -t overrides the number of threads. The choices are reported at exit\n", TUNE_FILE_NAME);
+	printf("--tune-file <tuning cache file>. Cache of tuned parameters used instead of $HOME/%s. Implies --autotune\n", TUNE_FILE_NAME);
+	printf("--save-state <state file>. Save the sorted lists, the items and the null distribution of the first aggregator, so that %s update can apply later corrections without a full run. Not with -m or --mem-limit\n", command);
+	printf("--list-cache <list cache file>. Reuse the sorted lists and the percentiles of their values saved by an earlier run on the same list ids and values, whatever the item ids and groups, ");
+	printf("so that scoring the same lists under other groups skips sorting and ranking. The cache is created, or replaced if the input changed. Not with -m or --mem-limit\n");
+	printf("--group-file <mapping file>. Another grouping of the items: <item id> <group id> [<list id> [<input group id>]], with a header. An item id may be in several groups. ");
+	printf("A row groups the item of its id in each list, or in its list and its group of the input if the file has these columns. A row that matches two items of a list, ");
+	printf("such as an id in two groups of the input, is rejected unless the fourth column tells them apart. May be given up to %d times. ", MAX_GROUPING_NUM);
+	printf("The items are ranked once for the input groups and all groupings, each grouping being an index over the ranked items. Its groups are scored by the first aggregator, ");
+	printf("with null distributions shared by the groups of the same size across groupings, and false discovery rates computed as for the input groups. ");
+	printf("Saved in the output format to the output file name with .<mapping file name without extension> inserted before the extension. Not with -m or --mem-limit\n");
+printf("Subcommands: %s query, to query a result store; %s meta, to aggregate the screens of a result store; %s update, to update a saved state with a patch\n", command, command, command);
+	printf("example:\n");
+	printf("%s -i input.txt -o output.txt -p 0.1 \n", command);
+	printf("CrisprNorm -i counts.txt -o - | awk 'NR>1{print $1,$2,\"ratio\",$9}' | %s -i - -o output.txt\n", command);
+	printf("%s -i input.txt -o output.txt --store screens.store --screen HL60\n", command);
+	printf("%s -i input.txt -o output.txt -a rra,rank-product\n", command);
+	printf("%s -i counts.txt -o output.txt --nb-control 2\n", command);
+	printf("%s -i sgrna_by_exon.txt -o exon.txt --list-cache screen.lists\n", command);
+	printf("%s -i input.txt -o gene.txt --group-file exon.txt --group-file domain.txt\n", command);
+
+}
+
+//print the usage of subcommand query
+void PrintQueryUsage(const char *command)
+{
+	printf("%s query - Query a result store of RRA.\n", command);
+	printf("usage:\n");
+	printf("-s <result store file>\n");
+	printf("-g <group id>. Print the group in every screen. Format: <screen> <group id> <number of items in the group> <lo-value> <false discovery rate> <rank> <number of groups in the screen>\n");
+	printf("-c <screen name>. Print the top groups of the screen, in the same format\n");
+	printf("-n <number of groups>. Used with -c. Default: 20\n");
+	printf("Without -g or -c, the screens of the store are listed\n");
+	printf("example:\n");
+	printf("%s query -s screens.store -g BCR\n", command);
+	printf("%s query -s screens.store -c HL60 -n 50\n", command);
+	
+}
+
+//print the usage of subcommand meta
+void PrintMetaUsage(const char *command)
+{
+	printf("%s meta - Aggregate the ranks of each group across the screens of a result store by a second-level RRA.\n", command);
+	printf("usage:\n");
+	printf("-s <result store file>\n");
+	printf("-o <output file>, - for standard output. Format: <group id> <number of screens with the group> <lo-value> <p-value> <false discovery rate>\n");
+	printf("-p <maximum percentile>. Only ranks with percentile smaller than this parameter in a screen are considered. Default=0.1\n");
+	printf("-n <number of null lo-values>. Simulated once for each number of screens that groups have. Default: %d\n", META_NULL_NUM);
+	printf("-t <number of threads>. Default: number of online CPUs\n");
+	printf("example:\n");
+	printf("%s meta -s screens.store -o meta.txt\n", command);
+	
+}
+
+//Read input file, "-" for standard input, in a single pass. File Format: <item id> <group id> <list id> <value>. Return 1 if success, -1 if failure
+//Arrow IPC files are read by ReadArrowFile
+int ReadFile(char *fileName, GROUP_STRUCT **pGroups, int *groupNum, LIST_STRUCT *lists, int maxListNum, int *listNum)
+{
+	READER_STRUCT *reader;
+	int i,j;
+	GROUP_STRUCT *groups, *tmpGroups;
+	int groupCapacity;
+	int *itemCapacity, *valueCapacity, *tmpI;
+	ITEM_STRUCT *tmpItems;
+	double *tmpValues;
+	DICT_STRUCT *groupDict, *listDict;
+	char **words, *line;
+	int wordNum;
+	int totalItemNum;
+	int tmpGroupNum, tmpListNum;
+	double tmpValue;
+	
+	if (IsArrowFile(fileName))
+	{
+		return ReadArrowFile(fileName, pGroups, groupNum, lists, maxListNum, listNum);
+	}
+	
+	words = AllocWords(255, MAX_NAME_LEN+1);
+	
+	assert(words!=NULL);
+	
+	if (words == NULL)
+	{
+		return -1;
+	}
+	
+	reader = ReaderOpen(fileName);
+	
+	if (!reader)
+	{
+		FreeWords(words, 255);
 		return -1;
 	}
 	
 	//Read the header row to get the sample number
-	fgets(tmpS, 255*(MAX_NAME_LEN+1)*sizeof(char), fh);
+	line = ReaderGetLine(reader);
 	
-	//read records of items
+	wordNum = line?StringToWords(words, line, MAX_NAME_LEN+1, 255, " \t\r\n\v\f"):0;
 	
-	fgets(tmpS, 255*(MAX_NAME_LEN+1)*sizeof(char), fh);
-	wordNum = StringToWords(words, tmpS, MAX_NAME_LEN+1, 255, " \t\r\n\v\f");
+	assert(wordNum == 4);
+	
+	if (wordNum != 4)
+	{
+		ReaderClose(reader);
+		FreeWords(words,255);
+		printf("Input file format: <item id> <group id> <list id> <value>\n");
+		return -1;
+	}
+	
+	//read records of items. The input is read once: groups and lists are found by their names in dictionaries,
+	//and the items of each group and the values of each list grow as they are read
+	
+	tmpGroupNum = 0;
+	tmpListNum = 0;
+	totalItemNum = 0;
+	
+	groupCapacity = 1024;
+	groups = (GROUP_STRUCT *)MemAlloc(MEM_GROUPS, groupCapacity*sizeof(GROUP_STRUCT));
+	itemCapacity = (int *)MemAlloc(MEM_INPUT, groupCapacity*sizeof(int));
+	valueCapacity = (int *)MemAlloc(MEM_INPUT, maxListNum*sizeof(int));
+	groupDict = DictCreate(1024);
+	listDict = DictCreate(16);
 	
-	while ((wordNum==4)&&(!feof(fh)))
+	if ((!groups)||(!itemCapacity)||(!valueCapacity)||(!groupDict)||(!listDict))
+	{
+		ReaderClose(reader);
+		return -1;
+	}
+	
+	line = ReaderGetLine(reader);
+	wordNum = line?StringToWords(words, line, MAX_NAME_LEN+1, 255, " \t\r\n\v\f"):0;
+	
+	TraceBegin("ingest chunk");
+	
+	while ((wordNum==4)&&(!ReaderAtEnd(reader)))
 	{
-		strcpy(tmpItemName, words[0]);
-		strcpy(tmpGroupName, words[1]);
-		strcpy(tmpListName, words[2]);
 		tmpValue = atof(words[3]);
-		
-		for (i=0;i<tmpGroupNum;i++)
+	
+		i = DictInsert(groupDict, words[1]);
+		j = DictInsert(listDict, words[2]);
+	
+		if ((i<0)||(j<0))
+		{
+			printf("Cannot allocate memory for group and list names\n");
+			ReaderClose(reader);
+			return -1;
+		}
+	
+		if (i>=tmpGroupNum)
 		{
-			if (!strcmp(tmpGroupName, groups[i].name))
+			if (tmpGroupNum >= groupCapacity)
 			{
-				break;
-			} 
+				tmpGroups = (GROUP_STRUCT *)MemRealloc(MEM_GROUPS, groups, 2*groupCapacity*sizeof(GROUP_STRUCT));
+				tmpI = (int *)MemRealloc(MEM_INPUT, itemCapacity, 2*groupCapacity*sizeof(int));
+	
+				if ((!tmpGroups)||(!tmpI))
+				{
+					printf("too many groups. %d groups read\n", tmpGroupNum);
+					ReaderClose(reader);
+					return -1;
+				}
+	
+				groups = tmpGroups;
+				itemCapacity = tmpI;
+				groupCapacity *= 2;
+			}
+			strcpy(groups[tmpGroupNum].name, words[1]);
+			groups[tmpGroupNum].items = NULL;
+			groups[tmpGroupNum].itemNum = 0;
+			itemCapacity[tmpGroupNum] = 0;
+			tmpGroupNum ++;
 		}
-		
-		for (j=0;j<tmpListNum;j++)
+	
+		if (j>=tmpListNum)
 		{
-			if (!strcmp(tmpListName, lists[j].name))
+			strcpy(lists[tmpListNum].name, words[2]);
+			lists[tmpListNum].values = NULL;
+			lists[tmpListNum].itemNum = 0;
+			valueCapacity[tmpListNum] = 0;
+			tmpListNum ++;
+			if (tmpListNum >= maxListNum)
 			{
-				break;
+				printf("too many lists. maxListNum = %d\n", maxListNum);
+				ReaderClose(reader);
+				return -1;
 			}
 		}
-		
-		assert(i<tmpGroupNum);
-		assert(j<tmpListNum);
-		
-		strcpy(groups[i].items[groups[i].itemNum].name,tmpItemName);
+	
+		if (groups[i].itemNum>=itemCapacity[i])
+		{
+			itemCapacity[i] = itemCapacity[i]>0?2*itemCapacity[i]:4;
+			tmpItems = (ITEM_STRUCT *)MemRealloc(MEM_GROUPS, groups[i].items, itemCapacity[i]*sizeof(ITEM_STRUCT));
+	
+			if (!tmpItems)
+			{
+				printf("%d items read, no memory for more\n", totalItemNum);
+				ReaderClose(reader);
+				return -1;
+			}
+	
+			groups[i].items = tmpItems;
+		}
+	
+		if (lists[j].itemNum>=valueCapacity[j])
+		{
+			valueCapacity[j] = valueCapacity[j]>0?2*valueCapacity[j]:1024;
+			tmpValues = (double *)MemRealloc(MEM_LISTS, lists[j].values, (long)valueCapacity[j]*sizeof(double));
+	
+			if (!tmpValues)
+			{
+				printf("%d items read, no memory for more\n", totalItemNum);
+				ReaderClose(reader);
+				return -1;
+			}
+	
+			lists[j].values = tmpValues;
+		}
+	
+		strcpy(groups[i].items[groups[i].itemNum].name, words[0]);
 		groups[i].items[groups[i].itemNum].value = tmpValue;
 		groups[i].items[groups[i].itemNum].listIndex = j;
 		groups[i].itemNum ++;
-		
+	
 		lists[j].values[lists[j].itemNum] = tmpValue;
 		lists[j].itemNum ++;
-		
-		fgets(tmpS, 255*(MAX_NAME_LEN+1)*sizeof(char), fh);
-		wordNum = StringToWords(words, tmpS, MAX_NAME_LEN+1, 255, " \t\r\n\v\f");
-	}
 	
-	fclose(fh);
+		totalItemNum++;
 	
-	printf("%d items\n%d groups\n%d lists\n", totalItemNum, tmpGroupNum, tmpListNum);
+		if (totalItemNum%TRACE_CHUNK_SIZE==0)
+		{
+			TraceEnd("ingest chunk");
+			TraceBegin("ingest chunk");
+		}
 	
-	*groupNum = tmpGroupNum;
-	*listNum = tmpListNum;
+		line = ReaderGetLine(reader);
+		wordNum = line?StringToWords(words, line, MAX_NAME_LEN+1, 255, " \t\r\n\v\f"):0;
+	}
+	
+	TraceEnd("ingest chunk");
 	
+	DictFree(groupDict);
+	DictFree(listDict);
+	MemFree(itemCapacity);
+	MemFree(valueCapacity);
 	FreeWords(words, 255);
-	free(tmpS);
+	
+	if (ReaderClose(reader)<0)
+	{
+		return -1;
+	}
+	
+	printf("%d items\n%d groups\n%d lists\n", totalItemNum, tmpGroupNum, tmpListNum);
+	
+	*pGroups = groups;
+	*groupNum = tmpGroupNum;
+	*listNum = tmpListNum;
 	
 	return totalItemNum;
 	
-}
-
-//Save group information to output file. Format <group id> <number of items in the group> <lo-value> <false discovery rate>
-int SaveGroupInfo(char *fileName, GROUP_STRUCT *groups, int groupNum)
-{
-	FILE *fh;
-	int i;
+}
+
+//Read a count table, "-" for standard input, by ReadCountTable. File Format: <item id> <group id> <count in sample 1> ... <count in sample n>, the first
+//controlNum samples being the controls. Each item is tested by NBTestGuides; its probability of a count as low, or as high if enriched is 1, is its value in a
+//single list. Groups are allocated in *pGroups. Return the number of items, or -1 if failure
+int ReadCountFile(char *fileName, int controlNum, int enriched, THREAD_POOL_STRUCT *pool, GROUP_STRUCT **pGroups, int *groupNum, LIST_STRUCT *lists, int *listNum)
+{
+	COUNT_TABLE table;
+	GROUP_STRUCT *groups, *tmpGroups;
+	ITEM_STRUCT *tmpItems;
+	int *itemCapacity, *tmpI;
+	double *sizeFactors, *pLow, *pHigh;
+	DICT_STRUCT *groupDict;
+	NB_TREND trend;
+	PERF_SAMPLE perf;
+	int i, j, flag, groupCapacity, tmpGroupNum;
+	
+	if (ReadCountTable(fileName, &table)<0)
+	{
+		return -1;
+	}
+	
+	if (table.sampleNum<=controlNum)
+	{
+		printf("%d samples, at least one more than the %d control samples is needed\n", table.sampleNum, controlNum);
+		FreeCountTable(&table);
+		return -1;
+	}
+	
+	printf("%d items\n%d samples, %d of them controls\n", table.itemNum, table.sampleNum, controlNum);
+	
+	//the test replaces the list values of a run on its output
+	sizeFactors = (double *)MemAlloc(MEM_WORK, table.sampleNum*sizeof(double));
+	pLow = (double *)MemAlloc(MEM_WORK, table.itemNum*sizeof(double));
+	pHigh = (double *)MemAlloc(MEM_WORK, table.itemNum*sizeof(double));
+	lists[0].values = (double *)MemAlloc(MEM_LISTS, table.itemNum*sizeof(double));
+	
+	flag = ((sizeFactors)&&(pLow)&&(pHigh)&&(lists[0].values))?1:-1;
+	
+	PerfBegin(&perf);
+	flag = flag>0?NBSizeFactors(table.counts, table.itemNum, table.sampleNum, sizeFactors):-1;
+	flag = flag>0?NBFitTrend(table.counts, table.itemNum, table.sampleNum, controlNum, sizeFactors, &trend):-1;
+	flag = flag>0?NBTestGuides(table.counts, table.itemNum, table.sampleNum, controlNum, sizeFactors, &trend, pool, pLow, pHigh):-1;
+	PerfEnd(&perf, "NBTestGuides");
+	
+	if (flag>0)
+	{
+		printf("variance = mean+%g*mean^%g, fitted on %d items\n", exp(trend.intercept), trend.slope, trend.fitNum);
+		
+		strcpy(lists[0].name, enriched?"nb_high":"nb_low");
+		lists[0].itemNum = table.itemNum;
+		
+		for (i=0;i<table.itemNum;i++)
+		{
+			lists[0].values[i] = enriched?pHigh[i]:pLow[i];
+		}
+	}
+	
+	MemFree(sizeFactors);
+	MemFree(pLow);
+	MemFree(pHigh);
+	
+	//the items are put in their groups, found by their names in a dictionary, in the order of the table
+	tmpGroupNum = 0;
+	groupCapacity = 1024;
+	groups = (GROUP_STRUCT *)MemAlloc(MEM_GROUPS, groupCapacity*sizeof(GROUP_STRUCT));
+	itemCapacity = (int *)MemAlloc(MEM_INPUT, groupCapacity*sizeof(int));
+	groupDict = DictCreate(1024);
+	
+	flag = ((flag>0)&&(groups)&&(itemCapacity)&&(groupDict))?1:-1;
+	
+	for (j=0;(j<table.itemNum)&&(flag>0);j++)
+	{
+		i = DictInsert(groupDict, table.items[j].geneName);
+		
+		if (i<0)
+		{
+			printf("Cannot allocate memory for group names\n");
+			flag = -1;
+			break;
+		}
+		
+		if (i>=tmpGroupNum)
+		{
+			if (tmpGroupNum >= groupCapacity)
+			{
+				tmpGroups = (GROUP_STRUCT *)MemRealloc(MEM_GROUPS, groups, 2*groupCapacity*sizeof(GROUP_STRUCT));
+				tmpI = (int *)MemRealloc(MEM_INPUT, itemCapacity, 2*groupCapacity*sizeof(int));
+				
+				groups = tmpGroups?tmpGroups:groups;
+				itemCapacity = tmpI?tmpI:itemCapacity;
+				
+				if ((!tmpGroups)||(!tmpI))
+				{
+					printf("too many groups. %d groups read\n", tmpGroupNum);
+					flag = -1;
+					break;
+				}
+				
+				groupCapacity *= 2;
+			}
+			strcpy(groups[tmpGroupNum].name, table.items[j].geneName);
+			groups[tmpGroupNum].items = NULL;
+			groups[tmpGroupNum].itemNum = 0;
+			itemCapacity[tmpGroupNum] = 0;
+			tmpGroupNum ++;
+		}
+		
+		if (groups[i].itemNum>=itemCapacity[i])
+		{
+			itemCapacity[i] = itemCapacity[i]>0?2*itemCapacity[i]:4;
+			tmpItems = (ITEM_STRUCT *)MemRealloc(MEM_GROUPS, groups[i].items, itemCapacity[i]*sizeof(ITEM_STRUCT));
+			
+			if (!tmpItems)
+			{
+				printf("%d items read, no memory for more\n", j);
+				flag = -1;
+				break;
+			}
+			
+			groups[i].items = tmpItems;
+		}
+		
+		strcpy(groups[i].items[groups[i].itemNum].name, table.items[j].sgName);
+		groups[i].items[groups[i].itemNum].listIndex = 0;
+		groups[i].items[groups[i].itemNum].value = lists[0].values[j];
+		groups[i].itemNum ++;
+	}
+	
+	if (groupDict)
+	{
+		DictFree(groupDict);
+	}
+	
+	MemFree(itemCapacity);
+	FreeCountTable(&table);
+	
+	if (flag<0)
+	{
+		return -1;
+	}
+	
+	printf("%d groups\n", tmpGroupNum);
+	
+	*pGroups = groups;
+	*groupNum = tmpGroupNum;
+	*listNum = 1;
+	
+	return lists[0].itemNum;
+	
+}
+
+//Number the strings of column columnIndex of an Arrow file in order of first appearance, into ids of all rows, with their names in dict.
+//Dictionary encoded columns are numbered through their indices, so that each string of the dictionary is read once. Return 1 if success, -1 if failure
+static int ArrowColumnIds(ARROW_FILE *file, int columnIndex, int *ids, DICT_STRUCT *dict)
+{
+	ARROW_COLUMN *column = file->columns+columnIndex;
+	ARROW_ARRAY *arrays;
+	int *dictMap;
+	int batchIndex, flag;
+	long i, k, row, rowNum, len;
+	const char *s;
+	char name[MAX_NAME_LEN];
+	
+	if (column->type!=ARROW_TYPE_UTF8)
+	{
+		printf("column %s of the Arrow file should be strings\n", column->name);
+		return -1;
+	}
+	
+	arrays = (ARROW_ARRAY *)MemAlloc(MEM_INPUT, file->columnNum*sizeof(ARROW_ARRAY));
+	dictMap = (int *)MemAlloc(MEM_INPUT, (column->dictNum+1)*sizeof(int));
+	
+	if ((!arrays)||(!dictMap))
+	{
+		MemFree(arrays);
+		MemFree(dictMap);
+		return -1;
+	}
+	
+	for (k=0;k<column->dictNum;k++)
+	{
+		dictMap[k] = -1;
+	}
+	
+	row = 0;
+	flag = 1;
+	
+	for (batchIndex=0;(batchIndex<file->batchNum)&&(flag>0);batchIndex++)
+	{
+		rowNum = ArrowReadBatch(file, batchIndex, arrays);
+		
+		if ((rowNum<0)||(arrays[columnIndex].nullCount>0))
+		{
+			printf("column %s of the Arrow file is damaged or has null values\n", column->name);
+			flag = -1;
+			break;
+		}
+		
+		if (column->dictionaryId>=0)
+		{
+			ArrowToIndices(column, arrays+columnIndex, ids+row);
+		}
+		
+		for (i=0;i<rowNum;i++)
+		{
+			k = ids[row+i];
+			
+			if ((column->dictionaryId>=0)&&(k>=0)&&(k<column->dictNum)&&(dictMap[k]>=0))
+			{
+				ids[row+i] = dictMap[k];
+				continue;
+			}
+			
+			s = column->dictionaryId>=0?ArrowDictString(column, k, &len):ArrowString(column, arrays+columnIndex, i, &len);
+			
+			if (!s)
+			{
+				printf("column %s of the Arrow file has a dictionary index out of range\n", column->name);
+				flag = -1;
+				break;
+			}
+			
+			len = len<MAX_NAME_LEN-1?len:MAX_NAME_LEN-1;
+			memcpy(name, s, len);
+			name[len] = 0;
+			
+			ids[row+i] = DictInsert(dict, name);
+			
+			if (ids[row+i]<0)
+			{
+				printf("Cannot allocate memory for group and list names\n");
+				flag = -1;
+				break;
+			}
+			
+			if (column->dictionaryId>=0)
+			{
+				dictMap[k] = ids[row+i];
+			}
+		}
+		
+		row += rowNum;
+	}
+	
+	MemFree(arrays);
+	MemFree(dictMap);
+	
+	return flag;
+}
+
+//Read an Arrow IPC file mapped in memory, with the columns <item id> <group id> <list id> <value> in this order.
+//Dictionary encoded group and list ids are used through their indices. Called by ReadFile. Return the number of items, or -1 if failure
+int ReadArrowFile(char *fileName, GROUP_STRUCT **pGroups, int *groupNum, LIST_STRUCT *lists, int maxListNum, int *listNum)
+{
+	ARROW_FILE *file;
+	ARROW_ARRAY *arrays;
+	GROUP_STRUCT *groups;
+	DICT_STRUCT *groupDict, *listDict;
+	int *groupIds, *listIds;
+	double *values;
+	int i, j, batchIndex, itemNum, flag;
+	long k, row, rowNum, len;
+	const char *s;
+	ITEM_STRUCT *item;
+	
+	file = ArrowOpen(fileName);
+	
+	if (!file)
+	{
+		return -1;
+	}
+	
+	if ((file->columnNum<4)||(file->rowNum>=0x7fffffff))
+	{
+		printf("Input file format: <item id> <group id> <list id> <value>\n");
+		ArrowClose(file);
+		return -1;
+	}
+	
+	itemNum = (int)file->rowNum;
+	
+	groupIds = (int *)MemAlloc(MEM_INPUT, (itemNum+1)*sizeof(int));
+	listIds = (int *)MemAlloc(MEM_INPUT, (itemNum+1)*sizeof(int));
+	values = (double *)MemAlloc(MEM_INPUT, (itemNum+1)*sizeof(double));
+	arrays = (ARROW_ARRAY *)MemAlloc(MEM_INPUT, file->columnNum*sizeof(ARROW_ARRAY));
+	groupDict = DictCreate(1024);
+	listDict = DictCreate(16);
+	groups = NULL;
+	
+	flag = ((groupIds)&&(listIds)&&(values)&&(arrays)&&(groupDict)&&(listDict))?1:-1;
+	
+	//groups and lists are numbered in order of first appearance, as in text input, and their sizes are known before allocation
+	TraceBegin("ingest chunk");
+	
+	if (flag>0)
+	{
+		flag = ArrowColumnIds(file, 1, groupIds, groupDict);
+	}
+	
+	if (flag>0)
+	{
+		flag = ArrowColumnIds(file, 2, listIds, listDict);
+	}
+	
+	if ((flag>0)&&(listDict->num>=maxListNum))
+	{
+		printf("too many lists. maxListNum = %d\n", maxListNum);
+		flag = -1;
+	}
+	
+	row = 0;
+	
+	for (batchIndex=0;(batchIndex<file->batchNum)&&(flag>0);batchIndex++)
+	{
+		rowNum = ArrowReadBatch(file, batchIndex, arrays);
+		
+		if ((rowNum<0)||(arrays[3].nullCount>0)||(ArrowToDoubles(file->columns+3, arrays+3, values+row)<0))
+		{
+			printf("column %s of the Arrow file should be numbers without null values\n", file->columns[3].name);
+			flag = -1;
+		}
+		
+		row += rowNum;
+	}
+	
+	if (flag>0)
+	{
+		groups = (GROUP_STRUCT *)MemCalloc(MEM_GROUPS, groupDict->num+1, sizeof(GROUP_STRUCT));
+		flag = groups?1:-1;
+	}
+	
+	if (flag>0)
+	{
+		for (j=0;j<listDict->num;j++)
+		{
+			strcpy(lists[j].name, listDict->names[j]);
+			lists[j].values = NULL;
+			lists[j].itemNum = 0;
+		}
+		
+		for (i=0;i<itemNum;i++)
+		{
+			groups[groupIds[i]].itemNum++;
+			lists[listIds[i]].itemNum++;
+		}
+		
+		for (i=0;(i<groupDict->num)&&(flag>0);i++)
+		{
+			strcpy(groups[i].name, groupDict->names[i]);
+			groups[i].items = (ITEM_STRUCT *)MemAlloc(MEM_GROUPS, groups[i].itemNum*sizeof(ITEM_STRUCT));
+			flag = groups[i].items?1:-1;
+			groups[i].itemNum = 0;
+		}
+		
+		for (j=0;(j<listDict->num)&&(flag>0);j++)
+		{
+			lists[j].values = (double *)MemAlloc(MEM_LISTS, (long)lists[j].itemNum*sizeof(double));
+			flag = lists[j].values?1:-1;
+			lists[j].itemNum = 0;
+		}
+		
+		if (flag<0)
+		{
+			printf("%d items, no memory for them\n", itemNum);
+		}
+	}
+	
+	//items are added to their group and list in input order, so that results are the same as with text input
+	row = 0;
+	
+	for (batchIndex=0;(batchIndex<file->batchNum)&&(flag>0);batchIndex++)
+	{
+		rowNum = ArrowReadBatch(file, batchIndex, arrays);
+		
+		if ((file->columns[0].type!=ARROW_TYPE_UTF8)||(arrays[0].nullCount>0))
+		{
+			printf("column %s of the Arrow file should be strings without null values\n", file->columns[0].name);
+			flag = -1;
+			break;
+		}
+		
+		for (k=0;k<rowNum;k++)
+		{
+			i = groupIds[row+k];
+			j = listIds[row+k];
+			item = groups[i].items+groups[i].itemNum;
+			
+			s = ArrowString(file->columns, arrays, k, &len);
+			
+			if (!s)
+			{
+				printf("column %s of the Arrow file has a dictionary index out of range\n", file->columns[0].name);
+				flag = -1;
+				break;
+			}
+			
+			len = len<MAX_NAME_LEN-1?len:MAX_NAME_LEN-1;
+			memcpy(item->name, s, len);
+			item->name[len] = 0;
+			item->value = values[row+k];
+			item->listIndex = j;
+			groups[i].itemNum++;
+			
+			lists[j].values[lists[j].itemNum] = values[row+k];
+			lists[j].itemNum++;
+		}
+		
+		row += rowNum;
+	}
+	
+	TraceEnd("ingest chunk");
+	
+	if (flag>0)
+	{
+		printf("%d items\n%d groups\n%d lists\n", itemNum, groupDict->num, listDict->num);
+		
+		*pGroups = groups;
+		*groupNum = groupDict->num;
+		*listNum = listDict->num;
+	}
+	
+	MemFree(groupIds);
+	MemFree(listIds);
+	MemFree(values);
+	MemFree(arrays);
+	DictFree(groupDict);
+	DictFree(listDict);
+	ArrowClose(file);
+	
+	return flag>0?itemNum:-1;
+}
+
+//Format one row of the output of groups. Return 1 if success, -1 if failure
+static int FormatGroupRow(OUT_BUFFER *buffer, void *data, int row)
+{
+	GROUP_STRUCT *group = (GROUP_STRUCT *)data+row;
+	
+	return OutBufferPrintf(buffer, "%s\t%d\t%10.4e\t%f\n", group->name, group->itemNum, group->loValue, group->fdr);
+}
+
+//Save group information to output file. Format <group id> <number of items in the group> <lo-value> <false discovery rate>
+//Rows are formatted in chunks on the thread pool and written in order by a writer thread. Output files named .arrow or .feather are written as Arrow
+int SaveGroupInfo(char *fileName, GROUP_STRUCT *groups, int groupNum, THREAD_POOL_STRUCT *pool)
+{
+	OUT_WRITER_STRUCT *writer;
+	OUT_BUFFER header;
+	ARROW_OUT_COLUMN columns[4];
+	int flag;
+	
+	//Arrow columns are written from the fields of the groups in place, without formatting
+	if (IsArrowName(fileName))
+	{
+		columns[0].name = "group_id";
+		columns[0].type = ARROW_TYPE_UTF8;
+		columns[0].base = groups[0].name;
+		columns[1].name = "#_items_in_group";
+		columns[1].type = ARROW_TYPE_INT;
+		columns[1].base = (char *)&groups[0].itemNum;
+		columns[2].name = "lo_value";
+		columns[2].type = ARROW_TYPE_FLOAT;
+		columns[2].base = (char *)&groups[0].loValue;
+		columns[3].name = "FDR";
+		columns[3].type = ARROW_TYPE_FLOAT;
+		columns[3].base = (char *)&groups[0].fdr;
+		columns[0].stride = columns[1].stride = columns[2].stride = columns[3].stride = sizeof(GROUP_STRUCT);
+		
+		return ArrowWriteFile(fileName, columns, 4, groupNum);
+	}
+	
+	//chunk 0 is the header, followed by the chunks of rows
+	writer = OutWriterOpen(fileName, 1+OutChunkNum(groupNum));
+	
+	if (!writer)
+	{
+		return -1;
+	}
+	
+	OutBufferInit(&header);
+	OutBufferPrintf(&header, "group_id\t#_items_in_group\tlo_value\tFDR\n");
+	OutWriterPut(writer, 0, &header);
+	
+	flag = OutWriterFormat(writer, pool, 1, groupNum, FormatGroupRow, groups);
+	
+	ThreadPoolWait(pool);
+	
+	if ((OutWriterClose(writer)<0)||(flag<0))
+	{
+		return -1;
+	}
+	
+	return 1;
+}
+
+//Process groups by computing percentiles for each item and the score of each of the aggregatorNum aggregators for each group. The score of the first
+//aggregator is the loValue of the group; those of the others are allocated in *pScores, groupNum per aggregator in the order of input, NULL if there is only one.
+//If ranked is 1, the lists are sorted and the percentiles of the items are known already, as loaded by LoadListCache, and only the scores are computed
+int ProcessGroups(GROUP_STRUCT *groups, int groupNum, LIST_STRUCT *lists, int listNum, double maxPercentile, const int *aggregators, int aggregatorNum, int ranked, double **pScores)
+{
+	int i,j,k;
+	int listIndex;
+	int maxItemPerGroup;
+	double *tmpF;
+	LO_BATCH_STRUCT *batches[AGG_KERNEL_NUM];
+	double *scores;
+	int flag;
+	
+	maxItemPerGroup = 0;
+	
+	for (i=0;i<groupNum;i++)
+	{
+		if (groups[i].itemNum>maxItemPerGroup)
+		{
+			maxItemPerGroup = groups[i].itemNum;
+		}
+	}
+	
+	assert(maxItemPerGroup>0);
+	
+	tmpF = (double *)MemAlloc(MEM_WORK, maxItemPerGroup*sizeof(double));
+	scores = aggregatorNum>1?(double *)MemAlloc(MEM_GROUPS, (long)(aggregatorNum-1)*groupNum*sizeof(double)):NULL;
+	flag = ((tmpF)&&((scores)||(aggregatorNum==1)))?1:-1;
+	
+	//one batch per aggregator, all fed with the same percentiles
+	for (k=0;k<aggregatorNum;k++)
+	{
+		batches[k] = LoBatchCreate(aggregators[k], maxItemPerGroup, maxPercentile);
+		flag = batches[k]?flag:-1;
+	}
+	
+	if (flag<0)
+	{
+		MemFree(tmpF);
+		MemFree(scores);
+
+		for (k=0;k<aggregatorNum;k++)
+		{
+			LoBatchFree(batches[k]);
+		}
+		
+		return -1;
+	}
+	
+	for (i=0;(i<listNum)&&(!ranked);i++)
+	{
+		TraceBegin("sort list");
+		QuicksortF(lists[i].values, 0, lists[i].itemNum-1);
+		TraceEnd("sort list");
+	}
+
+	TraceBegin("lo-value batch");
+	
+	for (i=0;i<groupNum;i++)
+	{
+		if ((i>0)&&(i%TRACE_CHUNK_SIZE==0))
+		{
+			TraceEnd("lo-value batch");
+			TraceBegin("lo-value batch");
+		}
+		
+		groups[i].index = i;
+		
+		//Compute percentile for each item
+
+		for (j=0;j<groups[i].itemNum;j++)
+		{
+			listIndex = groups[i].items[j].listIndex;
+			
+			if (!ranked)
+			{
+				groups[i].items[j].percentile = ListPercentile(groups[i].items[j].value, lists[listIndex].values, lists[listIndex].itemNum);
+			}
+			
+			tmpF[j] = groups[i].items[j].percentile;
+		}
+		
+		for (k=0;k<aggregatorNum;k++)
+		{
+			LoBatchAdd(batches[k], tmpF, groups[i].itemNum, k>0?scores+(long)(k-1)*groupNum+i:&(groups[i].loValue));
+		}
+	}
+	
+	for (k=0;k<aggregatorNum;k++)
+	{
+		LoBatchFlush(batches[k]);
+	}
+	
+	TraceEnd("lo-value batch");
+	
+	MemFree(tmpF);
+	
+	for (k=0;k<aggregatorNum;k++)
+	{
+		LoBatchFree(batches[k]);
+	}
+	
+	*pScores = scores;
+	
+	return 1;
+}
+
+//FNV-1a hash of size bytes of data, continuing from hash
+static unsigned long HashBytes(unsigned long hash, const void *data, int size)
+{
+	const unsigned char *bytes = (const unsigned char *)data;
+	int i;
+	
+	for (i=0;i<size;i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211UL;
+	}
+	
+	return hash;
+}
+
+//Mix the bits of a hash, so that sums of hashes do not cancel out
+static unsigned long MixHash(unsigned long hash)
+{
+	hash ^= hash>>30;
+	hash *= 0xbf58476d1ce4e5b9UL;
+	hash ^= hash>>27;
+	hash *= 0x94d049bb133111ebUL;
+	hash ^= hash>>31;
+	
+	return hash;
+}
+
+//Hash of the content of the lists: the list id and value of every item, in any order and whatever the item ids and groups. Used as the key of a list cache
+unsigned long ListContentHash(LIST_STRUCT *lists, int listNum)
+{
+	unsigned long hash, nameHash;
+	long itemNum;
+	int i, j;
+	
+	hash = 0;
+	itemNum = 0;
+	
+	for (j=0;j<listNum;j++)
+	{
+		nameHash = HashBytes(14695981039346656037UL, lists[j].name, strlen(lists[j].name)+1);
+		
+		//values are added up, so that the hash does not depend on their order
+		for (i=0;i<lists[j].itemNum;i++)
+		{
+			hash += MixHash(HashBytes(nameHash, lists[j].values+i, sizeof(double)));
+		}
+		
+		itemNum += lists[j].itemNum;
+	}
+	
+	return MixHash(hash+itemNum*listNum);
+}
+
+//Load the sorted lists from a list cache saved by SaveListCache with the same hash, and set the percentile of every item from the percentiles of the sorted
+//values, so that runs on the same lists under other groups skip sorting and ranking. Return 1 if loaded, 0 if the cache does not exist or does not match the input
+int LoadListCache(char *fileName, unsigned long hash, GROUP_STRUCT *groups, int groupNum, LIST_STRUCT *lists, int listNum)
+{
+	FILE *fh;
+	char magic[8];
+	char name[MAX_NAME_LEN];
+	unsigned long cachedHash;
+	int cachedListNum, itemNum, cachedItemNum;
+	int *listMap;
+	long *listStart, offset;
+	double *values, *percentiles, *sorted;
+	ITEM_STRUCT *item;
+	int i, j, k, n, lo, hi, ok;
+	
+	fh = (FILE *)fopen(fileName, "rb");
+	
+	if (!fh)
+	{
+		return 0;
+	}
+	
+	itemNum = 0;
+	
+	for (j=0;j<listNum;j++)
+	{
+		itemNum += lists[j].itemNum;
+	}
+	
+	ok = (fread(magic, 1, 8, fh)==8)&&(memcmp(magic, LIST_CACHE_MAGIC, 8)==0)
+		 &&(fread(&cachedHash, sizeof(unsigned long), 1, fh)==1)
+		 &&(fread(&cachedListNum, sizeof(int), 1, fh)==1)
+		 &&(fread(&cachedItemNum, sizeof(int), 1, fh)==1)
+		 &&(cachedHash==hash)&&(cachedListNum==listNum)&&(cachedItemNum==itemNum);
+	
+	listMap = ok?(int *)MemAlloc(MEM_WORK, listNum*sizeof(int)):NULL;
+	listStart = ok?(long *)MemAlloc(MEM_WORK, listNum*sizeof(long)):NULL;
+	values = ok?(double *)MemAlloc(MEM_WORK, (long)itemNum*sizeof(double)):NULL;
+	percentiles = ok?(double *)MemAlloc(MEM_WORK, (long)itemNum*sizeof(double)):NULL;
+	ok = ok&&(listMap)&&(listStart)&&(values)&&(percentiles);
+	offset = 0;
+	
+	for (j=0;(j<listNum)&&(ok);j++)
+	{
+		listMap[j] = -1;
+	}
+	
+	//the lists of the cache are matched to those of the input by name, as their order follows the input. Each holds its sorted values,
+	//then the percentile of each of them
+	for (k=0;(k<listNum)&&(ok);k++)
+	{
+		ok = (fread(name, 1, MAX_NAME_LEN, fh)==MAX_NAME_LEN)&&(fread(&n, sizeof(int), 1, fh)==1);
+		name[MAX_NAME_LEN-1] = 0;
+		
+		for (j=0;(j<listNum)&&(ok)&&(strcmp(lists[j].name, name)!=0);j++);
+		
+		ok = ok&&(j<listNum)&&(n==lists[j].itemNum)&&(offset+n<=itemNum)
+			 &&(fread(values+offset, sizeof(double), n, fh)==(size_t)n)
+			 &&(fread(percentiles+offset, sizeof(double), n, fh)==(size_t)n)&&(listMap[j]<0);
+		
+		if (ok)
+		{
+			listMap[j] = k;
+			listStart[k] = offset;
+			offset += n;
+		}
+	}
+	
+	fclose(fh);
+	
+	//an item takes the percentile of the first sorted value equal to its own, found by bisection. A value that is not found, which only a cache
+	//changed since it was saved gives, is ranked again
+	for (i=0;(i<groupNum)&&(ok);i++)
+	{
+		for (j=0;j<groups[i].itemNum;j++)
+		{
+			item = groups[i].items+j;
+			k = listStart[listMap[item->listIndex]];
+			n = lists[item->listIndex].itemNum;
+			sorted = values+k;
+			lo = 0;
+			hi = n-1;
+			
+			while (lo<hi)
+			{
+				if (sorted[(lo+hi)/2]<item->value)
+				{
+					lo = (lo+hi)/2+1;
+				}
+				else
+				{
+					hi = (lo+hi)/2;
+				}
+			}
+			
+			item->percentile = (sorted[lo]==item->value)?percentiles[k+lo]:ListPercentile(item->value, sorted, n);
+		}
+	}
+	
+	for (j=0;(j<listNum)&&(ok);j++)
+	{
+		memcpy(lists[j].values, values+listStart[listMap[j]], lists[j].itemNum*sizeof(double));
+	}
+	
+	MemFree(listMap);
+	MemFree(listStart);
+	MemFree(values);
+	MemFree(percentiles);
+	
+	return ok?1:0;
+}
+
+//Save the sorted lists and the percentile of each of their values to a list cache keyed by hash, after ProcessGroups. The file is replaced atomically.
+//Return 1 if success, -1 if failure
+int SaveListCache(char *fileName, unsigned long hash, LIST_STRUCT *lists, int listNum)
+{
+	FILE *fh;
+	char tmpFileName[1000];
+	double *percentiles;
+	int i, j, itemNum, maxItemNum, ok;
+	
+	itemNum = 0;
+	maxItemNum = 1;
+	
+	for (j=0;j<listNum;j++)
+	{
+		itemNum += lists[j].itemNum;
+		maxItemNum = lists[j].itemNum>maxItemNum?lists[j].itemNum:maxItemNum;
+	}
+	
+	percentiles = (double *)MemAlloc(MEM_WORK, maxItemNum*sizeof(double));
+	
+	if (!percentiles)
+	{
+		return -1;
+	}
+	
+	snprintf(tmpFileName, sizeof(tmpFileName), "%s.tmp", fileName);
+	
+	fh = (FILE *)fopen(tmpFileName, "wb");
+	
+	if (!fh)
+	{
+		printf("Cannot write list cache %s\n", tmpFileName);
+		MemFree(percentiles);
+		return -1;
+	}
+	
+	ok = (fwrite(LIST_CACHE_MAGIC, 1, 8, fh)==8)
+		 &&(fwrite(&hash, sizeof(unsigned long), 1, fh)==1)
+		 &&(fwrite(&listNum, sizeof(int), 1, fh)==1)
+		 &&(fwrite(&itemNum, sizeof(int), 1, fh)==1);
+	
+	for (j=0;(j<listNum)&&(ok);j++)
+	{
+		//tied values share one percentile, computed once
+		for (i=0;i<lists[j].itemNum;i++)
+		{
+			percentiles[i] = ((i>0)&&(lists[j].values[i]==lists[j].values[i-1]))?percentiles[i-1]
+							 :ListPercentile(lists[j].values[i], lists[j].values, lists[j].itemNum);
+		}
+		
+		ok = (fwrite(lists[j].name, 1, MAX_NAME_LEN, fh)==MAX_NAME_LEN)
+			 &&(fwrite(&(lists[j].itemNum), sizeof(int), 1, fh)==1)
+			 &&(fwrite(lists[j].values, sizeof(double), lists[j].itemNum, fh)==(size_t)lists[j].itemNum)
+			 &&(fwrite(percentiles, sizeof(double), lists[j].itemNum, fh)==(size_t)lists[j].itemNum);
+	}
+	
+	MemFree(percentiles);
+	
+	ok = (fclose(fh)==0)&&ok;
+	
+	if ((!ok)||(rename(tmpFileName, fileName)!=0))
+	{
+		printf("Cannot write list cache %s\n", fileName);
+		remove(tmpFileName);
+		return -1;
+	}
+	
+	return 1;
+}
+
+//Order OOC_VALUE_RECORD by list, then by value
+static int CompareValueRecord(const void *a, const void *b)
+{
+	const OOC_VALUE_RECORD *ra = (const OOC_VALUE_RECORD *)a;
+	const OOC_VALUE_RECORD *rb = (const OOC_VALUE_RECORD *)b;
+	
+	if (ra->listIndex!=rb->listIndex)
+	{
+		return ra->listIndex<rb->listIndex?-1:1;
+	}
+	
+	if (ra->value!=rb->value)
+	{
+		return ra->value<rb->value?-1:1;
+	}
+	
+	return 0;
+}
+
+//Order OOC_PERCENTILE_RECORD by group, then by percentile
+static int ComparePercentileRecord(const void *a, const void *b)
+{
+	const OOC_PERCENTILE_RECORD *ra = (const OOC_PERCENTILE_RECORD *)a;
+	const OOC_PERCENTILE_RECORD *rb = (const OOC_PERCENTILE_RECORD *)b;
+	
+	if (ra->groupIndex!=rb->groupIndex)
+	{
+		return ra->groupIndex<rb->groupIndex?-1:1;
+	}
+	
+	if (ra->percentile!=rb->percentile)
+	{
+		return ra->percentile<rb->percentile?-1:1;
+	}
+	
+	return 0;
+}
+
+//Emit (group, percentile) records for a run of tied values at ranks [start, start+spill->num-1] in a list of listSize items. Return 1 if success, -1 if failure
+static int FlushTiedValues(SPILL_BUFFER *spill, long start, long listSize, EXTSORT_STRUCT *percentileSorter)
+{
+	OOC_PERCENTILE_RECORD record;
+	int groupIndex;
+	int flag;
+	
+	//same as the mid-rank computed by bTreeSearchingF in ProcessGroups
+	record.percentile = ((double)start+(start+spill->num-1)+1)/((double)listSize*2);
+	record.reserved = 0;
+	
+	SpillBufferRewind(spill);
+	
+	while ((flag = SpillBufferNext(spill, &groupIndex))>0)
+	{
+		record.groupIndex = groupIndex;
+		
+		if (ExtSortAdd(percentileSorter, &record)<0)
+		{
+			return -1;
+		}
+	}
+	
+	SpillBufferClear(spill);
+	
+	return flag;
+}
+
+//Out-of-core replacement of ReadFile and ProcessGroups for inputs larger than memory. Stream the input once, sort (list, value) and (group, percentile) records
+//externally within memBudget bytes, and compute the scores of the aggregators group by group, stored as ProcessGroups does. Groups are allocated in *pGroups.
+//Return the number of items, or -1 if failure
+int ProcessFileOutOfCore(char *fileName, GROUP_STRUCT **pGroups, int *groupNum, int *listNum, double maxPercentile, const int *aggregators, int aggregatorNum,
+						 double **pScores, long memBudget, const char *tmpDir)
+{
+	READER_STRUCT *reader;
+	int i, flag;
+	char **words, *line;
+	int wordNum;
+	long totalItemNum, rank, runStart;
+	DICT_STRUCT *groupDict, *listDict;
+	long *listSizes, *tmpL;
+	int listCapacity;
+	int *groupSizes, *tmpI;
+	int groupCapacity;
+	int maxItemPerGroup, currentGroup, percentileNum;
+	double *tmpF, runValue;
+	LO_BATCH_STRUCT *batches[AGG_KERNEL_NUM];
+	double *scores;
+	int k;
+	OOC_VALUE_RECORD valueRecord;
+	OOC_PERCENTILE_RECORD percentileRecord;
+	EXTSORT_STRUCT *valueSorter, *percentileSorter;
+	SPILL_BUFFER *spill;
+	GROUP_STRUCT *groups;
+	int runList;
+	
+	words = AllocWords(255, MAX_NAME_LEN+1);
+	groupDict = DictCreate(1024);
+	listDict = DictCreate(16);
+	listCapacity = 16;
+	groupCapacity = 1024;
+	listSizes = (long *)MemCalloc(MEM_INPUT, listCapacity, sizeof(long));
+	groupSizes = (int *)MemCalloc(MEM_INPUT, groupCapacity, sizeof(int));
+	
+	//the value records are merged while the percentile records are collected, so the budget is shared among the two sorters and the tie buffer
+	valueSorter = ExtSortCreate(sizeof(OOC_VALUE_RECORD), CompareValueRecord, memBudget/2, tmpDir);
+	percentileSorter = ExtSortCreate(sizeof(OOC_PERCENTILE_RECORD), ComparePercentileRecord, memBudget/8*3, tmpDir);
+	spill = SpillBufferCreate(sizeof(int), memBudget/8, tmpDir);
+	
+	if ((!words)||(!groupDict)||(!listDict)||(!listSizes)||(!groupSizes)||(!valueSorter)||(!percentileSorter)||(!spill))
+	{
+		printf("Cannot allocate memory for out-of-core processing\n");
+		return -1;
+	}
+	
+	reader = ReaderOpen(fileName);
+	
+	if (!reader)
+	{
+		return -1;
+	}
+	
+	//Read the header row
+	line = ReaderGetLine(reader);
+	
+	wordNum = line?StringToWords(words, line, MAX_NAME_LEN+1, 255, " \t\r\n\v\f"):0;
+	
+	if (wordNum != 4)
+	{
+		ReaderClose(reader);
+		printf("Input file format: <item id> <group id> <list id> <value>\n");
+		return -1;
+	}
+	
+	//stream records of items, assigning indices to groups and lists on first sight
+	
+	totalItemNum = 0;
+	
+	line = ReaderGetLine(reader);
+	wordNum = line?StringToWords(words, line, MAX_NAME_LEN+1, 255, " \t\r\n\v\f"):0;
+	
+	TraceBegin("ingest chunk");
+	
+	while ((wordNum==4)&&(!ReaderAtEnd(reader)))
+	{
+		valueRecord.groupIndex = DictInsert(groupDict, words[1]);
+		valueRecord.listIndex = DictInsert(listDict, words[2]);
+		valueRecord.value = atof(words[3]);
+		
+		if ((valueRecord.groupIndex<0)||(valueRecord.listIndex<0))
+		{
+			ReaderClose(reader);
+			printf("Cannot allocate memory for group and list names\n");
+			return -1;
+		}
+		
+		if (valueRecord.groupIndex>=groupCapacity)
+		{
+			tmpI = (int *)MemRealloc(MEM_INPUT, groupSizes, 2*groupCapacity*sizeof(int));
+			
+			if (!tmpI)
+			{
+				ReaderClose(reader);
+				return -1;
+			}
+			
+			memset(tmpI+groupCapacity, 0, groupCapacity*sizeof(int));
+			groupSizes = tmpI;
+			groupCapacity *= 2;
+		}
+		
+		if (valueRecord.listIndex>=listCapacity)
+		{
+			tmpL = (long *)MemRealloc(MEM_INPUT, listSizes, 2*listCapacity*sizeof(long));
+			
+			if (!tmpL)
+			{
+				ReaderClose(reader);
+				return -1;
+			}
+			
+			memset(tmpL+listCapacity, 0, listCapacity*sizeof(long));
+			listSizes = tmpL;
+			listCapacity *= 2;
+		}
+		
+		groupSizes[valueRecord.groupIndex]++;
+		listSizes[valueRecord.listIndex]++;
+		
+		if (ExtSortAdd(valueSorter, &valueRecord)<0)
+		{
+			ReaderClose(reader);
+			return -1;
+		}
+		
+		totalItemNum++;
+		
+		if (totalItemNum%TRACE_CHUNK_SIZE==0)
+		{
+			TraceEnd("ingest chunk");
+			TraceBegin("ingest chunk");
+		}
+		
+		line = ReaderGetLine(reader);
+		wordNum = line?StringToWords(words, line, MAX_NAME_LEN+1, 255, " \t\r\n\v\f"):0;
+	}
+	
+	TraceEnd("ingest chunk");
+	
+	FreeWords(words, 255);
+	
+	if (ReaderClose(reader)<0)
+	{
+		return -1;
+	}
+	
+	printf("%ld items\n%d groups\n%d lists\n", totalItemNum, groupDict->num, listDict->num);
+	
+	if (totalItemNum==0)
+	{
+		return -1;
+	}
+	
+	//merge (list, value) runs. Items whose values are within the tolerance of ties of ListPercentile from the first value of the run,
+	//1E-9, share the mid-rank as their percentile. Records are sorted by exact value, as the in-memory lists are
+	
+	if (ExtSortFinish(valueSorter)<0)
+	{
+		return -1;
+	}
+	
+	runList = -1;
+	runValue = 0.0;
+	runStart = 0;
+	rank = 0;
+	
+	TraceBegin("merge values");
+	
+	while ((flag = ExtSortNext(valueSorter, &valueRecord))>0)
+	{
+		if ((valueRecord.listIndex!=runList)||(valueRecord.value>runValue+0.000000001))
+		{
+			if ((runList>=0)&&(FlushTiedValues(spill, runStart, listSizes[runList], percentileSorter)<0))
+			{
+				return -1;
+			}
+			
+			if (valueRecord.listIndex!=runList)
+			{
+				rank = 0;
+			}
+			
+			runList = valueRecord.listIndex;
+			runValue = valueRecord.value;
+			runStart = rank;
+		}
+		
+		if (SpillBufferAdd(spill, &(valueRecord.groupIndex))<0)
+		{
+			return -1;
+		}
+		
+		rank++;
+	}
+	
+	if ((flag<0)||(FlushTiedValues(spill, runStart, listSizes[runList], percentileSorter)<0))
+	{
+		return -1;
+	}
+	
+	TraceEnd("merge values");
+	
+	ExtSortFree(valueSorter);
+	SpillBufferFree(spill);
+	
+	//groups are kept in memory, in the order of their first appearance as ReadFile does
+	
+	groups = (GROUP_STRUCT *)MemAlloc(MEM_GROUPS, groupDict->num*sizeof(GROUP_STRUCT));
+	
+	if (!groups)
+	{
+		printf("Cannot allocate memory for %d groups\n", groupDict->num);
+		return -1;
+	}
+	
+	maxItemPerGroup = 0;
+	
+	for (i=0;i<groupDict->num;i++)
+	{
+		strncpy(groups[i].name, groupDict->names[i], MAX_NAME_LEN-1);
+		groups[i].name[MAX_NAME_LEN-1] = 0;
+		groups[i].items = NULL;
+		groups[i].itemNum = groupSizes[i];
+		groups[i].index = i;
+		groups[i].loValue = 1.0;
+		groups[i].fdr = 1.0;
+		
+		if (groupSizes[i]>maxItemPerGroup)
+		{
+			maxItemPerGroup = groupSizes[i];
+		}
+	}
+	
+	tmpF = (double *)MemAlloc(MEM_WORK, maxItemPerGroup*sizeof(double));
+	scores = aggregatorNum>1?(double *)MemAlloc(MEM_GROUPS, (long)(aggregatorNum-1)*groupDict->num*sizeof(double)):NULL;
+	flag = ((tmpF)&&((scores)||(aggregatorNum==1)))?1:-1;
+	
+	for (k=0;k<aggregatorNum;k++)
+	{
+		batches[k] = LoBatchCreate(aggregators[k], maxItemPerGroup, maxPercentile);
+		flag = batches[k]?flag:-1;
+	}
+	
+	if (flag<0)
+	{
+		MemFree(tmpF);
+		MemFree(scores);
+
+		for (k=0;k<aggregatorNum;k++)
+		{
+			LoBatchFree(batches[k]);
+		}
+		
+		return -1;
+	}
+	
+	//merge (group, percentile) runs and compute the scores group by group
+	
+	if (ExtSortFinish(percentileSorter)<0)
+	{
+		return -1;
+	}
+	
+	currentGroup = -1;
+	percentileNum = 0;
+	
+	TraceBegin("merge percentiles");
+	
+	while ((flag = ExtSortNext(percentileSorter, &percentileRecord))>0)
+	{
+		if (percentileRecord.groupIndex!=currentGroup)
+		{
+			for (k=0;(currentGroup>=0)&&(k<aggregatorNum);k++)
+			{
+				LoBatchAdd(batches[k], tmpF, percentileNum, k>0?scores+(long)(k-1)*groupDict->num+currentGroup:&(groups[currentGroup].loValue));
+			}
+			
+			currentGroup = percentileRecord.groupIndex;
+			percentileNum = 0;
+		}
+		
+		tmpF[percentileNum] = percentileRecord.percentile;
+		percentileNum++;
+	}
+	
+	if (flag<0)
+	{
+		return -1;
+	}
+	
+	for (k=0;k<aggregatorNum;k++)
+	{
+		LoBatchAdd(batches[k], tmpF, percentileNum, k>0?scores+(long)(k-1)*groupDict->num+currentGroup:&(groups[currentGroup].loValue));
+		LoBatchFlush(batches[k]);
+	}
+	
+	TraceEnd("merge percentiles");
+	
+	ExtSortFree(percentileSorter);
+	MemFree(tmpF);
+	
+	for (k=0;k<aggregatorNum;k++)
+	{
+		LoBatchFree(batches[k]);
+	}
+	
+	*pGroups = groups;
+	*pScores = scores;
+	*groupNum = groupDict->num;
+	*listNum = listDict->num;
+	
+	DictFree(groupDict);
+	DictFree(listDict);
+	MemFree(groupSizes);
+	MemFree(listSizes);
+	
+	return totalItemNum>0x7fffffff?0x7fffffff:(int)totalItemNum;
+}
+
+//Bin of a lo-value in the null sketch
+static int SketchBin(NULL_SKETCH *sketch, double loValue, double *fraction)
+{
+	double pos;
+	int bin;
+	
+	if (loValue<=0.0)
+	{
+		*fraction = 0.0;
+		return 0;
+	}
+	
+	pos = (log10(loValue)+NULL_SKETCH_DECADES)*sketch->binsPerDecade;
+	
+	if (pos<0.0)
+	{
+		*fraction = 0.0;
+		return 0;
+	}
+	
+	bin = (int)pos;
+	
+	if (bin>=sketch->binNum)
+	{
+		*fraction = 1.0;
+		return sketch->binNum-1;
+	}
+	
+	*fraction = pos-bin;
+	
+	return bin;
+}
+
+//Lo-value of the null lo-value of index index, placed by its rank within its bin of the sketch. counts must be cumulative
+static double SketchValue(NULL_SKETCH *sketch, long index)
+{
+	int lo, hi, mid;
+	double below;
+	
+	//first bin whose cumulative count passes index
+	lo = 0;
+	hi = sketch->binNum-1;
+	
+	while (lo<hi)
+	{
+		mid = (lo+hi)/2;
+		
+		if (sketch->counts[mid]>index)
+		{
+			hi = mid;
+		}
+		else
+		{
+			lo = mid+1;
+		}
+	}
+	
+	below = lo>0?sketch->counts[lo-1]:0.0;
+	
+	return pow(10.0, (lo+(index-below+0.5)/(sketch->counts[lo]-below))/sketch->binsPerDecade-NULL_SKETCH_DECADES);
+}
+
+//Position of a lo-value among the sorted null lo-values of the sketch, in the convention of bTreeSearchingF: the index of the nearest null
+//lo-value. Between two bins of null lo-values, the nearest of the last one below and the first one above, each placed by its rank in its bin;
+//within a bin, the expected index of the nearest under a uniform spread. counts must be cumulative
+static double SketchPosition(NULL_SKETCH *sketch, double loValue)
+{
+	double fraction, below, pos;
+	int bin;
+	
+	bin = SketchBin(sketch, loValue, &fraction);
+	
+	below = bin>0?sketch->counts[bin-1]:0.0;
+	
+	if (below<=0.0)
+	{
+		pos = 0.0;
+	}
+	else if (below>=sketch->total)
+	{
+		pos = sketch->total-1;
+	}
+	else if (sketch->counts[bin]==below)
+	{
+		//ties go to the one above, as in bTreeSearchingF
+		pos = loValue-SketchValue(sketch, (long)below-1)<SketchValue(sketch, (long)below)-loValue?below-1:below;
+	}
+	else
+	{
+		pos = below+(sketch->counts[bin]-below)*fraction-0.5;
+	}
+	
+	if (pos<0.0)
+	{
+		pos = 0.0;
+	}
+	
+	if (pos>sketch->total-1)
+	{
+		pos = sketch->total-1;
+	}
+	
+	return pos;
+}
+
+//Compute False Discovery Rate of the loValue of groups, scored by aggregator, based on uniform distribution. If sketchBins>0, the null lo-values are counted in a histogram with sketchBins bins
+//per decade instead of being stored. If pSortedNull is not NULL and the null lo-values are stored, they are handed over sorted in *pSortedNull, with their number in *nullNum
+int ComputeFDR(GROUP_STRUCT *groups, int groupNum, double maxPercentile, int aggregator, int numOfRandPass, int sketchBins, CHECKPOINT_STRUCT *ckpt,
+			   double **pSortedNull, int *nullNum)
+{
+	int i,j,k;
+	double *tmpPercentile;
+	int maxItemNum = 0;
+	int scanPass = numOfRandPass/groupNum+1;
+	double *randLoValue;
+	int randLoValueNum;
+	NULL_SKETCH sketch;
+	double *passLoValue, fraction;
+	LO_BATCH_STRUCT *batch;
+	int startPass, flag;
+	long loadedNum;
+	unsigned long long key;
+	PERF_SAMPLE perf;
+	
+	for (i=0;i<groupNum;i++)
+	{
+		if (groups[i].itemNum>maxItemNum)
+		{
+			maxItemNum = groups[i].itemNum;
+		}
+	}
+	
+	assert(maxItemNum>0);
+	
+	tmpPercentile = (double *)MemAlloc(MEM_WORK, maxItemNum*sizeof(double));
+	batch = LoBatchCreate(aggregator, maxItemNum, maxPercentile);
+	passLoValue = NULL;
+	
+	randLoValueNum = groupNum*scanPass;
+	
+	assert(randLoValueNum>0);
+	
+	randLoValue = NULL;
+	sketch.counts = NULL;
+	
+	if (sketchBins>0)
+	{
+		sketch.binsPerDecade = sketchBins;
+		sketch.binNum = NULL_SKETCH_DECADES*sketchBins;
+		sketch.total = 0;
+		sketch.counts = (double *)MemCalloc(MEM_NULL, sketch.binNum, sizeof(double));
+		passLoValue = (double *)MemAlloc(MEM_WORK, groupNum*sizeof(double));
+	}
+	else
+	{
+		randLoValue = (double *)MemAlloc(MEM_NULL, randLoValueNum*sizeof(double));
+	}
+	
+	if ((!tmpPercentile)||(!batch)||((!randLoValue)&&((!sketch.counts)||(!passLoValue))))
+	{
+		MemFree(tmpPercentile);
+		LoBatchFree(batch);
+		MemFree(randLoValue);
+		MemFree(sketch.counts);
+		MemFree(passLoValue);
+		return -1;
+	}
+	
+	randLoValueNum = 0;
+	startPass = 0;
+	key = 0;
+	
+	PlantSeeds(RAND_SEED);
+	
+	if (ckpt)
+	{
+		//the key identifies the simulation: its parameters and the size of every group, in order
+		key = CheckpointKey(key, &groupNum, sizeof(groupNum));
+		key = CheckpointKey(key, &scanPass, sizeof(scanPass));
+		key = CheckpointKey(key, &maxPercentile, sizeof(maxPercentile));
+		key = CheckpointKey(key, &sketchBins, sizeof(sketchBins));
+		
+		//keys of RRA runs are those of the runs before there were aggregators
+		if (aggregator!=AGG_RRA)
+		{
+			key = CheckpointKey(key, &aggregator, sizeof(aggregator));
+		}
+
+		for (j=0;j<groupNum;j++)
+		{
+			key = CheckpointKey(key, &(groups[j].itemNum), sizeof(int));
+		}
+		
+		ckpt->lastSaveTime = time(NULL);
+		
+		if (ckpt->resume)
+		{
+			if (randLoValue)
+			{
+				flag = LoadCheckpoint(ckpt, key, &startPass, randLoValue, groupNum*scanPass, &loadedNum);
+				randLoValueNum = (int)loadedNum;
+			}
+			else
+			{
+				flag = LoadCheckpoint(ckpt, key, &startPass, sketch.counts, sketch.binNum, &loadedNum);
+				randLoValueNum = startPass*groupNum;
+			}
+			
+			if (flag<0)
+			{
+				MemFree(tmpPercentile);
+				MemFree(randLoValue);
+				MemFree(sketch.counts);
+				MemFree(passLoValue);
+				LoBatchFree(batch);
+				return -1;
+			}
+			
+			if (flag>0)
+			{
+				printf("resumed at pass %d of %d...", startPass, scanPass);
+			}
+		}
+	}
+	
+	PerfBegin(&perf);
+	
+	for (i=startPass;i<scanPass;i++)
+	{
+		if ((ckpt)&&(i>startPass)&&(CheckpointDue(ckpt)))
+		{
+			TraceBegin("checkpoint");
+			
+			if (randLoValue)
+			{
+				flag = SaveCheckpoint(ckpt, key, i, randLoValue, randLoValueNum);
+			}
+			else
+			{
+				flag = SaveCheckpoint(ckpt, key, i, sketch.counts, sketch.binNum);
+			}
+			
+			TraceEnd("checkpoint");
+			
+			if ((flag<0)||(TerminateRequested()))
+			{
+				if (flag>0)
+				{
+					printf("terminated at pass %d of %d. Checkpoint saved to %s...", i, scanPass, ckpt->fileName);
+				}
+				
+				PerfEnd(&perf, "ComputeFDR simulation");
+				MemFree(tmpPercentile);
+				MemFree(randLoValue);
+				MemFree(sketch.counts);
+				MemFree(passLoValue);
+				LoBatchFree(batch);
+				return -1;
+			}
+		}
+		
+		TraceBegin("simulation pass");
+		
+		//percentiles are drawn group by group as before; lo-values are computed in batches of groups of the same size,
+		//all of them by the end of the pass, so that a checkpoint between passes has the whole pass
+		for (j=0;j<groupNum;j++)
+		{
+			for (k=0;k<groups[j].itemNum;k++)
+			{
+				tmpPercentile[k] = Uniform(0.0, 1.0);
+			}
+			
+			LoBatchAdd(batch, tmpPercentile, groups[j].itemNum, randLoValue?randLoValue+randLoValueNum+j:passLoValue+j);
+		}
+		
+		LoBatchFlush(batch);
+		
+		for (j=0;(!randLoValue)&&(j<groupNum);j++)
+		{
+			sketch.counts[SketchBin(&sketch, passLoValue[j], &fraction)] += 1.0;
+		}
+		
+		randLoValueNum += groupNum;
+		
+		TraceEnd("simulation pass");
+	}
+	
+	PerfEnd(&perf, "ComputeFDR simulation");
+	
+	TraceBegin("sort groups");
+	QuickSortGroupByLoValue(groups, 0, groupNum-1);
+	TraceEnd("sort groups");
+	
+	if (randLoValue)
+	{
+		TraceBegin("sort null");
+		QuicksortF(randLoValue, 0, randLoValueNum-1);
+		TraceEnd("sort null");
+		
+		for (i=0;i<groupNum;i++)
+		{
+			groups[i].fdr = NullRankFDR(groups[i].loValue, i, groupNum, randLoValue, randLoValueNum);
+		}
+		
+		if (pSortedNull)
+		{
+			*pSortedNull = randLoValue;
+			*nullNum = randLoValueNum;
+			randLoValue = NULL;
+		}
+	}
+	else
+	{
+		sketch.total = randLoValueNum;
+		
+		for (i=1;i<sketch.binNum;i++)
+		{
+			sketch.counts[i] += sketch.counts[i-1];
+		}
+		
+		for (i=0;i<groupNum;i++)
+		{
+			groups[i].fdr = (SketchPosition(&sketch, groups[i].loValue-0.000000001)
+							 +SketchPosition(&sketch, groups[i].loValue+0.000000001)+1)
+							/2/randLoValueNum/((double)i+0.5)*groupNum;
+		}
+	}
+	
+	if (groups[groupNum-1].fdr>1.0)
+	{
+		groups[groupNum-1].fdr = 1.0;
+	}
+	
+	for (i=groupNum-2;i>=0;i--)
+	{
+		if (groups[i].fdr>groups[i+1].fdr)
+		{
+			groups[i].fdr = groups[i+1].fdr;
+		}
+	}
+	
+	MemFree(tmpPercentile);
+	MemFree(randLoValue);
+	MemFree(sketch.counts);
+	MemFree(passLoValue);
+	LoBatchFree(batch);
+	
+	return 1;
+}
+
+//Plan how to process the input under the memory limit: in memory, or out of core with a sort budget. Return 1 if success, -1 if failure
+int PlanInput(char *fileName, RUN_PLAN *plan)
+{
+	FILE *fh;
+	ARROW_FILE *file;
+	struct stat fileStat;
+	char **words, *tmpS;
+	int wordNum, lineNum, distinctGroupNum;
+	long sampleBytes;
+	char lastGroupName[MAX_NAME_LEN+1];
+	long dictBytes;
+	
+	//standard input can be read only once, so its size cannot be sampled. It is processed out of core,
+	//with a quarter of the limit for the sorters and the rest left for groups and the null distribution
+	if (IsStdStream(fileName))
+	{
+		plan->threadBytes = PlanOutputBytes(-1, plan->threadNum);
+		plan->oocBudget = (plan->memLimit-plan->threadBytes)/4;
+		
+		if (plan->oocBudget<4*EXTSORT_MIN_RUN_BUFFER)
+		{
+			printf("memory limit %.1f MB is too small\n", plan->memLimit/1048576.0);
+			return -1;
+		}
+		
+		printf("memory plan: input size unknown on standard input, processed out of core with %.1f MB sort buffers\n", plan->oocBudget/1048576.0);
+		
+		return 1;
+	}
+	
+	//Arrow files give the number of items exactly, and the number of groups through the dictionary of group ids. They are read in memory only
+	if (IsArrowFile(fileName))
+	{
+		file = ArrowOpen(fileName);
+		
+		if ((!file)||(file->columnNum<4))
+		{
+			ArrowClose(file);
+			printf("Input file format: <item id> <group id> <list id> <value>\n");
+			return -1;
+		}
+		
+		plan->estimatedItemNum = file->rowNum;
+		plan->estimatedGroupNum = file->columns[1].dictionaryId>=0?file->columns[1].dictNum:file->rowNum;
+		plan->threadBytes = PlanOutputBytes(plan->estimatedGroupNum, plan->threadNum);
+		
+		ArrowClose(file);
+		
+		plan->inMemoryBytes = plan->estimatedItemNum*(sizeof(ITEM_STRUCT)+sizeof(double)+2*sizeof(int)+sizeof(double))
+							  +plan->estimatedGroupNum*sizeof(GROUP_STRUCT)
+							  +plan->estimatedGroupNum*(RAND_PASS_NUM+1)*sizeof(double)
+							  +plan->threadBytes;
+		plan->oocBudget = 0;
+		
+		if (plan->inMemoryBytes>plan->memLimit)
+		{
+			printf("Arrow input of %ld items does not fit the memory limit of %.1f MB; out-of-core processing reads text input only\n",
+				   plan->estimatedItemNum, plan->memLimit/1048576.0);
+			return -1;
+		}
+		
+		printf("memory plan: %ld items in at most %ld groups, processed in memory (%.1f MB estimated)\n",
+			   plan->estimatedItemNum, plan->estimatedGroupNum, plan->inMemoryBytes/1048576.0);
+		return 1;
+	}
+	
+	if (stat(fileName, &fileStat)!=0)
+	{
+		printf("Cannot open file %s\n", fileName);
+		return -1;
+	}
+	
+	fh = (FILE *)fopen(fileName, "r");
+	
+	if (!fh)
+	{
+		printf("Cannot open file %s\n", fileName);
+		return -1;
+	}
+	
+	words = AllocWords(255, MAX_NAME_LEN+1);
+	tmpS = (char *)malloc(255*(MAX_NAME_LEN+1)*sizeof(char));
+	
+	//sample the first lines for the average line length and group size. Inputs are usually ordered by group
+	fgets(tmpS, 255*(MAX_NAME_LEN+1)*sizeof(char), fh);
+	
+	lineNum = 0;
+	distinctGroupNum = 0;
+	sampleBytes = 0;
+	lastGroupName[0] = 0;
+	
+	while ((lineNum<PLAN_SAMPLE_LINES)&&(fgets(tmpS, 255*(MAX_NAME_LEN+1)*sizeof(char), fh)))
+	{
+		wordNum = StringToWords(words, tmpS, MAX_NAME_LEN+1, 255, " \t\r\n\v\f");
+		
+		if (wordNum!=4)
+		{
+			break;
+		}
+		
+		if (strcmp(lastGroupName, words[1]))
+		{
+			strcpy(lastGroupName, words[1]);
+			distinctGroupNum++;
+		}
+		
+		sampleBytes += strlen(tmpS);
+		lineNum++;
+	}
+	
+	fclose(fh);
+	FreeWords(words, 255);
+	free(tmpS);
+	
+	if (lineNum==0)
+	{
+		printf("Input file format: <item id> <group id> <list id> <value>\n");
+		return -1;
+	}
+	
+	plan->estimatedItemNum = (long)((double)fileStat.st_size/sampleBytes*lineNum)+1;
+	plan->estimatedGroupNum = (long)((double)plan->estimatedItemNum/lineNum*distinctGroupNum)+1;
+	plan->threadBytes = PlanOutputBytes(plan->estimatedGroupNum, plan->threadNum);
+	
+	//items and list values, groups with headroom for array growth, the null distribution and the working memory of the threads
+	plan->inMemoryBytes = plan->estimatedItemNum*(sizeof(ITEM_STRUCT)+sizeof(double))
+						  +plan->estimatedGroupNum*2*sizeof(GROUP_STRUCT)
+						  +plan->estimatedGroupNum*(RAND_PASS_NUM+1)*sizeof(double)
+						  +plan->threadBytes;
+	
+	if (plan->inMemoryBytes<=plan->memLimit)
+	{
+		plan->oocBudget = 0;
+		printf("memory plan: about %ld items in %ld groups, processed in memory (%.1f MB estimated)\n",
+			   plan->estimatedItemNum, plan->estimatedGroupNum, plan->inMemoryBytes/1048576.0);
+		return 1;
+	}
+	
+	//out of core: dictionaries, groups and the working memory of the threads stay in memory, the sorters share half of the rest,
+	//the other half is left for the null distribution
+	dictBytes = plan->estimatedGroupNum*(sizeof(GROUP_STRUCT)+MAX_NAME_LEN/4+48)+plan->threadBytes;
+	plan->oocBudget = (plan->memLimit-dictBytes)/2;
+	
+	if (plan->oocBudget<4*EXTSORT_MIN_RUN_BUFFER)
+	{
+		printf("memory limit %.1f MB is too small for about %ld groups\n", plan->memLimit/1048576.0, plan->estimatedGroupNum);
+		return -1;
+	}
+	
+	printf("memory plan: about %ld items in %ld groups, processed out of core with %.1f MB sort buffers\n",
+		   plan->estimatedItemNum, plan->estimatedGroupNum, plan->oocBudget/1048576.0);
+	
+	return 1;
+}
+
+//Return the memory of the output chunks of rowNum rows, -1 if unknown, that may wait for the writer with threadNum threads
+long PlanOutputBytes(long rowNum, int threadNum)
+{
+	long chunkRows;
+	
+	//chunks formatted ahead of the writer, and the one being written
+	chunkRows = (long)(OutPendingChunkNum(threadNum)+1)*GetOutChunkRows();
+	
+	if ((rowNum>=0)&&(rowNum<chunkRows))
+	{
+		chunkRows = rowNum;
+	}
+	
+	return chunkRows*PLAN_OUT_ROW_BYTES;
+}
+
+//Plan the null distribution under the memory left: exact array of lo-values, or a sketch with as many bins as fit. Return 1 if success, -1 if failure
+int PlanNull(GROUP_STRUCT *groups, int groupNum, int numOfRandPass, RUN_PLAN *plan)
+{
+	int i, maxItemNum;
+	long available, exactBytes, batchBytes;
+	char *sizeUsed;
+	
+	maxItemNum = 0;
+	
+	for (i=0;i<groupNum;i++)
+	{
+		if (groups[i].itemNum>maxItemNum)
+		{
+			maxItemNum = groups[i].itemNum;
+		}
+	}
+	
+	sizeUsed = (char *)calloc(maxItemNum+1, sizeof(char));
+	
+	if (!sizeUsed)
+	{
+		printf("Cannot allocate memory\n");
+		return -1;
+	}
+	
+	//ComputeFDR scores the null groups in one lo-value batch, with LO_BATCH_LANES lanes and the beta terms of each group size
+	batchBytes = sizeof(LO_BATCH_STRUCT)+(maxItemNum+1)*sizeof(LO_SIZE_CLASS *)+maxItemNum*sizeof(double);
+	
+	for (i=0;i<groupNum;i++)
+	{
+		if (!sizeUsed[groups[i].itemNum])
+		{
+			sizeUsed[groups[i].itemNum] = 1;
+			batchBytes += sizeof(LO_SIZE_CLASS)+(LO_BATCH_LANES+1)*(long)groups[i].itemNum*sizeof(double);
+		}
+	}
+	
+	free(sizeUsed);
+	
+	plan->threadBytes = PlanOutputBytes(groupNum, plan->threadNum)+batchBytes;
+	
+	//output chunks of the threads, the batch and working arrays of ComputeFDR, and those of ComputeLoValue
+	available = GetMemAvailable()-plan->threadBytes-2*maxItemNum*sizeof(double)-1024*1024;
+	exactBytes = (long)groupNum*(numOfRandPass/groupNum+1)*sizeof(double);
+	
+	if (exactBytes<=available)
+	{
+		plan->sketchBins = 0;
+		plan->nullBytes = exactBytes;
+		printf("memory plan: null distribution of %ld lo-values kept exactly (%.1f MB), %.1f MB working memory with %d thread%s\n",
+			   exactBytes/(long)sizeof(double), exactBytes/1048576.0, plan->threadBytes/1048576.0, plan->threadNum, plan->threadNum>1?"s":"");
+		return 1;
+	}
+	
+	plan->sketchBins = (int)(available/(NULL_SKETCH_DECADES*(long)sizeof(double)));
+	plan->sketchBins = plan->sketchBins>MAX_SKETCH_BINS?MAX_SKETCH_BINS:plan->sketchBins;
+	
+	if (plan->sketchBins<MIN_SKETCH_BINS)
+	{
+		printf("memory limit %.1f MB leaves too little memory for the null distribution\n", plan->memLimit/1048576.0);
+		return -1;
+	}
+	
+	plan->nullBytes = (long)NULL_SKETCH_DECADES*plan->sketchBins*sizeof(double);
+	printf("memory plan: null distribution of %ld lo-values kept in a sketch with %d bins per decade (%.1f MB), %.1f MB working memory with %d thread%s\n",
+		   exactBytes/(long)sizeof(double), plan->sketchBins, plan->nullBytes/1048576.0, plan->threadBytes/1048576.0, plan->threadNum, plan->threadNum>1?"s":"");
+	
+	return 1;
+}
+
+//Append the results of groups to a result store, as screen screenName read from inputFileName. Return 1 if success, -1 if failure
+int AppendToStore(char *storeFileName, char *screenName, char *inputFileName, GROUP_STRUCT *groups, int groupNum, int itemNum, int listNum, double maxPercentile)
+{
+	STORE_SCREEN screen;
+	STORE_RESULT *results;
+	int i, flag;
+	
+	results = (STORE_RESULT *)MemAlloc(MEM_OUTPUT, (groupNum+1)*sizeof(STORE_RESULT));
+	
+	if (!results)
+	{
+		return -1;
+	}
+	
+	//rows are stored in the order of the output, by lo-value
+	for (i=0;i<groupNum;i++)
+	{
+		results[i].name = groups[i].name;
+		results[i].itemNum = groups[i].itemNum;
+		results[i].loValue = groups[i].loValue;
+		results[i].fdr = groups[i].fdr;
+	}
+	
+	memset(&screen, 0, sizeof(STORE_SCREEN));
+	strncpy(screen.name, screenName, STORE_MAX_NAME_LEN-1);
+	strncpy(screen.source, inputFileName, STORE_MAX_NAME_LEN-1);
+	screen.maxPercentile = maxPercentile;
+	screen.itemNum = itemNum;
+	screen.listNum = listNum;
+	
+	flag = StoreAppend(storeFileName, &screen, results, groupNum);
+	
+	MemFree(results);
+	
+	return flag;
+}
+
+//Parse a comma separated list of aggregator names into aggregators. Return the number of aggregators, or -1 if a name is unknown or repeated
+int ParseAggregatorList(const char *text, int *aggregators)
+{
+	char name[MAX_NAME_LEN];
+	const char *start, *end;
+	int i, aggregatorNum, len;
+	
+	aggregatorNum = 0;
+	start = text;
+	
+	while (1)
+	{
+		end = strchr(start, ',');
+		len = end?(int)(end-start):(int)strlen(start);
+		
+		if ((len<=0)||(len>=MAX_NAME_LEN)||(aggregatorNum>=AGG_KERNEL_NUM))
+		{
+			return -1;
+		}
+		
+		memcpy(name, start, len);
+		name[len] = 0;
+		
+		aggregators[aggregatorNum] = ParseAggregator(name);
+		
+		if (aggregators[aggregatorNum]<0)
+		{
+			printf("unknown aggregator %s\n", name);
+			return -1;
+		}
+		
+		for (i=0;i<aggregatorNum;i++)
+		{
+			if (aggregators[i]==aggregators[aggregatorNum])
+			{
+				return -1;
+			}
+		}
+		
+		aggregatorNum++;
+		
+		if (!end)
+		{
+			break;
+		}
+		
+		start = end+1;
+	}
+	
+	return aggregatorNum;
+}
+
+//Copy fileName to result, with .<name> inserted before the extension if name is not NULL
+void AggregatorFileName(const char *fileName, const char *name, char *result, int size)
+{
+	const char *dot, *slash;
+	
+	if ((!name)||(fileName[0]==0))
+	{
+		snprintf(result, size, "%s", fileName);
+		return;
+	}
+	
+	dot = strrchr(fileName, '.');
+	slash = strrchr(fileName, '/');
+	
+	//a dot in a directory name, or at the start of a hidden file name, is no extension
+	if ((!dot)||(dot==fileName)||((slash)&&(dot<=slash+1)))
+	{
+		snprintf(result, size, "%s.%s", fileName, name);
+	}
+	else
+	{
+		snprintf(result, size, "%.*s.%s%s", (int)(dot-fileName), fileName, name, dot);
+	}
+}
+
+//Order RANK_SHIFT by list, then by the smallest value
+static int CompareRankShift(const void *a, const void *b)
+{
+	const RANK_SHIFT *shiftA = (const RANK_SHIFT *)a;
+	const RANK_SHIFT *shiftB = (const RANK_SHIFT *)b;
+	
+	if (shiftA->listIndex!=shiftB->listIndex)
+	{
+		return shiftA->listIndex<shiftB->listIndex?-1:1;
+	}
+	
+	return (shiftA->lo>shiftB->lo)-(shiftA->lo<shiftB->lo);
+}
+
+//Record that the item of key, an item id, group index and list index, is item position of group group. Return 1 if success, -1 if failure
+static int RecordItem(DICT_STRUCT *itemDict, const char *key, int group, int position, ITEM_REF **pItemRefs, int *itemCapacity)
+{
+	ITEM_REF *tmpRefs;
+	int n;
+	
+	n = DictInsert(itemDict, key);
+	
+	if (n<0)
+	{
+		return -1;
+	}
+	
+	if (n>=*itemCapacity)
+	{
+		tmpRefs = (ITEM_REF *)MemRealloc(MEM_WORK, *pItemRefs, 2*(*itemCapacity)*sizeof(ITEM_REF));
+		
+		if (!tmpRefs)
+		{
+			return -1;
+		}
+		
+		*pItemRefs = tmpRefs;
+		*itemCapacity *= 2;
+	}
+	
+	(*pItemRefs)[n].group = group;
+	(*pItemRefs)[n].position = position;
+	
+	return 1;
+}
+
+//Remove one value from the sorted values of a list. Return 1 if success, -1 if the value is not in the list
+static int ListRemoveValue(LIST_STRUCT *list, double value)
+{
+	int lo, hi, mid;
+	
+	lo = 0;
+	hi = list->itemNum;
+	
+	while (lo<hi)
+	{
+		mid = lo+(hi-lo)/2;
+		
+		if (list->values[mid]<value)
+		{
+			lo = mid+1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	
+	if ((lo>=list->itemNum)||(list->values[lo]!=value))
+	{
+		return -1;
+	}
+	
+	memmove(list->values+lo, list->values+lo+1, (list->itemNum-lo-1)*sizeof(double));
+	list->itemNum--;
+	
+	return 1;
+}
+
+//Insert one value into the sorted values of a list, which can hold *capacity values and grows if needed. Return 1 if success, -1 if failure
+static int ListInsertValue(LIST_STRUCT *list, int *capacity, double value)
+{
+	double *tmpValues;
+	int lo, hi, mid;
+	
+	if (list->itemNum>=*capacity)
+	{
+		tmpValues = (double *)MemRealloc(MEM_LISTS, list->values, (long)(*capacity+1024)*sizeof(double));
+		
+		if (!tmpValues)
+		{
+			return -1;
+		}
+		
+		list->values = tmpValues;
+		*capacity += 1024;
+	}
+	
+	lo = 0;
+	hi = list->itemNum;
+	
+	while (lo<hi)
+	{
+		mid = lo+(hi-lo)/2;
+		
+		if (list->values[mid]<=value)
+		{
+			lo = mid+1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	
+	memmove(list->values+lo+1, list->values+lo, (list->itemNum-lo)*sizeof(double));
+	list->values[lo] = value;
+	list->itemNum++;
+	
+	return 1;
+}
+
+//Save the state of an RRA run for later updates: the sorted lists, the groups in the order of input with their items and lo-values,
+//and the sorted null distribution. Groups may be in any order; they are written by index. The file is replaced atomically. Return 1 if success, -1 if failure
+int SaveState(char *fileName, GROUP_STRUCT *groups, int groupNum, LIST_STRUCT *lists, int listNum, int aggregator, double maxPercentile,
+			  double *sortedNull, int nullNum)
+{
+	FILE *fh;
+	char tmpFileName[1100];
+	int *order;
+	int i, j, ok;
+	
+	order = (int *)MemAlloc(MEM_WORK, groupNum*sizeof(int));
+	
+	if (!order)
+	{
+		return -1;
+	}
+	
+	for (i=0;i<groupNum;i++)
+	{
+		order[groups[i].index] = i;
+	}
+	
+	snprintf(tmpFileName, sizeof(tmpFileName), "%s.tmp", fileName);
+	
+	fh = (FILE *)fopen(tmpFileName, "wb");
+	
+	if (!fh)
+	{
+		printf("Cannot write state %s\n", tmpFileName);
+		MemFree(order);
+		return -1;
+	}
+	
+	ok = (fwrite(STATE_MAGIC, 1, 8, fh)==8)
+		 &&(fwrite(&aggregator, sizeof(int), 1, fh)==1)
+		 &&(fwrite(&maxPercentile, sizeof(double), 1, fh)==1)
+		 &&(fwrite(&listNum, sizeof(int), 1, fh)==1)
+		 &&(fwrite(&groupNum, sizeof(int), 1, fh)==1)
+		 &&(fwrite(&nullNum, sizeof(int), 1, fh)==1);
+	
+	for (j=0;(j<listNum)&&(ok);j++)
+	{
+		ok = (fwrite(lists[j].name, 1, MAX_NAME_LEN, fh)==MAX_NAME_LEN)
+			 &&(fwrite(&(lists[j].itemNum), sizeof(int), 1, fh)==1)
+			 &&(fwrite(lists[j].values, sizeof(double), lists[j].itemNum, fh)==(size_t)lists[j].itemNum);
+	}
+	
+	for (i=0;(i<groupNum)&&(ok);i++)
+	{
+		ok = (fwrite(groups[order[i]].name, 1, MAX_NAME_LEN, fh)==MAX_NAME_LEN)
+			 &&(fwrite(&(groups[order[i]].itemNum), sizeof(int), 1, fh)==1)
+			 &&(fwrite(&(groups[order[i]].loValue), sizeof(double), 1, fh)==1)
+			 &&(fwrite(groups[order[i]].items, sizeof(ITEM_STRUCT), groups[order[i]].itemNum, fh)==(size_t)groups[order[i]].itemNum);
+	}
+	
+	ok = ok&&(fwrite(sortedNull, sizeof(double), nullNum, fh)==(size_t)nullNum);
+	ok = (fclose(fh)==0)&&ok;
+	
+	MemFree(order);
+	
+	if ((!ok)||(rename(tmpFileName, fileName)!=0))
+	{
+		printf("Cannot write state %s\n", fileName);
+		remove(tmpFileName);
+		return -1;
+	}
+	
+	return 1;
+}
+
+//Load the state of an RRA run saved by SaveState. Groups are allocated in *pGroups in the order of input, and the null distribution in *pSortedNull.
+//Return the number of items, or -1 if failure
+int LoadState(char *fileName, GROUP_STRUCT **pGroups, int *groupNum, LIST_STRUCT *lists, int maxListNum, int *listNum, int *aggregator,
+			  double *maxPercentile, double **pSortedNull, int *nullNum)
+{
+	FILE *fh;
+	char magic[8];
+	GROUP_STRUCT *groups;
+	int i, j, ok, itemNum;
+	
+	fh = (FILE *)fopen(fileName, "rb");
+	
+	if (!fh)
+	{
+		printf("Cannot open state %s\n", fileName);
+		return -1;
+	}
+	
+	ok = (fread(magic, 1, 8, fh)==8)&&(memcmp(magic, STATE_MAGIC, 8)==0)
+		 &&(fread(aggregator, sizeof(int), 1, fh)==1)
+		 &&(fread(maxPercentile, sizeof(double), 1, fh)==1)
+		 &&(fread(listNum, sizeof(int), 1, fh)==1)
+		 &&(fread(groupNum, sizeof(int), 1, fh)==1)
+		 &&(fread(nullNum, sizeof(int), 1, fh)==1)
+		 &&(*aggregator>=0)&&(*aggregator<AGG_KERNEL_NUM)&&(*listNum>0)&&(*listNum<maxListNum)&&(*groupNum>0)&&(*nullNum>0);
+	
+	groups = ok?(GROUP_STRUCT *)MemCalloc(MEM_GROUPS, *groupNum, sizeof(GROUP_STRUCT)):NULL;
+	*pSortedNull = ok?(double *)MemAlloc(MEM_NULL, (long)(*nullNum)*sizeof(double)):NULL;
+	ok = ok&&(groups)&&(*pSortedNull);
+	itemNum = 0;
+	
+	for (j=0;(j<*listNum)&&(ok);j++)
+	{
+		lists[j].values = NULL;
+		ok = (fread(lists[j].name, 1, MAX_NAME_LEN, fh)==MAX_NAME_LEN)
+			 &&(fread(&(lists[j].itemNum), sizeof(int), 1, fh)==1)
+			 &&(lists[j].itemNum>0);
+		
+		lists[j].values = ok?(double *)MemAlloc(MEM_LISTS, (long)lists[j].itemNum*sizeof(double)):NULL;
+		ok = ok&&(lists[j].values)&&(fread(lists[j].values, sizeof(double), lists[j].itemNum, fh)==(size_t)lists[j].itemNum);
+		lists[j].name[MAX_NAME_LEN-1] = 0;
+	}
+	
+	for (i=0;(i<*groupNum)&&(ok);i++)
+	{
+		ok = (fread(groups[i].name, 1, MAX_NAME_LEN, fh)==MAX_NAME_LEN)
+			 &&(fread(&(groups[i].itemNum), sizeof(int), 1, fh)==1)
+			 &&(fread(&(groups[i].loValue), sizeof(double), 1, fh)==1)
+			 &&(groups[i].itemNum>0);
+		
+		groups[i].items = ok?(ITEM_STRUCT *)MemAlloc(MEM_GROUPS, groups[i].itemNum*sizeof(ITEM_STRUCT)):NULL;
+		ok = ok&&(groups[i].items)&&(fread(groups[i].items, sizeof(ITEM_STRUCT), groups[i].itemNum, fh)==(size_t)groups[i].itemNum);
+		groups[i].name[MAX_NAME_LEN-1] = 0;
+		groups[i].index = i;
+		groups[i].fdr = 1.0;
+		itemNum += groups[i].itemNum;
+	}
+	
+	ok = ok&&(fread(*pSortedNull, sizeof(double), *nullNum, fh)==(size_t)(*nullNum));
+	
+	fclose(fh);
+	
+	*pGroups = groups;
+	
+	if (!ok)
+	{
+		printf("Cannot read state %s\n", fileName);
+		return -1;
+	}
+	
+	return itemNum;
+}
+
+//Apply a patch of changed rows, in the input format with a header, to the groups and sorted lists of a state. A row replaces the value of
+//the item of the same id, group and list, adds the item to its group if it is new, or drops the item if the value is NA. Percentiles are
+//recomputed only for the items whose rank can shift: those within the range of a changed value, or all items of a list that changed size.
+//Groups whose score can change are flagged in *pRescore, allocated with one flag per group: those with a dropped item, or with a changed
+//percentile up to cutoff before or after the change, or with a changed percentile and none up to cutoff. cutoff is the maximum percentile
+//for RRA, whose lo-values ignore larger percentiles, and 1 for the other aggregators. Groups left without items are removed.
+//Return the number of rows applied, or -1 if failure
+int ApplyPatch(char *fileName, GROUP_STRUCT **pGroups, int *groupNum, LIST_STRUCT *lists, int listNum, double cutoff, char **pRescore)
+{
+	READER_STRUCT *reader;
+	GROUP_STRUCT *groups, *tmpGroups;
+	ITEM_STRUCT *item, *tmpItems;
+	DICT_STRUCT *groupDict, *listDict, *itemDict;
+	RANK_SHIFT *shifts, *tmpShifts;
+	char **words, *line, *rescore, *sizeChanged;
+	char key[2*MAX_NAME_LEN+2];
+	ITEM_REF *itemRefs;
+	int *capacities, *shiftStarts;
+	int i, j, k, m, n, wordNum, rowNum, shiftNum, shiftCapacity, itemCapacity, shiftLo, shiftHi, changed, below, flag;
+	double value, percentile;
+	
+	reader = ReaderOpen(fileName);
+	words = AllocWords(255, MAX_NAME_LEN+1);
+	
+	if ((!reader)||(!words))
+	{
+		return -1;
+	}
+	
+	groups = *pGroups;
+	groupDict = DictCreate(1024);
+	listDict = DictCreate(16);
+	itemDict = DictCreate(4096);
+	itemCapacity = 4096;
+	itemRefs = (ITEM_REF *)MemAlloc(MEM_WORK, itemCapacity*sizeof(ITEM_REF));
+	capacities = (int *)MemAlloc(MEM_WORK, listNum*sizeof(int));
+	sizeChanged = (char *)MemCalloc(MEM_WORK, listNum, sizeof(char));
+	shiftStarts = (int *)MemAlloc(MEM_WORK, (listNum+1)*sizeof(int));
+	shiftCapacity = 1024;
+	shifts = (RANK_SHIFT *)MemAlloc(MEM_WORK, shiftCapacity*sizeof(RANK_SHIFT));
+	rescore = NULL;
+	shiftNum = 0;
+	rowNum = 0;
+	
+	flag = ((groupDict)&&(listDict)&&(itemDict)&&(itemRefs)&&(capacities)&&(sizeChanged)&&(shiftStarts)&&(shifts))?1:-1;
+	
+	//groups and lists keep their indices as dictionary ids; items are found by their id, group and list, as an id may be in several groups
+	for (j=0;(j<listNum)&&(flag>0);j++)
+	{
+		flag = DictInsert(listDict, lists[j].name)==j?1:-1;
+		capacities[j] = lists[j].itemNum;
+	}
+	
+	for (i=0;(i<*groupNum)&&(flag>0);i++)
+	{
+		flag = DictInsert(groupDict, groups[i].name)==i?1:-1;
+		
+		for (k=0;(k<groups[i].itemNum)&&(flag>0);k++)
+		{
+			snprintf(key, sizeof(key), "%s\t%d\t%d", groups[i].items[k].name, i, groups[i].items[k].listIndex);
+			
+			//the item of a row would be ambiguous if an id were twice in the same group and list
+			if (DictLookup(itemDict, key)>=0)
+			{
+				printf("item id %s is in group %s and list %s more than once, so the item of a row is ambiguous\n",
+					   groups[i].items[k].name, groups[i].name, lists[groups[i].items[k].listIndex].name);
+				flag = -1;
+				break;
+			}
+			
+			flag = RecordItem(itemDict, key, i, k, &itemRefs, &itemCapacity);
+		}
+	}
+	
+	if (flag<0)
+	{
+		printf("Cannot index the items of the state\n");
+	}
+	
+	//header row
+	line = flag>0?ReaderGetLine(reader):NULL;
+	line = line?ReaderGetLine(reader):NULL;
+	wordNum = line?StringToWords(words, line, MAX_NAME_LEN+1, 255, " \t\r\n\v\f"):0;
+	
+	//the loop ends on the line read, not on ReaderAtEnd, which a final line without newline already sets
+	while ((flag>0)&&(line)&&(wordNum==4))
+	{
+		j = DictLookup(listDict, words[2]);
+		
+		if (j<0)
+		{
+			printf("list %s of item %s is not in the state\n", words[2], words[0]);
+			flag = -1;
+			break;
+		}
+		
+		i = DictLookup(groupDict, words[1]);
+		snprintf(key, sizeof(key), "%s\t%d\t%d", words[0], i, j);
+		n = i>=0?DictLookup(itemDict, key):-1;
+		item = (n>=0)&&(itemRefs[n].group>=0)?groups[itemRefs[n].group].items+itemRefs[n].position:NULL;
+		value = atof(words[3]);
+		
+		if ((!item)&&(strcmp(words[3], "NA")==0))
+		{
+			printf("item %s of group %s and list %s to drop is not in the state\n", words[0], words[1], words[2]);
+			flag = -1;
+			break;
+		}
+		
+		if (shiftNum>=shiftCapacity)
+		{
+			shiftCapacity *= 2;
+			tmpShifts = (RANK_SHIFT *)MemRealloc(MEM_WORK, shifts, shiftCapacity*sizeof(RANK_SHIFT));
+			flag = tmpShifts?1:-1;
+			shifts = tmpShifts?tmpShifts:shifts;
+		}
+		
+		if (flag<0)
+		{
+			break;
+		}
+		
+		if (item)
+		{
+			flag = ListRemoveValue(lists+j, item->value);
+		}
+		
+		if ((flag>0)&&(strcmp(words[3], "NA")==0))
+		{
+			//dropped items are removed from their group below
+			item->listIndex = -1;
+			itemRefs[n].group = -1;
+			sizeChanged[j] = 1;
+		}
+		else if ((flag>0)&&(item))
+		{
+			flag = ListInsertValue(lists+j, capacities+j, value);
+			shifts[shiftNum].listIndex = j;
+			shifts[shiftNum].lo = value<item->value?value:item->value;
+			shifts[shiftNum].hi = value<item->value?item->value:value;
+			shiftNum++;
+			item->value = value;
+		}
+		else if (flag>0)
+		{
+			flag = ListInsertValue(lists+j, capacities+j, value);
+			i = DictInsert(groupDict, words[1]);
+			
+			if ((flag>0)&&(i>=*groupNum))
+			{
+				tmpGroups = (GROUP_STRUCT *)MemRealloc(MEM_GROUPS, groups, (*groupNum+1)*sizeof(GROUP_STRUCT));
+				flag = tmpGroups?1:-1;
+				groups = tmpGroups?tmpGroups:groups;
+				
+				if (flag>0)
+				{
+					memset(groups+*groupNum, 0, sizeof(GROUP_STRUCT));
+					snprintf(groups[*groupNum].name, MAX_NAME_LEN, "%s", words[1]);
+					groups[*groupNum].index = *groupNum;
+					(*groupNum)++;
+				}
+			}
+			
+			tmpItems = flag>0?(ITEM_STRUCT *)MemRealloc(MEM_GROUPS, groups[i].items, (groups[i].itemNum+1)*sizeof(ITEM_STRUCT)):NULL;
+			flag = tmpItems?1:-1;
+			
+			if (flag>0)
+			{
+				groups[i].items = tmpItems;
+				item = groups[i].items+groups[i].itemNum;
+				snprintf(item->name, MAX_NAME_LEN, "%s", words[0]);
+				item->listIndex = j;
+				item->value = value;
+				item->percentile = -1.0;
+				groups[i].itemNum++;
+				sizeChanged[j] = 1;
+				snprintf(key, sizeof(key), "%s\t%d\t%d", words[0], i, j);
+				flag = RecordItem(itemDict, key, i, groups[i].itemNum-1, &itemRefs, &itemCapacity);
+			}
+		}
+		
+		if (flag<0)
+		{
+			printf("Cannot apply row %d of the patch\n", rowNum+1);
+			break;
+		}
+		
+		rowNum++;
+		line = ReaderGetLine(reader);
+		wordNum = line?StringToWords(words, line, MAX_NAME_LEN+1, 255, " \t\r\n\v\f"):0;
+	}
+	
+	if ((ReaderClose(reader)<0)||(flag<0))
+	{
+		flag = -1;
+	}
+	
+	//changed ranges are merged by list, so that an item is checked against the ranges of its list by a binary search
+	if (flag>0)
+	{
+		qsort(shifts, shiftNum, sizeof(RANK_SHIFT), CompareRankShift);
+		
+		m = 0;
+		
+		for (k=0;k<shiftNum;k++)
+		{
+			if ((m>0)&&(shifts[m-1].listIndex==shifts[k].listIndex)&&(shifts[k].lo<=shifts[m-1].hi+RANK_SHIFT_MARGIN))
+			{
+				shifts[m-1].hi = shifts[k].hi>shifts[m-1].hi?shifts[k].hi:shifts[m-1].hi;
+			}
+			else
+			{
+				shifts[m] = shifts[k];
+				m++;
+			}
+		}
+		
+		shiftNum = m;
+		
+		for (j=0,k=0;j<=listNum;j++)
+		{
+			while ((k<shiftNum)&&(shifts[k].listIndex<j))
+			{
+				k++;
+			}
+			
+			shiftStarts[j] = k;
+		}
+		
+		rescore = (char *)MemCalloc(MEM_WORK, *groupNum, sizeof(char));
+		flag = rescore?1:-1;
+	}
+	
+	for (i=0;(i<*groupNum)&&(flag>0);i++)
+	{
+		n = 0;
+		changed = 0;
+		below = 1;
+
+		for (k=0;k<groups[i].itemNum;k++)
+		{
+			item = groups[i].items+k;
+			j = item->listIndex;
+			
+			if (j<0)
+			{
+				rescore[i] = 1;
+				continue;
+			}
+			
+			groups[i].items[n] = *item;
+			item = groups[i].items+n;
+			n++;
+			
+			if (!sizeChanged[j])
+			{
+				//last merged range of the list starting at or below the value
+				shiftLo = shiftStarts[j];
+				shiftHi = shiftStarts[j+1];
+				
+				while (shiftLo<shiftHi)
+				{
+					m = shiftLo+(shiftHi-shiftLo)/2;
+					
+					if (shifts[m].lo-RANK_SHIFT_MARGIN<=item->value)
+					{
+						shiftLo = m+1;
+					}
+					else
+					{
+						shiftHi = m;
+					}
+				}
+				
+				if ((shiftLo==shiftStarts[j])||(item->value>shifts[shiftLo-1].hi+RANK_SHIFT_MARGIN))
+				{
+					continue;
+				}
+			}
+			
+			percentile = ListPercentile(item->value, lists[j].values, lists[j].itemNum);
+			
+			if (percentile!=item->percentile)
+			{
+				//a percentile above the cutoff before and after the change does not enter the lo-value
+				rescore[i] = ((item->percentile<=cutoff)||(percentile<=cutoff))?1:rescore[i];
+				item->percentile = percentile;
+				changed = 1;
+			}
+		}
+		
+		groups[i].itemNum = n;
+		
+		//unless no percentile of the group is within the cutoff, and the smallest one is used instead
+		for (k=0,below=0;(changed)&&(!rescore[i])&&(k<n);k++)
+		{
+			below = groups[i].items[k].percentile<=cutoff?1:below;
+		}
+		
+		rescore[i] = ((changed)&&(!below))?1:rescore[i];
+	}
+	
+	//groups left without items are removed, keeping the order of input
+	for (i=0,n=0;(i<*groupNum)&&(flag>0);i++)
+	{
+		if (groups[i].itemNum==0)
+		{
+			MemFree(groups[i].items);
+			continue;
+		}
+		
+		groups[n] = groups[i];
+		groups[n].index = n;
+		rescore[n] = rescore[i];
+		n++;
+	}
+	
+	if (flag>0)
+	{
+		*groupNum = n;
+	}
+	
+	DictFree(groupDict);
+	DictFree(listDict);
+	DictFree(itemDict);
+	FreeWords(words, 255);
+	MemFree(itemRefs);
+	MemFree(capacities);
+	MemFree(sizeChanged);
+	MemFree(shiftStarts);
+	MemFree(shifts);
+	
+	*pGroups = groups;
+	*pRescore = rescore;
+	
+	return flag>0?rowNum:-1;
+}
+
+//Recompute the score of aggregator of the groups flagged in rescore, from the percentiles of their items. Return 1 if success, -1 if failure
+int RescoreGroups(GROUP_STRUCT *groups, int groupNum, const char *rescore, int aggregator, double maxPercentile)
+{
+	LO_BATCH_STRUCT *batch;
+	double *tmpF;
+	int i, k, maxItemNum, flag;
+	
+	maxItemNum = 0;
+	
+	for (i=0;i<groupNum;i++)
+	{
+		maxItemNum = groups[i].itemNum>maxItemNum?groups[i].itemNum:maxItemNum;
+	}
+	
+	tmpF = (double *)MemAlloc(MEM_WORK, maxItemNum*sizeof(double));
+	batch = LoBatchCreate(aggregator, maxItemNum, maxPercentile);
+	flag = ((tmpF)&&(batch))?1:-1;
+	
+	for (i=0;(i<groupNum)&&(flag>0);i++)
+	{
+		if (!rescore[i])
+		{
+			continue;
+		}
+		
+		for (k=0;k<groups[i].itemNum;k++)
+		{
+			tmpF[k] = groups[i].items[k].percentile;
+		}
+		
+		flag = LoBatchAdd(batch, tmpF, groups[i].itemNum, &(groups[i].loValue));
+	}
+	
+	if (flag>0)
+	{
+		flag = LoBatchFlush(batch);
+	}
+	
+	MemFree(tmpF);
+	LoBatchFree(batch);
+	
+	return flag;
+}
+
+//Sort groups by lo-value and compute their false discovery rates against a null distribution of nullNum lo-values sorted in ascending order
+void RankFDR(GROUP_STRUCT *groups, int groupNum, double *sortedNull, int nullNum)
+{
+	int i;
+	
+	QuickSortGroupByLoValue(groups, 0, groupNum-1);
+	
+	for (i=0;i<groupNum;i++)
+	{
+		groups[i].fdr = NullRankFDR(groups[i].loValue, i, groupNum, sortedNull, nullNum);
+	}
+	
+	if (groups[groupNum-1].fdr>1.0)
+	{
+		groups[groupNum-1].fdr = 1.0;
+	}
+	
+	for (i=groupNum-2;i>=0;i--)
+	{
+		if (groups[i].fdr>groups[i+1].fdr)
+		{
+			groups[i].fdr = groups[i+1].fdr;
+		}
+	}
+}
+
+//Subcommand update: apply a patch to the state of an earlier run, rescore the affected groups and compute false discovery rates against
+//the null distribution of the state. Return 0 if success, -1 if failure. argv[1] is "update"
+int UpdateMain(int argc, const char *argv[])
+{
+	int i, flag, threadNum, groupNum, listNum, nullNum, aggregator, rowNum, rescoreNum;
+	char stateFileName[1000], patchFileName[1000], outputFileName[1000], saveFileName[1000];
+	double maxPercentile, cutoff, *sortedNull;
+	char *rescore;
+	GROUP_STRUCT *groups;
+	LIST_STRUCT *lists;
+	THREAD_POOL_STRUCT *pool;
+	PERF_SAMPLE perf;
+	
+	stateFileName[0] = 0;
+	patchFileName[0] = 0;
+	outputFileName[0] = 0;
+	saveFileName[0] = 0;
+	threadNum = GetCPUNum();
+	
+	for (i=3;i<argc;i++)
+	{
+		if (strcmp(argv[i-1], "-s")==0)
+		{
+			strcpy(stateFileName, argv[i]);
+		}
+		if (strcmp(argv[i-1], "--patch")==0)
+		{
+			strcpy(patchFileName, argv[i]);
+		}
+		if (strcmp(argv[i-1], "-o")==0)
+		{
+			strcpy(outputFileName, argv[i]);
+		}
+		if (strcmp(argv[i-1], "--save-state")==0)
+		{
+			strcpy(saveFileName, argv[i]);
+		}
+		if (strcmp(argv[i-1], "-t")==0)
+		{
+			threadNum = atoi(argv[i]);
+		}
+	}
+	
+	if ((stateFileName[0]==0)||(patchFileName[0]==0)||(outputFileName[0]==0))
+	{
+		printf("Command error!\n");
+		PrintUpdateUsage(argv[0]);
+		return -1;
+	}
+	
+	if ((IsStdStream(outputFileName))&&(OutUseStdout()<0))
+	{
+		return -1;
+	}
+	
+	if (threadNum<1)
+	{
+		printf("number of threads should be at least 1\n");
+		printf("program exit!\n");
+		return -1;
+	}
+	
+	lists = (LIST_STRUCT *)MemAlloc(MEM_LISTS, MAX_LIST_NUM*sizeof(LIST_STRUCT));
+	pool = ThreadPoolCreate(threadNum);
+	
+	if ((!lists)||(!pool))
+	{
+		printf("program exit!\n");
+		return -1;
+	}
+	
+	printf("loading state...");
+	
+	if (LoadState(stateFileName, &groups, &groupNum, lists, MAX_LIST_NUM, &listNum, &aggregator, &maxPercentile, &sortedNull, &nullNum)<=0)
+	{
+		printf("\nfailed.\n");
+		printf("program exit!\n");
+		
+		return -1;
+	}
+	else
+	{
+		printf("done.\n");
+	}
+	
+	printf("applying patch...");
+	
+	PerfBegin(&perf);
+	cutoff = ((aggregator==AGG_RRA)||(aggregator==AGG_ALPHA_RRA))?maxPercentile:1.0;
+	rowNum = ApplyPatch(patchFileName, &groups, &groupNum, lists, listNum, cutoff, &rescore);
+	PerfEnd(&perf, "ApplyPatch");
+	
+	if ((rowNum<0)||(groupNum==0))
+	{
+		printf("\nfailed.\n");
+		printf("program exit!\n");
+		
+		return -1;
+	}
+	
+	rescoreNum = 0;
+	
+	for (i=0;i<groupNum;i++)
+	{
+		rescoreNum += rescore[i];
+	}
+	
+	printf("done.\n%d rows applied, %d of %d groups to rescore\n", rowNum, rescoreNum, groupNum);
+	
+	printf("rescoring groups...");
+	
+	PerfBegin(&perf);
+	flag = RescoreGroups(groups, groupNum, rescore, aggregator, maxPercentile);
+	PerfEnd(&perf, "RescoreGroups");
+	
+	if (flag<=0)
+	{
+		printf("\nfailed.\n");
+		printf("program exit!\n");
+		
+		return -1;
+	}
+	else
+	{
+		printf("done.\n");
+	}
+	
+	printf("computing false discovery rate against the null of the state...");
+	
+	RankFDR(groups, groupNum, sortedNull, nullNum);
+	
+	printf("done.\n");
+	
+	printf("save to output file...");
+	
+	TraceBegin("output");
+	flag = SaveGroupInfo(outputFileName, groups, groupNum, pool);
+	TraceEnd("output");
+	
+	if (flag<=0)
+	{
+		printf("\nfailed.\n");
+		printf("program exit!\n");
+		
+		return -1;
+	}
+	else
+	{
+		printf("done.\n");
+	}
+	
+	if (saveFileName[0])
+	{
+		printf("save state...");
+		
+		if (SaveState(saveFileName, groups, groupNum, lists, listNum, aggregator, maxPercentile, sortedNull, nullNum)<=0)
+		{
+			printf("\nfailed.\n");
+			printf("program exit!\n");
+			
+			return -1;
+		}
+		else
+		{
+			printf("done.\n");
+		}
+	}
+	
+	printf("finished.\n");
+	
+	ThreadPoolDestroy(pool);
 	
-	fh = (FILE *)fopen(fileName, "w");
+	PerfReport(stdout);
 	
-	if (!fh)
+	for (i=0;i<groupNum;i++)
 	{
-		printf("Cannot open %s.\n", fileName);
-		return -1;
+		MemFree(groups[i].items);
 	}
 	
-	fprintf(fh, "group_id\t#_items_in_group\tlo_value\tFDR\n");
-	
-	for (i=0;i<groupNum;i++)
+	for (i=0;i<listNum;i++)
 	{
-		fprintf(fh, "%s\t%d\t%10.4e\t%f\n", groups[i].name, groups[i].itemNum, groups[i].loValue, groups[i].fdr);
+		MemFree(lists[i].values);
 	}
 	
-	fclose(fh);
+	MemFree(groups);
+	MemFree(lists);
+	MemFree(rescore);
+	MemFree(sortedNull);
 	
-	return 1;
+	return 0;
 }
 
-//Process groups by computing percentiles for each item and lo-values for each group
-int ProcessGroups(GROUP_STRUCT *groups, int groupNum, LIST_STRUCT *lists, int listNum, double maxPercentile)
+//print the usage of subcommand update
+void PrintUpdateUsage(const char *command)
 {
-	int i,j;
-	int listIndex, index1, index2;
-	int maxItemPerGroup;
-	double *tmpF;
+	printf("%s update - Update the results of an RRA run whose state was saved with --save-state, after some items changed.\n", command);
+	printf("usage:\n");
+	printf("-s <state file>\n");
+	printf("--patch <patch file>, - for standard input. Format as the input, with a header: <item id> <group id> <list id> <value>. A row sets the value of the item of the same id in the group and the list, adds the item to its group if it is new, or drops it if the value is NA\n");
+	printf("-o <output file>, - for standard output. Format as RRA. Only the groups whose percentiles changed are rescored; false discovery rates are computed against the null distribution of the state. ");
+	printf("When only values change, the results are those of a full run on the patched input\n");
+	printf("--save-state <state file>. Save the updated state, for further updates. May be the state file given by -s\n");
+	printf("-t <number of threads>. Default: number of online CPUs\n");
+	printf("example:\n");
+	printf("%s -i input.txt -o output.txt --save-state screen.state\n", command);
+	printf("%s update -s screen.state --patch qc_fixes.txt -o output.txt --save-state screen.state\n", command);
+
+}
+
+//Subcommand query: print one gene across all screens of a result store, the top hits of one screen, or the screens. Return 0 if success, -1 if failure
+//argv[1] is "query"
+int QueryMain(int argc, const char *argv[])
+{
+	int i, row, screenIndex, geneId, topNum;
+	char storeFileName[1000], geneName[1000], screenName[1000], timeText[64];
+	RESULT_STORE *store;
+	STORE_SEGMENT segment;
+	const STORE_SCREEN *screen;
+	time_t created;
 	
-	maxItemPerGroup = 0;
+	storeFileName[0] = 0;
+	geneName[0] = 0;
+	screenName[0] = 0;
+	topNum = 20;
 	
-	for (i=0;i<groupNum;i++)
+	for (i=3;i<argc;i++)
 	{
-		if (groups[i].itemNum>maxItemPerGroup)
+		if (strcmp(argv[i-1], "-s")==0)
 		{
-			maxItemPerGroup = groups[i].itemNum;
+			strcpy(storeFileName, argv[i]);
+		}
+		if (strcmp(argv[i-1], "-g")==0)
+		{
+			strcpy(geneName, argv[i]);
+		}
+		if (strcmp(argv[i-1], "-c")==0)
+		{
+			strcpy(screenName, argv[i]);
+		}
+		if (strcmp(argv[i-1], "-n")==0)
+		{
+			topNum = atoi(argv[i]);
 		}
 	}
 	
-	assert(maxItemPerGroup>0);
+	if ((storeFileName[0]==0)||((geneName[0])&&(screenName[0])))
+	{
+		printf("Command error!\n");
+		PrintQueryUsage(argv[0]);
+		return -1;
+	}
 	
-	tmpF = (double *)malloc(maxItemPerGroup*sizeof(double));
+	store = StoreOpen(storeFileName);
 	
-	for (i=0;i<listNum;i++)
+	if (!store)
 	{
-		QuicksortF(lists[i].values, 0, lists[i].itemNum-1);
+		return -1;
 	}
 	
-	for (i=0;i<groupNum;i++)
+	if (geneName[0])
 	{
-		//Compute percentile for each item
+		//one probe of the gene index, then one row lookup per screen
+		geneId = StoreFindGene(store, geneName);
 		
-		for (j=0;j<groups[i].itemNum;j++)
+		printf("screen\tgroup_id\t#_items_in_group\tlo_value\tFDR\trank\t#_groups\n");
+		
+		for (i=0;(geneId>=0)&&(i<store->trailer.screenNum);i++)
 		{
-			listIndex = groups[i].items[j].listIndex;
+			if (StoreSegment(store, i, &segment)<0)
+			{
+				printf("screen %s of the result store is damaged\n", store->screens[i].name);
+				StoreClose(store);
+				return -1;
+			}
 			
-			index1 = bTreeSearchingF(groups[i].items[j].value-0.000000001, lists[listIndex].values, 0, lists[listIndex].itemNum-1);
-			index2 = bTreeSearchingF(groups[i].items[j].value+0.000000001, lists[listIndex].values, 0, lists[listIndex].itemNum-1);
+			row = StoreGeneRow(store, i, &segment, geneId);
 			
-			groups[i].items[j].percentile = ((double)index1+index2+1)/(lists[listIndex].itemNum*2);
-			tmpF[j] = groups[i].items[j].percentile;
+			if (row>=0)
+			{
+				printf("%s\t%s\t%d\t%10.4e\t%f\t%d\t%d\n", store->screens[i].name, geneName, segment.itemNums[row],
+					   segment.loValues[row], segment.fdrs[row], row+1, store->screens[i].groupNum);
+			}
 		}
-		
-		ComputeLoValue(tmpF, groups[i].itemNum, &(groups[i].loValue), maxPercentile);
-	}
-	
-	return 1;
-}
-
-//Compute lo-value based on an array of percentiles. Return 1 if success, 0 if failure
-int ComputeLoValue(double *percentiles,     //array of percentiles
-				   int num,                 //length of array
-				   double *loValue,         //pointer to the output lo-value
-				   double maxPercentile)   //maximum percentile, computation stops when maximum percentile is reached
-{
-	int i;
-	double *tmpArray;
-	double tmpLoValue, tmpF;
-	
-	assert(num>0);
-	
-	tmpArray = (double *)malloc(num*sizeof(double));
-	
-	if (!tmpArray)
-	{
-		return -1;
 	}
-	
-	memcpy(tmpArray, percentiles, num*sizeof(double));
-	
-	QuicksortF(tmpArray, 0, num-1);
-	
-	tmpLoValue = 1.0;
-	
-	for (i=0;i<num;i++)
+	else if (screenName[0])
 	{
-		if ((tmpArray[i]>maxPercentile)&&(i>0))
+		screenIndex = StoreFindScreen(store, screenName);
+		
+		if ((screenIndex<0)||(StoreSegment(store, screenIndex, &segment)<0))
 		{
-			break;
+			printf("screen %s is not in the result store\n", screenName);
+			StoreClose(store);
+			return -1;
+		}
+		
+		screen = store->screens+screenIndex;
+		
+		printf("screen\tgroup_id\t#_items_in_group\tlo_value\tFDR\trank\t#_groups\n");
+		
+		//rows are stored by lo-value, so the top hits are the first rows
+		for (row=0;(row<topNum)&&(row<screen->groupNum);row++)
+		{
+			printf("%s\t%s\t%d\t%10.4e\t%f\t%d\t%d\n", screen->name, StoreGeneName(store, segment.geneIds[row]), segment.itemNums[row],
+				   segment.loValues[row], segment.fdrs[row], row+1, screen->groupNum);
 		}
-		tmpF = BetaNoncentralCdf((double)(i+1),(double)(num-i),0.0,tmpArray[i],CDF_MAX_ERROR);
-		if (tmpF<tmpLoValue)
+	}
+	else
+	{
+		printf("screen\tsource\tcreated\t#_items\t#_groups\t#_lists\tmax_percentile\n");
+		
+		for (i=0;i<store->trailer.screenNum;i++)
 		{
-			tmpLoValue = tmpF;
+			screen = store->screens+i;
+			created = (time_t)screen->created;
+			strftime(timeText, sizeof(timeText), "%Y-%m-%d %H:%M:%S", localtime(&created));
+			
+			printf("%s\t%s\t%s\t%d\t%d\t%d\t%f\n", screen->name, screen->source, timeText, screen->itemNum,
+				   screen->groupNum, screen->listNum, screen->maxPercentile);
 		}
 	}
 	
-	*loValue = tmpLoValue;
-
-	free(tmpArray);
+	StoreClose(store);
 	
 	return 0;
+}
+
+//Format one row of the output of meta. Return 1 if success, -1 if failure
+static int FormatMetaRow(OUT_BUFFER *buffer, void *data, int row)
+{
+	META_OUTPUT *output = (META_OUTPUT *)data;
+	int geneId = output->order[row].index;
+	META_RESULT *result = output->results+geneId;
 	
+	return OutBufferPrintf(buffer, "%s\t%d\t%10.4e\t%10.4e\t%f\n", StoreGeneName(output->store, geneId), result->screenNum,
+						   result->loValue, result->pValue, result->fdr);
 }
 
-//Compute False Discovery Rate based on uniform distribution
-int ComputeFDR(GROUP_STRUCT *groups, int groupNum, double maxPercentile, int numOfRandPass)
+//Subcommand meta: aggregate the ranks of each gene across the screens of a result store by a second-level RRA. Return 0 if success, -1 if failure
+//argv[1] is "meta"
+int MetaMain(int argc, const char *argv[])
 {
-	int i,j,k;
-	double *tmpPercentile;
-	int maxItemNum = 0;
-	int scanPass = numOfRandPass/groupNum+1;
-	double *randLoValue;
-	int randLoValueNum;
+	int i, geneNum, nullNum, threadNum, flag;
+	char storeFileName[1000], outputFileName[1000];
+	double maxPercentile;
+	RESULT_STORE *store;
+	THREAD_POOL_STRUCT *pool;
+	META_OUTPUT output;
+	OUT_WRITER_STRUCT *writer;
+	OUT_BUFFER header;
+	PERF_SAMPLE perf;
 	
-	for (i=0;i<groupNum;i++)
+	storeFileName[0] = 0;
+	outputFileName[0] = 0;
+	maxPercentile = 0.1;
+	nullNum = META_NULL_NUM;
+	threadNum = GetCPUNum();
+	
+	for (i=3;i<argc;i++)
 	{
-		if (groups[i].itemNum>maxItemNum)
+		if (strcmp(argv[i-1], "-s")==0)
 		{
-			maxItemNum = groups[i].itemNum;
+			strcpy(storeFileName, argv[i]);
+		}
+		if (strcmp(argv[i-1], "-o")==0)
+		{
+			strcpy(outputFileName, argv[i]);
+		}
+		if (strcmp(argv[i-1], "-p")==0)
+		{
+			maxPercentile = atof(argv[i]);
+		}
+		if (strcmp(argv[i-1], "-n")==0)
+		{
+			nullNum = atoi(argv[i]);
+		}
+		if (strcmp(argv[i-1], "-t")==0)
+		{
+			threadNum = atoi(argv[i]);
 		}
 	}
 	
-	assert(maxItemNum>0);
+	if ((storeFileName[0]==0)||(outputFileName[0]==0))
+	{
+		printf("Command error!\n");
+		PrintMetaUsage(argv[0]);
+		return -1;
+	}
+	
+	if ((IsStdStream(outputFileName))&&(OutUseStdout()<0))
+	{
+		return -1;
+	}
 	
-	tmpPercentile = (double *)malloc(maxItemNum*sizeof(double));
+	if ((maxPercentile>1.0)||(maxPercentile<0.0)||(nullNum<=0)||(threadNum<1))
+	{
+		printf("maxPercentile should be within 0.0 and 1.0, and the null size and number of threads positive\n");
+		printf("program exit!\n");
+		return -1;
+	}
 	
-	randLoValueNum = groupNum*scanPass;
+	store = StoreOpen(storeFileName);
+	pool = ThreadPoolCreate(threadNum);
 	
-	assert(randLoValueNum>0);
+	if ((!store)||(!pool)||(store->trailer.geneNum==0))
+	{
+		printf("program exit!\n");
+		return -1;
+	}
 	
-	randLoValue = (double *)malloc(randLoValueNum*sizeof(double));
+	geneNum = store->trailer.geneNum;
 	
-	randLoValueNum = 0;
+	printf("aggregating %d genes over %d screens...", geneNum, store->trailer.screenNum);
 	
-	PlantSeeds(123456);
+	output.store = store;
+	output.results = (META_RESULT *)MemAlloc(MEM_GROUPS, geneNum*sizeof(META_RESULT));
+	output.order = (INDEXED_FLOAT *)MemAlloc(MEM_OUTPUT, geneNum*sizeof(INDEXED_FLOAT));
 	
-	for (i=0;i<scanPass;i++)
+	PerfBegin(&perf);
+	flag = ((output.results)&&(output.order))?MetaAggregate(store, maxPercentile, nullNum, pool, output.results):-1;
+	PerfEnd(&perf, "MetaAggregate");
+	
+	if (flag<=0)
 	{
-		for (j=0;j<groupNum;j++)
-		{
-			for (k=0;k<groups[j].itemNum;k++)
-			{
-				tmpPercentile[k] = Uniform(0.0, 1.0);
-			}
-			
-			ComputeLoValue(tmpPercentile, groups[j].itemNum,&(randLoValue[randLoValueNum]), maxPercentile);
-			
-			randLoValueNum++;
-		}
+		printf("\nfailed.\n");
+		printf("program exit!\n");
+		
+		return -1;
 	}
-	
-	QuicksortF(randLoValue, 0, randLoValueNum-1);
-						  
-	QuickSortGroupByLoValue(groups, 0, groupNum-1);
-	
-	for (i=0;i<groupNum;i++)
+	else
 	{
-		groups[i].fdr = (double)(bTreeSearchingF(groups[i].loValue-0.000000001, randLoValue, 0, randLoValueNum-1)
-								 +bTreeSearchingF(groups[i].loValue+0.000000001, randLoValue, 0, randLoValueNum-1)+1)
-								/2/randLoValueNum/((double)i+0.5)*groupNum;
+		printf("done.\n");
 	}
 	
-	if (groups[groupNum-1].fdr>1.0)
+	printf("save to output file...");
+	
+	//genes are written in order of p-value
+	for (i=0;i<geneNum;i++)
 	{
-		groups[groupNum-1].fdr = 1.0;
+		output.order[i].value = output.results[i].pValue;
+		output.order[i].index = i;
 	}
 	
-	for (i=groupNum-2;i>=0;i--)
+	QuicksortIndexedArray(output.order, 0, geneNum-1);
+	
+	writer = OutWriterOpen(outputFileName, 1+OutChunkNum(geneNum));
+	flag = writer?1:-1;
+	
+	if (writer)
 	{
-		if (groups[i].fdr>groups[i+1].fdr)
+		OutBufferInit(&header);
+		OutBufferPrintf(&header, "group_id\t#_screens\tlo_value\tp_value\tFDR\n");
+		OutWriterPut(writer, 0, &header);
+		
+		flag = OutWriterFormat(writer, pool, 1, geneNum, FormatMetaRow, &output);
+		
+		ThreadPoolWait(pool);
+		
+		if (OutWriterClose(writer)<0)
 		{
-			groups[i].fdr = groups[i+1].fdr;
+			flag = -1;
 		}
 	}
 	
-	free(tmpPercentile);
-	free(randLoValue);
+	if (flag<=0)
+	{
+		printf("\nfailed.\n");
+		printf("program exit!\n");
+		
+		return -1;
+	}
+	else
+	{
+		printf("done.\n");
+	}
+	
+	printf("finished.\n");
+	
+	ThreadPoolDestroy(pool);
 	
-	return 1;
+	PerfReport(stdout);
+	
+	MemFree(output.results);
+	MemFree(output.order);
+	StoreClose(store);
+	
+	return 0;
 }
 
 //QuickSort groups by loValue
@@ -649,3 +4313,175 @@ void QuickSortGroupByLoValue(GROUP_STRUCT *groups, int lo, int hi)
     if (i<hi) QuickSortGroupByLoValue(groups, i, hi);
 	
 }
+
+//Order groups by index, which is the order of input
+int CompareGroupIndex(const void *a, const void *b)
+{
+	const GROUP_STRUCT *groupA = (const GROUP_STRUCT *)a;
+	const GROUP_STRUCT *groupB = (const GROUP_STRUCT *)b;
+	
+	return (groupA->index>groupB->index)-(groupA->index<groupB->index);
+}
+
+//Score the groups of each of the groupingNum mapping files of groupFileNames, <item id> <group id> [<list id> [<input group id>]] with a header, by aggregator from the
+//percentiles of the items computed by ProcessGroups, each item ranked once for all groupings. Each grouping is saved as SaveGroupInfo does, to outputFileName
+//with .<grouping name> inserted before the extension. Groups without items in the input are not saved. Return 1 if success, -1 if failure
+int ScoreGroupFiles(char (*groupFileNames)[1000], int groupingNum, GROUP_STRUCT *groups, int groupNum, LIST_STRUCT *lists, int listNum, int aggregator,
+					double maxPercentile, char *outputFileName, THREAD_POOL_STRUCT *pool)
+{
+	GROUPING_ITEMS items;
+	GROUPING *groupings;
+	GROUP_STRUCT *savedGroups;
+	double *percentiles;
+	int *itemIds;
+	char fileName[1000];
+	int i, j, k, g, n, itemNum, savedNum, flag;
+	
+	itemNum = 0;
+	
+	for (i=0;i<groupNum;i++)
+	{
+		itemNum += groups[i].itemNum;
+	}
+	
+	memset(&items, 0, sizeof(GROUPING_ITEMS));
+	items.idDict = DictCreate(itemNum);
+	items.listDict = DictCreate(listNum);
+	items.groupDict = DictCreate(groupNum);
+	items.itemLists = (int *)MemAlloc(MEM_WORK, (long)itemNum*sizeof(int));
+	items.itemGroups = (int *)MemAlloc(MEM_WORK, (long)itemNum*sizeof(int));
+	items.idItems = (int *)MemAlloc(MEM_WORK, (long)itemNum*sizeof(int));
+	percentiles = (double *)MemAlloc(MEM_WORK, (long)itemNum*sizeof(double));
+	itemIds = (int *)MemAlloc(MEM_WORK, (long)itemNum*sizeof(int));
+	groupings = (GROUPING *)MemCalloc(MEM_GROUPS, groupingNum, sizeof(GROUPING));
+	
+	flag = ((items.idDict)&&(items.listDict)&&(items.groupDict)&&(items.itemLists)&&(items.itemGroups)&&(items.idItems)
+			&&(percentiles)&&(itemIds)&&(groupings))?1:-1;
+	
+	//list and group names are inserted in the order of the lists and the groups, so that the ids of a mapping file are found by their index
+	for (k=0;(k<listNum)&&(flag>0);k++)
+	{
+		flag = DictInsert(items.listDict, lists[k].name)==k?1:-1;
+	}
+	
+	for (i=0;(i<groupNum)&&(flag>0);i++)
+	{
+		flag = DictInsert(items.groupDict, groups[i].name)==i?1:-1;
+	}
+	
+	//the items of all groups in one array, indexed by their id, which may be repeated in several lists
+	n = 0;
+	
+	for (i=0;(i<groupNum)&&(flag>0);i++)
+	{
+		for (j=0;(j<groups[i].itemNum)&&(flag>0);j++)
+		{
+			itemIds[n] = DictInsert(items.idDict, groups[i].items[j].name);
+			items.itemLists[n] = groups[i].items[j].listIndex;
+			items.itemGroups[n] = i;
+			percentiles[n] = groups[i].items[j].percentile;
+			flag = itemIds[n]>=0?1:-1;
+			n++;
+		}
+	}
+	
+	items.idStart = flag>0?(int *)MemCalloc(MEM_WORK, items.idDict->num+2, sizeof(int)):NULL;
+	flag = items.idStart?1:-1;
+	
+	for (n=0;(n<itemNum)&&(flag>0);n++)
+	{
+		items.idStart[itemIds[n]+2]++;
+	}
+	
+	for (k=2;(k<=items.idDict->num)&&(flag>0);k++)
+	{
+		items.idStart[k] += items.idStart[k-1];
+	}
+	
+	for (n=0;(n<itemNum)&&(flag>0);n++)
+	{
+		items.idItems[items.idStart[itemIds[n]+1]++] = n;
+	}
+	
+	for (k=0;(k<groupingNum)&&(flag>0);k++)
+	{
+		flag = ReadGrouping(groupFileNames[k], &items, groupings+k)>0?1:-1;
+		
+		if ((flag>0)&&(groupings[k].unmatchedNum>0))
+		{
+			printf("%d rows of %s have an item id, list id or input group id not in the input...", groupings[k].unmatchedNum, groupFileNames[k]);
+		}
+	}
+	
+	flag = flag>0?ScoreGroupings(percentiles, groupings, groupingNum, aggregator, maxPercentile, pool):-1;
+	
+	for (k=0;(k<groupingNum)&&(flag>0);k++)
+	{
+		savedGroups = (GROUP_STRUCT *)MemAlloc(MEM_GROUPS, (groupings[k].groupNum+1)*sizeof(GROUP_STRUCT));
+		flag = savedGroups?1:-1;
+		savedNum = 0;
+		
+		for (g=0;(g<groupings[k].groupNum)&&(flag>0);g++)
+		{
+			if (groupings[k].groupStart[g+1]>groupings[k].groupStart[g])
+			{
+				strncpy(savedGroups[savedNum].name, groupings[k].groupDict->names[g], MAX_NAME_LEN-1);
+				savedGroups[savedNum].name[MAX_NAME_LEN-1] = 0;
+				savedGroups[savedNum].items = NULL;
+				savedGroups[savedNum].itemNum = groupings[k].groupStart[g+1]-groupings[k].groupStart[g];
+				savedGroups[savedNum].index = g;
+				savedGroups[savedNum].loValue = groupings[k].loValues[g];
+				savedGroups[savedNum].fdr = groupings[k].fdr[g];
+				savedNum++;
+			}
+		}
+		
+		if ((flag>0)&&(savedNum==0))
+		{
+			printf("no group of %s has items in the input\n", groupFileNames[k]);
+			flag = -1;
+		}
+		
+		if (flag>0)
+		{
+			QuickSortGroupByLoValue(savedGroups, 0, savedNum-1);
+			AggregatorFileName(outputFileName, groupings[k].name, fileName, sizeof(fileName));
+			
+			TraceBegin("output");
+			flag = SaveGroupInfo(fileName, savedGroups, savedNum, pool);
+			TraceEnd("output");
+		}
+		
+		MemFree(savedGroups);
+	}
+	
+	for (k=0;(groupings)&&(k<groupingNum);k++)
+	{
+		FreeGrouping(groupings+k);
+	}
+	
+	if (items.idDict)
+	{
+		DictFree(items.idDict);
+	}
+	
+	if (items.listDict)
+	{
+		DictFree(items.listDict);
+	}
+	
+	if (items.groupDict)
+	{
+		DictFree(items.groupDict);
+	}
+	
+	MemFree(groupings);
+	MemFree(percentiles);
+	MemFree(itemIds);
+	MemFree(items.itemLists);
+	MemFree(items.itemGroups);
+	MemFree(items.idItems);
+	MemFree(items.idStart);
+	
+	return flag;
+}
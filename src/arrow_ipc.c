@@ -0,0 +1,1339 @@
+/*
+ *  arrow_ipc.c
+ *	Reader and writer of Apache Arrow IPC files (Feather version 2) with flat columns of numbers and strings
+ *
+ *  The file is mapped in memory and its columns are used in place: numbers, dictionary indices
+ *  and string offsets are read straight from the record batch bodies. The metadata is stored as
+ *  flatbuffers, which are decoded here by hand for the few tables the tools need: Footer, Schema,
+ *  Field, Message, RecordBatch and DictionaryBatch. Flat columns of any primitive or string type
+ *  are accepted; nested columns, compressed bodies and delta dictionaries are not. Bodies compressed with LZ4 or ZSTD,
+ *  the default of pyarrow, would have to be decompressed into memory instead of being used in place, and are rejected
+ *  with a message telling how to write the file uncompressed.
+ *  Files are written with the same tables, built front to back, so that offsets point forward.
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "arrow_ipc.h"
+#include "mem_acct.h"
+
+#define ARROW_MAGIC "ARROW1"       //first and last bytes of an Arrow IPC file
+#define ARROW_CONTINUATION 0xffffffffu   //marks the start of a message
+#define ARROW_METADATA_V5 4        //MetadataVersion.V5
+
+#define MESSAGE_SCHEMA 1           //MessageHeader.Schema
+#define MESSAGE_DICTIONARY_BATCH 2 //MessageHeader.DictionaryBatch
+#define MESSAGE_RECORD_BATCH 3     //MessageHeader.RecordBatch
+
+#define TYPE_NULL 1                //Type.Null
+#define TYPE_INT 2                 //Type.Int
+#define TYPE_FLOATING_POINT 3      //Type.FloatingPoint
+#define TYPE_UTF8 5                //Type.Utf8
+#define TYPE_LARGE_UTF8 20         //Type.LargeUtf8
+
+typedef struct
+{
+	char *data;                    //bytes of the flatbuffer
+	long len;                      //length of the flatbuffer
+	long size;                     //allocated size of data
+} FB_BUILDER;
+
+//Read little-endian scalars at any alignment
+static int32_t Get32(const char *p);
+static int64_t Get64(const char *p);
+
+//Return field fieldIndex of a flatbuffer table, or NULL if absent
+static const char *FbField(const char *table, int fieldIndex);
+
+//Return the table, vector or string referenced by field fieldIndex of a table, or NULL if absent or outside the file
+static const char *FbRef(const ARROW_FILE *file, const char *table, int fieldIndex);
+
+//Return the flatbuffer Message at offset of the file, with the body following it in *body. Return NULL if failure
+static const char *ReadMessage(const ARROW_FILE *file, long offset, int metaLength, const char **body);
+
+//Read a Field of the schema into column. Return 1 if success, -1 if the field is nested or of an unknown type
+static int ReadField(const ARROW_FILE *file, const char *field, ARROW_COLUMN *column);
+
+//Check that the body of a record batch is not compressed, or print which codec compressed it. Return 1 if uncompressed, -1 otherwise
+static int CheckUncompressed(const ARROW_FILE *file, const char *batch, const char *fileName);
+
+//Locate the buffers of a record batch. buffers receives the address and length of bufferNum buffers. Return 1 if success, -1 if failure
+static int ReadBuffers(const ARROW_FILE *file, const char *batch, const char *body, int bufferNum, const char **buffers, long *lengths);
+
+//Append n bytes of zero to a flatbuffer, after padding to align. Return the position of the bytes, or -1 if failure
+static long FbReserve(FB_BUILDER *b, long n, int align);
+
+//Append a table with fieldNum fields of fieldSizes bytes, 0 for an absent field. The position of each field is returned in fieldPos.
+//Return the position of the table, or -1 if failure
+static long FbTable(FB_BUILDER *b, int fieldNum, const int *fieldSizes, long *fieldPos);
+
+//Point the offset field at pos to target
+static void FbSetOffset(FB_BUILDER *b, long pos, long target);
+
+//Append a string. Return its position, or -1 if failure
+static long FbString(FB_BUILDER *b, const char *s);
+
+//Append a vector of count elements of elemSize bytes aligned on align bytes. The position of the first element is returned in *dataPos.
+//Return the position of the vector, or -1 if failure
+static long FbVector(FB_BUILDER *b, int elemSize, int align, long count, long *dataPos);
+
+//Append a Schema table for columns. Return its position, or -1 if failure
+static long FbSchema(FB_BUILDER *b, const ARROW_OUT_COLUMN *columns, int columnNum);
+
+//Write a message of the flatbuffer b with its prefix, padded to 8 bytes. Return the length written, or -1 if failure
+static long WriteMessage(FILE *fh, FB_BUILDER *b);
+
+//Write a record batch of rowNum rows from row first. Return 1 if success, -1 if failure. The message length and body length are returned
+static int WriteBatch(FILE *fh, const ARROW_OUT_COLUMN *columns, int columnNum, long first, long rowNum, int *metaLength, long *bodyLength);
+
+//Read little-endian scalars at any alignment
+static int32_t Get32(const char *p)
+{
+	int32_t v;
+
+	memcpy(&v, p, sizeof(v));
+
+	return v;
+}
+
+static int64_t Get64(const char *p)
+{
+	int64_t v;
+
+	memcpy(&v, p, sizeof(v));
+
+	return v;
+}
+
+//Return field fieldIndex of a flatbuffer table, or NULL if absent
+static const char *FbField(const char *table, int fieldIndex)
+{
+	const char *vtable;
+	uint16_t vtableSize, offset;
+
+	vtable = table-Get32(table);
+	memcpy(&vtableSize, vtable, sizeof(uint16_t));
+
+	if (4+2*fieldIndex>=vtableSize)
+	{
+		return NULL;
+	}
+
+	memcpy(&offset, vtable+4+2*fieldIndex, sizeof(uint16_t));
+
+	return offset?table+offset:NULL;
+}
+
+//Return the table, vector or string referenced by field fieldIndex of a table, or NULL if absent or outside the file
+static const char *FbRef(const ARROW_FILE *file, const char *table, int fieldIndex)
+{
+	const char *field, *target;
+
+	field = FbField(table, fieldIndex);
+
+	if (!field)
+	{
+		return NULL;
+	}
+
+	target = field+(uint32_t)Get32(field);
+
+	if ((target<file->map)||(target+4>file->map+file->size))
+	{
+		return NULL;
+	}
+
+	return target;
+}
+
+//Return the flatbuffer Message at offset of the file, with the body following it in *body. Return NULL if failure
+static const char *ReadMessage(const ARROW_FILE *file, long offset, int metaLength, const char **body)
+{
+	const char *p, *message;
+
+	if ((offset<8)||(metaLength<8)||(offset+metaLength>(long)file->size))
+	{
+		return NULL;
+	}
+
+	p = file->map+offset;
+
+	//messages start with a continuation marker, except in files written before Arrow 0.15
+	if ((uint32_t)Get32(p)==ARROW_CONTINUATION)
+	{
+		p += 4;
+	}
+
+	message = p+4+(uint32_t)Get32(p+4);
+
+	if (message+4>file->map+offset+metaLength)
+	{
+		return NULL;
+	}
+
+	*body = file->map+offset+metaLength;
+
+	return message;
+}
+
+//Read a Field of the schema into column. Return 1 if success, -1 if the field is nested or of an unknown type
+static int ReadField(const ARROW_FILE *file, const char *field, ARROW_COLUMN *column)
+{
+	const char *name, *p, *type, *children, *dictionary, *indexType;
+	int typeType, nameLen;
+
+	memset(column, 0, sizeof(ARROW_COLUMN));
+	column->dictionaryId = -1;
+
+	name = FbRef(file, field, 0);
+
+	if (name)
+	{
+		nameLen = Get32(name);
+		nameLen = nameLen<ARROW_MAX_NAME_LEN-1?nameLen:ARROW_MAX_NAME_LEN-1;
+		memcpy(column->name, name+4, nameLen);
+	}
+
+	children = FbRef(file, field, 5);
+
+	if ((children)&&(Get32(children)>0))
+	{
+		printf("column %s of the Arrow file is nested; only flat columns are supported\n", column->name);
+		return -1;
+	}
+
+	p = FbField(field, 2);
+	typeType = p?(unsigned char)*p:0;
+	type = FbRef(file, field, 3);
+
+	switch (typeType)
+	{
+		case TYPE_NULL:
+			column->bufferNum = 0;
+			break;
+
+		case TYPE_INT:
+			column->type = ARROW_TYPE_INT;
+			p = type?FbField(type, 0):NULL;
+			column->bitWidth = p?Get32(p):32;
+			p = type?FbField(type, 1):NULL;
+			column->isSigned = p?*p:0;
+			column->bufferNum = 2;
+			break;
+
+		case TYPE_FLOATING_POINT:
+			//precision is HALF, SINGLE or DOUBLE; half precision is not read
+			p = type?FbField(type, 0):NULL;
+			column->bitWidth = p?(p[0]==1?32:(p[0]==2?64:16)):16;
+			column->type = column->bitWidth>16?ARROW_TYPE_FLOAT:ARROW_TYPE_OTHER;
+			column->bufferNum = 2;
+			break;
+
+		case TYPE_UTF8:
+		case TYPE_LARGE_UTF8:
+			column->type = ARROW_TYPE_UTF8;
+			column->bitWidth = typeType==TYPE_UTF8?32:64;
+			column->bufferNum = 3;
+			break;
+
+		case 4:                        //Binary
+		case 19:                       //LargeBinary
+			column->bufferNum = 3;
+			break;
+
+		case 6:                        //Bool
+		case 7:                        //Decimal
+		case 8:                        //Date
+		case 9:                        //Time
+		case 10:                       //Timestamp
+		case 11:                       //Interval
+		case 15:                       //FixedSizeBinary
+		case 18:                       //Duration
+			column->bufferNum = 2;
+			break;
+
+		default:
+			printf("column %s of the Arrow file has an unsupported type %d\n", column->name, typeType);
+			return -1;
+	}
+
+	dictionary = FbRef(file, field, 4);
+
+	if (dictionary)
+	{
+		p = FbField(dictionary, 0);
+		column->dictionaryId = p?Get64(p):0;
+
+		//the indices are 32 bit signed integers unless given
+		indexType = FbRef(file, dictionary, 1);
+		p = indexType?FbField(indexType, 0):NULL;
+		column->indexBitWidth = p?Get32(p):32;
+		column->bufferNum = 2;
+	}
+
+	return 1;
+}
+
+//Return 1 if the file starts with the magic bytes of an Arrow IPC file. Standard input "-" is never an Arrow file
+int IsArrowFile(const char *fileName)
+{
+	FILE *fh;
+	char magic[6];
+	int flag;
+
+	if (strcmp(fileName, "-")==0)
+	{
+		return 0;
+	}
+
+	fh = (FILE *)fopen(fileName, "rb");
+
+	if (!fh)
+	{
+		return 0;
+	}
+
+	flag = (fread(magic, 1, 6, fh)==6)&&(memcmp(magic, ARROW_MAGIC, 6)==0);
+
+	fclose(fh);
+
+	return flag?1:0;
+}
+
+//Return 1 if the file name ends with .arrow or .feather, for results written as Arrow
+int IsArrowName(const char *fileName)
+{
+	const char *dot;
+
+	dot = strrchr(fileName, '.');
+
+	return (dot)&&((strcmp(dot, ".arrow")==0)||(strcmp(dot, ".feather")==0))?1:0;
+}
+
+//Map an Arrow IPC file and read its schema, dictionaries and record batch index. Return NULL if failure
+ARROW_FILE *ArrowOpen(const char *fileName)
+{
+	ARROW_FILE *file;
+	struct stat fileStat;
+	int fd, i, j, footerLen;
+	const char *footer, *schema, *fields, *blocks, *block, *message, *body, *p, *batch, *buffers[3];
+	long lengths[3];
+
+	file = (ARROW_FILE *)calloc(1, sizeof(ARROW_FILE));
+
+	if (!file)
+	{
+		return NULL;
+	}
+
+	fd = open(fileName, O_RDONLY);
+
+	if ((fd<0)||(fstat(fd, &fileStat)!=0))
+	{
+		printf("Cannot open file %s\n", fileName);
+		free(file);
+		return NULL;
+	}
+
+	file->size = (size_t)fileStat.st_size;
+	file->map = (file->size>=22)?(char *)mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0):(char *)MAP_FAILED;
+
+	close(fd);
+
+	if (file->map==(char *)MAP_FAILED)
+	{
+		printf("Cannot map file %s\n", fileName);
+		free(file);
+		return NULL;
+	}
+
+	//the footer is followed by its length and the magic bytes
+	footerLen = Get32(file->map+file->size-10);
+
+	if ((memcmp(file->map, ARROW_MAGIC, 6)!=0)||(memcmp(file->map+file->size-6, ARROW_MAGIC, 6)!=0)
+		||(footerLen<=0)||(footerLen>(long)file->size-18))
+	{
+		printf("%s is not an Arrow IPC file\n", fileName);
+		ArrowClose(file);
+		return NULL;
+	}
+
+	footer = file->map+file->size-10-footerLen;
+	footer = footer+(uint32_t)Get32(footer);
+	schema = FbRef(file, footer, 1);
+	fields = schema?FbRef(file, schema, 1):NULL;
+
+	if (!fields)
+	{
+		printf("%s has no schema\n", fileName);
+		ArrowClose(file);
+		return NULL;
+	}
+
+	file->columnNum = Get32(fields);
+	file->columns = (ARROW_COLUMN *)calloc(file->columnNum>0?file->columnNum:1, sizeof(ARROW_COLUMN));
+
+	if (!file->columns)
+	{
+		ArrowClose(file);
+		return NULL;
+	}
+
+	for (i=0;i<file->columnNum;i++)
+	{
+		p = fields+4+4*i;
+
+		if (ReadField(file, p+(uint32_t)Get32(p), file->columns+i)<0)
+		{
+			ArrowClose(file);
+			return NULL;
+		}
+	}
+
+	//dictionaries of string columns. A Block is {offset: long, metaDataLength: int, bodyLength: long}, 24 bytes
+	blocks = FbRef(file, footer, 2);
+
+	for (i=0;(blocks)&&(i<Get32(blocks));i++)
+	{
+		block = blocks+4+24*i;
+		message = ReadMessage(file, Get64(block), Get32(block+8), &body);
+		p = message?FbField(message, 1):NULL;
+
+		if ((!p)||(*p!=MESSAGE_DICTIONARY_BATCH))
+		{
+			printf("%s has a damaged dictionary\n", fileName);
+			ArrowClose(file);
+			return NULL;
+		}
+
+		message = FbRef(file, message, 2);
+		p = FbField(message, 2);
+
+		if ((p)&&(*p))
+		{
+			printf("%s has delta dictionaries, which are not supported\n", fileName);
+			ArrowClose(file);
+			return NULL;
+		}
+
+		p = FbField(message, 0);
+		batch = FbRef(file, message, 1);
+
+		for (j=0;j<file->columnNum;j++)
+		{
+			if ((file->columns[j].dictionaryId==(p?Get64(p):0))&&(file->columns[j].type==ARROW_TYPE_UTF8))
+			{
+				if ((batch)&&(CheckUncompressed(file, batch, fileName)<0))
+				{
+					ArrowClose(file);
+					return NULL;
+				}
+
+				if ((!batch)||(ReadBuffers(file, batch, body, 3, buffers, lengths)<0))
+				{
+					printf("%s has a damaged dictionary\n", fileName);
+					ArrowClose(file);
+					return NULL;
+				}
+
+				file->columns[j].dictNum = lengths[1]/(file->columns[j].bitWidth/8)-1;
+				file->columns[j].dictOffsets = buffers[1];
+				file->columns[j].dictData = buffers[2];
+			}
+		}
+	}
+
+	//record batches
+	blocks = FbRef(file, footer, 3);
+	file->batchNum = blocks?Get32(blocks):0;
+	file->batchMeta = (const char **)calloc(file->batchNum+1, sizeof(const char *));
+	file->batchBody = (const char **)calloc(file->batchNum+1, sizeof(const char *));
+
+	if ((!file->batchMeta)||(!file->batchBody))
+	{
+		ArrowClose(file);
+		return NULL;
+	}
+
+	for (i=0;i<file->batchNum;i++)
+	{
+		block = blocks+4+24*i;
+		message = ReadMessage(file, Get64(block), Get32(block+8), file->batchBody+i);
+		p = message?FbField(message, 1):NULL;
+		batch = message?FbRef(file, message, 2):NULL;
+
+		if ((!p)||(*p!=MESSAGE_RECORD_BATCH)||(!batch))
+		{
+			printf("%s has a damaged record batch\n", fileName);
+			ArrowClose(file);
+			return NULL;
+		}
+
+		if (CheckUncompressed(file, batch, fileName)<0)
+		{
+			ArrowClose(file);
+			return NULL;
+		}
+
+		file->batchMeta[i] = batch;
+		p = FbField(batch, 0);
+		file->rowNum += p?Get64(p):0;
+	}
+
+	return file;
+}
+
+//Check that the body of a record batch is not compressed, or print which codec compressed it. Return 1 if uncompressed, -1 otherwise
+static int CheckUncompressed(const ARROW_FILE *file, const char *batch, const char *fileName)
+{
+	const char *compression, *codec;
+
+	//field 3 of a RecordBatch is its BodyCompression, whose field 0 is the codec: 0 for LZ4_FRAME (the default), 1 for ZSTD
+	compression = FbRef(file, batch, 3);
+
+	if (!compression)
+	{
+		return 1;
+	}
+
+	codec = FbField(compression, 0);
+
+	printf("%s is compressed with %s. Only uncompressed Arrow IPC files are read, as their columns are used in place. ", fileName, (codec)&&(*codec==1)?"ZSTD":"LZ4");
+	printf("Write it with compression=\"uncompressed\", e.g. pyarrow.feather.write_feather(table, file, compression=\"uncompressed\")\n");
+
+	return -1;
+}
+
+//Locate the buffers of a record batch. buffers receives the address and length of bufferNum buffers. Return 1 if success, -1 if failure
+static int ReadBuffers(const ARROW_FILE *file, const char *batch, const char *body, int bufferNum, const char **buffers, long *lengths)
+{
+	const char *vector;
+	int i;
+	long offset;
+
+	vector = FbRef(file, batch, 2);
+
+	if ((!vector)||(Get32(vector)<bufferNum))
+	{
+		return -1;
+	}
+
+	//a Buffer is {offset: long, length: long}, relative to the body
+	for (i=0;i<bufferNum;i++)
+	{
+		offset = Get64(vector+4+16*i);
+		lengths[i] = Get64(vector+12+16*i);
+
+		if ((offset<0)||(lengths[i]<0)||(body+offset+lengths[i]>file->map+file->size))
+		{
+			return -1;
+		}
+
+		buffers[i] = body+offset;
+	}
+
+	return 1;
+}
+
+//Locate the arrays of all columns of record batch batchIndex, in place in the mapped file. Return the number of rows, or -1 if failure
+long ArrowReadBatch(ARROW_FILE *file, int batchIndex, ARROW_ARRAY *arrays)
+{
+	const char *batch, *nodes, *vector, *p;
+	int i, bufferIndex;
+	long offset, length;
+
+	batch = file->batchMeta[batchIndex];
+	nodes = FbRef(file, batch, 1);
+	vector = FbRef(file, batch, 2);
+
+	if ((!nodes)||(!vector)||(Get32(nodes)<file->columnNum))
+	{
+		return -1;
+	}
+
+	bufferIndex = 0;
+
+	for (i=0;i<file->columnNum;i++)
+	{
+		//a FieldNode is {length: long, null_count: long}
+		arrays[i].length = Get64(nodes+4+16*i);
+		arrays[i].nullCount = Get64(nodes+12+16*i);
+		arrays[i].values = NULL;
+		arrays[i].data = NULL;
+
+		if (bufferIndex+file->columns[i].bufferNum>Get32(vector))
+		{
+			return -1;
+		}
+
+		if (file->columns[i].bufferNum>=2)
+		{
+			p = vector+4+16*(bufferIndex+1);
+			offset = Get64(p);
+			length = Get64(p+8);
+
+			if (file->batchBody[batchIndex]+offset+length>file->map+file->size)
+			{
+				return -1;
+			}
+
+			arrays[i].values = file->batchBody[batchIndex]+offset;
+		}
+
+		if (file->columns[i].bufferNum>=3)
+		{
+			p = vector+4+16*(bufferIndex+2);
+			offset = Get64(p);
+			length = Get64(p+8);
+
+			if (file->batchBody[batchIndex]+offset+length>file->map+file->size)
+			{
+				return -1;
+			}
+
+			arrays[i].data = file->batchBody[batchIndex]+offset;
+		}
+
+		bufferIndex += file->columns[i].bufferNum;
+	}
+
+	p = FbField(batch, 0);
+
+	return p?Get64(p):0;
+}
+
+//Convert the numbers of an array of an integer or floating point column to doubles. Return 1 if success, -1 if the column is not numeric
+int ArrowToDoubles(const ARROW_COLUMN *column, const ARROW_ARRAY *array, double *values)
+{
+	long i;
+	const char *p = array->values;
+
+	if ((column->dictionaryId>=0)||(!p))
+	{
+		return -1;
+	}
+
+	if (column->type==ARROW_TYPE_FLOAT)
+	{
+		if (column->bitWidth==64)
+		{
+			memcpy(values, p, array->length*sizeof(double));
+		}
+		else
+		{
+			for (i=0;i<array->length;i++)
+			{
+				values[i] = ((const float *)p)[i];
+			}
+		}
+
+		return 1;
+	}
+
+	if (column->type!=ARROW_TYPE_INT)
+	{
+		return -1;
+	}
+
+	for (i=0;i<array->length;i++)
+	{
+		switch (column->bitWidth*(column->isSigned?1:-1))
+		{
+			case 8: values[i] = ((const int8_t *)p)[i]; break;
+			case 16: values[i] = ((const int16_t *)p)[i]; break;
+			case 32: values[i] = ((const int32_t *)p)[i]; break;
+			case 64: values[i] = (double)((const int64_t *)p)[i]; break;
+			case -8: values[i] = ((const uint8_t *)p)[i]; break;
+			case -16: values[i] = ((const uint16_t *)p)[i]; break;
+			case -32: values[i] = ((const uint32_t *)p)[i]; break;
+			default: values[i] = (double)((const uint64_t *)p)[i]; break;
+		}
+	}
+
+	return 1;
+}
+
+//Copy the dictionary indices of an array of a dictionary encoded column to ints. Return 1 if success, -1 if the column is not dictionary encoded
+int ArrowToIndices(const ARROW_COLUMN *column, const ARROW_ARRAY *array, int *indices)
+{
+	long i;
+	const char *p = array->values;
+
+	if ((column->dictionaryId<0)||(!p))
+	{
+		return -1;
+	}
+
+	for (i=0;i<array->length;i++)
+	{
+		switch (column->indexBitWidth)
+		{
+			case 8: indices[i] = ((const int8_t *)p)[i]; break;
+			case 16: indices[i] = ((const int16_t *)p)[i]; break;
+			case 32: indices[i] = ((const int32_t *)p)[i]; break;
+			default: indices[i] = (int)((const int64_t *)p)[i]; break;
+		}
+	}
+
+	return 1;
+}
+
+//Return string index of the dictionary of a column, and its length in *len. Return NULL if out of range
+const char *ArrowDictString(const ARROW_COLUMN *column, long index, long *len)
+{
+	long start, end;
+
+	if ((index<0)||(index>=column->dictNum))
+	{
+		return NULL;
+	}
+
+	if (column->bitWidth==32)
+	{
+		start = ((const int32_t *)column->dictOffsets)[index];
+		end = ((const int32_t *)column->dictOffsets)[index+1];
+	}
+	else
+	{
+		start = ((const int64_t *)column->dictOffsets)[index];
+		end = ((const int64_t *)column->dictOffsets)[index+1];
+	}
+
+	*len = end-start;
+
+	return column->dictData+start;
+}
+
+//Return string row of an array of a string column, not terminated by 0, and its length in *len. Dictionaries are resolved
+const char *ArrowString(const ARROW_COLUMN *column, const ARROW_ARRAY *array, long row, long *len)
+{
+	long start, end, index;
+
+	if (column->dictionaryId>=0)
+	{
+		switch (column->indexBitWidth)
+		{
+			case 8: index = ((const int8_t *)array->values)[row]; break;
+			case 16: index = ((const int16_t *)array->values)[row]; break;
+			case 32: index = ((const int32_t *)array->values)[row]; break;
+			default: index = ((const int64_t *)array->values)[row]; break;
+		}
+
+		return ArrowDictString(column, index, len);
+	}
+
+	if (column->bitWidth==32)
+	{
+		start = ((const int32_t *)array->values)[row];
+		end = ((const int32_t *)array->values)[row+1];
+	}
+	else
+	{
+		start = ((const int64_t *)array->values)[row];
+		end = ((const int64_t *)array->values)[row+1];
+	}
+
+	*len = end-start;
+
+	return array->data+start;
+}
+
+//Unmap the file and free it
+void ArrowClose(ARROW_FILE *file)
+{
+	if (!file)
+	{
+		return;
+	}
+
+	if ((file->map)&&(file->map!=(char *)MAP_FAILED))
+	{
+		munmap(file->map, file->size);
+	}
+
+	free(file->columns);
+	free(file->batchMeta);
+	free(file->batchBody);
+	free(file);
+}
+
+//Append n bytes of zero to a flatbuffer, after padding to align. Return the position of the bytes, or -1 if failure
+static long FbReserve(FB_BUILDER *b, long n, int align)
+{
+	long pos, newSize;
+	char *tmpData;
+
+	pos = (b->len+align-1)/align*align;
+
+	if (pos+n>b->size)
+	{
+		newSize = b->size>0?b->size:1024;
+
+		while (newSize<pos+n)
+		{
+			newSize *= 2;
+		}
+
+		tmpData = (char *)MemRealloc(MEM_OUTPUT, b->data, newSize);
+
+		if (!tmpData)
+		{
+			return -1;
+		}
+
+		b->data = tmpData;
+		b->size = newSize;
+	}
+
+	memset(b->data+b->len, 0, pos+n-b->len);
+	b->len = pos+n;
+
+	return pos;
+}
+
+//Append a table with fieldNum fields of fieldSizes bytes, 0 for an absent field. The position of each field is returned in fieldPos.
+//Return the position of the table, or -1 if failure
+static long FbTable(FB_BUILDER *b, int fieldNum, const int *fieldSizes, long *fieldPos)
+{
+	long vtablePos, tablePos, offset;
+	int i, size, vtableSize;
+	uint16_t v;
+	int32_t soffset;
+
+	//fields are laid out from the largest to the smallest after the offset to the vtable, so that all are aligned
+	offset = 4;
+
+	for (size=8;size>=1;size/=2)
+	{
+		for (i=0;i<fieldNum;i++)
+		{
+			if (fieldSizes[i]==size)
+			{
+				offset = (offset+size-1)/size*size;
+				fieldPos[i] = offset;
+				offset += size;
+			}
+		}
+	}
+
+	//the vtable is placed just before the table, which starts on 8 bytes
+	vtableSize = 4+2*fieldNum;
+	tablePos = (b->len+vtableSize+7)/8*8;
+
+	if (FbReserve(b, tablePos+offset-b->len, 1)<0)
+	{
+		return -1;
+	}
+
+	vtablePos = tablePos-vtableSize;
+
+	v = (uint16_t)vtableSize;
+	memcpy(b->data+vtablePos, &v, 2);
+	v = (uint16_t)offset;
+	memcpy(b->data+vtablePos+2, &v, 2);
+
+	for (i=0;i<fieldNum;i++)
+	{
+		v = fieldSizes[i]?(uint16_t)fieldPos[i]:0;
+		memcpy(b->data+vtablePos+4+2*i, &v, 2);
+		fieldPos[i] = fieldSizes[i]?tablePos+fieldPos[i]:-1;
+	}
+
+	soffset = (int32_t)(tablePos-vtablePos);
+	memcpy(b->data+tablePos, &soffset, 4);
+
+	return tablePos;
+}
+
+//Point the offset field at pos to target
+static void FbSetOffset(FB_BUILDER *b, long pos, long target)
+{
+	uint32_t offset = (uint32_t)(target-pos);
+
+	memcpy(b->data+pos, &offset, 4);
+}
+
+//Append a string. Return its position, or -1 if failure
+static long FbString(FB_BUILDER *b, const char *s)
+{
+	long pos;
+	int32_t len = (int32_t)strlen(s);
+
+	pos = FbReserve(b, 4+len+1, 4);
+
+	if (pos>=0)
+	{
+		memcpy(b->data+pos, &len, 4);
+		memcpy(b->data+pos+4, s, len);
+	}
+
+	return pos;
+}
+
+//Append a vector of count elements of elemSize bytes aligned on align bytes. The position of the first element is returned in *dataPos.
+//Return the position of the vector, or -1 if failure
+static long FbVector(FB_BUILDER *b, int elemSize, int align, long count, long *dataPos)
+{
+	long pos;
+	int32_t len = (int32_t)count;
+
+	//the length comes just before the elements, which are aligned
+	if (FbReserve(b, 0, align)<0)
+	{
+		return -1;
+	}
+
+	if ((b->len+4)%align!=0)
+	{
+		FbReserve(b, align-(b->len+4)%align, 1);
+	}
+
+	pos = FbReserve(b, 4+elemSize*count, 1);
+
+	if (pos>=0)
+	{
+		memcpy(b->data+pos, &len, 4);
+		*dataPos = pos+4;
+	}
+
+	return pos;
+}
+
+//Append a Schema table for columns. Return its position, or -1 if failure
+static long FbSchema(FB_BUILDER *b, const ARROW_OUT_COLUMN *columns, int columnNum)
+{
+	int schemaSizes[2] = {0, 4};                //endianness (little, the default), fields
+	int fieldSizes[6] = {4, 1, 1, 4, 0, 4};     //name, nullable, type_type, type, dictionary, children
+	int intSizes[2] = {4, 1};                   //bitWidth, is_signed
+	int floatSizes[1] = {2};                    //precision
+	long schemaPos[2], fieldPos[6], typePos[2];
+	long schema, fields, fieldsData, field, pos, children, childrenData;
+	int i;
+	int16_t precision;
+	int32_t bitWidth;
+
+	schema = FbTable(b, 2, schemaSizes, schemaPos);
+	fields = FbVector(b, 4, 4, columnNum, &fieldsData);
+
+	if ((schema<0)||(fields<0))
+	{
+		return -1;
+	}
+
+	FbSetOffset(b, schemaPos[1], fields);
+
+	for (i=0;i<columnNum;i++)
+	{
+		field = FbTable(b, 6, fieldSizes, fieldPos);
+
+		if (field<0)
+		{
+			return -1;
+		}
+
+		FbSetOffset(b, fieldsData+4*i, field);
+
+		b->data[fieldPos[1]] = 0;
+		b->data[fieldPos[2]] = columns[i].type==ARROW_TYPE_INT?TYPE_INT:(columns[i].type==ARROW_TYPE_FLOAT?TYPE_FLOATING_POINT:TYPE_UTF8);
+
+		pos = FbString(b, columns[i].name);
+
+		if (pos<0)
+		{
+			return -1;
+		}
+
+		FbSetOffset(b, fieldPos[0], pos);
+
+		if (columns[i].type==ARROW_TYPE_INT)
+		{
+			pos = FbTable(b, 2, intSizes, typePos);
+
+			if (pos<0)
+			{
+				return -1;
+			}
+
+			bitWidth = 32;
+			memcpy(b->data+typePos[0], &bitWidth, 4);
+			b->data[typePos[1]] = 1;
+		}
+		else if (columns[i].type==ARROW_TYPE_FLOAT)
+		{
+			pos = FbTable(b, 1, floatSizes, typePos);
+
+			if (pos<0)
+			{
+				return -1;
+			}
+
+			precision = 2;
+			memcpy(b->data+typePos[0], &precision, 2);
+		}
+		else
+		{
+			pos = FbTable(b, 0, NULL, typePos);
+		}
+
+		children = FbVector(b, 4, 4, 0, &childrenData);
+
+		if ((pos<0)||(children<0))
+		{
+			return -1;
+		}
+
+		FbSetOffset(b, fieldPos[3], pos);
+		FbSetOffset(b, fieldPos[5], children);
+	}
+
+	return schema;
+}
+
+//Write a message of the flatbuffer b with its prefix, padded to 8 bytes. Return the length written, or -1 if failure
+static long WriteMessage(FILE *fh, FB_BUILDER *b)
+{
+	uint32_t prefix[2];
+	char padding[8] = {0};
+	long padded;
+
+	padded = (b->len+7)/8*8;
+	prefix[0] = ARROW_CONTINUATION;
+	prefix[1] = (uint32_t)padded;
+
+	if ((fwrite(prefix, 4, 2, fh)!=2)||(fwrite(b->data, 1, b->len, fh)!=(size_t)b->len)
+		||(fwrite(padding, 1, padded-b->len, fh)!=(size_t)(padded-b->len)))
+	{
+		return -1;
+	}
+
+	return 8+padded;
+}
+
+//Write a record batch of rowNum rows from row first. Return 1 if success, -1 if failure. The message length and body length are returned
+static int WriteBatch(FILE *fh, const ARROW_OUT_COLUMN *columns, int columnNum, long first, long rowNum, int *metaLength, long *bodyLength)
+{
+	FB_BUILDER b;
+	int messageSizes[4] = {2, 1, 4, 8};         //version, header_type, header, bodyLength
+	int batchSizes[3] = {8, 4, 4};              //length, nodes, buffers
+	long messagePos[4], batchPos[3];
+	long message, batch, nodes, nodesData, buffers, buffersData;
+	long *bufferLengths, offset, i, row, len;
+	int j, k, bufferNum;
+	int16_t version;
+	int64_t v64;
+	char **bodies, padding[8] = {0};
+	int32_t *offsets;
+	const char *value;
+	int flag;
+
+	memset(&b, 0, sizeof(FB_BUILDER));
+
+	bodies = (char **)calloc(3*columnNum, sizeof(char *));
+	bufferLengths = (long *)calloc(3*columnNum, sizeof(long));
+
+	if ((!bodies)||(!bufferLengths))
+	{
+		free(bodies);
+		free(bufferLengths);
+		return -1;
+	}
+
+	flag = 1;
+
+	//each column has a validity buffer, empty as there are no nulls, and its values; strings have offsets and characters
+	for (j=0;(j<columnNum)&&(flag>0);j++)
+	{
+		if (columns[j].type==ARROW_TYPE_UTF8)
+		{
+			offsets = (int32_t *)MemAlloc(MEM_OUTPUT, (rowNum+1)*sizeof(int32_t));
+			bodies[3*j+1] = (char *)offsets;
+
+			if (!offsets)
+			{
+				flag = -1;
+				break;
+			}
+
+			offsets[0] = 0;
+
+			for (i=0;i<rowNum;i++)
+			{
+				offsets[i+1] = offsets[i]+(int32_t)strlen(columns[j].base+(first+i)*columns[j].stride);
+			}
+
+			bodies[3*j+2] = (char *)MemAlloc(MEM_OUTPUT, offsets[rowNum]+1);
+
+			if (!bodies[3*j+2])
+			{
+				flag = -1;
+				break;
+			}
+
+			for (i=0;i<rowNum;i++)
+			{
+				memcpy(bodies[3*j+2]+offsets[i], columns[j].base+(first+i)*columns[j].stride, offsets[i+1]-offsets[i]);
+			}
+
+			bufferLengths[3*j+1] = (rowNum+1)*sizeof(int32_t);
+			bufferLengths[3*j+2] = offsets[rowNum];
+		}
+		else
+		{
+			len = columns[j].type==ARROW_TYPE_INT?sizeof(int32_t):sizeof(double);
+			bodies[3*j+1] = (char *)MemAlloc(MEM_OUTPUT, rowNum*len+1);
+
+			if (!bodies[3*j+1])
+			{
+				flag = -1;
+				break;
+			}
+
+			for (row=0;row<rowNum;row++)
+			{
+				value = columns[j].base+(first+row)*columns[j].stride;
+				memcpy(bodies[3*j+1]+row*len, value, len);
+			}
+
+			bufferLengths[3*j+1] = rowNum*len;
+		}
+	}
+
+	bufferNum = 0;
+
+	for (j=0;j<columnNum;j++)
+	{
+		bufferNum += columns[j].type==ARROW_TYPE_UTF8?3:2;
+	}
+
+	if (flag>0)
+	{
+		FbReserve(&b, 4, 4);
+		message = FbTable(&b, 4, messageSizes, messagePos);
+		batch = FbTable(&b, 3, batchSizes, batchPos);
+		nodes = FbVector(&b, 16, 8, columnNum, &nodesData);
+		buffers = FbVector(&b, 16, 8, bufferNum, &buffersData);
+
+		if ((message<0)||(batch<0)||(nodes<0)||(buffers<0))
+		{
+			flag = -1;
+		}
+	}
+
+	if (flag>0)
+	{
+		b.data[messagePos[1]] = MESSAGE_RECORD_BATCH;
+		version = ARROW_METADATA_V5;
+		memcpy(b.data+messagePos[0], &version, 2);
+		FbSetOffset(&b, 0, message);
+		FbSetOffset(&b, messagePos[2], batch);
+		v64 = rowNum;
+		memcpy(b.data+batchPos[0], &v64, 8);
+		FbSetOffset(&b, batchPos[1], nodes);
+		FbSetOffset(&b, batchPos[2], buffers);
+
+		offset = 0;
+		bufferNum = 0;
+
+		for (j=0;j<columnNum;j++)
+		{
+			v64 = rowNum;
+			memcpy(b.data+nodesData+16*j, &v64, 8);
+
+			for (k=0;k<(columns[j].type==ARROW_TYPE_UTF8?3:2);k++)
+			{
+				v64 = offset;
+				memcpy(b.data+buffersData+16*bufferNum, &v64, 8);
+				v64 = bufferLengths[3*j+k];
+				memcpy(b.data+buffersData+16*bufferNum+8, &v64, 8);
+				offset += (bufferLengths[3*j+k]+7)/8*8;
+				bufferNum++;
+			}
+		}
+
+		*bodyLength = offset;
+		v64 = offset;
+		memcpy(b.data+messagePos[3], &v64, 8);
+	}
+
+	if (flag>0)
+	{
+		len = WriteMessage(fh, &b);
+		*metaLength = (int)len;
+		flag = len>0?1:-1;
+	}
+
+	for (j=0;(j<columnNum)&&(flag>0);j++)
+	{
+		for (k=0;k<3;k++)
+		{
+			if ((bufferLengths[3*j+k]>0)&&((fwrite(bodies[3*j+k], 1, bufferLengths[3*j+k], fh)!=(size_t)bufferLengths[3*j+k])
+										  ||(fwrite(padding, 1, (8-bufferLengths[3*j+k]%8)%8, fh)!=(size_t)((8-bufferLengths[3*j+k]%8)%8))))
+			{
+				flag = -1;
+				break;
+			}
+		}
+	}
+
+	for (j=0;j<3*columnNum;j++)
+	{
+		MemFree(bodies[j]);
+	}
+
+	free(bodies);
+	free(bufferLengths);
+	MemFree(b.data);
+
+	return flag;
+}
+
+//Write rowNum rows of columns to an Arrow IPC file, in record batches of ARROW_BATCH_ROWS rows. Return 1 if success, -1 if failure
+int ArrowWriteFile(const char *fileName, const ARROW_OUT_COLUMN *columns, int columnNum, long rowNum)
+{
+	FILE *fh;
+	FB_BUILDER b;
+	int messageSizes[4] = {2, 1, 4, 8};         //version, header_type, header, bodyLength
+	int footerSizes[4] = {2, 4, 4, 4};          //version, schema, dictionaries, recordBatches
+	long messagePos[4], footerPos[4];
+	long message, schema, footer, dictionaries, batches, batchesData, tmpData;
+	long position, len, first, *blockOffsets, *bodyLengths;
+	int *metaLengths, batchNum, i, flag;
+	int16_t version;
+	int32_t footerLen;
+	int64_t v64;
+	const char eos[8] = {-1, -1, -1, -1, 0, 0, 0, 0};
+
+	batchNum = (int)((rowNum+ARROW_BATCH_ROWS-1)/ARROW_BATCH_ROWS);
+
+	fh = (FILE *)fopen(fileName, "wb");
+
+	if (!fh)
+	{
+		printf("Cannot open file %s\n", fileName);
+		return -1;
+	}
+
+	memset(&b, 0, sizeof(FB_BUILDER));
+	version = ARROW_METADATA_V5;
+
+	blockOffsets = (long *)calloc(batchNum+1, sizeof(long));
+	bodyLengths = (long *)calloc(batchNum+1, sizeof(long));
+	metaLengths = (int *)calloc(batchNum+1, sizeof(int));
+
+	flag = ((blockOffsets)&&(bodyLengths)&&(metaLengths))?1:-1;
+
+	//magic, padded to 8 bytes, and the schema message
+	if ((flag>0)&&(fwrite(ARROW_MAGIC "\0\0", 1, 8, fh)!=8))
+	{
+		flag = -1;
+	}
+
+	if (flag>0)
+	{
+		FbReserve(&b, 4, 4);
+		message = FbTable(&b, 4, messageSizes, messagePos);
+		schema = FbSchema(&b, columns, columnNum);
+
+		if ((message<0)||(schema<0))
+		{
+			flag = -1;
+		}
+		else
+		{
+			memcpy(b.data+messagePos[0], &version, 2);
+			b.data[messagePos[1]] = MESSAGE_SCHEMA;
+			FbSetOffset(&b, 0, message);
+			FbSetOffset(&b, messagePos[2], schema);
+		}
+	}
+
+	position = 8;
+
+	if (flag>0)
+	{
+		len = WriteMessage(fh, &b);
+		flag = len>0?1:-1;
+		position += len;
+	}
+
+	for (i=0;(i<batchNum)&&(flag>0);i++)
+	{
+		first = (long)i*ARROW_BATCH_ROWS;
+		blockOffsets[i] = position;
+		flag = WriteBatch(fh, columns, columnNum, first, rowNum-first<ARROW_BATCH_ROWS?rowNum-first:ARROW_BATCH_ROWS,
+						  metaLengths+i, bodyLengths+i);
+		position += metaLengths[i]+bodyLengths[i];
+	}
+
+	//end of stream, then the footer with the schema again and the blocks of the record batches
+	if ((flag>0)&&(fwrite(eos, 1, 8, fh)!=8))
+	{
+		flag = -1;
+	}
+
+	if (flag>0)
+	{
+		b.len = 0;
+		footer = FbReserve(&b, 4, 4);
+		footer = FbTable(&b, 4, footerSizes, footerPos);
+		schema = FbSchema(&b, columns, columnNum);
+		dictionaries = FbVector(&b, 24, 8, 0, &tmpData);
+		batches = FbVector(&b, 24, 8, batchNum, &batchesData);
+
+		if ((footer<0)||(schema<0)||(dictionaries<0)||(batches<0))
+		{
+			flag = -1;
+		}
+		else
+		{
+			FbSetOffset(&b, 0, footer);
+			memcpy(b.data+footerPos[0], &version, 2);
+			FbSetOffset(&b, footerPos[1], schema);
+			FbSetOffset(&b, footerPos[2], dictionaries);
+			FbSetOffset(&b, footerPos[3], batches);
+
+			for (i=0;i<batchNum;i++)
+			{
+				v64 = blockOffsets[i];
+				memcpy(b.data+batchesData+24*i, &v64, 8);
+				memcpy(b.data+batchesData+24*i+8, metaLengths+i, 4);
+				v64 = bodyLengths[i];
+				memcpy(b.data+batchesData+24*i+16, &v64, 8);
+			}
+
+			footerLen = (int32_t)b.len;
+
+			if ((fwrite(b.data, 1, b.len, fh)!=(size_t)b.len)||(fwrite(&footerLen, 4, 1, fh)!=1)||(fwrite(ARROW_MAGIC, 1, 6, fh)!=6))
+			{
+				flag = -1;
+			}
+		}
+	}
+
+	MemFree(b.data);
+	free(blockOffsets);
+	free(bodyLengths);
+	free(metaLengths);
+
+	if (fclose(fh)!=0)
+	{
+		flag = -1;
+	}
+
+	if (flag<0)
+	{
+		printf("Cannot write file %s\n", fileName);
+	}
+
+	return flag;
+}
@@ -0,0 +1,334 @@
+/*
+ *  autotune.c
+ *	Calibration of the execution parameters on the host, cached per host in a small config file
+ *
+ *  The number of threads and the chunk sizes of AdjustMR and of the output that run fastest depend
+ *  on the cores, caches and memory of the host. On first use, short microbenchmarks on synthetic
+ *  data time each candidate; a larger number of threads or chunk size is taken only if it saves
+ *  TUNE_MIN_GAIN of the time, so that noise does not decide. The choice is kept in one line per
+ *  host of the cache file, and read from there afterwards.
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "autotune.h"
+#include "norm_core.h"
+#include "out_writer.h"
+#include "thread_pool.h"
+#include "mem_acct.h"
+#include "rngs.h"
+
+typedef struct
+{
+	double *m;                     //log-means
+	double *r;                     //log-ratios
+	double *adjustedR;             //adjusted log-ratios
+} TUNE_BENCH;
+
+#define TUNE_CHUNK_NUM 3           //number of candidate chunk sizes
+
+static const int tuneChunkRows[TUNE_CHUNK_NUM] = {4096, 16384, 65536};  //candidate chunk sizes, in increasing order
+
+//Return the wall time in seconds
+static double WallTime(void);
+
+//Find the line of the host in the cache. Return 1 if found, 0 if not, -1 if the cache cannot be read
+static int TuneFind(const char *fileName, TUNE_PARAMS *params);
+
+//Replace the line of the host in the cache with the parameters. Return 1 if success, -1 if failure
+static int TuneSave(const char *fileName, const TUNE_PARAMS *params);
+
+//Format one row of the calibration output. Return 1 if success, -1 if failure
+static int FormatBenchRow(OUT_BUFFER *buffer, void *data, int row);
+
+//Return the wall time in seconds
+static double WallTime(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return tv.tv_sec+tv.tv_usec*1E-6;
+}
+
+//Find the line of the host in the cache. Return 1 if found, 0 if not, -1 if the cache cannot be read
+static int TuneFind(const char *fileName, TUNE_PARAMS *params)
+{
+	FILE *fh;
+	char line[TUNE_MAX_LINE], host[TUNE_MAX_HOST_LEN];
+	int cpuNum, threadNum, normChunkRows, outChunkRows, found;
+
+	fh = fopen(fileName, "r");
+
+	if (!fh)
+	{
+		return -1;
+	}
+
+	found = 0;
+
+	while ((!found)&&(fgets(line, TUNE_MAX_LINE, fh)))
+	{
+		if ((line[0]=='#')||(sscanf(line, "%255s %d %d %d %d", host, &cpuNum, &threadNum, &normChunkRows, &outChunkRows)!=5))
+		{
+			continue;
+		}
+
+		if ((strcmp(host, params->host)==0)&&(cpuNum==params->cpuNum)&&(threadNum>0)&&(normChunkRows>0)&&(outChunkRows>0))
+		{
+			params->threadNum = threadNum;
+			params->normChunkRows = normChunkRows;
+			params->outChunkRows = outChunkRows;
+			found = 1;
+		}
+	}
+
+	fclose(fh);
+
+	return found;
+}
+
+//Replace the line of the host in the cache with the parameters. Return 1 if success, -1 if failure
+static int TuneSave(const char *fileName, const TUNE_PARAMS *params)
+{
+	FILE *fh, *tmpFh;
+	char line[TUNE_MAX_LINE], host[TUNE_MAX_HOST_LEN], tmpFileName[TUNE_MAX_LINE+8];
+	int flag;
+
+	snprintf(tmpFileName, sizeof(tmpFileName), "%s.tmp", fileName);
+
+	tmpFh = fopen(tmpFileName, "w");
+
+	if (!tmpFh)
+	{
+		return -1;
+	}
+
+	fprintf(tmpFh, "#host\tCPUs\tthreads\tnorm_chunk_rows\tout_chunk_rows\n");
+
+	//lines of the other hosts are kept; the cache is replaced at once so that a run reading it never sees half of it
+	fh = fopen(fileName, "r");
+
+	while ((fh)&&(fgets(line, TUNE_MAX_LINE, fh)))
+	{
+		if ((line[0]!='#')&&(sscanf(line, "%255s", host)==1)&&(strcmp(host, params->host)!=0))
+		{
+			fputs(line, tmpFh);
+		}
+	}
+
+	if (fh)
+	{
+		fclose(fh);
+	}
+
+	fprintf(tmpFh, "%s\t%d\t%d\t%d\t%d\n", params->host, params->cpuNum, params->threadNum, params->normChunkRows, params->outChunkRows);
+
+	flag = fclose(tmpFh)==0?1:-1;
+
+	if ((flag>0)&&(rename(tmpFileName, fileName)!=0))
+	{
+		flag = -1;
+	}
+
+	if (flag<0)
+	{
+		remove(tmpFileName);
+	}
+
+	return flag;
+}
+
+//Format one row of the calibration output. Return 1 if success, -1 if failure
+static int FormatBenchRow(OUT_BUFFER *buffer, void *data, int row)
+{
+	TUNE_BENCH *bench = (TUNE_BENCH *)data;
+
+	return OutBufferPrintf(buffer, "sg%d\tgene%d\t%f\t%f\t%f\n", row, row/4, bench->m[row], bench->r[row], bench->adjustedR[row]);
+}
+
+//Run the calibration microbenchmarks on synthetic data: AdjustMR for each number of threads and chunk size, then
+//formatted output for each chunk size with the best number of threads. Return 1 if success, -1 if failure
+int TuneCalibrate(TUNE_PARAMS *params)
+{
+	TUNE_BENCH bench;
+	THREAD_POOL_STRUCT *pool;
+	OUT_WRITER_STRUCT *writer;
+	double startTime, elapsed, bestTime;
+	long seed;
+	int i, j, threadNum, flag;
+
+	bench.m = (double *)MemAlloc(MEM_WORK, TUNE_BENCH_ITEMS*sizeof(double));
+	bench.r = (double *)MemAlloc(MEM_WORK, TUNE_BENCH_ITEMS*sizeof(double));
+	bench.adjustedR = (double *)MemAlloc(MEM_WORK, TUNE_BENCH_ITEMS*sizeof(double));
+
+	flag = ((bench.m)&&(bench.r)&&(bench.adjustedR))?1:-1;
+	seed = TUNE_BENCH_SEED;
+
+	//log-means spread like counts of a screen, log-ratios around 0
+	for (i=0;(i<TUNE_BENCH_ITEMS)&&(flag>0);i++)
+	{
+		bench.m[i] = 20.0*RandomR(&seed)-10.0;
+		bench.r[i] = RandomR(&seed)-0.5;
+	}
+
+	params->threadNum = 1;
+	params->normChunkRows = NORM_CHUNK_ROWS;
+	params->outChunkRows = OUT_CHUNK_ROWS;
+	bestTime = 0.0;
+
+	//threads 1, 2, 4, ... and all CPUs, each with every chunk size of AdjustMR
+	threadNum = 1;
+
+	while (flag>0)
+	{
+		pool = ThreadPoolCreate(threadNum);
+		flag = pool?1:-1;
+
+		for (j=0;(j<TUNE_CHUNK_NUM)&&(flag>0);j++)
+		{
+			SetNormChunkRows(tuneChunkRows[j]);
+
+			startTime = WallTime();
+			flag = AdjustMR(bench.m, bench.r, TUNE_BENCH_ITEMS, TUNE_BENCH_WINDOW, pool, bench.adjustedR, NULL, NULL);
+			elapsed = WallTime()-startTime;
+
+			if ((flag>0)&&((bestTime==0.0)||(elapsed<bestTime*(1.0-TUNE_MIN_GAIN))))
+			{
+				bestTime = elapsed;
+				params->threadNum = threadNum;
+				params->normChunkRows = tuneChunkRows[j];
+			}
+		}
+
+		if (pool)
+		{
+			ThreadPoolDestroy(pool);
+		}
+
+		if (threadNum>=params->cpuNum)
+		{
+			break;
+		}
+
+		threadNum = threadNum*2<params->cpuNum?threadNum*2:params->cpuNum;
+	}
+
+	//chunk sizes of the output, formatted by the chosen threads and written to nowhere
+	pool = flag>0?ThreadPoolCreate(params->threadNum):NULL;
+	flag = pool?flag:-1;
+	bestTime = 0.0;
+
+	for (j=0;(j<TUNE_CHUNK_NUM)&&(flag>0);j++)
+	{
+		SetOutChunkRows(tuneChunkRows[j]);
+
+		startTime = WallTime();
+		writer = OutWriterOpen("/dev/null", OutChunkNum(TUNE_BENCH_ITEMS));
+		flag = writer?1:-1;
+
+		if (flag>0)
+		{
+			flag = OutWriterFormat(writer, pool, 0, TUNE_BENCH_ITEMS, FormatBenchRow, &bench);
+			ThreadPoolWait(pool);
+			flag = (OutWriterClose(writer)>0)?flag:-1;
+		}
+
+		elapsed = WallTime()-startTime;
+
+		if ((flag>0)&&((bestTime==0.0)||(elapsed<bestTime*(1.0-TUNE_MIN_GAIN))))
+		{
+			bestTime = elapsed;
+			params->outChunkRows = tuneChunkRows[j];
+		}
+	}
+
+	if (pool)
+	{
+		ThreadPoolDestroy(pool);
+	}
+
+	SetNormChunkRows(NORM_CHUNK_ROWS);
+	SetOutChunkRows(OUT_CHUNK_ROWS);
+
+	MemFree(bench.m);
+	MemFree(bench.r);
+	MemFree(bench.adjustedR);
+
+	return flag;
+}
+
+//Find the parameters of this host in the cache fileName, or in TUNE_FILE_NAME of the home directory if fileName is NULL.
+//A host is matched by its name and number of CPUs; if it is not found, the parameters are calibrated and added to the cache.
+//Return 1 if success, -1 if failure
+int TuneLoad(const char *fileName, TUNE_PARAMS *params)
+{
+	const char *home;
+
+	memset(params, 0, sizeof(TUNE_PARAMS));
+
+	if (gethostname(params->host, TUNE_MAX_HOST_LEN-1)!=0)
+	{
+		strcpy(params->host, "localhost");
+	}
+
+	params->cpuNum = GetCPUNum();
+
+	if (fileName)
+	{
+		snprintf(params->fileName, TUNE_MAX_LINE, "%s", fileName);
+	}
+	else
+	{
+		home = getenv("HOME");
+
+		if (home)
+		{
+			snprintf(params->fileName, TUNE_MAX_LINE, "%s/%s", home, TUNE_FILE_NAME);
+		}
+	}
+
+	if ((params->fileName[0])&&(TuneFind(params->fileName, params)>0))
+	{
+		params->fromCache = 1;
+		return 1;
+	}
+
+	if (TuneCalibrate(params)<0)
+	{
+		return -1;
+	}
+
+	//a cache that cannot be written only costs the calibration of the next run
+	if ((params->fileName[0])&&(TuneSave(params->fileName, params)<0))
+	{
+		printf("Cannot save tuned parameters to %s\n", params->fileName);
+		params->fileName[0] = 0;
+	}
+
+	return 1;
+}
+
+//Set the chunk sizes of the parameters. The number of threads is given to ThreadPoolCreate by the caller
+void TuneApply(const TUNE_PARAMS *params)
+{
+	SetNormChunkRows(params->normChunkRows);
+	SetOutChunkRows(params->outChunkRows);
+}
+
+//Print the parameters in use and where they came from
+void TuneReport(FILE *fh, const TUNE_PARAMS *params)
+{
+	fprintf(fh, "auto-tune on %s (%d CPUs), %s%s%s:\n", params->host, params->cpuNum, params->fromCache?"read from ":"calibrated",
+			params->fileName[0]?(params->fromCache?"":", saved to "):"", params->fileName);
+	fprintf(fh, "\tthreads\t%d\n", params->threadNum);
+	fprintf(fh, "\tnorm chunk rows\t%d\n", params->normChunkRows);
+	fprintf(fh, "\toutput chunk rows\t%d\n", params->outChunkRows);
+}
@@ -0,0 +1,330 @@
+/*
+ *  block_reader.c
+ *	Line reader of files or standard input, prefetched by a reader thread into double-buffered blocks
+ *
+ *  The reader thread fills one block with fread while the parser splits the other into lines,
+ *  so parsing overlaps I/O, and the input is read exactly once. This makes pipes usable as input.
+ *  Lines inside a block are returned in place; only a line spanning two blocks is copied.
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "block_reader.h"
+#include "mem_acct.h"
+#include "perf_counters.h"
+#include "trace.h"
+
+//Fill the blocks in turn until the end of input
+static void *ReaderMain(void *arg);
+
+//Hand the block being parsed back to the reader thread
+static void ReleaseBlock(READER_STRUCT *reader);
+
+//Append len bytes to the line spanning two blocks. Return 1 if success, -1 if failure
+static int AppendToLine(READER_STRUCT *reader, long *lineLen, const char *data, long len);
+
+//Return 1 if fileName means standard input or standard output
+int IsStdStream(const char *fileName)
+{
+	return strcmp(fileName, "-")==0?1:0;
+}
+
+//Open a file for reading, "-" for standard input, and start the reader thread. Return NULL if failure
+READER_STRUCT *ReaderOpen(const char *fileName)
+{
+	READER_STRUCT *reader;
+	int i;
+
+	reader = (READER_STRUCT *)calloc(1, sizeof(READER_STRUCT));
+
+	if (!reader)
+	{
+		return NULL;
+	}
+
+	reader->fh = IsStdStream(fileName)?stdin:(FILE *)fopen(fileName, "r");
+
+	if (!reader->fh)
+	{
+		printf("Cannot open file %s\n", fileName);
+		free(reader);
+		return NULL;
+	}
+
+	for (i=0;i<READER_BLOCK_NUM;i++)
+	{
+		reader->blocks[i] = (char *)MemAlloc(MEM_INPUT, READER_BLOCK_SIZE);
+
+		if (!reader->blocks[i])
+		{
+			while (--i>=0)
+			{
+				MemFree(reader->blocks[i]);
+			}
+
+			if (reader->fh!=stdin)
+			{
+				fclose(reader->fh);
+			}
+
+			free(reader);
+			return NULL;
+		}
+	}
+
+	pthread_mutex_init(&(reader->mutex), NULL);
+	pthread_cond_init(&(reader->blockFilled), NULL);
+	pthread_cond_init(&(reader->blockEmptied), NULL);
+
+	if (pthread_create(&(reader->thread), NULL, ReaderMain, reader)!=0)
+	{
+		printf("Cannot create reader thread\n");
+		reader->stopping = 1;
+		reader->thread = pthread_self();
+		ReaderClose(reader);
+		return NULL;
+	}
+
+	return reader;
+}
+
+//Fill the blocks in turn until the end of input
+static void *ReaderMain(void *arg)
+{
+	READER_STRUCT *reader = (READER_STRUCT *)arg;
+	int i;
+	long len;
+	int last;
+
+	TraceSetThreadName("reader");
+
+	i = 0;
+
+	while (1)
+	{
+		pthread_mutex_lock(&(reader->mutex));
+
+		while ((reader->blockFull[i])&&(!reader->stopping))
+		{
+			pthread_cond_wait(&(reader->blockEmptied), &(reader->mutex));
+		}
+
+		if (reader->stopping)
+		{
+			pthread_mutex_unlock(&(reader->mutex));
+			break;
+		}
+
+		pthread_mutex_unlock(&(reader->mutex));
+
+		TraceBegin("read block");
+		len = (long)fread(reader->blocks[i], 1, READER_BLOCK_SIZE, reader->fh);
+		TraceEnd("read block");
+
+		last = (len<READER_BLOCK_SIZE)?1:0;
+
+		pthread_mutex_lock(&(reader->mutex));
+
+		if ((last)&&(ferror(reader->fh)))
+		{
+			reader->error = 1;
+		}
+
+		reader->blockLen[i] = len;
+		reader->blockLast[i] = last;
+		reader->blockFull[i] = 1;
+
+		pthread_cond_signal(&(reader->blockFilled));
+		pthread_mutex_unlock(&(reader->mutex));
+
+		if (last)
+		{
+			break;
+		}
+
+		i = (i+1)%READER_BLOCK_NUM;
+	}
+
+	PerfThreadExit();
+
+	return NULL;
+}
+
+//Hand the block being parsed back to the reader thread
+static void ReleaseBlock(READER_STRUCT *reader)
+{
+	pthread_mutex_lock(&(reader->mutex));
+
+	if (reader->blockLast[reader->readIndex])
+	{
+		reader->finished = 1;
+	}
+
+	reader->blockFull[reader->readIndex] = 0;
+	reader->readIndex = (reader->readIndex+1)%READER_BLOCK_NUM;
+	reader->readPos = 0;
+	reader->holding = 0;
+
+	pthread_cond_signal(&(reader->blockEmptied));
+	pthread_mutex_unlock(&(reader->mutex));
+}
+
+//Append len bytes to the line spanning two blocks. Return 1 if success, -1 if failure
+static int AppendToLine(READER_STRUCT *reader, long *lineLen, const char *data, long len)
+{
+	char *tmpLine;
+	long newSize;
+
+	if (*lineLen+len+1>reader->lineSize)
+	{
+		newSize = reader->lineSize>0?reader->lineSize:256;
+
+		while (newSize<*lineLen+len+1)
+		{
+			newSize *= 2;
+		}
+
+		tmpLine = (char *)MemRealloc(MEM_INPUT, reader->line, newSize);
+
+		if (!tmpLine)
+		{
+			return -1;
+		}
+
+		reader->line = tmpLine;
+		reader->lineSize = newSize;
+	}
+
+	memcpy(reader->line+*lineLen, data, len);
+	*lineLen += len;
+	reader->line[*lineLen] = 0;
+
+	return 1;
+}
+
+//Return the next line, terminated by 0 and without its newline, or NULL at the end of input.
+//The line stays valid until the next call
+char *ReaderGetLine(READER_STRUCT *reader)
+{
+	char *block, *start, *newline;
+	long lineLen, len;
+
+	lineLen = 0;
+
+	while (1)
+	{
+		if (!reader->holding)
+		{
+			if (reader->finished)
+			{
+				break;
+			}
+
+			pthread_mutex_lock(&(reader->mutex));
+
+			while (!reader->blockFull[reader->readIndex])
+			{
+				pthread_cond_wait(&(reader->blockFilled), &(reader->mutex));
+			}
+
+			pthread_mutex_unlock(&(reader->mutex));
+
+			reader->holding = 1;
+			reader->readPos = 0;
+		}
+
+		block = reader->blocks[reader->readIndex];
+		len = reader->blockLen[reader->readIndex];
+		start = block+reader->readPos;
+		newline = (char *)memchr(start, '\n', len-reader->readPos);
+
+		if (newline)
+		{
+			reader->readPos = newline-block+1;
+			*newline = 0;
+
+			if (lineLen==0)
+			{
+				//the whole line is inside the block
+				reader->atEnd = 0;
+				return start;
+			}
+
+			if (AppendToLine(reader, &lineLen, start, newline-start)<0)
+			{
+				reader->error = 1;
+				break;
+			}
+
+			reader->atEnd = 0;
+			return reader->line;
+		}
+
+		if ((len>reader->readPos)&&(AppendToLine(reader, &lineLen, start, len-reader->readPos)<0))
+		{
+			reader->error = 1;
+			break;
+		}
+
+		ReleaseBlock(reader);
+	}
+
+	reader->atEnd = 1;
+
+	//a final line without newline
+	return lineLen>0?reader->line:NULL;
+}
+
+//Return 1 if the last line returned reached the end of input, as feof does after fgets. A final line without newline sets it
+int ReaderAtEnd(READER_STRUCT *reader)
+{
+	return reader->atEnd;
+}
+
+//Stop the reader thread, close the input and free the reader. Return 1 if the input was read without error, -1 otherwise
+int ReaderClose(READER_STRUCT *reader)
+{
+	int i, status;
+
+	pthread_mutex_lock(&(reader->mutex));
+	reader->stopping = 1;
+	pthread_cond_broadcast(&(reader->blockEmptied));
+	pthread_mutex_unlock(&(reader->mutex));
+
+	if (!pthread_equal(reader->thread, pthread_self()))
+	{
+		pthread_join(reader->thread, NULL);
+	}
+
+	status = reader->error?-1:1;
+
+	if (reader->error)
+	{
+		printf("Cannot read input\n");
+	}
+
+	if (reader->fh!=stdin)
+	{
+		fclose(reader->fh);
+	}
+
+	for (i=0;i<READER_BLOCK_NUM;i++)
+	{
+		MemFree(reader->blocks[i]);
+	}
+
+	MemFree(reader->line);
+
+	pthread_mutex_destroy(&(reader->mutex));
+	pthread_cond_destroy(&(reader->blockFilled));
+	pthread_cond_destroy(&(reader->blockEmptied));
+
+	free(reader);
+
+	return status;
+}
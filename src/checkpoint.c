@@ -0,0 +1,197 @@
+/*
+ *  checkpoint.c
+ *	Checkpoint and resume of long random simulations
+ *
+ *  A checkpoint stores the key of the simulation, the number of passes done, the states
+ *  of all random number streams of rngs.c and the values simulated so far. Resuming from
+ *  it replays exactly the same random numbers, so the result is identical to a run that
+ *  was never interrupted.
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include "checkpoint.h"
+#include "rngs.h"
+
+#define CHECKPOINT_MAGIC "RRACKPT1"   //first bytes of a checkpoint file
+
+static volatile sig_atomic_t terminateRequested = 0;  //set when SIGTERM or SIGINT is received
+
+//Signal handler of SIGTERM and SIGINT
+static void OnTerminateSignal(int sig)
+{
+	terminateRequested = 1;
+}
+
+//Catch SIGTERM and SIGINT, so that a simulation can save a checkpoint before it is preempted
+void CatchTerminateSignals(void)
+{
+	struct sigaction action;
+
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = OnTerminateSignal;
+	sigemptyset(&action.sa_mask);
+
+	sigaction(SIGTERM, &action, NULL);
+	sigaction(SIGINT, &action, NULL);
+}
+
+//Return 1 if SIGTERM or SIGINT was received
+int TerminateRequested(void)
+{
+	return terminateRequested?1:0;
+}
+
+//Hash a block of bytes into a running 64-bit key (FNV-1a). Start with key = 0
+unsigned long long CheckpointKey(unsigned long long key, const void *data, long size)
+{
+	const unsigned char *p = (const unsigned char *)data;
+	long i;
+
+	if (key==0)
+	{
+		key = 14695981039346656037ULL;
+	}
+
+	for (i=0;i<size;i++)
+	{
+		key ^= p[i];
+		key *= 1099511628211ULL;
+	}
+
+	return key;
+}
+
+//Return 1 if a checkpoint is due, either because the interval has passed or because the program was asked to terminate
+int CheckpointDue(CHECKPOINT_STRUCT *ckpt)
+{
+	if (terminateRequested)
+	{
+		return 1;
+	}
+
+	return (time(NULL)-ckpt->lastSaveTime>=ckpt->interval)?1:0;
+}
+
+//Save the progress of a simulation: number of passes done, the states of all random number streams and the values
+//simulated so far. key identifies the simulation. The file is replaced atomically. Return 1 if success, -1 if failure
+int SaveCheckpoint(CHECKPOINT_STRUCT *ckpt, unsigned long long key, int passDone, const double *values, long valueNum)
+{
+	FILE *fh;
+	char tmpFileName[1100];
+	long seeds[CHECKPOINT_RNG_STREAMS];
+	int i, ok;
+
+	//the simulations use the default stream 0, which is selected again afterwards
+	for (i=0;i<CHECKPOINT_RNG_STREAMS;i++)
+	{
+		SelectStream(i);
+		GetSeed(&(seeds[i]));
+	}
+
+	SelectStream(0);
+
+	sprintf(tmpFileName, "%s.tmp", ckpt->fileName);
+
+	fh = (FILE *)fopen(tmpFileName, "wb");
+
+	if (!fh)
+	{
+		printf("Cannot write checkpoint %s\n", tmpFileName);
+		return -1;
+	}
+
+	ok = (fwrite(CHECKPOINT_MAGIC, 1, 8, fh)==8)
+		 &&(fwrite(&key, sizeof(key), 1, fh)==1)
+		 &&(fwrite(&passDone, sizeof(passDone), 1, fh)==1)
+		 &&(fwrite(seeds, sizeof(long), CHECKPOINT_RNG_STREAMS, fh)==CHECKPOINT_RNG_STREAMS)
+		 &&(fwrite(&valueNum, sizeof(valueNum), 1, fh)==1)
+		 &&(fwrite(values, sizeof(double), valueNum, fh)==(size_t)valueNum);
+
+	ok = ok&&(fflush(fh)==0)&&(fsync(fileno(fh))==0);
+	ok = (fclose(fh)==0)&&ok;
+
+	if ((!ok)||(rename(tmpFileName, ckpt->fileName)!=0))
+	{
+		printf("Cannot write checkpoint %s\n", ckpt->fileName);
+		remove(tmpFileName);
+		return -1;
+	}
+
+	ckpt->lastSaveTime = time(NULL);
+
+	return 1;
+}
+
+//Load a checkpoint saved with the same key. Restore the random number streams and copy at most maxValueNum values.
+//Return 1 if loaded, 0 if there is no checkpoint file, -1 if the checkpoint is for another simulation or cannot be read
+int LoadCheckpoint(CHECKPOINT_STRUCT *ckpt, unsigned long long key, int *passDone, double *values, long maxValueNum, long *valueNum)
+{
+	FILE *fh;
+	char magic[8];
+	unsigned long long fileKey;
+	long seeds[CHECKPOINT_RNG_STREAMS];
+	int i, tmpPassDone;
+	long tmpValueNum;
+
+	fh = (FILE *)fopen(ckpt->fileName, "rb");
+
+	if (!fh)
+	{
+		return 0;
+	}
+
+	if ((fread(magic, 1, 8, fh)!=8)||(memcmp(magic, CHECKPOINT_MAGIC, 8))
+		||(fread(&fileKey, sizeof(fileKey), 1, fh)!=1)
+		||(fread(&tmpPassDone, sizeof(tmpPassDone), 1, fh)!=1)
+		||(fread(seeds, sizeof(long), CHECKPOINT_RNG_STREAMS, fh)!=CHECKPOINT_RNG_STREAMS)
+		||(fread(&tmpValueNum, sizeof(tmpValueNum), 1, fh)!=1))
+	{
+		fclose(fh);
+		printf("Cannot read checkpoint %s\n", ckpt->fileName);
+		return -1;
+	}
+
+	if (fileKey!=key)
+	{
+		fclose(fh);
+		printf("Checkpoint %s was saved for another input or other parameters\n", ckpt->fileName);
+		return -1;
+	}
+
+	if ((tmpValueNum<0)||(tmpValueNum>maxValueNum)||(fread(values, sizeof(double), tmpValueNum, fh)!=(size_t)tmpValueNum))
+	{
+		fclose(fh);
+		printf("Cannot read checkpoint %s\n", ckpt->fileName);
+		return -1;
+	}
+
+	fclose(fh);
+
+	for (i=0;i<CHECKPOINT_RNG_STREAMS;i++)
+	{
+		SelectStream(i);
+		PutSeed(seeds[i]);
+	}
+
+	SelectStream(0);
+
+	*passDone = tmpPassDone;
+	*valueNum = tmpValueNum;
+	ckpt->lastSaveTime = time(NULL);
+
+	return 1;
+}
+
+//Remove the checkpoint file after the simulation completed
+void RemoveCheckpoint(CHECKPOINT_STRUCT *ckpt)
+{
+	remove(ckpt->fileName);
+}
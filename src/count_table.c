@@ -0,0 +1,408 @@
+/*
+ *  count_table.c
+ *	Table of sgRNA counts in many samples, read from text in a single pass into columns
+ *
+ *  The counts are kept by column, so that a sample is one contiguous array, as the normalization
+ *  and the kernels over samples read them. Columns share one buffer with room for capacity rows
+ *  each; when it is full, the buffer doubles and the columns move to their new places, last first.
+ *
+ *  Screens of many samples, where most counts are zero, are read from Matrix Market files instead,
+ *  and kept as rows of nonzero counts, so that memory grows with the nonzero counts only.
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "count_table.h"
+#include "words.h"
+#include "block_reader.h"
+#include "mem_acct.h"
+#include "trace.h"
+
+//Read the names of the nameNum rows of a matrix, <sgRNA id> <gene id> per line, into items if it is not NULL, or of its columns, one per line,
+//into sampleNames. Return 1 if success, -1 if failure
+static int ReadMatrixNames(const char *fileName, int nameNum, COUNT_ITEM *items, char (*sampleNames)[COUNT_NAME_LEN]);
+
+//Read a count table, "-" for standard input, in a single pass. File Format: <sgRNA id> <gene id> <count in sample 1> ... <count in sample n>,
+//with a header naming the samples. Each column of counts grows in place as rows are read. Return the number of sgRNAs, or -1 if failure
+int ReadCountTable(const char *fileName, COUNT_TABLE *table)
+{
+	READER_STRUCT *reader;
+	char **words, *line;
+	int i, j, wordNum, capacity, flag;
+	COUNT_ITEM *tmpItems;
+	double *tmpCounts;
+
+	memset(table, 0, sizeof(COUNT_TABLE));
+
+	words = AllocWords(COUNT_MAX_SAMPLES+2, COUNT_NAME_LEN+1);
+
+	if (words == NULL)
+	{
+		return -1;
+	}
+
+	reader = ReaderOpen(fileName);
+
+	if (!reader)
+	{
+		FreeWords(words, COUNT_MAX_SAMPLES+2);
+		return -1;
+	}
+
+	//the header row names the samples
+	line = ReaderGetLine(reader);
+
+	wordNum = line?StringToWords(words, line, COUNT_NAME_LEN+1, COUNT_MAX_SAMPLES+2, " \t\r\n\v\f"):0;
+
+	if (wordNum<3)
+	{
+		printf("Count file format: <sgRNA id> <gene id> <count in sample 1> ... <count in sample n>, with a header\n");
+		ReaderClose(reader);
+		FreeWords(words, COUNT_MAX_SAMPLES+2);
+		return -1;
+	}
+
+	table->sampleNum = wordNum-2;
+	capacity = 1024;
+	table->sampleNames = (char (*)[COUNT_NAME_LEN])MemAlloc(MEM_INPUT, table->sampleNum*COUNT_NAME_LEN);
+	table->items = (COUNT_ITEM *)MemAlloc(MEM_INPUT, capacity*sizeof(COUNT_ITEM));
+	table->counts = (double *)MemAlloc(MEM_INPUT, (long)capacity*table->sampleNum*sizeof(double));
+
+	flag = ((table->sampleNames)&&(table->items)&&(table->counts))?1:-1;
+
+	for (j=0;(j<table->sampleNum)&&(flag>0);j++)
+	{
+		strncpy(table->sampleNames[j], words[2+j], COUNT_NAME_LEN-1);
+		table->sampleNames[j][COUNT_NAME_LEN-1] = 0;
+	}
+
+	line = ReaderGetLine(reader);
+	wordNum = line?StringToWords(words, line, COUNT_NAME_LEN+1, COUNT_MAX_SAMPLES+2, " \t\r\n\v\f"):0;
+
+	TraceBegin("ingest chunk");
+
+	while ((flag>0)&&(wordNum==table->sampleNum+2)&&(!ReaderAtEnd(reader)))
+	{
+		i = table->itemNum;
+
+		if (i>=capacity)
+		{
+			tmpItems = (COUNT_ITEM *)MemRealloc(MEM_INPUT, table->items, 2*(long)capacity*sizeof(COUNT_ITEM));
+
+			if (tmpItems)
+			{
+				table->items = tmpItems;
+			}
+
+			tmpCounts = (double *)MemRealloc(MEM_INPUT, table->counts, 2*(long)capacity*table->sampleNum*sizeof(double));
+
+			if (tmpCounts)
+			{
+				table->counts = tmpCounts;
+			}
+
+			if ((!tmpItems)||(!tmpCounts))
+			{
+				printf("%d sgRNAs read, no memory for more\n", i);
+				flag = -1;
+				break;
+			}
+
+			//column j moves from j*capacity to 2*j*capacity; the last column moves first so that none is overwritten before it moves
+			for (j=table->sampleNum-1;j>0;j--)
+			{
+				memmove(table->counts+2*(long)j*capacity, table->counts+(long)j*capacity, capacity*sizeof(double));
+			}
+
+			capacity *= 2;
+		}
+
+		strcpy(table->items[i].sgName, words[0]);
+		strcpy(table->items[i].geneName, words[1]);
+
+		for (j=0;j<table->sampleNum;j++)
+		{
+			table->counts[(long)j*capacity+i] = atof(words[2+j]);
+		}
+
+		table->itemNum++;
+
+		if (table->itemNum%TRACE_CHUNK_SIZE==0)
+		{
+			TraceEnd("ingest chunk");
+			TraceBegin("ingest chunk");
+		}
+
+		line = ReaderGetLine(reader);
+		wordNum = line?StringToWords(words, line, COUNT_NAME_LEN+1, COUNT_MAX_SAMPLES+2, " \t\r\n\v\f"):0;
+	}
+
+	TraceEnd("ingest chunk");
+
+	FreeWords(words, COUNT_MAX_SAMPLES+2);
+
+	flag = ReaderClose(reader)<0?-1:flag;
+
+	if ((flag<0)||(table->itemNum==0))
+	{
+		FreeCountTable(table);
+		return -1;
+	}
+
+	//the columns are packed to itemNum values each, the first column first
+	for (j=1;j<table->sampleNum;j++)
+	{
+		memmove(table->counts+(long)j*table->itemNum, table->counts+(long)j*capacity, table->itemNum*sizeof(double));
+	}
+
+	return table->itemNum;
+}
+
+//Free the names and counts of table
+void FreeCountTable(COUNT_TABLE *table)
+{
+	MemFree(table->items);
+	MemFree(table->counts);
+	MemFree(table->sampleNames);
+
+	memset(table, 0, sizeof(COUNT_TABLE));
+}
+
+//Read the names of the nameNum rows of a matrix, <sgRNA id> <gene id> per line, into items if it is not NULL, or of its columns, one per line,
+//into sampleNames. Return 1 if success, -1 if failure
+static int ReadMatrixNames(const char *fileName, int nameNum, COUNT_ITEM *items, char (*sampleNames)[COUNT_NAME_LEN])
+{
+	READER_STRUCT *reader;
+	char **words, *line;
+	int i, wordNum;
+
+	words = AllocWords(2, COUNT_NAME_LEN+1);
+	reader = words?ReaderOpen(fileName):NULL;
+
+	if (!reader)
+	{
+		if (words)
+		{
+			FreeWords(words, 2);
+		}
+		return -1;
+	}
+
+	line = ReaderGetLine(reader);
+
+	for (i=0;(i<nameNum)&&(line);i++)
+	{
+		wordNum = StringToWords(words, line, COUNT_NAME_LEN+1, 2, " \t\r\n\v\f");
+
+		if (wordNum<(items?2:1))
+		{
+			break;
+		}
+
+		if (items)
+		{
+			strncpy(items[i].sgName, words[0], COUNT_NAME_LEN-1);
+			items[i].sgName[COUNT_NAME_LEN-1] = 0;
+			strncpy(items[i].geneName, words[1], COUNT_NAME_LEN-1);
+			items[i].geneName[COUNT_NAME_LEN-1] = 0;
+		}
+		else
+		{
+			strncpy(sampleNames[i], words[0], COUNT_NAME_LEN-1);
+			sampleNames[i][COUNT_NAME_LEN-1] = 0;
+		}
+
+		line = ReaderGetLine(reader);
+	}
+
+	FreeWords(words, 2);
+
+	if ((ReaderClose(reader)<0)||(i<nameNum))
+	{
+		printf(items?"%s should name the %d rows of the matrix: <sgRNA id> <gene id> per line\n":"%s should name the %d columns of the matrix, one per line\n",
+			   fileName, nameNum);
+		return -1;
+	}
+
+	return 1;
+}
+
+//Read a sparse count table from a Matrix Market coordinate file, "-" for standard input, with sgRNAs as rows and samples as columns, into rows
+//of nonzero counts (CSR). The row names are read from rowFileName, <sgRNA id> <gene id> per line, and the sample names from columnFileName,
+//one per line, in the order of the matrix. Zero entries are dropped, and each sgRNA and sample should have one entry at most.
+//Memory grows with the nonzero counts. Return the number of sgRNAs, or -1 if failure
+int ReadSparseCountTable(const char *fileName, const char *rowFileName, const char *columnFileName, SPARSE_COUNT_TABLE *table)
+{
+	READER_STRUCT *reader;
+	char *line, *end;
+	int *entryRows;
+	long i, entryNum, rowNum, columnNum, row, column, position;
+	double value;
+	int pattern, flag;
+
+	memset(table, 0, sizeof(SPARSE_COUNT_TABLE));
+
+	reader = ReaderOpen(fileName);
+
+	if (!reader)
+	{
+		return -1;
+	}
+
+	//banner, comments, then the size line: <rows> <columns> <entries>
+	line = ReaderGetLine(reader);
+	flag = (line)&&(strncmp(line, "%%MatrixMarket matrix coordinate", 32)==0)?1:-1;
+	pattern = (flag>0)&&(strstr(line, "pattern"))?1:0;
+
+	while ((flag>0)&&(line)&&(line[0]=='%'))
+	{
+		line = ReaderGetLine(reader);
+	}
+
+	if ((flag<0)||(!line)||(sscanf(line, "%ld %ld %ld", &rowNum, &columnNum, &entryNum)!=3)
+		||(rowNum<=0)||(rowNum>=0x7fffffff)||(columnNum<=0)||(columnNum>=0x7fffffff)||(entryNum<0))
+	{
+		printf("Count matrix format: Matrix Market coordinate, with sgRNAs as rows and samples as columns\n");
+		ReaderClose(reader);
+		return -1;
+	}
+
+	table->itemNum = (int)rowNum;
+	table->sampleNum = (int)columnNum;
+
+	//entries come in any order; they are read as they are, then placed by row
+	entryRows = (int *)MemAlloc(MEM_WORK, (entryNum+1)*sizeof(int));
+	table->columns = (int *)MemAlloc(MEM_INPUT, (entryNum+1)*sizeof(int));
+	table->values = (double *)MemAlloc(MEM_INPUT, (entryNum+1)*sizeof(double));
+	table->rowStart = (long *)MemAlloc(MEM_INPUT, (rowNum+1)*sizeof(long));
+	table->items = (COUNT_ITEM *)MemAlloc(MEM_INPUT, rowNum*sizeof(COUNT_ITEM));
+	table->sampleNames = (char (*)[COUNT_NAME_LEN])MemAlloc(MEM_INPUT, columnNum*COUNT_NAME_LEN);
+
+	flag = ((entryRows)&&(table->columns)&&(table->values)&&(table->rowStart)&&(table->items)&&(table->sampleNames))?1:-1;
+
+	TraceBegin("ingest chunk");
+
+	for (i=0;(flag>0)&&(i<entryNum);i++)
+	{
+		line = ReaderGetLine(reader);
+
+		if (!line)
+		{
+			flag = -1;
+			break;
+		}
+
+		row = strtol(line, &end, 10);
+		column = strtol(end, &end, 10);
+		value = pattern?1.0:strtod(end, &end);
+
+		if ((row<1)||(row>rowNum)||(column<1)||(column>columnNum))
+		{
+			flag = -1;
+			break;
+		}
+
+		if (value!=0.0)
+		{
+			entryRows[table->nonzeroNum] = (int)row-1;
+			table->columns[table->nonzeroNum] = (int)column-1;
+			table->values[table->nonzeroNum] = value;
+			table->nonzeroNum++;
+		}
+
+		if ((i+1)%TRACE_CHUNK_SIZE==0)
+		{
+			TraceEnd("ingest chunk");
+			TraceBegin("ingest chunk");
+		}
+	}
+
+	TraceEnd("ingest chunk");
+
+	if (ReaderClose(reader)<0)
+	{
+		flag = -1;
+	}
+
+	if (flag<0)
+	{
+		printf("%ld of %ld entries of the count matrix read, the matrix is incomplete or has an entry out of range\n", i, entryNum);
+		MemFree(entryRows);
+		FreeSparseCountTable(table);
+		return -1;
+	}
+
+	//rows by a counting sort in place: rowStart[r] is advanced past each entry of row r placed, then shifted back by one row
+	memset(table->rowStart, 0, (rowNum+1)*sizeof(long));
+
+	for (i=0;i<table->nonzeroNum;i++)
+	{
+		table->rowStart[entryRows[i]+1]++;
+	}
+
+	for (row=0;row<rowNum;row++)
+	{
+		table->rowStart[row+1] += table->rowStart[row];
+	}
+
+	//the entries are moved by following cycles of the permutation from entry order to row order, so no second copy is needed.
+	//An entry is placed when its row is marked by -1 in entryRows
+	for (i=0;i<table->nonzeroNum;i++)
+	{
+		while (entryRows[i]>=0)
+		{
+			row = entryRows[i];
+			position = table->rowStart[row]++;
+
+			if (position==i)
+			{
+				entryRows[i] = -1;
+				break;
+			}
+
+			column = table->columns[position];
+			value = table->values[position];
+			table->columns[position] = table->columns[i];
+			table->values[position] = table->values[i];
+			table->columns[i] = (int)column;
+			table->values[i] = value;
+			entryRows[i] = entryRows[position];
+			entryRows[position] = -1;
+		}
+	}
+
+	for (row=rowNum;row>0;row--)
+	{
+		table->rowStart[row] = table->rowStart[row-1];
+	}
+
+	table->rowStart[0] = 0;
+
+	MemFree(entryRows);
+
+	if ((ReadMatrixNames(rowFileName, table->itemNum, table->items, NULL)<0)
+		||(ReadMatrixNames(columnFileName, table->sampleNum, NULL, table->sampleNames)<0))
+	{
+		FreeSparseCountTable(table);
+		return -1;
+	}
+
+	return table->itemNum;
+}
+
+//Free the names and counts of table
+void FreeSparseCountTable(SPARSE_COUNT_TABLE *table)
+{
+	MemFree(table->items);
+	MemFree(table->sampleNames);
+	MemFree(table->rowStart);
+	MemFree(table->columns);
+	MemFree(table->values);
+
+	memset(table, 0, sizeof(SPARSE_COUNT_TABLE));
+}
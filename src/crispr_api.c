@@ -0,0 +1,466 @@
+/*
+ *  crispr_api.c
+ *	C interface to run normalization and RRA on columns held in memory by the caller, as built into libcrispr.so
+ *
+ *  Services that already hold count matrices in memory call these functions instead of writing
+ *  text for CrisprNorm and RRA to parse. Inputs are read in place; only the work arrays of the
+ *  algorithms are allocated, through the memory accounting layer, and freed before returning.
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "crispr_api.h"
+#include "norm_core.h"
+#include "rra_core.h"
+#include "math_api.h"
+#include "mem_acct.h"
+#include "thread_pool.h"
+#include "rngs.h"
+#include "rvgs.h"
+
+#define GRID_TASK_ROWS 8           //rows of the grid of BetaNoncentralGridColumns evaluated by one task
+
+typedef struct
+{
+	const double *a;               //first shape parameter of each row
+	const double *b;               //second shape parameter of each row
+	const double *lambda;          //non-centrality of each row
+	const double *x;               //values of each row
+	int xNum;                      //number of values
+	int rowNum;                    //number of rows
+	int nextRow;                   //first row of the next block of GRID_TASK_ROWS rows, taken by the workers
+	double *work;                  //2*xNum values of each worker
+	double *values;                //CDF of all rows
+} GRID_CONTEXT;
+
+static __thread char apiError[256];                //message of the last failure of the calling thread
+
+//Record the message of a failure. Return -1
+static int SetApiError(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+//Compute the false discovery rate of the groups with items, as ComputeFDR of RRA does with the null distribution kept in memory.
+//groupStart gives the first item of each group in the items ordered by group. Return 1 if success, -1 if failure
+static int ComputeColumnsFDR(const int *groupStart, int groupNum, double maxPercentile, double *loValue, double *fdr);
+
+//Evaluate blocks of rows of the grid taken from the shared counter, in the work array of the worker
+static void BetaGridWorker(void *arg, int workerIndex, int workerNum);
+
+//Record the message of a failure. Return -1
+static int SetApiError(const char *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	vsnprintf(apiError, sizeof(apiError), format, args);
+	va_end(args);
+
+	return -1;
+}
+
+//Return CRISPR_API_VERSION of the library
+int CrisprApiVersion(void)
+{
+	return CRISPR_API_VERSION;
+}
+
+//Return the message of the last failure, or an empty string
+const char *CrisprApiError(void)
+{
+	return apiError;
+}
+
+//Normalize itemNum sgRNAs measured in two libraries, x1 and x2, as CrisprNorm does with window size winSize, on threadNum threads.
+//The log-means, log-ratios and adjusted log-ratios are written to m, r and adjustedR, each of itemNum values.
+//The normalized measures of CrisprNorm are m-adjustedR/2 and m+adjustedR/2. Return 1 if success, -1 if failure
+int CrisprNormColumns(const double *x1, const double *x2, int itemNum, int winSize, int threadNum,
+					  double *m, double *r, double *adjustedR)
+{
+	THREAD_POOL_STRUCT *pool;
+	int flag;
+
+	apiError[0] = 0;
+
+	if ((!x1)||(!x2)||(!m)||(!r)||(!adjustedR))
+	{
+		return SetApiError("missing column");
+	}
+
+	if ((itemNum<=0)||(winSize<=0))
+	{
+		return SetApiError("number of sgRNAs and window size should be positive");
+	}
+
+	pool = ThreadPoolCreate(threadNum>0?threadNum:GetCPUNum());
+
+	if (!pool)
+	{
+		return SetApiError("cannot create threads");
+	}
+
+	flag = ComputeMR(x1, x2, itemNum, m, r);
+
+	if (flag>0)
+	{
+		flag = AdjustMR(m, r, itemNum, winSize, pool, adjustedR, NULL, NULL);
+	}
+
+	ThreadPoolDestroy(pool);
+
+	if (flag<=0)
+	{
+		return SetApiError("no memory for %d sgRNAs", itemNum);
+	}
+
+	return 1;
+}
+
+//Run RRA as RRA does on itemNum items, given by their value, the index of their group from 0 to groupNum-1 and the index of
+//their list from 0 to listNum-1. The lo-value and false discovery rate of each group are written to loValue and fdr, each of
+//groupNum values. Groups numbered in order of first appearance give the same results as RRA on the same input.
+//A group without items gets a lo-value and a false discovery rate of 1. Return 1 if success, -1 if failure
+int RRAColumns(const double *values, const int *groupIds, const int *listIds, int itemNum, int groupNum, int listNum,
+			   double maxPercentile, double *loValue, double *fdr)
+{
+	int i, j, k;
+	int *listStart, *groupStart, *fill;
+	double *sortedValues, *percentiles;
+	LO_BATCH_STRUCT *batch;
+	int maxItemNum, flag;
+
+	apiError[0] = 0;
+
+	if ((!values)||(!groupIds)||(!listIds)||(!loValue)||(!fdr))
+	{
+		return SetApiError("missing column");
+	}
+
+	if ((itemNum<=0)||(groupNum<=0)||(listNum<=0))
+	{
+		return SetApiError("numbers of items, groups and lists should be positive");
+	}
+
+	if ((maxPercentile>1.0)||(maxPercentile<0.0))
+	{
+		return SetApiError("maxPercentile should be within 0.0 and 1.0");
+	}
+
+	for (i=0;i<itemNum;i++)
+	{
+		if ((groupIds[i]<0)||(groupIds[i]>=groupNum)||(listIds[i]<0)||(listIds[i]>=listNum))
+		{
+			return SetApiError("item %d: group %d or list %d out of range", i, groupIds[i], listIds[i]);
+		}
+	}
+
+	listStart = (int *)MemCalloc(MEM_WORK, listNum+1, sizeof(int));
+	groupStart = (int *)MemCalloc(MEM_WORK, groupNum+1, sizeof(int));
+	fill = (int *)MemAlloc(MEM_WORK, (listNum>groupNum?listNum:groupNum)*sizeof(int));
+	sortedValues = (double *)MemAlloc(MEM_LISTS, itemNum*sizeof(double));
+	percentiles = (double *)MemAlloc(MEM_GROUPS, itemNum*sizeof(double));
+
+	if ((!listStart)||(!groupStart)||(!fill)||(!sortedValues)||(!percentiles))
+	{
+		MemFree(listStart);
+		MemFree(groupStart);
+		MemFree(fill);
+		MemFree(sortedValues);
+		MemFree(percentiles);
+		return SetApiError("no memory for %d items", itemNum);
+	}
+
+	//the values of each list, and the percentiles of each group, are gathered in consecutive ranges
+	for (i=0;i<itemNum;i++)
+	{
+		listStart[listIds[i]+1]++;
+		groupStart[groupIds[i]+1]++;
+	}
+
+	for (j=0;j<listNum;j++)
+	{
+		listStart[j+1] += listStart[j];
+	}
+
+	for (j=0;j<groupNum;j++)
+	{
+		groupStart[j+1] += groupStart[j];
+	}
+
+	memset(fill, 0, listNum*sizeof(int));
+
+	for (i=0;i<itemNum;i++)
+	{
+		sortedValues[listStart[listIds[i]]+fill[listIds[i]]] = values[i];
+		fill[listIds[i]]++;
+	}
+
+	for (j=0;j<listNum;j++)
+	{
+		QuicksortF(sortedValues, listStart[j], listStart[j+1]-1);
+	}
+
+	memset(fill, 0, groupNum*sizeof(int));
+
+	for (i=0;i<itemNum;i++)
+	{
+		j = listIds[i];
+		k = groupIds[i];
+
+		percentiles[groupStart[k]+fill[k]] = ListPercentile(values[i], sortedValues+listStart[j], listStart[j+1]-listStart[j]);
+		fill[k]++;
+	}
+
+	maxItemNum = 0;
+
+	for (k=0;k<groupNum;k++)
+	{
+		maxItemNum = fill[k]>maxItemNum?fill[k]:maxItemNum;
+	}
+
+	batch = LoBatchCreate(AGG_RRA, maxItemNum, maxPercentile);
+	flag = batch?1:-1;
+
+	for (k=0;(k<groupNum)&&(flag>0);k++)
+	{
+		loValue[k] = 1.0;
+
+		if (groupStart[k+1]>groupStart[k])
+		{
+			flag = LoBatchAdd(batch, percentiles+groupStart[k], groupStart[k+1]-groupStart[k], loValue+k);
+		}
+	}
+
+	if (flag>0)
+	{
+		flag = LoBatchFlush(batch);
+	}
+
+	LoBatchFree(batch);
+
+	if (flag>0)
+	{
+		flag = ComputeColumnsFDR(groupStart, groupNum, maxPercentile, loValue, fdr);
+	}
+
+	MemFree(listStart);
+	MemFree(fill);
+	MemFree(sortedValues);
+	MemFree(percentiles);
+	MemFree(groupStart);
+
+	if (flag<=0)
+	{
+		return SetApiError("no memory for the false discovery rate of %d groups", groupNum);
+	}
+
+	return 1;
+}
+
+//Compute the false discovery rate of the groups with items, as ComputeFDR of RRA does with the null distribution kept in memory.
+//groupStart gives the first item of each group in the items ordered by group. Return 1 if success, -1 if failure
+static int ComputeColumnsFDR(const int *groupStart, int groupNum, double maxPercentile, double *loValue, double *fdr)
+{
+	int i, j, k;
+	int usedNum, maxItemNum, itemNum, scanPass, randLoValueNum;
+	double *tmpPercentile, *randLoValue;
+	INDEXED_FLOAT *order;
+	LO_BATCH_STRUCT *batch;
+
+	usedNum = 0;
+	maxItemNum = 0;
+
+	for (k=0;k<groupNum;k++)
+	{
+		fdr[k] = 1.0;
+		itemNum = groupStart[k+1]-groupStart[k];
+
+		if (itemNum>0)
+		{
+			usedNum++;
+		}
+
+		if (itemNum>maxItemNum)
+		{
+			maxItemNum = itemNum;
+		}
+	}
+
+	//RRA simulates RAND_PASS_NUM*groupNum random groups, in passes over all groups
+	scanPass = RAND_PASS_NUM+1;
+
+	tmpPercentile = (double *)MemAlloc(MEM_WORK, maxItemNum*sizeof(double));
+	randLoValue = (double *)MemAlloc(MEM_NULL, (long)usedNum*scanPass*sizeof(double));
+	order = (INDEXED_FLOAT *)MemAlloc(MEM_WORK, usedNum*sizeof(INDEXED_FLOAT));
+	batch = LoBatchCreate(AGG_RRA, maxItemNum, maxPercentile);
+
+	if ((!tmpPercentile)||(!randLoValue)||(!order)||(!batch))
+	{
+		MemFree(tmpPercentile);
+		MemFree(randLoValue);
+		MemFree(order);
+		LoBatchFree(batch);
+		return -1;
+	}
+
+	randLoValueNum = 0;
+
+	PlantSeeds(RAND_SEED);
+
+	for (i=0;i<scanPass;i++)
+	{
+		for (k=0;k<groupNum;k++)
+		{
+			itemNum = groupStart[k+1]-groupStart[k];
+
+			if (itemNum==0)
+			{
+				continue;
+			}
+
+			for (j=0;j<itemNum;j++)
+			{
+				tmpPercentile[j] = Uniform(0.0, 1.0);
+			}
+
+			LoBatchAdd(batch, tmpPercentile, itemNum, randLoValue+randLoValueNum);
+			randLoValueNum++;
+		}
+	}
+
+	LoBatchFlush(batch);
+	LoBatchFree(batch);
+
+	QuicksortF(randLoValue, 0, randLoValueNum-1);
+
+	//groups are ranked by lo-value with the same sort as RRA, so that tied groups get the same rates
+	j = 0;
+
+	for (k=0;k<groupNum;k++)
+	{
+		if (groupStart[k+1]>groupStart[k])
+		{
+			order[j].value = loValue[k];
+			order[j].index = k;
+			j++;
+		}
+	}
+
+	QuicksortIndexedArray(order, 0, usedNum-1);
+
+	for (i=0;i<usedNum;i++)
+	{
+		fdr[order[i].index] = NullRankFDR(order[i].value, i, usedNum, randLoValue, randLoValueNum);
+	}
+
+	if (fdr[order[usedNum-1].index]>1.0)
+	{
+		fdr[order[usedNum-1].index] = 1.0;
+	}
+
+	for (i=usedNum-2;i>=0;i--)
+	{
+		if (fdr[order[i].index]>fdr[order[i+1].index])
+		{
+			fdr[order[i].index] = fdr[order[i+1].index];
+		}
+	}
+
+	MemFree(tmpPercentile);
+	MemFree(randLoValue);
+	MemFree(order);
+
+	return 1;
+}
+
+//Evaluate blocks of rows of the grid taken from the shared counter, in the work array of the worker
+static void BetaGridWorker(void *arg, int workerIndex, int workerNum)
+{
+	GRID_CONTEXT *context = (GRID_CONTEXT *)arg;
+	double *work = context->work+2*(long)workerIndex*context->xNum;
+	int r, start;
+
+	while ((start = __atomic_fetch_add(&(context->nextRow), GRID_TASK_ROWS, __ATOMIC_RELAXED))<context->rowNum)
+	{
+		for (r=start;(r<start+GRID_TASK_ROWS)&&(r<context->rowNum);r++)
+		{
+			BetaNoncentralRow(context->a[r], context->b[r], context->lambda[r], context->x, context->xNum, CDF_MAX_ERROR, work,
+							  context->values+(long)r*context->xNum);
+		}
+	}
+}
+
+//CDF of the non-central beta distribution on a grid of rowNum rows of parameters a, b and lambda by xNum values x, as BetaNoncentralCdf gives
+//with the error of RRA, into values[r*xNum+i] for row r and value x[i], for power and calibration studies. Each row computes its log beta
+//function and Poisson weights once and advances all x together; rows run in parallel on threadNum threads, each with its own work array.
+//Return 1 if success, -1 if failure
+int BetaNoncentralGridColumns(const double *a, const double *b, const double *lambda, int rowNum, const double *x, int xNum, int threadNum,
+							  double *values)
+{
+	THREAD_POOL_STRUCT *pool;
+	GRID_CONTEXT context;
+	int i, workerNum;
+
+	apiError[0] = 0;
+
+	if ((!a)||(!b)||(!lambda)||(!x)||(!values))
+	{
+		return SetApiError("missing column");
+	}
+
+	if ((rowNum<=0)||(xNum<=0))
+	{
+		return SetApiError("numbers of rows and values should be positive");
+	}
+
+	//the Poisson series runs until its weights sum to 1-CDF_MAX_ERROR, which exp(-lambda/2) must not underflow
+	for (i=0;i<rowNum;i++)
+	{
+		if ((a[i]<=0.0)||(b[i]<=0.0)||(lambda[i]<0.0)||(lambda[i]>1000.0))
+		{
+			return SetApiError("row %d: a and b should be positive and lambda within 0 and 1000", i);
+		}
+	}
+
+	for (i=0;i<xNum;i++)
+	{
+		if ((x[i]<0.0)||(x[i]>1.0))
+		{
+			return SetApiError("value %d: x should be within 0 and 1", i);
+		}
+	}
+
+	pool = ThreadPoolCreate(threadNum>0?threadNum:GetCPUNum());
+	workerNum = (pool)&&(pool->threadNum>0)?pool->threadNum:1;
+	context.work = pool?(double *)MemAlloc(MEM_WORK, 2*(long)workerNum*xNum*sizeof(double)):NULL;
+
+	if (!context.work)
+	{
+		if (pool)
+		{
+			ThreadPoolDestroy(pool);
+		}
+		return SetApiError("no memory or threads for a grid of %d rows", rowNum);
+	}
+
+	//each worker evaluates blocks of rows in its own work array and writes its own rows, so the workers run independently
+	context.a = a;
+	context.b = b;
+	context.lambda = lambda;
+	context.x = x;
+	context.xNum = xNum;
+	context.rowNum = rowNum;
+	context.nextRow = 0;
+	context.values = values;
+
+	ThreadPoolBroadcast(pool, BetaGridWorker, &context);
+	ThreadPoolDestroy(pool);
+
+	MemFree(context.work);
+
+	return 1;
+}
@@ -0,0 +1,201 @@
+/*
+ *  dict.c
+ *	Dictionary of names, mapping each distinct name to a dense index
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "dict.h"
+#include "mem_acct.h"
+
+//Grow the hash table to newSize slots and re-insert all names
+static int DictRehash(DICT_STRUCT *dict, int newSize);
+
+//Hash value of a string (FNV-1a)
+unsigned int DictHash(const char *name)
+{
+	unsigned int h = 2166136261u;
+
+	while (*name)
+	{
+		h ^= (unsigned char)(*name);
+		h *= 16777619u;
+		name++;
+	}
+
+	return h;
+}
+
+//Create an empty dictionary. initCapacity is a hint of the number of names. Return NULL if failure
+DICT_STRUCT *DictCreate(int initCapacity)
+{
+	DICT_STRUCT *dict;
+	int tableSize;
+
+	if (initCapacity<16)
+	{
+		initCapacity = 16;
+	}
+
+	tableSize = 16;
+
+	while (tableSize<initCapacity*2)
+	{
+		tableSize *= 2;
+	}
+
+	dict = (DICT_STRUCT *)MemAlloc(MEM_INPUT, sizeof(DICT_STRUCT));
+
+	if (!dict)
+	{
+		return NULL;
+	}
+
+	dict->names = (char **)MemAlloc(MEM_INPUT, initCapacity*sizeof(char *));
+	dict->table = (int *)MemCalloc(MEM_INPUT, tableSize, sizeof(int));
+
+	if ((!dict->names)||(!dict->table))
+	{
+		MemFree(dict->names);
+		MemFree(dict->table);
+		MemFree(dict);
+		return NULL;
+	}
+
+	dict->num = 0;
+	dict->capacity = initCapacity;
+	dict->tableSize = tableSize;
+
+	return dict;
+}
+
+//Free a dictionary
+void DictFree(DICT_STRUCT *dict)
+{
+	int i;
+
+	if (!dict)
+	{
+		return;
+	}
+
+	for (i=0;i<dict->num;i++)
+	{
+		MemFree(dict->names[i]);
+	}
+
+	MemFree(dict->names);
+	MemFree(dict->table);
+	MemFree(dict);
+}
+
+//Look up a name. Return its index, or -1 if the name is not in the dictionary
+int DictLookup(DICT_STRUCT *dict, const char *name)
+{
+	unsigned int slot;
+	int mask = dict->tableSize-1;
+
+	slot = DictHash(name)&mask;
+
+	while (dict->table[slot])
+	{
+		if (!strcmp(dict->names[dict->table[slot]-1], name))
+		{
+			return dict->table[slot]-1;
+		}
+		slot = (slot+1)&mask;
+	}
+
+	return -1;
+}
+
+//Insert a name if it is not in the dictionary yet. Return the index of the name, or -1 if failure
+int DictInsert(DICT_STRUCT *dict, const char *name)
+{
+	unsigned int slot;
+	int mask = dict->tableSize-1;
+	char **tmpNames;
+
+	slot = DictHash(name)&mask;
+
+	while (dict->table[slot])
+	{
+		if (!strcmp(dict->names[dict->table[slot]-1], name))
+		{
+			return dict->table[slot]-1;
+		}
+		slot = (slot+1)&mask;
+	}
+
+	if (dict->num>=dict->capacity)
+	{
+		tmpNames = (char **)MemRealloc(MEM_INPUT, dict->names, 2*dict->capacity*sizeof(char *));
+
+		if (!tmpNames)
+		{
+			return -1;
+		}
+
+		dict->names = tmpNames;
+		dict->capacity *= 2;
+	}
+
+	dict->names[dict->num] = (char *)MemAlloc(MEM_INPUT, (strlen(name)+1)*sizeof(char));
+
+	if (!dict->names[dict->num])
+	{
+		return -1;
+	}
+
+	strcpy(dict->names[dict->num], name);
+	dict->table[slot] = dict->num+1;
+	dict->num++;
+
+	//keep the load factor of the hash table under 0.5
+	if (dict->num*2>dict->tableSize)
+	{
+		if (DictRehash(dict, dict->tableSize*2)<0)
+		{
+			return -1;
+		}
+	}
+
+	return dict->num-1;
+}
+
+//Grow the hash table to newSize slots and re-insert all names
+static int DictRehash(DICT_STRUCT *dict, int newSize)
+{
+	int *newTable;
+	int i;
+	unsigned int slot;
+
+	newTable = (int *)MemCalloc(MEM_INPUT, newSize, sizeof(int));
+
+	if (!newTable)
+	{
+		return -1;
+	}
+
+	for (i=0;i<dict->num;i++)
+	{
+		slot = DictHash(dict->names[i])&(newSize-1);
+
+		while (newTable[slot])
+		{
+			slot = (slot+1)&(newSize-1);
+		}
+
+		newTable[slot] = i+1;
+	}
+
+	MemFree(dict->table);
+	dict->table = newTable;
+	dict->tableSize = newSize;
+
+	return 1;
+}
@@ -0,0 +1,566 @@
+/*
+ *  exec_ctx.c
+ *	Execution context: NUMA topology, pinning of worker threads, interleaving and huge pages for large buffers
+ *
+ *  The topology is read from /sys/devices/system/node. Linux places a page on the node of the
+ *  thread that first writes it, so a buffer filled by the main thread ends up on one node. With
+ *  --numa, workers are pinned to CPUs spread over the nodes in turn, and ExecInterleave sets an
+ *  interleaved policy with mbind on a buffer that all workers read at any position, such as the
+ *  sorted arrays whose windows AdjustMR tasks read, so that its pages are spread over the nodes
+ *  whichever thread fills it. Tasks are pulled from the pool dynamically, so there is no fixed
+ *  partition of such a buffer by worker to place by first touch. Buffers of EXEC_LARGE_BUFFER bytes or more are
+ *  mapped separately so they can be backed by huge pages, which saves TLB misses on the sorted
+ *  lists, the null distribution and item arrays. Where their pages landed is sampled with
+ *  move_pages and AnonHugePages of /proc/self/smaps, when a buffer is unmapped and at the report.
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "exec_ctx.h"
+#include "mem_acct.h"
+
+#if !defined( MAP_HUGETLB )
+#define MAP_HUGETLB 0x40000
+#endif
+
+#if !defined( MADV_HUGEPAGE )
+#define MADV_HUGEPAGE 14
+#endif
+
+#if !defined( MPOL_INTERLEAVE )
+#define MPOL_INTERLEAVE 3
+#endif
+
+typedef struct
+{
+	char *start;                   //start of the mapping
+	size_t size;                   //size of the mapping
+	int subsystem;                 //subsystem charged for the buffer
+	int explicitHuge;              //1 if mapped from the explicit huge page pool
+} EXEC_REGION;
+
+typedef struct
+{
+	long buffers;                  //number of large buffers mapped
+	double bytes;                  //bytes mapped
+	double hugeBytes;              //bytes backed by huge pages when sampled
+	double nodePages[EXEC_MAX_NODE_NUM+1];  //sampled pages on each node, the last for pages not present
+} EXEC_PLACEMENT;
+
+static int execNuma = 0;                           //1 if pinning and interleaving are on
+static int execHugePages = HUGE_PAGES_OFF;         //how large buffers are backed
+static int execReport = 0;                         //1 if the placement of large buffers is sampled
+static int execNodeNum = 1;                        //number of NUMA nodes
+static int execCpuNum = 0;                         //number of CPUs in cpuOrder
+static int *cpuOrder = NULL;                       //CPUs in the order workers are pinned: one per node in turn
+static int *cpuNode = NULL;                        //node of each CPU in cpuOrder
+static int hugeWarned = 0;                         //1 after the fallback from explicit huge pages was printed
+static int interleaveWarned = 0;                   //1 after the failure of mbind was printed
+static EXEC_REGION regions[EXEC_MAX_REGION_NUM];   //live large buffers
+static int regionNum = 0;
+static EXEC_PLACEMENT *placements = NULL;          //placement of large buffers of each subsystem
+static pthread_mutex_t execMutex = PTHREAD_MUTEX_INITIALIZER;
+
+//Read a CPU list such as 0-3,8-11 into cpus. Return the number of CPUs
+static int ReadCpuList(const char *fileName, int *cpus, int maxCpuNum);
+
+//Add the sampled placement of a region to the placement of its subsystem
+static void SampleRegion(EXEC_REGION *region);
+
+//Return the bytes of AnonHugePages of the mapping starting at start, from /proc/self/smaps
+static double HugeBytesOfMapping(const char *start);
+
+//Read a CPU list such as 0-3,8-11 into cpus. Return the number of CPUs
+static int ReadCpuList(const char *fileName, int *cpus, int maxCpuNum)
+{
+	FILE *fh;
+	char text[4096], *p, *next;
+	long first, last, i;
+	int cpuNum;
+
+	fh = (FILE *)fopen(fileName, "r");
+
+	if (!fh)
+	{
+		return 0;
+	}
+
+	if (!fgets(text, sizeof(text), fh))
+	{
+		fclose(fh);
+		return 0;
+	}
+
+	fclose(fh);
+
+	cpuNum = 0;
+	p = text;
+
+	while ((*p>='0')&&(*p<='9'))
+	{
+		first = strtol(p, &next, 10);
+		last = first;
+
+		if (*next=='-')
+		{
+			last = strtol(next+1, &next, 10);
+		}
+
+		for (i=first;(i<=last)&&(cpuNum<maxCpuNum);i++)
+		{
+			cpus[cpuNum] = (int)i;
+			cpuNum++;
+		}
+
+		p = (*next==',')?next+1:next;
+	}
+
+	return cpuNum;
+}
+
+//Detect the NUMA topology and set the options. With numa, worker threads are pinned and large buffers read by all workers are
+//interleaved over the nodes. hugePages is one of HUGE_PAGES_OFF, HUGE_PAGES_THP or HUGE_PAGES_EXPLICIT. With report, the placement of
+//large buffers is sampled for ExecReport. Return 1 if success, -1 if failure
+int ExecInit(int numa, int hugePages, int report)
+{
+	char fileName[256];
+	int **nodeCpus, *nodeCpuNum;
+	int maxCpuNum, node, i, k;
+
+	execNuma = numa?1:0;
+	execHugePages = hugePages;
+	execReport = report?1:0;
+
+	maxCpuNum = (int)sysconf(_SC_NPROCESSORS_CONF);
+	maxCpuNum = maxCpuNum>0?maxCpuNum:1;
+
+	placements = (EXEC_PLACEMENT *)calloc(MEM_SUBSYSTEM_NUM, sizeof(EXEC_PLACEMENT));
+	cpuOrder = (int *)malloc(maxCpuNum*sizeof(int));
+	cpuNode = (int *)malloc(maxCpuNum*sizeof(int));
+	nodeCpus = (int **)calloc(EXEC_MAX_NODE_NUM, sizeof(int *));
+	nodeCpuNum = (int *)calloc(EXEC_MAX_NODE_NUM, sizeof(int));
+
+	if ((!placements)||(!cpuOrder)||(!cpuNode)||(!nodeCpus)||(!nodeCpuNum))
+	{
+		return -1;
+	}
+
+	//nodes are numbered from 0; a machine without NUMA support has no node directory and is one node
+	execNodeNum = 0;
+
+	for (node=0;node<EXEC_MAX_NODE_NUM;node++)
+	{
+		sprintf(fileName, "/sys/devices/system/node/node%d/cpulist", node);
+
+		if (access(fileName, R_OK)!=0)
+		{
+			break;
+		}
+
+		nodeCpus[node] = (int *)malloc(maxCpuNum*sizeof(int));
+
+		if (!nodeCpus[node])
+		{
+			return -1;
+		}
+
+		nodeCpuNum[node] = ReadCpuList(fileName, nodeCpus[node], maxCpuNum);
+		execNodeNum++;
+	}
+
+	execCpuNum = 0;
+
+	if (execNodeNum==0)
+	{
+		execNodeNum = 1;
+
+		for (i=0;i<maxCpuNum;i++)
+		{
+			cpuOrder[i] = i;
+			cpuNode[i] = 0;
+		}
+
+		execCpuNum = maxCpuNum;
+	}
+	else
+	{
+		//interleave the nodes: first CPU of each node, then the second, ...
+		for (k=0;execCpuNum<maxCpuNum;k++)
+		{
+			i = execCpuNum;
+
+			for (node=0;node<execNodeNum;node++)
+			{
+				if ((k<nodeCpuNum[node])&&(execCpuNum<maxCpuNum))
+				{
+					cpuOrder[execCpuNum] = nodeCpus[node][k];
+					cpuNode[execCpuNum] = node;
+					execCpuNum++;
+				}
+			}
+
+			if (i==execCpuNum)
+			{
+				break;
+			}
+		}
+	}
+
+	for (node=0;node<EXEC_MAX_NODE_NUM;node++)
+	{
+		free(nodeCpus[node]);
+	}
+
+	free(nodeCpus);
+	free(nodeCpuNum);
+
+	return 1;
+}
+
+//Parse the value of --huge-pages: off, thp or explicit. Return -1 if unknown
+int ParseHugePages(const char *value)
+{
+	if (strcmp(value, "off")==0)
+	{
+		return HUGE_PAGES_OFF;
+	}
+
+	if (strcmp(value, "thp")==0)
+	{
+		return HUGE_PAGES_THP;
+	}
+
+	if (strcmp(value, "explicit")==0)
+	{
+		return HUGE_PAGES_EXPLICIT;
+	}
+
+	return -1;
+}
+
+//Return the number of NUMA nodes
+int ExecNodeNum(void)
+{
+	return execNodeNum;
+}
+
+//Pin the calling worker thread to a CPU. Workers are spread over the nodes in turn. Does nothing unless numa is on
+void ExecPinWorker(int workerIndex)
+{
+	cpu_set_t cpuSet;
+
+	if ((!execNuma)||(execCpuNum<=0))
+	{
+		return;
+	}
+
+	CPU_ZERO(&cpuSet);
+	CPU_SET(cpuOrder[workerIndex%execCpuNum], &cpuSet);
+
+	if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuSet)!=0)
+	{
+		printf("Cannot pin worker %d to CPU %d\n", workerIndex, cpuOrder[workerIndex%execCpuNum]);
+	}
+}
+
+//Interleave the pages of a buffer over the NUMA nodes, for a buffer that is read by all workers wherever they are. Call before the
+//buffer is written: pages already placed stay where they are. Does nothing unless numa is on and there are several nodes
+void ExecInterleave(void *ptr, size_t size)
+{
+	unsigned long nodeMask[EXEC_MAX_NODE_NUM/(8*sizeof(unsigned long))+1];
+	size_t pageSize, start, end;
+	int node;
+
+	if ((!execNuma)||(execNodeNum<=1)||(!ptr)||(size<EXEC_LARGE_BUFFER))
+	{
+		return;
+	}
+
+	memset(nodeMask, 0, sizeof(nodeMask));
+
+	for (node=0;node<execNodeNum;node++)
+	{
+		nodeMask[node/(8*sizeof(unsigned long))] |= 1UL<<(node%(8*sizeof(unsigned long)));
+	}
+
+	//mbind takes whole pages; the partial pages at the ends, shared with the allocation header, keep their placement
+	pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	start = ((size_t)ptr+pageSize-1)/pageSize*pageSize;
+	end = ((size_t)ptr+size)/pageSize*pageSize;
+
+	if ((start<end)&&(syscall(SYS_mbind, start, end-start, MPOL_INTERLEAVE, nodeMask, EXEC_MAX_NODE_NUM+1, 0)!=0)
+		&&(!__atomic_exchange_n(&interleaveWarned, 1, __ATOMIC_RELAXED)))
+	{
+		printf("Cannot interleave buffers over the NUMA nodes\n");
+	}
+}
+
+//Map a large buffer backed by huge pages as set by ExecInit. subsystem is recorded for the report. Return NULL if large buffers
+//are not mapped (HUGE_PAGES_OFF) or if failure
+void *ExecMapLarge(size_t size, int subsystem)
+{
+	void *ptr;
+	size_t hugeSize;
+	int explicitHuge;
+
+	if ((execHugePages==HUGE_PAGES_OFF)||(size<EXEC_LARGE_BUFFER))
+	{
+		return NULL;
+	}
+
+	ptr = MAP_FAILED;
+	explicitHuge = 0;
+
+	if (execHugePages==HUGE_PAGES_EXPLICIT)
+	{
+		hugeSize = (size+EXEC_LARGE_BUFFER-1)/EXEC_LARGE_BUFFER*EXEC_LARGE_BUFFER;
+		ptr = mmap(NULL, hugeSize, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+
+		if (ptr!=MAP_FAILED)
+		{
+			explicitHuge = 1;
+		}
+		else if (!__atomic_exchange_n(&hugeWarned, 1, __ATOMIC_RELAXED))
+		{
+			printf("explicit huge pages unavailable, see /proc/sys/vm/nr_hugepages; using transparent huge pages\n");
+		}
+	}
+
+	if (ptr==MAP_FAILED)
+	{
+		ptr = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+
+		if (ptr==MAP_FAILED)
+		{
+			return NULL;
+		}
+
+		madvise(ptr, size, MADV_HUGEPAGE);
+	}
+
+	pthread_mutex_lock(&execMutex);
+
+	if (regionNum<EXEC_MAX_REGION_NUM)
+	{
+		regions[regionNum].start = (char *)ptr;
+		regions[regionNum].size = size;
+		regions[regionNum].subsystem = subsystem;
+		regions[regionNum].explicitHuge = explicitHuge;
+		regionNum++;
+	}
+
+	if (placements)
+	{
+		placements[subsystem].buffers++;
+	}
+
+	pthread_mutex_unlock(&execMutex);
+
+	return ptr;
+}
+
+//Unmap a buffer mapped by ExecMapLarge
+void ExecUnmapLarge(void *ptr, size_t size)
+{
+	int i;
+	size_t mapSize;
+
+	mapSize = size;
+
+	pthread_mutex_lock(&execMutex);
+
+	for (i=0;i<regionNum;i++)
+	{
+		if (regions[i].start==(char *)ptr)
+		{
+			if (regions[i].explicitHuge)
+			{
+				mapSize = (size+EXEC_LARGE_BUFFER-1)/EXEC_LARGE_BUFFER*EXEC_LARGE_BUFFER;
+			}
+
+			SampleRegion(regions+i);
+
+			regionNum--;
+			regions[i] = regions[regionNum];
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&execMutex);
+
+	munmap(ptr, mapSize);
+}
+
+//Return the bytes of AnonHugePages of the mapping starting at start, from /proc/self/smaps
+static double HugeBytesOfMapping(const char *start)
+{
+	FILE *fh;
+	char line[512];
+	unsigned long mapStart;
+	int inMapping;
+	long kb;
+
+	fh = (FILE *)fopen("/proc/self/smaps", "r");
+
+	if (!fh)
+	{
+		return 0.0;
+	}
+
+	inMapping = 0;
+
+	while (fgets(line, sizeof(line), fh))
+	{
+		//a mapping starts with a line "start-end perms ..."
+		if ((strchr(line, '-'))&&(sscanf(line, "%lx-", &mapStart)==1)&&(strchr(line, ' ')>strchr(line, '-')))
+		{
+			inMapping = (mapStart==(unsigned long)start)?1:0;
+			continue;
+		}
+
+		if ((inMapping)&&(sscanf(line, "AnonHugePages: %ld kB", &kb)==1))
+		{
+			fclose(fh);
+			return kb*1024.0;
+		}
+	}
+
+	fclose(fh);
+
+	return 0.0;
+}
+
+//Add the sampled placement of a region to the placement of its subsystem. Called with execMutex held
+static void SampleRegion(EXEC_REGION *region)
+{
+	void *pages[EXEC_SAMPLE_PAGES];
+	int status[EXEC_SAMPLE_PAGES];
+	long pageNum, sampleNum, i;
+	EXEC_PLACEMENT *placement;
+
+	if ((!placements)||(!execReport))
+	{
+		return;
+	}
+
+	placement = placements+region->subsystem;
+	placement->bytes += region->size;
+	placement->hugeBytes += region->explicitHuge?region->size:HugeBytesOfMapping(region->start);
+
+	pageNum = (region->size+4095)/4096;
+	sampleNum = pageNum<EXEC_SAMPLE_PAGES?pageNum:EXEC_SAMPLE_PAGES;
+
+	for (i=0;i<sampleNum;i++)
+	{
+		pages[i] = region->start+(pageNum*i/sampleNum)*4096;
+		status[i] = -1;
+	}
+
+	//with no target nodes, move_pages reports the node of each page, or a negative errno if the page is not present
+	if (syscall(SYS_move_pages, 0, sampleNum, pages, NULL, status, 0)!=0)
+	{
+		for (i=0;i<sampleNum;i++)
+		{
+			status[i] = -1;
+		}
+	}
+
+	for (i=0;i<sampleNum;i++)
+	{
+		if ((status[i]>=0)&&(status[i]<EXEC_MAX_NODE_NUM))
+		{
+			placement->nodePages[status[i]] += (double)pageNum/sampleNum;
+		}
+		else
+		{
+			placement->nodePages[EXEC_MAX_NODE_NUM] += (double)pageNum/sampleNum;
+		}
+	}
+}
+
+//Print the topology, the options and where the pages of the large buffers of each subsystem were placed
+void ExecReport(FILE *fh, const char **subsystemNames, int subsystemNum)
+{
+	int i, node;
+	long bufferNum;
+	EXEC_PLACEMENT *placement;
+	const char *hugeNames[3] = {"off", "thp", "explicit"};
+
+	if (!placements)
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&execMutex);
+
+	//buffers still mapped are sampled now
+	for (i=0;i<regionNum;i++)
+	{
+		SampleRegion(regions+i);
+	}
+
+	regionNum = 0;
+
+	fprintf(fh, "execution context: %d NUMA node(s), %d CPU(s), pinning %s, huge pages %s\n",
+			execNodeNum, execCpuNum, execNuma?"on":"off", hugeNames[execHugePages]);
+	for (i=0,bufferNum=0;i<subsystemNum;i++)
+	{
+		bufferNum += placements[i].buffers;
+	}
+
+	if (!execReport)
+	{
+		pthread_mutex_unlock(&execMutex);
+		return;
+	}
+
+	//only mapped buffers are tracked, so without huge pages there is nothing to sample
+	if (bufferNum==0)
+	{
+		fprintf(fh, "placement of large buffers: none mapped%s\n", execHugePages==HUGE_PAGES_OFF?", as they are mapped separately only with huge pages":"");
+		pthread_mutex_unlock(&execMutex);
+		return;
+	}
+
+	fprintf(fh, "placement of large buffers (pages sampled with move_pages):\n");
+	fprintf(fh, "subsystem\tbuffers\tMB\thuge_page_MB");
+
+	for (node=0;node<execNodeNum;node++)
+	{
+		fprintf(fh, "\tnode%d_MB", node);
+	}
+
+	fprintf(fh, "\tnot_present_MB\n");
+
+	for (i=0;i<subsystemNum;i++)
+	{
+		placement = placements+i;
+
+		if (placement->buffers==0)
+		{
+			continue;
+		}
+
+		fprintf(fh, "%s\t%ld\t%.2f\t%.2f", subsystemNames[i], placement->buffers, placement->bytes/1048576.0, placement->hugeBytes/1048576.0);
+
+		for (node=0;node<execNodeNum;node++)
+		{
+			fprintf(fh, "\t%.2f", placement->nodePages[node]*4096/1048576.0);
+		}
+
+		fprintf(fh, "\t%.2f\n", placement->nodePages[EXEC_MAX_NODE_NUM]*4096/1048576.0);
+	}
+
+	pthread_mutex_unlock(&execMutex);
+}
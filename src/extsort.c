@@ -0,0 +1,650 @@
+/*
+ *  extsort.c
+ *	External sort of fixed-size records, for data sets larger than memory
+ *
+ *  Records are collected in a memory buffer. When the buffer is full it is sorted and
+ *  spilled to a temporary file as a sorted run. Runs are combined by k-way merges with
+ *  a min-heap; when there are more runs than the memory budget allows to merge at once,
+ *  intermediate passes merge them into longer runs first.
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "extsort.h"
+#include "mem_acct.h"
+#include "trace.h"
+
+//Sort the records in the buffer and write them to a new run. Return 1 if success, -1 if failure
+static int SpillRun(EXTSORT_STRUCT *sorter);
+
+//Prepare a k-way merge of runs[0..runNum-1]. Return 1 if success, -1 if failure
+static int MergeStart(EXTSORT_STRUCT *sorter, FILE **runs, int runNum);
+
+//Pop the smallest record of a k-way merge. Return 1 if a record is read, 0 if no record is left, -1 if failure
+static int MergePop(EXTSORT_STRUCT *sorter, FILE **runs, void *record);
+
+//Release the buffers of a k-way merge
+static void MergeEnd(EXTSORT_STRUCT *sorter, int runNum);
+
+//Read the next record of a run into heads. Return 1 if a record is read, 0 at the end of the run, -1 if failure
+static int ReadRunRecord(EXTSORT_STRUCT *sorter, FILE **runs, int runIndex);
+
+//Restore the heap property downward from position pos
+static void SiftDown(EXTSORT_STRUCT *sorter, int pos);
+
+//Open an unnamed temporary file in tmpDir (NULL for the default directory). The file is removed when closed. Return NULL if failure
+FILE *OpenTempFile(const char *tmpDir)
+{
+	char fileName[1100];
+	int fd;
+	FILE *fh;
+
+	if ((tmpDir==NULL)||(tmpDir[0]==0))
+	{
+		tmpDir = getenv("TMPDIR");
+	}
+
+	if ((tmpDir==NULL)||(tmpDir[0]==0))
+	{
+		tmpDir = "/tmp";
+	}
+
+	sprintf(fileName, "%s/crispr_XXXXXX", tmpDir);
+
+	fd = mkstemp(fileName);
+
+	if (fd<0)
+	{
+		printf("Cannot create temporary file in %s\n", tmpDir);
+		return NULL;
+	}
+
+	//the file is removed from the directory now and from the disk when it is closed
+	unlink(fileName);
+
+	fh = fdopen(fd, "w+b");
+
+	if (!fh)
+	{
+		close(fd);
+		return NULL;
+	}
+
+	return fh;
+}
+
+//Create a sorter of records. memBudget is in bytes. tmpDir is the directory of temporary files, NULL to use $TMPDIR or /tmp. Return NULL if failure
+EXTSORT_STRUCT *ExtSortCreate(int recordSize, EXTSORT_COMPARE compare, long memBudget, const char *tmpDir)
+{
+	EXTSORT_STRUCT *sorter;
+
+	sorter = (EXTSORT_STRUCT *)MemCalloc(MEM_SORT, 1, sizeof(EXTSORT_STRUCT));
+
+	if (!sorter)
+	{
+		return NULL;
+	}
+
+	sorter->recordSize = recordSize;
+	sorter->compare = compare;
+	sorter->memBudget = memBudget>2*EXTSORT_MIN_RUN_BUFFER?memBudget:2*EXTSORT_MIN_RUN_BUFFER;
+	sorter->bufferCapacity = sorter->memBudget/recordSize;
+	sorter->buffer = (char *)MemAlloc(MEM_SORT, sorter->bufferCapacity*recordSize);
+
+	if (tmpDir)
+	{
+		strncpy(sorter->tmpDir, tmpDir, sizeof(sorter->tmpDir)-1);
+	}
+
+	sorter->runCapacity = 16;
+	sorter->runs = (FILE **)MemAlloc(MEM_SORT, sorter->runCapacity*sizeof(FILE *));
+
+	if ((!sorter->buffer)||(!sorter->runs))
+	{
+		ExtSortFree(sorter);
+		return NULL;
+	}
+
+	return sorter;
+}
+
+//Add a record to the sorter. Return 1 if success, -1 if failure
+int ExtSortAdd(EXTSORT_STRUCT *sorter, const void *record)
+{
+	if (sorter->merging)
+	{
+		return -1;
+	}
+
+	if (sorter->bufferNum>=sorter->bufferCapacity)
+	{
+		if (SpillRun(sorter)<0)
+		{
+			return -1;
+		}
+	}
+
+	memcpy(sorter->buffer+sorter->bufferNum*sorter->recordSize, record, sorter->recordSize);
+	sorter->bufferNum++;
+	sorter->totalNum++;
+
+	return 1;
+}
+
+//Sort the records in the buffer and write them to a new run. Return 1 if success, -1 if failure
+static int SpillRun(EXTSORT_STRUCT *sorter)
+{
+	FILE *fh;
+	FILE **tmpRuns;
+
+	TraceBegin("sort run");
+	qsort(sorter->buffer, sorter->bufferNum, sorter->recordSize, sorter->compare);
+	TraceEnd("sort run");
+
+	fh = OpenTempFile(sorter->tmpDir);
+
+	if (!fh)
+	{
+		return -1;
+	}
+
+	TraceBegin("spill run");
+
+	if (fwrite(sorter->buffer, sorter->recordSize, sorter->bufferNum, fh)!=(size_t)sorter->bufferNum)
+	{
+		TraceEnd("spill run");
+		printf("Cannot write temporary file. Is the disk full?\n");
+		fclose(fh);
+		return -1;
+	}
+
+	TraceEnd("spill run");
+
+	if (sorter->runNum>=sorter->runCapacity)
+	{
+		tmpRuns = (FILE **)MemRealloc(MEM_SORT, sorter->runs, 2*sorter->runCapacity*sizeof(FILE *));
+
+		if (!tmpRuns)
+		{
+			fclose(fh);
+			return -1;
+		}
+
+		sorter->runs = tmpRuns;
+		sorter->runCapacity *= 2;
+	}
+
+	sorter->runs[sorter->runNum] = fh;
+	sorter->runNum++;
+	sorter->bufferNum = 0;
+
+	return 1;
+}
+
+//Finish adding records and prepare to read them in sorted order. Merge the runs with k-way merges. Return 1 if success, -1 if failure
+int ExtSortFinish(EXTSORT_STRUCT *sorter)
+{
+	int i, j, fanIn, newRunNum, mergeNum;
+	FILE *fh;
+	char *record;
+	int flag;
+
+	if (sorter->merging)
+	{
+		return -1;
+	}
+
+	sorter->merging = 1;
+
+	//everything fits in memory, no temporary file needed
+	if (sorter->runNum==0)
+	{
+		TraceBegin("sort run");
+		qsort(sorter->buffer, sorter->bufferNum, sorter->recordSize, sorter->compare);
+		TraceEnd("sort run");
+		sorter->bufferPos = 0;
+		return 1;
+	}
+
+	if (sorter->bufferNum>0)
+	{
+		if (SpillRun(sorter)<0)
+		{
+			return -1;
+		}
+	}
+
+	//the sort buffer is no longer needed; its memory is reused by the read buffers of the runs
+	MemFree(sorter->buffer);
+	sorter->buffer = NULL;
+
+	fanIn = (int)(sorter->memBudget/EXTSORT_MIN_RUN_BUFFER)-1;
+	fanIn = fanIn<2?2:fanIn;
+
+	record = (char *)MemAlloc(MEM_SORT, sorter->recordSize);
+
+	if (!record)
+	{
+		return -1;
+	}
+
+	//intermediate passes, until all runs can be merged at once
+	while (sorter->runNum>fanIn)
+	{
+		TraceBegin("merge pass");
+		newRunNum = 0;
+
+		for (i=0;i<sorter->runNum;i+=fanIn)
+		{
+			mergeNum = sorter->runNum-i<fanIn?sorter->runNum-i:fanIn;
+
+			fh = OpenTempFile(sorter->tmpDir);
+
+			if ((!fh)||(MergeStart(sorter, sorter->runs+i, mergeNum)<0))
+			{
+				MemFree(record);
+				return -1;
+			}
+
+			while ((flag = MergePop(sorter, sorter->runs+i, record))>0)
+			{
+				if (fwrite(record, sorter->recordSize, 1, fh)!=1)
+				{
+					printf("Cannot write temporary file. Is the disk full?\n");
+					flag = -1;
+					break;
+				}
+			}
+
+			MergeEnd(sorter, mergeNum);
+
+			for (j=i;j<i+mergeNum;j++)
+			{
+				fclose(sorter->runs[j]);
+			}
+
+			if (flag<0)
+			{
+				TraceEnd("merge pass");
+				fclose(fh);
+				MemFree(record);
+				return -1;
+			}
+
+			sorter->runs[newRunNum] = fh;
+			newRunNum++;
+		}
+
+		sorter->runNum = newRunNum;
+		TraceEnd("merge pass");
+	}
+
+	MemFree(record);
+
+	return MergeStart(sorter, sorter->runs, sorter->runNum);
+}
+
+//Read the next record in sorted order. Return 1 if a record is read, 0 if no record is left, -1 if failure
+int ExtSortNext(EXTSORT_STRUCT *sorter, void *record)
+{
+	if (!sorter->merging)
+	{
+		return -1;
+	}
+
+	if (sorter->runNum==0)
+	{
+		if (sorter->bufferPos>=sorter->bufferNum)
+		{
+			return 0;
+		}
+
+		memcpy(record, sorter->buffer+sorter->bufferPos*sorter->recordSize, sorter->recordSize);
+		sorter->bufferPos++;
+
+		return 1;
+	}
+
+	return MergePop(sorter, sorter->runs, record);
+}
+
+//Free a sorter and remove its temporary files
+void ExtSortFree(EXTSORT_STRUCT *sorter)
+{
+	int i;
+
+	if (!sorter)
+	{
+		return;
+	}
+
+	if (sorter->heads)
+	{
+		MergeEnd(sorter, sorter->runNum);
+	}
+
+	for (i=0;i<sorter->runNum;i++)
+	{
+		fclose(sorter->runs[i]);
+	}
+
+	MemFree(sorter->runs);
+	MemFree(sorter->buffer);
+	MemFree(sorter);
+}
+
+//Prepare a k-way merge of runs[0..runNum-1]. Return 1 if success, -1 if failure
+static int MergeStart(EXTSORT_STRUCT *sorter, FILE **runs, int runNum)
+{
+	int i, flag;
+
+	sorter->runBufferSize = sorter->memBudget/(runNum+1);
+	sorter->runBufferSize -= sorter->runBufferSize%sorter->recordSize;
+
+	if (sorter->runBufferSize<sorter->recordSize)
+	{
+		sorter->runBufferSize = sorter->recordSize;
+	}
+
+	sorter->heads = (char *)MemAlloc(MEM_SORT, runNum*sorter->recordSize);
+	sorter->heap = (int *)MemAlloc(MEM_SORT, runNum*sizeof(int));
+	sorter->runBuffers = (char **)MemCalloc(MEM_SORT, runNum, sizeof(char *));
+	sorter->runBufferPos = (long *)MemCalloc(MEM_SORT, runNum, sizeof(long));
+	sorter->runBufferLen = (long *)MemCalloc(MEM_SORT, runNum, sizeof(long));
+
+	if ((!sorter->heads)||(!sorter->heap)||(!sorter->runBuffers)||(!sorter->runBufferPos)||(!sorter->runBufferLen))
+	{
+		MergeEnd(sorter, runNum);
+		return -1;
+	}
+
+	sorter->heapSize = 0;
+
+	for (i=0;i<runNum;i++)
+	{
+		sorter->runBuffers[i] = (char *)MemAlloc(MEM_SORT, sorter->runBufferSize);
+
+		if (!sorter->runBuffers[i])
+		{
+			MergeEnd(sorter, runNum);
+			return -1;
+		}
+
+		rewind(runs[i]);
+
+		flag = ReadRunRecord(sorter, runs, i);
+
+		if (flag<0)
+		{
+			MergeEnd(sorter, runNum);
+			return -1;
+		}
+
+		if (flag>0)
+		{
+			sorter->heap[sorter->heapSize] = i;
+			sorter->heapSize++;
+		}
+	}
+
+	for (i=sorter->heapSize/2-1;i>=0;i--)
+	{
+		SiftDown(sorter, i);
+	}
+
+	return 1;
+}
+
+//Pop the smallest record of a k-way merge. Return 1 if a record is read, 0 if no record is left, -1 if failure
+static int MergePop(EXTSORT_STRUCT *sorter, FILE **runs, void *record)
+{
+	int runIndex, flag;
+
+	if (sorter->heapSize<=0)
+	{
+		return 0;
+	}
+
+	runIndex = sorter->heap[0];
+
+	memcpy(record, sorter->heads+runIndex*sorter->recordSize, sorter->recordSize);
+
+	flag = ReadRunRecord(sorter, runs, runIndex);
+
+	if (flag<0)
+	{
+		return -1;
+	}
+
+	if (flag==0)
+	{
+		sorter->heapSize--;
+		sorter->heap[0] = sorter->heap[sorter->heapSize];
+	}
+
+	if (sorter->heapSize>0)
+	{
+		SiftDown(sorter, 0);
+	}
+
+	return 1;
+}
+
+//Release the buffers of a k-way merge
+static void MergeEnd(EXTSORT_STRUCT *sorter, int runNum)
+{
+	int i;
+
+	if (sorter->runBuffers)
+	{
+		for (i=0;i<runNum;i++)
+		{
+			MemFree(sorter->runBuffers[i]);
+		}
+	}
+
+	MemFree(sorter->runBuffers);
+	MemFree(sorter->runBufferPos);
+	MemFree(sorter->runBufferLen);
+	MemFree(sorter->heads);
+	MemFree(sorter->heap);
+
+	sorter->runBuffers = NULL;
+	sorter->runBufferPos = NULL;
+	sorter->runBufferLen = NULL;
+	sorter->heads = NULL;
+	sorter->heap = NULL;
+	sorter->heapSize = 0;
+}
+
+//Read the next record of a run into heads. Return 1 if a record is read, 0 at the end of the run, -1 if failure
+static int ReadRunRecord(EXTSORT_STRUCT *sorter, FILE **runs, int runIndex)
+{
+	size_t readNum;
+
+	if (sorter->runBufferPos[runIndex]>=sorter->runBufferLen[runIndex])
+	{
+		readNum = fread(sorter->runBuffers[runIndex], sorter->recordSize, sorter->runBufferSize/sorter->recordSize, runs[runIndex]);
+
+		if ((readNum==0)&&(ferror(runs[runIndex])))
+		{
+			printf("Cannot read temporary file.\n");
+			return -1;
+		}
+
+		sorter->runBufferPos[runIndex] = 0;
+		sorter->runBufferLen[runIndex] = readNum*sorter->recordSize;
+
+		if (readNum==0)
+		{
+			return 0;
+		}
+	}
+
+	memcpy(sorter->heads+runIndex*sorter->recordSize, sorter->runBuffers[runIndex]+sorter->runBufferPos[runIndex], sorter->recordSize);
+	sorter->runBufferPos[runIndex] += sorter->recordSize;
+
+	return 1;
+}
+
+//Restore the heap property downward from position pos
+static void SiftDown(EXTSORT_STRUCT *sorter, int pos)
+{
+	int child, tmp;
+	int recordSize = sorter->recordSize;
+
+	while (2*pos+1<sorter->heapSize)
+	{
+		child = 2*pos+1;
+
+		if ((child+1<sorter->heapSize)
+			&&(sorter->compare(sorter->heads+sorter->heap[child+1]*recordSize, sorter->heads+sorter->heap[child]*recordSize)<0))
+		{
+			child++;
+		}
+
+		if (sorter->compare(sorter->heads+sorter->heap[child]*recordSize, sorter->heads+sorter->heap[pos]*recordSize)>=0)
+		{
+			break;
+		}
+
+		tmp = sorter->heap[pos];
+		sorter->heap[pos] = sorter->heap[child];
+		sorter->heap[child] = tmp;
+		pos = child;
+	}
+}
+
+//Create a buffer of records that keeps up to memBudget bytes in memory and spills the rest to a temporary file. Return NULL if failure
+SPILL_BUFFER *SpillBufferCreate(int recordSize, long memBudget, const char *tmpDir)
+{
+	SPILL_BUFFER *spill;
+
+	spill = (SPILL_BUFFER *)MemCalloc(MEM_SORT, 1, sizeof(SPILL_BUFFER));
+
+	if (!spill)
+	{
+		return NULL;
+	}
+
+	spill->recordSize = recordSize;
+	spill->bufferCapacity = memBudget/recordSize>0?memBudget/recordSize:1;
+	spill->buffer = (char *)MemAlloc(MEM_SORT, spill->bufferCapacity*recordSize);
+
+	if (tmpDir)
+	{
+		strncpy(spill->tmpDir, tmpDir, sizeof(spill->tmpDir)-1);
+	}
+
+	if (!spill->buffer)
+	{
+		MemFree(spill);
+		return NULL;
+	}
+
+	return spill;
+}
+
+//Append a record. Return 1 if success, -1 if failure
+int SpillBufferAdd(SPILL_BUFFER *spill, const void *record)
+{
+	if (spill->num<spill->bufferCapacity)
+	{
+		memcpy(spill->buffer+spill->num*spill->recordSize, record, spill->recordSize);
+		spill->num++;
+		return 1;
+	}
+
+	if (!spill->overflow)
+	{
+		spill->overflow = OpenTempFile(spill->tmpDir);
+
+		if (!spill->overflow)
+		{
+			return -1;
+		}
+	}
+
+	if (fwrite(record, spill->recordSize, 1, spill->overflow)!=1)
+	{
+		printf("Cannot write temporary file. Is the disk full?\n");
+		return -1;
+	}
+
+	spill->num++;
+
+	return 1;
+}
+
+//Start reading the records from the beginning. Return 1 if success, -1 if failure
+int SpillBufferRewind(SPILL_BUFFER *spill)
+{
+	spill->readPos = 0;
+
+	if (spill->overflow)
+	{
+		fflush(spill->overflow);
+		rewind(spill->overflow);
+	}
+
+	return 1;
+}
+
+//Read the next record. Return 1 if a record is read, 0 if no record is left, -1 if failure
+int SpillBufferNext(SPILL_BUFFER *spill, void *record)
+{
+	if (spill->readPos>=spill->num)
+	{
+		return 0;
+	}
+
+	if (spill->readPos<spill->bufferCapacity)
+	{
+		memcpy(record, spill->buffer+spill->readPos*spill->recordSize, spill->recordSize);
+	}
+	else if (fread(record, spill->recordSize, 1, spill->overflow)!=1)
+	{
+		printf("Cannot read temporary file.\n");
+		return -1;
+	}
+
+	spill->readPos++;
+
+	return 1;
+}
+
+//Remove all records
+void SpillBufferClear(SPILL_BUFFER *spill)
+{
+	spill->num = 0;
+	spill->readPos = 0;
+
+	if (spill->overflow)
+	{
+		fclose(spill->overflow);
+		spill->overflow = NULL;
+	}
+}
+
+//Free a spill buffer
+void SpillBufferFree(SPILL_BUFFER *spill)
+{
+	if (!spill)
+	{
+		return;
+	}
+
+	if (spill->overflow)
+	{
+		fclose(spill->overflow);
+	}
+
+	MemFree(spill->buffer);
+	MemFree(spill);
+}
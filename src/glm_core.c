@@ -0,0 +1,396 @@
+/*
+ *  glm_core.c
+ *	Per-gene negative binomial regression of sgRNA counts on a sparse design of the samples
+ *
+ *  Each gene is a small model: one intercept per guide and one effect per covariate, fitted jointly
+ *  on the counts of all its guides in all samples by Newton iterations (Fisher scoring, the same
+ *  steps as IRLS for the log link). The variance of a count is that of the mean-variance trend of
+ *  nb_test, so that no dispersion is estimated per gene from a few guides.
+ *
+ *  Genes are sorted by their number of guides and cut into batches of genes of the same size, so
+ *  that a worker fits a run of models of one shape in the same few cache lines of its workspace.
+ *  Workers take batches from a shared counter, each with a workspace allocated for the largest gene.
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "glm_core.h"
+#include "math_api.h"
+#include "mem_acct.h"
+#include "trace.h"
+
+typedef struct
+{
+	double *info;                  //Fisher information, then its Cholesky factor, paramNum*paramNum
+	double *score;                 //score, then the Newton step
+	double *theta;                 //guide intercepts followed by covariate effects
+	double *unit;                  //column of the inverse information
+	double *y;                     //counts of the guides of the gene, by guide
+} GLM_WORKSPACE;
+
+typedef struct
+{
+	const double *counts;          //counts by column
+	int itemNum;                   //number of guides of the table
+	const double *logSizeFactors;  //log of the size factor of each sample
+	const NB_TREND *trend;         //mean-variance trend
+	const GLM_DESIGN *design;      //design of the samples
+	const int *guides;             //guides of the genes
+	const int *geneStart;          //first guide of each gene
+	const INDEXED_FLOAT *order;    //genes sorted by number of guides
+	const int *batchStart;         //first gene in order of each batch, batchNum+1 offsets
+	int batchNum;                  //number of batches
+	int nextBatch;                 //next batch to fit, taken by the workers
+	GLM_WORKSPACE *workspaces;     //workspace of each worker
+	GLM_RESULT *results;           //results of the genes
+} GLM_CONTEXT;
+
+//Cholesky factor of the n*n symmetric matrix a in its lower triangle, in place. Return 1 if success, -1 if a is not positive definite
+static int CholeskyFactor(double *a, int n);
+
+//Solve L*L'*x = b with the Cholesky factor L in the lower triangle of a, in place of b
+static void CholeskySolve(const double *a, int n, double *b);
+
+//Fit gene g in the workspace. Return the number of iterations, GLM_MAX_ITER+1 if the fit did not converge
+static int FitGene(GLM_CONTEXT *context, GLM_WORKSPACE *work, int g);
+
+//Fit batches of genes taken from the shared counter, in the workspace of the worker
+static void FitWorker(void *arg, int workerIndex, int workerNum);
+
+//Cholesky factor of the n*n symmetric matrix a in its lower triangle, in place. Return 1 if success, -1 if a is not positive definite
+static int CholeskyFactor(double *a, int n)
+{
+	int i, j, k;
+	double sum;
+
+	for (j=0;j<n;j++)
+	{
+		sum = a[j*n+j];
+
+		for (k=0;k<j;k++)
+		{
+			sum -= a[j*n+k]*a[j*n+k];
+		}
+
+		if (sum<=0.0)
+		{
+			return -1;
+		}
+
+		a[j*n+j] = sqrt(sum);
+
+		for (i=j+1;i<n;i++)
+		{
+			sum = a[i*n+j];
+
+			for (k=0;k<j;k++)
+			{
+				sum -= a[i*n+k]*a[j*n+k];
+			}
+
+			a[i*n+j] = sum/a[j*n+j];
+		}
+	}
+
+	return 1;
+}
+
+//Solve L*L'*x = b with the Cholesky factor L in the lower triangle of a, in place of b
+static void CholeskySolve(const double *a, int n, double *b)
+{
+	int i, k;
+
+	for (i=0;i<n;i++)
+	{
+		for (k=0;k<i;k++)
+		{
+			b[i] -= a[i*n+k]*b[k];
+		}
+
+		b[i] /= a[i*n+i];
+	}
+
+	for (i=n-1;i>=0;i--)
+	{
+		for (k=i+1;k<n;k++)
+		{
+			b[i] -= a[k*n+i]*b[k];
+		}
+
+		b[i] /= a[i*n+i];
+	}
+}
+
+//Fit gene g in the workspace. Return the number of iterations, GLM_MAX_ITER+1 if the fit did not converge
+static int FitGene(GLM_CONTEXT *context, GLM_WORKSPACE *work, int g)
+{
+	const GLM_DESIGN *design = context->design;
+	int guideNum = context->geneStart[g+1]-context->geneStart[g];
+	int sampleNum = design->sampleNum;
+	int covariateNum = design->covariateNum;
+	int n = guideNum+covariateNum;
+	double *info = work->info;
+	double *score = work->score;
+	double *theta = work->theta;
+	double *y = work->y;
+	double eta, mu, variance, weight, residual, sum, maxStep;
+	int i, j, k, l, c, iter, converged;
+
+	//counts of the guides by guide, and the start of each guide intercept from its mean normalized count
+	for (i=0;i<guideNum;i++)
+	{
+		sum = 0.0;
+
+		for (j=0;j<sampleNum;j++)
+		{
+			y[i*sampleNum+j] = context->counts[(long)j*context->itemNum+context->guides[context->geneStart[g]+i]];
+			sum += (y[i*sampleNum+j]+0.5)/exp(context->logSizeFactors[j]);
+		}
+
+		theta[i] = log(sum/sampleNum);
+	}
+
+	for (c=0;c<covariateNum;c++)
+	{
+		theta[guideNum+c] = 0.0;
+	}
+
+	converged = 0;
+
+	for (iter=1;(iter<=GLM_MAX_ITER)&&(!converged);iter++)
+	{
+		memset(info, 0, n*n*sizeof(double));
+		memset(score, 0, n*sizeof(double));
+
+		//each count adds w*x*x' to the information and (y-mu)*mu/variance*x to the score, x being 1 for its guide and the design row of its sample
+		for (i=0;i<guideNum;i++)
+		{
+			for (j=0;j<sampleNum;j++)
+			{
+				eta = context->logSizeFactors[j]+theta[i];
+
+				for (k=design->rowStart[j];k<design->rowStart[j+1];k++)
+				{
+					eta += design->values[k]*theta[guideNum+design->columns[k]];
+				}
+
+				eta = eta<GLM_MAX_ETA?eta:GLM_MAX_ETA;
+				mu = exp(eta);
+				variance = mu+exp(context->trend->intercept+context->trend->slope*eta);
+				weight = mu*mu/variance;
+				residual = (y[i*sampleNum+j]-mu)*mu/variance;
+
+				info[i*n+i] += weight;
+				score[i] += residual;
+
+				for (k=design->rowStart[j];k<design->rowStart[j+1];k++)
+				{
+					c = guideNum+design->columns[k];
+
+					info[c*n+i] += weight*design->values[k];
+					score[c] += residual*design->values[k];
+
+					for (l=design->rowStart[j];l<=k;l++)
+					{
+						info[c*n+guideNum+design->columns[l]] += weight*design->values[k]*design->values[l];
+					}
+				}
+			}
+		}
+
+		//the lower triangle is filled; covariates listed out of order in a sample land above the diagonal and are folded back
+		for (i=0;i<n;i++)
+		{
+			info[i*n+i] += GLM_RIDGE;
+
+			for (k=i+1;k<n;k++)
+			{
+				info[k*n+i] += info[i*n+k];
+				info[i*n+k] = 0.0;
+			}
+		}
+
+		if (CholeskyFactor(info, n)<0)
+		{
+			break;
+		}
+
+		CholeskySolve(info, n, score);
+
+		maxStep = 0.0;
+
+		for (i=0;i<n;i++)
+		{
+			maxStep = fabs(score[i])>maxStep?fabs(score[i]):maxStep;
+		}
+
+		for (i=0;i<n;i++)
+		{
+			theta[i] += maxStep>GLM_MAX_STEP?score[i]*GLM_MAX_STEP/maxStep:score[i];
+		}
+
+		converged = maxStep<GLM_TOLERANCE;
+	}
+
+	//standard errors from the diagonal of the inverse information, factored at the last iteration
+	for (c=0;c<covariateNum;c++)
+	{
+		context->results->beta[(long)g*covariateNum+c] = theta[guideNum+c];
+
+		if (!converged)
+		{
+			context->results->stdErr[(long)g*covariateNum+c] = NAN;
+			continue;
+		}
+
+		memset(work->unit, 0, n*sizeof(double));
+		work->unit[guideNum+c] = 1.0;
+
+		CholeskySolve(info, n, work->unit);
+
+		context->results->stdErr[(long)g*covariateNum+c] = sqrt(work->unit[guideNum+c]);
+	}
+
+	return converged?iter-1:GLM_MAX_ITER+1;
+}
+
+//Fit batches of genes taken from the shared counter, in the workspace of the worker
+static void FitWorker(void *arg, int workerIndex, int workerNum)
+{
+	GLM_CONTEXT *context = (GLM_CONTEXT *)arg;
+	int b, i, g;
+
+	while ((b = __atomic_fetch_add(&(context->nextBatch), 1, __ATOMIC_RELAXED))<context->batchNum)
+	{
+		TraceBegin("glm batch");
+
+		for (i=context->batchStart[b];i<context->batchStart[b+1];i++)
+		{
+			g = context->order[i].index;
+			context->results->iterations[g] = FitGene(context, context->workspaces+workerIndex, g);
+		}
+
+		TraceEnd("glm batch");
+	}
+}
+
+//Fit log(mean count of guide i of gene g in sample j) = log(sizeFactors[j])+alpha_i+sum over c of design(j,c)*beta_gc for each of geneNum genes,
+//whose guides are guides[geneStart[g]] to guides[geneStart[g+1]-1], rows of counts by column (counts[j*itemNum+i]), with the variance of the trend.
+//The guide intercepts alpha take the place of an intercept of the design. Genes are fitted by Newton iterations in batches of genes with the same
+//number of guides, each worker of the pool in its own workspace allocated beforehand. Results are allocated by the caller. Return 1 if success, -1 if failure
+int GLMFitGenes(const double *counts, int itemNum, const double *sizeFactors, const NB_TREND *trend, const GLM_DESIGN *design,
+				const int *guides, const int *geneStart, int geneNum, THREAD_POOL_STRUCT *pool, GLM_RESULT *results)
+{
+	GLM_CONTEXT context;
+	INDEXED_FLOAT *order;
+	double *logSizeFactors;
+	int *batchStart;
+	int i, workerNum, maxGuideNum, paramNum, flag;
+
+	if ((geneNum<=0)||(!pool))
+	{
+		return -1;
+	}
+
+	workerNum = pool->threadNum>0?pool->threadNum:1;
+
+	order = (INDEXED_FLOAT *)MemAlloc(MEM_WORK, geneNum*sizeof(INDEXED_FLOAT));
+	batchStart = (int *)MemAlloc(MEM_WORK, (geneNum+1)*sizeof(int));
+	logSizeFactors = (double *)MemAlloc(MEM_WORK, design->sampleNum*sizeof(double));
+	context.workspaces = (GLM_WORKSPACE *)MemAlloc(MEM_WORK, workerNum*sizeof(GLM_WORKSPACE));
+
+	if ((!order)||(!batchStart)||(!logSizeFactors)||(!context.workspaces))
+	{
+		MemFree(order);
+		MemFree(batchStart);
+		MemFree(logSizeFactors);
+		MemFree(context.workspaces);
+		return -1;
+	}
+
+	//genes sorted by number of guides, cut into batches of the same number of guides
+	maxGuideNum = 0;
+
+	for (i=0;i<geneNum;i++)
+	{
+		order[i].value = geneStart[i+1]-geneStart[i];
+		order[i].index = i;
+		maxGuideNum = geneStart[i+1]-geneStart[i]>maxGuideNum?geneStart[i+1]-geneStart[i]:maxGuideNum;
+	}
+
+	QuicksortIndexedArray(order, 0, geneNum-1);
+
+	context.batchNum = 0;
+
+	for (i=0;i<geneNum;i++)
+	{
+		if ((i==0)||(order[i].value!=order[i-1].value)||(i-batchStart[context.batchNum-1]>=GLM_BATCH_GENES))
+		{
+			batchStart[context.batchNum++] = i;
+		}
+	}
+
+	batchStart[context.batchNum] = geneNum;
+
+	for (i=0;i<design->sampleNum;i++)
+	{
+		logSizeFactors[i] = log(sizeFactors[i]);
+	}
+
+	//one workspace per worker, sized for the largest gene
+	paramNum = maxGuideNum+design->covariateNum;
+	flag = 1;
+
+	memset(context.workspaces, 0, workerNum*sizeof(GLM_WORKSPACE));
+
+	for (i=0;(i<workerNum)&&(flag>0);i++)
+	{
+		context.workspaces[i].info = (double *)MemAlloc(MEM_WORK, (long)paramNum*paramNum*sizeof(double));
+		context.workspaces[i].score = (double *)MemAlloc(MEM_WORK, paramNum*sizeof(double));
+		context.workspaces[i].theta = (double *)MemAlloc(MEM_WORK, paramNum*sizeof(double));
+		context.workspaces[i].unit = (double *)MemAlloc(MEM_WORK, paramNum*sizeof(double));
+		context.workspaces[i].y = (double *)MemAlloc(MEM_WORK, (long)maxGuideNum*design->sampleNum*sizeof(double));
+
+		flag = ((context.workspaces[i].info)&&(context.workspaces[i].score)&&(context.workspaces[i].theta)
+				&&(context.workspaces[i].unit)&&(context.workspaces[i].y))?1:-1;
+	}
+
+	if (flag>0)
+	{
+		context.counts = counts;
+		context.itemNum = itemNum;
+		context.logSizeFactors = logSizeFactors;
+		context.trend = trend;
+		context.design = design;
+		context.guides = guides;
+		context.geneStart = geneStart;
+		context.order = order;
+		context.batchStart = batchStart;
+		context.nextBatch = 0;
+		context.results = results;
+
+		ThreadPoolBroadcast(pool, FitWorker, &context);
+	}
+
+	for (i=0;i<workerNum;i++)
+	{
+		MemFree(context.workspaces[i].info);
+		MemFree(context.workspaces[i].score);
+		MemFree(context.workspaces[i].theta);
+		MemFree(context.workspaces[i].unit);
+		MemFree(context.workspaces[i].y);
+	}
+
+	MemFree(context.workspaces);
+	MemFree(order);
+	MemFree(batchStart);
+	MemFree(logSizeFactors);
+
+	return flag;
+}
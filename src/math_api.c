@@ -19,11 +19,11 @@ double normalInv(double p);
 //compute Euclidean distance
 double EucliDist(double *a, double *b, int dim);
 
-//Compute logarithm of Gamma function. flag=0, no error; flag=1, x<=0
-double LogGamma(double x, int *flag);
+//Sum of one block of at most REPRO_BLOCK values in 4 lanes; with b, the block of ReproDot
+static double ReproBlock(const double *a, const double *b, int n, double centerA, double centerB);
 
-//Compute incomplete beta function ratio
-double betain (double x, double p, double q, double beta, int *ifault);
+//Pairwise sum of blocks loBlock to hiBlock-1 of n values
+static double ReproTree(const double *a, const double *b, int n, double centerA, double centerB, int loBlock, int hiBlock);
 
 //BTreeSearchingF: Searching value in array, which was organized in ascending order previously
 int  bTreeSearchingF(double value, double *a, int lo, int hi)
@@ -348,31 +348,14 @@ void PermuteFloatArrays(double *a, int size)
 //Pearson correlation
 double PearsonCorrel(double *a, double *b, int dim)
 {
-	int i;
 	double mean1, mean2, sumAB, sumAA, sumBB;
 	
-	mean1 = 0;
-	mean2 = 0;
+	mean1 = ReproSum(a, dim)/dim;
+	mean2 = ReproSum(b, dim)/dim;
 	
-	for (i=0;i<dim;i++)
-	{
-		mean1 += a[i];
-		mean2 += b[i];
-	}
-	
-	mean1 /= dim;
-	mean2 /= dim;
-	
-	sumAB = 0;
-	sumAA = 0;
-	sumBB = 0;
-	
-	for (i=0;i<dim;i++)
-	{
-		sumAB += (a[i]-mean1)*(b[i]-mean2);
-		sumAA += (a[i]-mean1)*(a[i]-mean1);
-		sumBB += (b[i]-mean2)*(b[i]-mean2);
-	}
+	sumAB = ReproDot(a, b, dim, mean1, mean2);
+	sumAA = ReproDot(a, a, dim, mean1, mean1);
+	sumBB = ReproDot(b, b, dim, mean2, mean2);
 	
 	return sumAB/sqrt(sumAA*sumBB+0.00000000001);
 }
@@ -437,7 +420,35 @@ double LogGamma(double x, int *flag)
 	return value;
 }
 
-//Compute incomplete beta function ratio
+//Logarithm of the Gamma function of n values x into values, by the series of LogGamma. The argument is shifted by a fixed 7 rather than
+//up to 7, so that the loop has no branch on the values and compilers can vectorize it. Values of x not positive give 0
+void LogGammaArray(const double *x, int n, double *values)
+{
+	int i;
+	double y, f, z, shift;
+	
+	for (i=0;i<n;i++)
+	{
+		y = x[i]>0.0?x[i]:1.0;
+		shift = y<7.0?1.0:0.0;
+		
+		//log(y(y+1)...(y+6)) is subtracted when the argument is moved to y+7, as LogGamma does one step at a time
+		f = -shift*log(shift*y*(y+1.0)*(y+2.0)*(y+3.0)*(y+4.0)*(y+5.0)*(y+6.0)+(1.0-shift));
+		y = y+7.0*shift;
+		z = 1.0 / y / y;
+		
+		values[i] = x[i]>0.0?f + ( y - 0.5 ) * log ( y ) - y
+		+ 0.918938533204673 +
+		(((
+		   - 0.000595238095238   * z
+		   + 0.000793650793651 ) * z
+		  - 0.002777777777778 ) * z
+		 + 0.083333333333333 ) / y:0.0;
+	}
+}
+
+//Compute incomplete beta function ratio of x with parameters p and q, and beta, the log of the beta function of p and q.
+//ifault=0, no error; ifault=1, p or q not positive; ifault=2, x out of [0,1]
 double betain ( double x, double p, double q, double beta, int *ifault )
 {
 	double acu = 0.1E-14;
@@ -606,3 +617,257 @@ double BetaNoncentralCdf ( double a, double b, double lambda, double x, double e
 	return value;
 }
 
+//CDF of the non-central beta distribution of a, b and lambda at xNum values x into values, each what BetaNoncentralCdf returns for x[i].
+//The log of the beta function and the Poisson weights are computed once for all x, the incomplete beta ratios start in lanes of
+//BetaIncompleteLanes, and each term of the series advances all x in one loop without branches. work holds 2*xNum values
+void BetaNoncentralRow(double a, double b, double lambda, const double *x, int xNum, double error_max, double *work, double *values)
+{
+	double *bi = work;
+	double *si = work+xNum;
+	double beta_log, pi, p_sum, ratio, denominator;
+	int i, l, ifault;
+	
+	beta_log = LogGamma(a, &ifault)+LogGamma(b, &ifault)-LogGamma(a+b, &ifault);
+	
+	for (l=0;l<xNum;l+=BETA_MAX_LANES)
+	{
+		BetaIncompleteLanes(x+l, xNum-l<BETA_MAX_LANES?xNum-l:BETA_MAX_LANES, a, b, beta_log, bi+l);
+	}
+	
+	pi = exp(-lambda/2.0);
+	p_sum = pi;
+	
+	for (l=0;l<xNum;l++)
+	{
+		si[l] = exp(a*log(x[l])+b*log(1.0-x[l])-beta_log-log(a));
+		values[l] = pi*bi[l];
+	}
+	
+	//the number of terms depends on lambda only, so all x take the same terms, in the order of the operations of BetaNoncentralCdf
+	for (i=1;p_sum<1.0-error_max;i++)
+	{
+		pi = 0.5*lambda*pi/(double)i;
+		p_sum = p_sum+pi;
+		ratio = a+b+i-1;
+		denominator = a+i;
+		
+		for (l=0;l<xNum;l++)
+		{
+			bi[l] = bi[l]-si[l];
+			si[l] = x[l]*ratio*si[l]/denominator;
+			values[l] = values[l]+pi*bi[l];
+		}
+	}
+}
+
+//Incomplete beta function ratio of laneNum values x sharing the parameters p and q and beta, the log of the beta function of p and q.
+//The lanes run the series of betain in lockstep and each stops when it converges, so that values[i] is what betain returns for x[i]
+void BetaIncompleteLanes(const double *x, int laneNum, double p, double q, double beta, double *values)
+{
+	double acu = 0.1E-14;
+	double ai[BETA_MAX_LANES], cx[BETA_MAX_LANES], pp[BETA_MAX_LANES], psq[BETA_MAX_LANES], qq[BETA_MAX_LANES];
+	double rx[BETA_MAX_LANES], temp[BETA_MAX_LANES], term[BETA_MAX_LANES], xx[BETA_MAX_LANES];
+	int indx[BETA_MAX_LANES], ns[BETA_MAX_LANES], done[BETA_MAX_LANES];
+	int l, leftNum;
+	
+	leftNum = 0;
+	
+	//the checks, the change of tail and the start of the series of each lane, as in betain
+	for (l=0;l<laneNum;l++)
+	{
+		values[l] = x[l];
+		done[l] = 1;
+		
+		if ( p <= 0.0 || q <= 0.0 || x[l] < 0.0 || 1.0 < x[l] || x[l] == 0.0 || x[l] == 1.0 )
+		{
+			continue;
+		}
+		
+		psq[l] = p + q;
+		cx[l] = 1.0 - x[l];
+		
+		if ( p < psq[l] * x[l] )
+		{
+			xx[l] = cx[l];
+			cx[l] = x[l];
+			pp[l] = q;
+			qq[l] = p;
+			indx[l] = 1;
+		}
+		else
+		{
+			xx[l] = x[l];
+			pp[l] = p;
+			qq[l] = q;
+			indx[l] = 0;
+		}
+		
+		term[l] = 1.0;
+		ai[l] = 1.0;
+		values[l] = 1.0;
+		ns[l] = ( int ) ( qq[l] + cx[l] * psq[l] );
+		
+		rx[l] = xx[l] / cx[l];
+		temp[l] = qq[l] - ai[l];
+		if ( ns[l] == 0 )
+		{
+			rx[l] = xx[l];
+		}
+		
+		done[l] = 0;
+		leftNum++;
+	}
+	
+	//one term of the Soper reduction formula for every lane not converged yet
+	while (leftNum>0)
+	{
+		for (l=0;l<laneNum;l++)
+		{
+			if (done[l])
+			{
+				continue;
+			}
+			
+			term[l] = term[l] * temp[l] * rx[l] / ( pp[l] + ai[l] );
+			values[l] = values[l] + term[l];
+			temp[l] = fabs( term[l] );
+			
+			if ( temp[l] <= acu && temp[l] <= acu * values[l] )
+			{
+				values[l] = values[l] * exp ( pp[l] * log ( xx[l] )
+											 + ( qq[l] - 1.0 ) * log ( cx[l] ) - beta ) / pp[l];
+				
+				if ( indx[l] )
+				{
+					values[l] = 1.0 - values[l];
+				}
+				
+				done[l] = 1;
+				leftNum--;
+				continue;
+			}
+			
+			ai[l] = ai[l] + 1.0;
+			ns[l] = ns[l] - 1;
+			
+			if ( 0 <= ns[l] )
+			{
+				temp[l] = qq[l] - ai[l];
+				if ( ns[l] == 0 )
+				{
+					rx[l] = xx[l];
+				}
+			}
+			else
+			{
+				temp[l] = psq[l];
+				psq[l] = psq[l] + 1.0;
+			}
+		}
+	}
+}
+
+//Sum of one block of at most REPRO_BLOCK values in 4 lanes; with b, the block of ReproDot
+static double ReproBlock(const double *a, const double *b, int n, double centerA, double centerB)
+{
+	double lane0, lane1, lane2, lane3;
+	int i;
+	
+	lane0 = 0.0;
+	lane1 = 0.0;
+	lane2 = 0.0;
+	lane3 = 0.0;
+	
+	//value i always goes to lane i%4, so that the 4 lanes can be one vector register
+	if (!b)
+	{
+		for (i=0;i+4<=n;i+=4)
+		{
+			lane0 += a[i];
+			lane1 += a[i+1];
+			lane2 += a[i+2];
+			lane3 += a[i+3];
+		}
+		
+		lane0 += i<n?a[i]:0.0;
+		lane1 += i+1<n?a[i+1]:0.0;
+		lane2 += i+2<n?a[i+2]:0.0;
+	}
+	else
+	{
+		for (i=0;i+4<=n;i+=4)
+		{
+			lane0 += (a[i]-centerA)*(b[i]-centerB);
+			lane1 += (a[i+1]-centerA)*(b[i+1]-centerB);
+			lane2 += (a[i+2]-centerA)*(b[i+2]-centerB);
+			lane3 += (a[i+3]-centerA)*(b[i+3]-centerB);
+		}
+		
+		lane0 += i<n?(a[i]-centerA)*(b[i]-centerB):0.0;
+		lane1 += i+1<n?(a[i+1]-centerA)*(b[i+1]-centerB):0.0;
+		lane2 += i+2<n?(a[i+2]-centerA)*(b[i+2]-centerB):0.0;
+	}
+	
+	return (lane0+lane1)+(lane2+lane3);
+}
+
+//Pairwise sum of blocks loBlock to hiBlock-1 of n values
+static double ReproTree(const double *a, const double *b, int n, double centerA, double centerB, int loBlock, int hiBlock)
+{
+	int start, midBlock;
+	
+	if (hiBlock-loBlock==1)
+	{
+		start = loBlock*REPRO_BLOCK;
+		
+		return ReproBlock(a+start, b?b+start:NULL, n-start<REPRO_BLOCK?n-start:REPRO_BLOCK, centerA, centerB);
+	}
+	
+	midBlock = loBlock+(hiBlock-loBlock)/2;
+	
+	return ReproTree(a, b, n, centerA, centerB, loBlock, midBlock)+ReproTree(a, b, n, centerA, centerB, midBlock, hiBlock);
+}
+
+//Sum of n values in a fixed order: blocks of REPRO_BLOCK values are summed in 4 interleaved lanes, and the block sums pairwise.
+//The result depends only on the values and n, not on how the caller splits the work
+double ReproSum(const double *a, int n)
+{
+	if (n<=0)
+	{
+		return 0.0;
+	}
+	
+	return ReproTree(a, NULL, n, 0.0, 0.0, 0, (n+REPRO_BLOCK-1)/REPRO_BLOCK);
+}
+
+//Sum of (a[i]-centerA)*(b[i]-centerB) over n values, in the order of ReproSum. ReproDot(a, a, n, mean, mean) is a sum of squared deviations
+double ReproDot(const double *a, const double *b, int n, double centerA, double centerB)
+{
+	if (n<=0)
+	{
+		return 0.0;
+	}
+	
+	return ReproTree(a, b, n, centerA, centerB, 0, (n+REPRO_BLOCK-1)/REPRO_BLOCK);
+}
+
+//Combine the sums of consecutive blocks of REPRO_BLOCK values pairwise, as ReproSum does. Threads that sum whole blocks with ReproSum
+//or ReproDot and combine them here get the same result as one ReproSum over all values, for any number of threads
+double ReproCombine(const double *blockSums, int blockNum)
+{
+	int midBlock;
+	
+	if (blockNum<=0)
+	{
+		return 0.0;
+	}
+	
+	if (blockNum==1)
+	{
+		return blockSums[0];
+	}
+	
+	midBlock = blockNum/2;
+	
+	return ReproCombine(blockSums, midBlock)+ReproCombine(blockSums+midBlock, blockNum-midBlock);
+}
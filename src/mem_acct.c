@@ -0,0 +1,365 @@
+/*
+ *  mem_acct.c
+ *	Accounting of memory allocations by subsystem, with an optional memory limit
+ *
+ *  Every block carries a small header recording its size and subsystem, so that
+ *  MemFree and MemRealloc can update the counters without help from the caller.
+ *  Counters are updated with atomic operations and can be used from any thread.
+ *  Blocks of EXEC_LARGE_BUFFER bytes or more are mapped by the execution context, so
+ *  that they can be backed by huge pages and placed by first touch; they are never
+ *  zeroed by the allocating thread, as a fresh mapping is already zero.
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include "mem_acct.h"
+#include "exec_ctx.h"
+
+#define MEM_HEADER_MAGIC 0x4d454d41   //marks a block allocated by the accounting layer
+#define MEM_MAPPED_MAGIC 0x4d454d4d   //marks a block mapped by the execution context
+
+typedef struct
+{
+	size_t size;                   //size of the block, excluding the header
+	int subsystem;                 //subsystem charged for the block
+	int magic;                     //MEM_HEADER_MAGIC or MEM_MAPPED_MAGIC
+} MEM_HEADER;
+
+static const char *subsystemNames[MEM_SUBSYSTEM_NUM] = {"input", "groups", "lists", "null", "sort", "work", "output"};
+
+static long memLimit = 0;                          //memory limit in bytes, 0 if no limit
+static long memInUse = 0;                          //bytes currently allocated
+static long memPeak = 0;                           //peak of memInUse
+static long subsystemInUse[MEM_SUBSYSTEM_NUM];     //bytes currently allocated by each subsystem
+static long subsystemPeak[MEM_SUBSYSTEM_NUM];      //peak of subsystemInUse
+
+//Charge size bytes to a subsystem. Return 1 if success, -1 if the memory limit would be exceeded
+static int MemCharge(int subsystem, long size);
+
+//Return size bytes charged to a subsystem
+static void MemRelease(int subsystem, long size);
+
+//Raise *peak to value if value is larger
+static void UpdatePeak(long *peak, long value);
+
+//Return the header of a block, or NULL if ptr was not allocated by the accounting layer
+static MEM_HEADER *GetHeader(void *ptr);
+
+//Allocate a block with its header, mapped if it is large. Return NULL if failure
+static MEM_HEADER *AllocBlock(int subsystem, size_t size);
+
+//Free a block with its header
+static void FreeBlock(MEM_HEADER *header);
+
+//Set the memory limit in bytes. 0 means no limit
+void SetMemLimit(long limit)
+{
+	memLimit = limit>0?limit:0;
+}
+
+//Return the memory limit in bytes. 0 means no limit
+long GetMemLimit(void)
+{
+	return memLimit;
+}
+
+//Return the number of bytes currently allocated through the accounting layer
+long GetMemInUse(void)
+{
+	return __atomic_load_n(&memInUse, __ATOMIC_RELAXED);
+}
+
+//Return the number of bytes that can still be allocated under the limit. Return a large number if there is no limit
+long GetMemAvailable(void)
+{
+	long available;
+
+	if (memLimit<=0)
+	{
+		return 0x7fffffffffffffffL;
+	}
+
+	available = memLimit-GetMemInUse();
+
+	return available>0?available:0;
+}
+
+//Raise *peak to value if value is larger
+static void UpdatePeak(long *peak, long value)
+{
+	long old = __atomic_load_n(peak, __ATOMIC_RELAXED);
+
+	while ((value>old)&&(!__atomic_compare_exchange_n(peak, &old, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)))
+	{
+	}
+}
+
+//Charge size bytes to a subsystem. Return 1 if success, -1 if the memory limit would be exceeded
+static int MemCharge(int subsystem, long size)
+{
+	long total;
+
+	total = __atomic_add_fetch(&memInUse, size, __ATOMIC_RELAXED);
+
+	if ((memLimit>0)&&(size>0)&&(total>memLimit))
+	{
+		__atomic_sub_fetch(&memInUse, size, __ATOMIC_RELAXED);
+		printf("memory limit exceeded: %s needs %.1f MB more, %.1f MB of %.1f MB in use\n",
+			   subsystemNames[subsystem], size/1048576.0, (total-size)/1048576.0, memLimit/1048576.0);
+		return -1;
+	}
+
+	UpdatePeak(&memPeak, total);
+	UpdatePeak(&(subsystemPeak[subsystem]), __atomic_add_fetch(&(subsystemInUse[subsystem]), size, __ATOMIC_RELAXED));
+
+	return 1;
+}
+
+//Return size bytes charged to a subsystem
+static void MemRelease(int subsystem, long size)
+{
+	__atomic_sub_fetch(&memInUse, size, __ATOMIC_RELAXED);
+	__atomic_sub_fetch(&(subsystemInUse[subsystem]), size, __ATOMIC_RELAXED);
+}
+
+//Return the header of a block, or NULL if ptr was not allocated by the accounting layer
+static MEM_HEADER *GetHeader(void *ptr)
+{
+	MEM_HEADER *header;
+
+	header = (MEM_HEADER *)ptr-1;
+
+	if ((header->magic!=MEM_HEADER_MAGIC)&&(header->magic!=MEM_MAPPED_MAGIC))
+	{
+		return NULL;
+	}
+
+	return header;
+}
+
+//Allocate a block with its header, mapped if it is large. Return NULL if failure
+static MEM_HEADER *AllocBlock(int subsystem, size_t size)
+{
+	MEM_HEADER *header;
+
+	header = (MEM_HEADER *)ExecMapLarge(sizeof(MEM_HEADER)+size, subsystem);
+
+	if (header)
+	{
+		header->magic = MEM_MAPPED_MAGIC;
+	}
+	else
+	{
+		header = (MEM_HEADER *)malloc(sizeof(MEM_HEADER)+size);
+
+		if (!header)
+		{
+			return NULL;
+		}
+
+		header->magic = MEM_HEADER_MAGIC;
+	}
+
+	header->size = size;
+	header->subsystem = subsystem;
+
+	return header;
+}
+
+//Free a block with its header
+static void FreeBlock(MEM_HEADER *header)
+{
+	if (header->magic==MEM_MAPPED_MAGIC)
+	{
+		header->magic = 0;
+		ExecUnmapLarge(header, sizeof(MEM_HEADER)+header->size);
+	}
+	else
+	{
+		header->magic = 0;
+		free(header);
+	}
+}
+
+//Allocate memory charged to a subsystem. Return NULL if failure or if the allocation would exceed the memory limit
+void *MemAlloc(int subsystem, size_t size)
+{
+	MEM_HEADER *header;
+
+	if ((subsystem<0)||(subsystem>=MEM_SUBSYSTEM_NUM))
+	{
+		return NULL;
+	}
+
+	if (MemCharge(subsystem, (long)size)<0)
+	{
+		return NULL;
+	}
+
+	header = AllocBlock(subsystem, size);
+
+	if (!header)
+	{
+		MemRelease(subsystem, (long)size);
+		return NULL;
+	}
+
+	return header+1;
+}
+
+//Allocate zero-initialized memory charged to a subsystem. Return NULL if failure or if the allocation would exceed the memory limit
+void *MemCalloc(int subsystem, size_t num, size_t size)
+{
+	void *ptr;
+
+	if ((size>0)&&(num>((size_t)-1)/size))
+	{
+		return NULL;
+	}
+
+	ptr = MemAlloc(subsystem, num*size);
+
+	//a mapped block is already zero, and is left untouched for first touch
+	if ((ptr)&&(GetHeader(ptr)->magic!=MEM_MAPPED_MAGIC))
+	{
+		memset(ptr, 0, num*size);
+	}
+
+	return ptr;
+}
+
+//Resize memory allocated by MemAlloc, MemCalloc or MemRealloc. ptr can be NULL. Return NULL if failure, in which case ptr is left unchanged
+void *MemRealloc(int subsystem, void *ptr, size_t size)
+{
+	MEM_HEADER *header, *newHeader;
+	long delta;
+
+	if (!ptr)
+	{
+		return MemAlloc(subsystem, size);
+	}
+
+	header = GetHeader(ptr);
+
+	if (!header)
+	{
+		return NULL;
+	}
+
+	delta = (long)size-(long)header->size;
+
+	if (MemCharge(header->subsystem, delta)<0)
+	{
+		return NULL;
+	}
+
+	//a mapped block, or a block growing large enough to be mapped, is moved by copy
+	if ((header->magic==MEM_MAPPED_MAGIC)||(size>=EXEC_LARGE_BUFFER))
+	{
+		newHeader = (MEM_HEADER *)ExecMapLarge(sizeof(MEM_HEADER)+size, header->subsystem);
+
+		if (newHeader)
+		{
+			newHeader->magic = MEM_MAPPED_MAGIC;
+		}
+		else if (header->magic==MEM_MAPPED_MAGIC)
+		{
+			newHeader = (MEM_HEADER *)malloc(sizeof(MEM_HEADER)+size);
+
+			if (!newHeader)
+			{
+				MemRelease(header->subsystem, delta);
+				return NULL;
+			}
+
+			newHeader->magic = MEM_HEADER_MAGIC;
+		}
+
+		if (newHeader)
+		{
+			newHeader->size = size;
+			newHeader->subsystem = header->subsystem;
+			memcpy(newHeader+1, header+1, size<header->size?size:header->size);
+			FreeBlock(header);
+			return newHeader+1;
+		}
+	}
+
+	newHeader = (MEM_HEADER *)realloc(header, sizeof(MEM_HEADER)+size);
+
+	if (!newHeader)
+	{
+		MemRelease(header->subsystem, delta);
+		return NULL;
+	}
+
+	newHeader->size = size;
+
+	return newHeader+1;
+}
+
+//Free memory allocated by MemAlloc, MemCalloc or MemRealloc. ptr can be NULL
+void MemFree(void *ptr)
+{
+	MEM_HEADER *header;
+
+	if (!ptr)
+	{
+		return;
+	}
+
+	header = GetHeader(ptr);
+
+	if (!header)
+	{
+		return;
+	}
+
+	MemRelease(header->subsystem, (long)header->size);
+	FreeBlock(header);
+}
+
+//Return the peak resident set size of the process in bytes
+long GetPeakRSS(void)
+{
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage)!=0)
+	{
+		return 0;
+	}
+
+	//ru_maxrss is in kilobytes on Linux
+	return usage.ru_maxrss*1024L;
+}
+
+//Print the current and peak memory of each subsystem and the peak resident set size
+void PrintMemReport(FILE *fh)
+{
+	int i;
+
+	fprintf(fh, "memory usage (MB):\n");
+	fprintf(fh, "subsystem\tin_use\tpeak\n");
+
+	for (i=0;i<MEM_SUBSYSTEM_NUM;i++)
+	{
+		fprintf(fh, "%s\t%.2f\t%.2f\n", subsystemNames[i], subsystemInUse[i]/1048576.0, subsystemPeak[i]/1048576.0);
+	}
+
+	fprintf(fh, "total\t%.2f\t%.2f\n", memInUse/1048576.0, memPeak/1048576.0);
+
+	if (memLimit>0)
+	{
+		fprintf(fh, "memory limit: %.2f MB\n", memLimit/1048576.0);
+	}
+
+	fprintf(fh, "peak resident set size: %.2f MB\n", GetPeakRSS()/1048576.0);
+
+	ExecReport(fh, subsystemNames, MEM_SUBSYSTEM_NUM);
+}
@@ -0,0 +1,290 @@
+/*
+ *  nb_test.c
+ *	Negative binomial test of sgRNA counts of replicate samples, ranking sgRNAs for RRA
+ *
+ *  Counts are normalized by median-ratio size factors. The variance of the normalized control counts
+ *  is modeled as mean+exp(intercept)*mean^slope, a trend fitted across all sgRNAs, since a few
+ *  replicates do not give the variance of each sgRNA. The mean treatment count of an sgRNA is then
+ *  a tail of the negative binomial distribution of its control mean and the variance of the trend,
+ *  computed as an incomplete beta function ratio.
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "nb_test.h"
+#include "math_api.h"
+#include "mem_acct.h"
+#include "trace.h"
+
+#define NB_LGAMMA_NUM 5            //log-gamma values of each sgRNA: r, k+1, r+k+1, k and r+k
+
+typedef struct
+{
+	const double *counts;          //counts of the sgRNAs in all samples, by column
+	int itemNum;                   //number of sgRNAs
+	int sampleNum;                 //number of samples
+	int controlNum;                //number of control samples, the first ones
+	const double *sizeFactors;     //size factor of each sample
+	const NB_TREND *trend;         //mean-variance trend
+	double *work;                  //NB_LGAMMA_NUM+3 values per sgRNA of the chunk
+	double *pLow;                  //probability of a count as low, in input order
+	double *pHigh;                 //probability of a count as high, in input order
+	int start;                     //first sgRNA of the chunk
+	int end;                       //last sgRNA of the chunk plus one
+} NB_TASK;
+
+//Mean and sample variance of the normalized counts of sgRNA i in samples start to end-1
+static void NormalizedMoments(const double *counts, int i, int itemNum, int start, int end, const double *sizeFactors, double *mean, double *variance);
+
+//Test the sgRNAs of one chunk
+static void NBTestChunk(void *arg);
+
+//Mean and sample variance of the normalized counts of sgRNA i in samples start to end-1
+static void NormalizedMoments(const double *counts, int i, int itemNum, int start, int end, const double *sizeFactors, double *mean, double *variance)
+{
+	int j;
+	double x, sum, squares;
+
+	sum = 0.0;
+
+	for (j=start;j<end;j++)
+	{
+		sum += counts[(long)j*itemNum+i]/sizeFactors[j];
+	}
+
+	*mean = sum/(end-start);
+	squares = 0.0;
+
+	for (j=start;j<end;j++)
+	{
+		x = counts[(long)j*itemNum+i]/sizeFactors[j]-*mean;
+		squares += x*x;
+	}
+
+	*variance = end-start>1?squares/(end-start-1):0.0;
+}
+
+//Median-ratio size factor of each of the sampleNum samples of the counts of itemNum sgRNAs, counts[j*itemNum+i] for sgRNA i in sample j,
+//into sizeFactors. Only the sgRNAs counted in all samples take part. Return 1 if success, -1 if failure
+int NBSizeFactors(const double *counts, int itemNum, int sampleNum, double *sizeFactors)
+{
+	double *logMeans, *ratios;
+	int i, j, n;
+
+	logMeans = (double *)MemAlloc(MEM_WORK, (itemNum+1)*sizeof(double));
+	ratios = (double *)MemAlloc(MEM_WORK, (itemNum+1)*sizeof(double));
+
+	if ((!logMeans)||(!ratios))
+	{
+		MemFree(logMeans);
+		MemFree(ratios);
+		return -1;
+	}
+
+	//log of the geometric mean of each sgRNA, 0 for sgRNAs missing from a sample, which are left out
+	for (i=0;i<itemNum;i++)
+	{
+		logMeans[i] = 0.0;
+
+		for (j=0;(j<sampleNum)&&(logMeans[i]<HUGE_VAL);j++)
+		{
+			logMeans[i] = counts[(long)j*itemNum+i]>0.0?logMeans[i]+log(counts[(long)j*itemNum+i])/sampleNum:HUGE_VAL;
+		}
+	}
+
+	for (j=0;j<sampleNum;j++)
+	{
+		for (i=0,n=0;i<itemNum;i++)
+		{
+			if (logMeans[i]<HUGE_VAL)
+			{
+				ratios[n++] = log(counts[(long)j*itemNum+i])-logMeans[i];
+			}
+		}
+
+		if (n==0)
+		{
+			printf("no sgRNA is counted in all samples, size factors cannot be estimated\n");
+			MemFree(logMeans);
+			MemFree(ratios);
+			return -1;
+		}
+
+		QuicksortF(ratios, 0, n-1);
+
+		sizeFactors[j] = exp(n%2?ratios[n/2]:(ratios[n/2-1]+ratios[n/2])/2);
+	}
+
+	MemFree(logMeans);
+	MemFree(ratios);
+
+	return 1;
+}
+
+//Fit the trend of the variance of the normalized counts on their mean across sgRNAs, over the controlNum control samples, the first ones,
+//or over all samples if there is a single control. Only sgRNAs whose variance is above the mean are fitted. Return 1 if success, -1 if failure
+int NBFitTrend(const double *counts, int itemNum, int sampleNum, int controlNum, const double *sizeFactors, NB_TREND *trend)
+{
+	double *logMeans, *logExcess;
+	double mean, variance, centerX, centerY, sxx;
+	int i, n, end;
+
+	logMeans = (double *)MemAlloc(MEM_WORK, (itemNum+1)*sizeof(double));
+	logExcess = (double *)MemAlloc(MEM_WORK, (itemNum+1)*sizeof(double));
+
+	if ((!logMeans)||(!logExcess))
+	{
+		MemFree(logMeans);
+		MemFree(logExcess);
+		return -1;
+	}
+
+	end = controlNum>1?controlNum:sampleNum;
+
+	for (i=0,n=0;i<itemNum;i++)
+	{
+		NormalizedMoments(counts, i, itemNum, 0, end, sizeFactors, &mean, &variance);
+
+		if ((mean>0.0)&&(variance>mean))
+		{
+			logMeans[n] = log(mean);
+			logExcess[n] = log(variance-mean);
+			n++;
+		}
+	}
+
+	//least squares in the order of ReproSum, so that the trend does not depend on the build
+	centerX = n>0?ReproSum(logMeans, n)/n:0.0;
+	centerY = n>0?ReproSum(logExcess, n)/n:0.0;
+	sxx = n>0?ReproDot(logMeans, logMeans, n, centerX, centerX):0.0;
+
+	if ((n<NB_MIN_FIT_NUM)||(sxx<=0.0))
+	{
+		printf("%d sgRNAs have a variance above their mean, too few to fit the mean-variance trend\n", n);
+		MemFree(logMeans);
+		MemFree(logExcess);
+		return -1;
+	}
+
+	trend->slope = ReproDot(logMeans, logExcess, n, centerX, centerY)/sxx;
+	trend->intercept = centerY-trend->slope*centerX;
+	trend->fitNum = n;
+
+	MemFree(logMeans);
+	MemFree(logExcess);
+
+	return 1;
+}
+
+//Test the sgRNAs of one chunk
+static void NBTestChunk(void *arg)
+{
+	NB_TASK *task = (NB_TASK *)arg;
+	int n = task->end-task->start;
+	double *logs = task->work;
+	double *sizes = task->work+NB_LGAMMA_NUM*n;
+	double *probs = sizes+n;
+	double *ks = probs+n;
+	double mean, variance, treatment;
+	int i, l, ifault;
+
+	TraceBegin("nb chunk");
+
+	//the size r, the success probability p and the count k of each sgRNA, and the arguments of its log-gamma values
+	for (i=task->start,l=0;i<task->end;i++,l++)
+	{
+		NormalizedMoments(task->counts, i, task->itemNum, 0, task->controlNum, task->sizeFactors, &mean, &variance);
+		NormalizedMoments(task->counts, i, task->itemNum, task->controlNum, task->sampleNum, task->sizeFactors, &treatment, &variance);
+
+		mean = mean>NB_MIN_MEAN?mean:NB_MIN_MEAN;
+		variance = mean+exp(task->trend->intercept+task->trend->slope*log(mean));
+
+		sizes[l] = mean*mean/(variance-mean);
+		probs[l] = mean/variance;
+		ks[l] = floor(treatment+0.5);
+
+		logs[NB_LGAMMA_NUM*l] = sizes[l];
+		logs[NB_LGAMMA_NUM*l+1] = ks[l]+1.0;
+		logs[NB_LGAMMA_NUM*l+2] = sizes[l]+ks[l]+1.0;
+		logs[NB_LGAMMA_NUM*l+3] = ks[l]>0.0?ks[l]:1.0;
+		logs[NB_LGAMMA_NUM*l+4] = sizes[l]+ks[l];
+	}
+
+	//the log-gamma values of the chunk in one batch, in place
+	LogGammaArray(logs, NB_LGAMMA_NUM*n, logs);
+
+	//P(X<=k) = I_p(r, k+1) and P(X>=k) = I_(1-p)(k, r)
+	for (i=task->start,l=0;i<task->end;i++,l++)
+	{
+		task->pLow[i] = betain(probs[l], sizes[l], ks[l]+1.0, logs[NB_LGAMMA_NUM*l]+logs[NB_LGAMMA_NUM*l+1]-logs[NB_LGAMMA_NUM*l+2], &ifault);
+		task->pHigh[i] = ks[l]>0.0?betain(1.0-probs[l], ks[l], sizes[l], logs[NB_LGAMMA_NUM*l+3]+logs[NB_LGAMMA_NUM*l]-logs[NB_LGAMMA_NUM*l+4], &ifault):1.0;
+	}
+
+	TraceEnd("nb chunk");
+}
+
+//Test the mean normalized count of the treatment samples of each sgRNA against a negative binomial distribution of the mean of its
+//control samples and the variance of the trend. The probabilities of a count as low and as high are written to pLow and pHigh, each of
+//itemNum values. Chunks of NB_CHUNK_ROWS sgRNAs are tested on the thread pool, the log-gamma values of a chunk in one batch. Return 1 if success, -1 if failure
+int NBTestGuides(const double *counts, int itemNum, int sampleNum, int controlNum, const double *sizeFactors, const NB_TREND *trend,
+				 THREAD_POOL_STRUCT *pool, double *pLow, double *pHigh)
+{
+	NB_TASK *tasks;
+	double *work;
+	int i, taskNum;
+
+	if ((itemNum<=0)||(controlNum<1)||(controlNum>=sampleNum))
+	{
+		return -1;
+	}
+
+	taskNum = (itemNum+NB_CHUNK_ROWS-1)/NB_CHUNK_ROWS;
+
+	tasks = (NB_TASK *)MemAlloc(MEM_WORK, taskNum*sizeof(NB_TASK));
+	work = (double *)MemAlloc(MEM_WORK, (NB_LGAMMA_NUM+3)*(long)itemNum*sizeof(double));
+
+	if ((!tasks)||(!work))
+	{
+		MemFree(tasks);
+		MemFree(work);
+		return -1;
+	}
+
+	//each task tests one chunk in its own part of the work array, so the tasks run independently
+	for (i=0;i<taskNum;i++)
+	{
+		tasks[i].counts = counts;
+		tasks[i].itemNum = itemNum;
+		tasks[i].sampleNum = sampleNum;
+		tasks[i].controlNum = controlNum;
+		tasks[i].sizeFactors = sizeFactors;
+		tasks[i].trend = trend;
+		tasks[i].pLow = pLow;
+		tasks[i].pHigh = pHigh;
+		tasks[i].start = i*NB_CHUNK_ROWS;
+		tasks[i].end = (i+1)*NB_CHUNK_ROWS<itemNum?(i+1)*NB_CHUNK_ROWS:itemNum;
+		tasks[i].work = work+(NB_LGAMMA_NUM+3)*(long)tasks[i].start;
+
+		if ((!pool)||(ThreadPoolSubmit(pool, NBTestChunk, tasks+i)<0))
+		{
+			//test the chunk in this thread
+			NBTestChunk(tasks+i);
+		}
+	}
+
+	if (pool)
+	{
+		ThreadPoolWait(pool);
+	}
+
+	MemFree(tasks);
+	MemFree(work);
+
+	return 1;
+}
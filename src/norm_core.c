@@ -0,0 +1,868 @@
+/*
+ *  norm_core.c
+ *	Normalization of Crispr measures on columns of values: MA transform, adjustment of the log-ratio in a sliding window, copy-number correction and slopes of time courses
+ *
+ *  The functions read and write plain columns owned by the caller, so that CrisprNorm and the
+ *  embedding API share the same code. Only the work arrays of the sort by log-mean are allocated.
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "norm_core.h"
+#include "mem_acct.h"
+#include "trace.h"
+#include "exec_ctx.h"
+
+typedef struct
+{
+	const double *m;                 //log-means in input order
+	const double *r;                 //log-ratios in input order
+	double *sortedM;                 //log-means sorted
+	double *sortedR;                 //log-ratios in the order of sortedM
+	double *adjustedR;               //adjusted log-ratios in input order
+	int itemNum;                     //number of items
+	int winSize;                     //window size
+	int start;                       //first item of the chunk
+	int end;                         //last item of the chunk plus one
+	int chunkIndex;                  //index of the chunk
+	NORM_CHUNK_FUNC chunkDone;       //called when the chunk is adjusted
+	void *arg;                       //argument of chunkDone
+} ADJUST_TASK;
+
+typedef struct
+{
+	const double *x;                 //values of all columns, x[j*itemNum+i], or NULL for a sparse matrix
+	const long *rowStart;            //offsets of the nonzero values of each item of a sparse matrix
+	const int *columns;              //column of each nonzero value
+	const double *values;            //nonzero values
+	const double *weights;           //time of each column minus the mean time
+	const double *sizeFactors;       //size factor of each column
+	double *shift;                   //normalized log value of each item in the first column
+	double *sums;                    //sum of the shifted values of each item
+	double *slopes;                  //sum of the weighted values of each item, then the slope
+	double *variances;               //sum of the squared shifted values of each item, then the residual variance
+	double sxx;                      //sum of the squared weights
+	int itemNum;                     //number of items
+	int sampleNum;                   //number of columns
+	int start;                       //first item of the chunk
+	int end;                         //last item of the chunk plus one
+} SLOPE_TASK;
+
+typedef struct
+{
+	const INDEXED_FLOAT *order;      //items of all chromosomes sorted by chromosome and position, indices into r
+	const double *r;                 //adjusted log-ratios in input order
+	const long *positions;           //position of each item
+	double *correctedR;              //corrected log-ratios in input order
+	INDEXED_FLOAT *byValue;          //log-ratios of the chromosome in ascending order, with their sorted items, in the slice of the chromosome
+	int *ranks;                      //rank of the log-ratio of each sorted item among those of its chromosome
+	int *counts;                     //Fenwick tree over the ranks of the chromosome of the items of the window, in the slice of the chromosome
+	long halfWindow;                 //items within this distance are in the window
+	int start;                       //first sorted item of the chromosome
+	int end;                         //last sorted item of the chromosome plus one
+} COPY_TASK;
+
+static int normChunkRows = NORM_CHUNK_ROWS;  //number of items adjusted by one task
+
+//Adjust the items of one chunk
+static void AdjustMRChunk(void *arg);
+
+//Median of the itemNum values of x, sorted in work, at index (itemNum+1)/2 as CrisprNorm always took it, clamped for a single item
+static double ColumnMedian(const double *x, int itemNum, double *work);
+
+//Divide the medians of sampleNum columns by their geometric mean. Return 1 if success, -1 if a median is not positive
+static int ScaleSizeFactors(double *sizeFactors, int sampleNum);
+
+//Fit the slopes of the items of one chunk
+static void TimeCourseChunk(void *arg);
+
+//Fit the slopes of the items of one chunk of a sparse matrix
+static void SparseTimeCourseChunk(void *arg);
+
+//Slope and residual variance of an item from the sum, weighted sum and sum of squares of its values over sampleNum columns
+static void SlopeFromSums(double sum, double sxy, double syy, double sxx, int sampleNum, double *slope, double *variance);
+
+//Fit the slopes of the task on the thread pool, in chunks of items set by SetNormChunkRows. Return 1 if success, -1 if failure
+static int RunSlopeTasks(SLOPE_TASK *model, const double *times, TASK_FUNC func, THREAD_POOL_STRUCT *pool);
+
+//Add delta to the count of rank rank, from 0, of a Fenwick tree of num ranks
+static void RankCountAdd(int *counts, int num, int rank, int delta);
+
+//Rank, from 0, of the item k, from 0, in ascending order of the ranks counted in a Fenwick tree of num ranks
+static int RankCountSelect(const int *counts, int num, int k);
+
+//Correct the items of one chromosome
+static void CopyNumberChromosome(void *arg);
+
+//Set the number of items adjusted by one task of AdjustMR, NORM_CHUNK_ROWS by default
+void SetNormChunkRows(int itemNum)
+{
+	normChunkRows = itemNum>0?itemNum:NORM_CHUNK_ROWS;
+}
+
+//Return the number of chunks of AdjustMR for itemNum items
+int NormChunkNum(int itemNum)
+{
+	return (itemNum+normChunkRows-1)/normChunkRows;
+}
+
+//Median of the itemNum values of x, sorted in work, at index (itemNum+1)/2 as CrisprNorm always took it, clamped for a single item
+static double ColumnMedian(const double *x, int itemNum, double *work)
+{
+	memcpy(work, x, itemNum*sizeof(double));
+
+	QuicksortF(work, 0, itemNum-1);
+
+	return work[(itemNum+1)/2<itemNum?(itemNum+1)/2:itemNum-1];
+}
+
+//transform to log mean-ratio. m = x1'+x2', r = x2'-x1', x' = log2(x/median+0.01), 0.01 is the pseudo-count.
+//m and r have itemNum values, allocated by the caller. Return 1 if success, -1 if failure
+int ComputeMR(const double *x1, const double *x2, int itemNum, double *m, double *r)
+{
+	double *tmpF;
+	int i;
+	double median1, median2, x1ba, x2ba;
+
+	if (itemNum<=0)
+	{
+		return -1;
+	}
+
+	tmpF = (double *)MemAlloc(MEM_WORK, itemNum*sizeof(double));
+
+	if (!tmpF)
+	{
+		return -1;
+	}
+
+	median1 = ColumnMedian(x1, itemNum, tmpF);
+	median2 = ColumnMedian(x2, itemNum, tmpF);
+
+	for (i=0;i<itemNum;i++)
+	{
+		x1ba = log2(x1[i]/median1+0.01);
+		x2ba = log2(x2[i]/median2+0.01);
+
+		m[i] = x1ba + x2ba;
+		r[i] = x2ba - x1ba;
+	}
+
+	MemFree(tmpF);
+
+	return 1;
+}
+
+//Size factors of sampleNum columns of itemNum values, x[j*itemNum+i] for item i in column j: the median of each column as in ComputeMR,
+//divided by the geometric mean of the medians so that normalized values keep the scale of counts. Return 1 if success, -1 if failure
+int MedianSizeFactors(const double *x, int itemNum, int sampleNum, double *sizeFactors)
+{
+	double *tmpF;
+	int j;
+
+	if ((itemNum<=0)||(sampleNum<=0))
+	{
+		return -1;
+	}
+
+	tmpF = (double *)MemAlloc(MEM_WORK, itemNum*sizeof(double));
+
+	if (!tmpF)
+	{
+		return -1;
+	}
+
+	for (j=0;j<sampleNum;j++)
+	{
+		sizeFactors[j] = ColumnMedian(x+(long)j*itemNum, itemNum, tmpF);
+	}
+
+	MemFree(tmpF);
+
+	return ScaleSizeFactors(sizeFactors, sampleNum);
+}
+
+//Divide the medians of sampleNum columns by their geometric mean. Return 1 if success, -1 if a median is not positive
+static int ScaleSizeFactors(double *sizeFactors, int sampleNum)
+{
+	double logMean;
+	int j;
+
+	logMean = 0.0;
+
+	for (j=0;j<sampleNum;j++)
+	{
+		if (sizeFactors[j]<=0.0)
+		{
+			printf("the median of column %d is not positive, it cannot be normalized\n", j+1);
+			return -1;
+		}
+
+		logMean += log(sizeFactors[j])/sampleNum;
+	}
+
+	for (j=0;j<sampleNum;j++)
+	{
+		sizeFactors[j] /= exp(logMean);
+	}
+
+	return 1;
+}
+
+//Size factors of sampleNum columns of a sparse matrix of itemNum rows, whose nonzero values of row i are values[rowStart[i]] to values[rowStart[i+1]-1]
+//in columns columns[rowStart[i]] to columns[rowStart[i+1]-1]. The median of a column that is mostly zeros is zero, so each column takes instead the median,
+//over its nonzero values, of the value divided by the geometric mean of its row, in which zeros count as 1 (the "poscounts" estimator of DESeq2),
+//then divided by the geometric mean of the columns as in MedianSizeFactors. Values should not be negative. Return 1 if success, -1 if failure
+int SparseMedianSizeFactors(const long *rowStart, const int *columns, const double *values, int itemNum, int sampleNum, double *sizeFactors)
+{
+	long *columnStart;
+	double *byColumn, logMean;
+	long k, n;
+	int i, j;
+
+	if ((itemNum<=0)||(sampleNum<=0))
+	{
+		return -1;
+	}
+
+	columnStart = (long *)MemAlloc(MEM_WORK, (sampleNum+2)*sizeof(long));
+	byColumn = (double *)MemAlloc(MEM_WORK, (rowStart[itemNum]+1)*sizeof(double));
+
+	if ((!columnStart)||(!byColumn))
+	{
+		MemFree(columnStart);
+		MemFree(byColumn);
+		return -1;
+	}
+
+	//the positive values are gathered by column: columnStart[j+1] starts at the first value of column j and advances past each value placed,
+	//so that it ends at the first value of column j+1
+	memset(columnStart, 0, (sampleNum+2)*sizeof(long));
+
+	for (k=0;k<rowStart[itemNum];k++)
+	{
+		columnStart[columns[k]+2] += values[k]>0.0?1:0;
+	}
+
+	for (j=2;j<=sampleNum;j++)
+	{
+		columnStart[j] += columnStart[j-1];
+	}
+
+	//each value is divided by the geometric mean of its row over all sampleNum columns, zeros counting as 1, which is positive for any row with a
+	//positive value. The ratios of a column do not depend on how many of its rows are zero
+	for (i=0;i<itemNum;i++)
+	{
+		logMean = 0.0;
+
+		for (k=rowStart[i];k<rowStart[i+1];k++)
+		{
+			logMean += values[k]>0.0?log(values[k]):0.0;
+		}
+
+		logMean /= sampleNum;
+
+		for (k=rowStart[i];k<rowStart[i+1];k++)
+		{
+			if (values[k]>0.0)
+			{
+				byColumn[columnStart[columns[k]+1]++] = exp(log(values[k])-logMean);
+			}
+		}
+	}
+
+	//item (n+1)/2 of the n ratios of each column in ascending order, as ColumnMedian takes it. A column without positive values stays at 0
+	for (j=0;j<sampleNum;j++)
+	{
+		n = columnStart[j+1]-columnStart[j];
+		sizeFactors[j] = 0.0;
+
+		if (n>0)
+		{
+			QuicksortF(byColumn+columnStart[j], 0, (int)n-1);
+			sizeFactors[j] = byColumn[columnStart[j]+((n+1)/2<n?(n+1)/2:n-1)];
+		}
+	}
+
+	MemFree(columnStart);
+	MemFree(byColumn);
+
+	return ScaleSizeFactors(sizeFactors, sampleNum);
+}
+
+//Adjust the items of one chunk
+static void AdjustMRChunk(void *arg)
+{
+	ADJUST_TASK *task = (ADJUST_TASK *)arg;
+	double *sortedM = task->sortedM;
+	double *sortedR = task->sortedR;
+	int itemNum = task->itemNum;
+	int winSize = task->winSize;
+	int i;
+	double tmpMean, tmpStdev;
+	int index1, index2, tmpRange;
+
+	TraceBegin("window batch");
+
+	for (i=task->start;i<task->end;i++)
+	{
+		index1 = bTreeSearchingF(task->m[i]-0.000000001, sortedM, 0, itemNum-1);
+		index2 = bTreeSearchingF(task->m[i]+0.000000001, sortedM, 0, itemNum-1);
+
+		tmpRange = index2-index1+1;
+
+		if (tmpRange<winSize)
+		{
+			index1 = index1-(winSize-tmpRange+1)/2;
+			index2 = index2+(winSize-tmpRange+1)/2;
+
+			index1 = index1>=0?index1:0;
+			index2 = index2<itemNum?index2:itemNum-1;
+		}
+
+		index1 = bTreeSearchingF(sortedM[index1]-0.000000001, sortedM, 0, itemNum-1);
+		index2 = bTreeSearchingF(sortedM[index2]+0.000000001, sortedM, 0, itemNum-1);
+
+		//sums of the window in the fixed order of ReproSum, so that an item gets the same value on any machine and build.
+		//The squared deviations stop before index2, as they always have
+		tmpMean = ReproSum(sortedR+index1, index2-index1+1)/(index2-index1+1);
+
+		tmpStdev = sqrt(ReproDot(sortedR+index1, sortedR+index1, index2-index1, tmpMean, tmpMean)/(index2-index1+1));
+
+		task->adjustedR[i] = (task->r[i]-tmpMean)/(tmpStdev+0.000000001);
+	}
+
+	TraceEnd("window batch");
+
+	if (task->chunkDone)
+	{
+		task->chunkDone(task->arg, task->chunkIndex, task->start, task->end);
+	}
+}
+
+//Adjust r using z-transform within a window sliding on items sorted by m, into adjustedR allocated by the caller.
+//Chunks of items set by SetNormChunkRows are adjusted on the thread pool; if chunkDone is not NULL, it is called for each chunk as soon as
+//the chunk is adjusted, so that the caller can use it while the others are computed. Return 1 if success, -1 if failure
+int AdjustMR(const double *m, const double *r, int itemNum, int winSize, THREAD_POOL_STRUCT *pool, double *adjustedR,
+			 NORM_CHUNK_FUNC chunkDone, void *arg)
+{
+	int i;
+	INDEXED_FLOAT *order;
+	double *sortedM, *sortedR;
+	ADJUST_TASK *tasks;
+	int taskNum;
+
+	if ((itemNum<=0)||(winSize<=0))
+	{
+		return -1;
+	}
+
+	taskNum = NormChunkNum(itemNum);
+
+	order = (INDEXED_FLOAT *)MemAlloc(MEM_WORK, (itemNum+1)*sizeof(INDEXED_FLOAT));
+	sortedM = (double *)MemAlloc(MEM_WORK, itemNum*sizeof(double));
+	sortedR = (double *)MemAlloc(MEM_WORK, itemNum*sizeof(double));
+	tasks = (ADJUST_TASK *)MemAlloc(MEM_WORK, taskNum*sizeof(ADJUST_TASK));
+
+	if ((!order)||(!sortedM)||(!sortedR)||(!tasks))
+	{
+		MemFree(order);
+		MemFree(sortedM);
+		MemFree(sortedR);
+		MemFree(tasks);
+		return -1;
+	}
+
+	//the windows of any chunk may read the sorted arrays anywhere, so their pages are interleaved over the nodes before this thread fills them
+	ExecInterleave(sortedM, itemNum*sizeof(double));
+	ExecInterleave(sortedR, itemNum*sizeof(double));
+
+	//items are sorted by an index rather than moved. The original sort ran over itemNum+1 items, including a zeroed slot
+	//past the end, which took part in the windows as an item with m=0 and r=0 while the item of largest m fell out of the
+	//sorted arrays. The slot is kept explicitly, so that results are unchanged
+	for (i=0;i<itemNum;i++)
+	{
+		order[i].value = m[i];
+		order[i].index = i;
+	}
+
+	order[itemNum].value = 0.0;
+	order[itemNum].index = itemNum;
+
+	TraceBegin("sort by mean");
+	QuicksortIndexedArray(order, 0, itemNum);
+	TraceEnd("sort by mean");
+
+	for (i=0;i<itemNum;i++)
+	{
+		sortedM[i] = order[i].value;
+		sortedR[i] = order[i].index<itemNum?r[order[i].index]:0.0;
+	}
+
+	MemFree(order);
+
+	//each task adjusts one chunk; tasks only read the sorted arrays, so they run independently
+	for (i=0;i<taskNum;i++)
+	{
+		tasks[i].m = m;
+		tasks[i].r = r;
+		tasks[i].sortedM = sortedM;
+		tasks[i].sortedR = sortedR;
+		tasks[i].adjustedR = adjustedR;
+		tasks[i].itemNum = itemNum;
+		tasks[i].winSize = winSize;
+		tasks[i].start = i*normChunkRows;
+		tasks[i].end = (i+1)*normChunkRows<itemNum?(i+1)*normChunkRows:itemNum;
+		tasks[i].chunkIndex = i;
+		tasks[i].chunkDone = chunkDone;
+		tasks[i].arg = arg;
+
+		if ((!pool)||(ThreadPoolSubmit(pool, AdjustMRChunk, tasks+i)<0))
+		{
+			//adjust the chunk in this thread
+			AdjustMRChunk(tasks+i);
+		}
+	}
+
+	if (pool)
+	{
+		ThreadPoolWait(pool);
+	}
+
+	MemFree(sortedM);
+	MemFree(sortedR);
+	MemFree(tasks);
+
+	return 1;
+}
+
+//Fit the slopes of the items of one chunk
+static void TimeCourseChunk(void *arg)
+{
+	SLOPE_TASK *task = (SLOPE_TASK *)arg;
+	int n = task->end-task->start;
+	const double *column;
+	double *shift = task->shift+task->start;
+	double *sums = task->sums+task->start;
+	double *slopes = task->slopes+task->start;
+	double *variances = task->variances+task->start;
+	double y, w, scale;
+	int i, j;
+
+	TraceBegin("slope chunk");
+
+	//values are shifted by the first column, so that the sums of squares do not cancel for large values.
+	//The first column adds nothing to the shifted sums
+	column = task->x+task->start;
+	scale = 1.0/task->sizeFactors[0];
+
+	for (i=0;i<n;i++)
+	{
+		shift[i] = log2(column[i]*scale+1.0);
+		sums[i] = 0.0;
+		slopes[i] = 0.0;
+		variances[i] = 0.0;
+	}
+
+	//one sweep of each column over the contiguous values of the chunk, without branches, so that the compiler vectorizes it.
+	//The weights sum to zero, so the weighted sum of shifted values is the weighted sum of values
+	for (j=1;j<task->sampleNum;j++)
+	{
+		column = task->x+(long)j*task->itemNum+task->start;
+		scale = 1.0/task->sizeFactors[j];
+		w = task->weights[j];
+
+		for (i=0;i<n;i++)
+		{
+			y = log2(column[i]*scale+1.0)-shift[i];
+			sums[i] += y;
+			slopes[i] += w*y;
+			variances[i] += y*y;
+		}
+	}
+
+	for (i=0;i<n;i++)
+	{
+		SlopeFromSums(sums[i], slopes[i], variances[i], task->sxx, task->sampleNum, slopes+i, variances+i);
+	}
+
+	TraceEnd("slope chunk");
+}
+
+//Fit the slopes of the items of one chunk of a sparse matrix
+static void SparseTimeCourseChunk(void *arg)
+{
+	SLOPE_TASK *task = (SLOPE_TASK *)arg;
+	double y, sum, sxy, syy;
+	long k;
+	int i;
+
+	TraceBegin("slope chunk");
+
+	//a zero is log2(0+1) = 0, so only the nonzero values of an item add to its sums
+	for (i=task->start;i<task->end;i++)
+	{
+		sum = 0.0;
+		sxy = 0.0;
+		syy = 0.0;
+
+		for (k=task->rowStart[i];k<task->rowStart[i+1];k++)
+		{
+			y = log2(task->values[k]/task->sizeFactors[task->columns[k]]+1.0);
+			sum += y;
+			sxy += task->weights[task->columns[k]]*y;
+			syy += y*y;
+		}
+
+		SlopeFromSums(sum, sxy, syy, task->sxx, task->sampleNum, task->slopes+i, task->variances+i);
+	}
+
+	TraceEnd("slope chunk");
+}
+
+//Slope and residual variance of an item from the sum, weighted sum and sum of squares of its values over sampleNum columns
+static void SlopeFromSums(double sum, double sxy, double syy, double sxx, int sampleNum, double *slope, double *variance)
+{
+	double rss;
+
+	//closed form of the least squares: slope = Sxy/Sxx, and the residual sum of squares is Syy-slope*Sxy
+	*slope = sxy/sxx;
+	rss = syy-sum*sum/sampleNum-*slope*sxy;
+	*variance = sampleNum>2?(rss>0.0?rss:0.0)/(sampleNum-2):0.0;
+}
+
+//Fit the slopes of the task on the thread pool, in chunks of items set by SetNormChunkRows. Return 1 if success, -1 if failure
+static int RunSlopeTasks(SLOPE_TASK *model, const double *times, TASK_FUNC func, THREAD_POOL_STRUCT *pool)
+{
+	SLOPE_TASK *tasks;
+	double *weights;
+	double meanTime;
+	int i, j, taskNum;
+
+	taskNum = NormChunkNum(model->itemNum);
+
+	weights = (double *)MemAlloc(MEM_WORK, model->sampleNum*sizeof(double));
+	tasks = (SLOPE_TASK *)MemAlloc(MEM_WORK, taskNum*sizeof(SLOPE_TASK));
+
+	if ((!weights)||(!tasks))
+	{
+		MemFree(weights);
+		MemFree(tasks);
+		return -1;
+	}
+
+	meanTime = 0.0;
+
+	for (j=0;j<model->sampleNum;j++)
+	{
+		meanTime += times[j]/model->sampleNum;
+	}
+
+	model->sxx = 0.0;
+
+	for (j=0;j<model->sampleNum;j++)
+	{
+		weights[j] = times[j]-meanTime;
+		model->sxx += weights[j]*weights[j];
+	}
+
+	if (model->sxx<=0.0)
+	{
+		printf("all columns have the same time, slopes cannot be fitted\n");
+		MemFree(weights);
+		MemFree(tasks);
+		return -1;
+	}
+
+	model->weights = weights;
+
+	//each task fits one chunk into its own part of the arrays, so the tasks run independently
+	for (i=0;i<taskNum;i++)
+	{
+		tasks[i] = *model;
+		tasks[i].start = i*normChunkRows;
+		tasks[i].end = (i+1)*normChunkRows<model->itemNum?(i+1)*normChunkRows:model->itemNum;
+
+		if ((!pool)||(ThreadPoolSubmit(pool, func, tasks+i)<0))
+		{
+			//fit the chunk in this thread
+			func(tasks+i);
+		}
+	}
+
+	if (pool)
+	{
+		ThreadPoolWait(pool);
+	}
+
+	MemFree(weights);
+	MemFree(tasks);
+
+	return 1;
+}
+
+//Least-squares slope of x' = log2(x/sizeFactor+1) on the times of sampleNum columns of itemNum values, x[j*itemNum+i] for item i in column j,
+//and the variance of its residuals, into slopes and variances of itemNum values allocated by the caller; 1 is the pseudo-count on the scale of counts.
+//Chunks of items set by SetNormChunkRows are fitted on the thread pool. Return 1 if success, -1 if failure
+int TimeCourseSlopes(const double *x, int itemNum, int sampleNum, const double *times, const double *sizeFactors, THREAD_POOL_STRUCT *pool,
+					 double *slopes, double *variances)
+{
+	SLOPE_TASK model;
+	int flag;
+
+	if ((itemNum<=0)||(sampleNum<2))
+	{
+		return -1;
+	}
+
+	memset(&model, 0, sizeof(SLOPE_TASK));
+
+	model.x = x;
+	model.sizeFactors = sizeFactors;
+	model.shift = (double *)MemAlloc(MEM_WORK, itemNum*sizeof(double));
+	model.sums = (double *)MemAlloc(MEM_WORK, itemNum*sizeof(double));
+	model.slopes = slopes;
+	model.variances = variances;
+	model.itemNum = itemNum;
+	model.sampleNum = sampleNum;
+
+	flag = ((model.shift)&&(model.sums))?RunSlopeTasks(&model, times, TimeCourseChunk, pool):-1;
+
+	MemFree(model.shift);
+	MemFree(model.sums);
+
+	return flag;
+}
+
+//Slopes and residual variances of TimeCourseSlopes for a sparse matrix of itemNum rows, whose nonzero values of row i are values[rowStart[i]] to
+//values[rowStart[i+1]-1] in columns columns[rowStart[i]] to columns[rowStart[i+1]-1]. Zeros are implicit: log2(0+1) is 0, so only the nonzero values
+//are transformed and summed, and no work memory grows with the items. Return 1 if success, -1 if failure
+int SparseTimeCourseSlopes(const long *rowStart, const int *columns, const double *values, int itemNum, int sampleNum, const double *times,
+						   const double *sizeFactors, THREAD_POOL_STRUCT *pool, double *slopes, double *variances)
+{
+	SLOPE_TASK model;
+
+	if ((itemNum<=0)||(sampleNum<2))
+	{
+		return -1;
+	}
+
+	memset(&model, 0, sizeof(SLOPE_TASK));
+
+	model.rowStart = rowStart;
+	model.columns = columns;
+	model.values = values;
+	model.sizeFactors = sizeFactors;
+	model.slopes = slopes;
+	model.variances = variances;
+	model.itemNum = itemNum;
+	model.sampleNum = sampleNum;
+
+	return RunSlopeTasks(&model, times, SparseTimeCourseChunk, pool);
+}
+
+//Add delta to the count of rank rank, from 0, of a Fenwick tree of num ranks
+static void RankCountAdd(int *counts, int num, int rank, int delta)
+{
+	int i;
+
+	//counts[i-1] holds the ranks from i-(i&-i) to i-1
+	for (i=rank+1;i<=num;i+=i&(-i))
+	{
+		counts[i-1] += delta;
+	}
+}
+
+//Rank, from 0, of the item k, from 0, in ascending order of the ranks counted in a Fenwick tree of num ranks
+static int RankCountSelect(const int *counts, int num, int k)
+{
+	int pos, step;
+
+	for (step=1;step*2<=num;step*=2);
+
+	//descend from the largest power of two, skipping the ranges with at most k items
+	for (pos=0;step>0;step/=2)
+	{
+		if ((pos+step<=num)&&(counts[pos+step-1]<=k))
+		{
+			pos += step;
+			k -= counts[pos-1];
+		}
+	}
+
+	return pos;
+}
+
+//Correct the items of one chromosome
+static void CopyNumberChromosome(void *arg)
+{
+	COPY_TASK *task = (COPY_TASK *)arg;
+	const INDEXED_FLOAT *order = task->order;
+	INDEXED_FLOAT *byValue = task->byValue;
+	int *counts = task->counts;
+	int i, left, right, num, median;
+	long position;
+
+	TraceBegin("copy number chromosome");
+
+	//the log-ratios of the chromosome are ranked once, so that the window is a count of ranks from which the median is selected exactly
+	num = task->end-task->start;
+
+	for (i=0;i<num;i++)
+	{
+		byValue[i].value = task->r[order[task->start+i].index];
+		byValue[i].index = task->start+i;
+		counts[i] = 0;
+	}
+
+	QuicksortIndexedArray(byValue, 0, num-1);
+
+	for (i=0;i<num;i++)
+	{
+		task->ranks[byValue[i].index] = i;
+	}
+
+	//the window [left, right) moves along the sorted items with both ends only going forward
+	left = task->start;
+	right = task->start;
+
+	for (i=task->start;i<task->end;i++)
+	{
+		position = task->positions[order[i].index];
+
+		while ((right<task->end)&&(task->positions[order[right].index]<=position+task->halfWindow))
+		{
+			RankCountAdd(counts, num, task->ranks[right], 1);
+			right++;
+		}
+
+		while (task->positions[order[left].index]<position-task->halfWindow)
+		{
+			RankCountAdd(counts, num, task->ranks[left], -1);
+			left++;
+		}
+
+		//lower median, item (n-1)/2 of the window in ascending order
+		median = RankCountSelect(counts, num, (right-left-1)/2);
+		task->correctedR[order[i].index] = task->r[order[i].index]-byValue[median].value;
+	}
+
+	TraceEnd("copy number chromosome");
+}
+
+//Subtract from r of each item the median of r over the items of its chromosome within halfWindow of its position, into correctedR allocated by
+//the caller. chromosomes numbers the chromosome of each item, -1 for an item of unknown position, which is copied. Items are sorted by chromosome
+//and position once, and the log-ratios of each chromosome by value; the window is kept as a count of the ranks of its log-ratios as it slides, from
+//which its exact median is selected, so each chromosome is corrected in O(n log n), chromosomes in parallel on the thread pool. Return 1 if success,
+//-1 if failure
+int CorrectCopyNumber(const double *r, const int *chromosomes, const long *positions, int itemNum, long halfWindow, THREAD_POOL_STRUCT *pool,
+					  double *correctedR)
+{
+	INDEXED_FLOAT *order, *byValue;
+	COPY_TASK *tasks;
+	int *ranks, *counts;
+	int i, n, taskNum;
+
+	if ((itemNum<=0)||(halfWindow<0))
+	{
+		return -1;
+	}
+
+	order = (INDEXED_FLOAT *)MemAlloc(MEM_WORK, itemNum*sizeof(INDEXED_FLOAT));
+
+	if (!order)
+	{
+		return -1;
+	}
+
+	//items of known position are sorted once by chromosome, then position, in one key
+	for (i=0,n=0;i<itemNum;i++)
+	{
+		correctedR[i] = r[i];
+
+		if (chromosomes[i]>=0)
+		{
+			order[n].value = chromosomes[i]*NORM_CN_CHROM_STRIDE+positions[i];
+			order[n].index = i;
+			n++;
+		}
+	}
+
+	if (n==0)
+	{
+		MemFree(order);
+		return 1;
+	}
+
+	TraceBegin("sort by position");
+	QuicksortIndexedArray(order, 0, n-1);
+	TraceEnd("sort by position");
+
+	for (i=1,taskNum=1;i<n;i++)
+	{
+		taskNum += chromosomes[order[i].index]!=chromosomes[order[i-1].index]?1:0;
+	}
+
+	tasks = (COPY_TASK *)MemAlloc(MEM_WORK, taskNum*sizeof(COPY_TASK));
+	byValue = (INDEXED_FLOAT *)MemAlloc(MEM_WORK, n*sizeof(INDEXED_FLOAT));
+	ranks = (int *)MemAlloc(MEM_WORK, n*sizeof(int));
+	counts = (int *)MemAlloc(MEM_WORK, n*sizeof(int));
+
+	if ((!tasks)||(!byValue)||(!ranks)||(!counts))
+	{
+		MemFree(order);
+		MemFree(tasks);
+		MemFree(byValue);
+		MemFree(ranks);
+		MemFree(counts);
+		return -1;
+	}
+
+	//one task per chromosome, each in the slice of its sorted items of the work arrays, so the tasks run independently
+	for (i=0,taskNum=0;i<n;i++)
+	{
+		if ((i==0)||(chromosomes[order[i].index]!=chromosomes[order[i-1].index]))
+		{
+			tasks[taskNum].order = order;
+			tasks[taskNum].r = r;
+			tasks[taskNum].positions = positions;
+			tasks[taskNum].correctedR = correctedR;
+			tasks[taskNum].byValue = byValue+i;
+			tasks[taskNum].ranks = ranks;
+			tasks[taskNum].counts = counts+i;
+			tasks[taskNum].halfWindow = halfWindow;
+			tasks[taskNum].start = i;
+			taskNum++;
+		}
+
+		tasks[taskNum-1].end = i+1;
+	}
+
+	for (i=0;i<taskNum;i++)
+	{
+		if ((!pool)||(ThreadPoolSubmit(pool, CopyNumberChromosome, tasks+i)<0))
+		{
+			//correct the chromosome in this thread
+			CopyNumberChromosome(tasks+i);
+		}
+	}
+
+	if (pool)
+	{
+		ThreadPoolWait(pool);
+	}
+
+	MemFree(order);
+	MemFree(tasks);
+	MemFree(byValue);
+	MemFree(ranks);
+	MemFree(counts);
+
+	return 1;
+}
@@ -0,0 +1,392 @@
+/*
+ *  out_writer.c
+ *	Output formatted in chunks by several threads and written in order by a writer thread
+ *
+ *  Rows are formatted with the same printf formats as before into one buffer per chunk, so
+ *  the output is byte-identical whatever the number of threads. A chunk that is formatted
+ *  before its predecessors waits in memory until the writer thread reaches it. OutWriterFormat
+ *  holds back the submission of chunks too far ahead of the writer, so that at most
+ *  OUT_PENDING_PER_THREAD chunks per worker thread wait in memory.
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include "out_writer.h"
+#include "block_reader.h"
+#include "mem_acct.h"
+#include "perf_counters.h"
+#include "trace.h"
+
+#define OUT_INIT_BUFFER_SIZE 65536 //initial size of a chunk buffer
+
+typedef struct
+{
+	OUT_WRITER_STRUCT *writer;     //writer of the output
+	OUT_FORMAT_FUNC format;        //function formatting one row
+	void *data;                    //data of the rows
+	int chunkIndex;                //index of the chunk in the output
+	int start;                     //first row of the chunk
+	int end;                       //last row of the chunk plus one
+} FORMAT_TASK;
+
+static FILE *stdoutData = NULL;    //standard output kept for data by OutUseStdout
+static int outChunkRows = OUT_CHUNK_ROWS;  //number of rows formatted into one chunk
+
+//Write the chunks in order until all are written
+static void *WriterMain(void *arg);
+
+//Format the rows of one chunk and put it. The task is freed
+static void FormatChunk(void *arg);
+
+//Empty a buffer
+void OutBufferInit(OUT_BUFFER *buffer)
+{
+	buffer->data = NULL;
+	buffer->len = 0;
+	buffer->size = 0;
+}
+
+//Append formatted text to a buffer, growing it as needed. Return 1 if success, -1 if failure
+int OutBufferPrintf(OUT_BUFFER *buffer, const char *format, ...)
+{
+	va_list args;
+	char *tmpData;
+	long newSize;
+	int len;
+
+	while (1)
+	{
+		va_start(args, format);
+		len = vsnprintf(buffer->data?buffer->data+buffer->len:NULL, buffer->size-buffer->len, format, args);
+		va_end(args);
+
+		if (len<0)
+		{
+			return -1;
+		}
+
+		if (buffer->len+len<buffer->size)
+		{
+			buffer->len += len;
+			return 1;
+		}
+
+		newSize = buffer->size>0?buffer->size*2:OUT_INIT_BUFFER_SIZE;
+
+		while (newSize<=buffer->len+len)
+		{
+			newSize *= 2;
+		}
+
+		tmpData = (char *)MemRealloc(MEM_OUTPUT, buffer->data, newSize);
+
+		if (!tmpData)
+		{
+			return -1;
+		}
+
+		buffer->data = tmpData;
+		buffer->size = newSize;
+	}
+}
+
+//Free the text of a buffer
+void OutBufferFree(OUT_BUFFER *buffer)
+{
+	MemFree(buffer->data);
+	OutBufferInit(buffer);
+}
+
+//Set the number of rows formatted into one chunk, OUT_CHUNK_ROWS by default. Call before any output is opened
+void SetOutChunkRows(int rowNum)
+{
+	outChunkRows = rowNum>0?rowNum:OUT_CHUNK_ROWS;
+}
+
+//Return the number of chunks of rowNum rows
+int OutChunkNum(int rowNum)
+{
+	return (rowNum+outChunkRows-1)/outChunkRows;
+}
+
+//Return the number of rows formatted into one chunk
+int GetOutChunkRows(void)
+{
+	return outChunkRows;
+}
+
+//Return the number of chunks that OutWriterFormat keeps formatted or being formatted ahead of the writer with threadNum threads
+int OutPendingChunkNum(int threadNum)
+{
+	return OUT_PENDING_PER_THREAD*(threadNum>1?threadNum:1);
+}
+
+//Keep standard output for the data written to "-" and send messages printed to stdout to stderr instead.
+//Call before printing anything. Return 1 if success, -1 if failure
+int OutUseStdout(void)
+{
+	int fd;
+
+	fflush(stdout);
+
+	fd = dup(STDOUT_FILENO);
+
+	if (fd<0)
+	{
+		return -1;
+	}
+
+	stdoutData = fdopen(fd, "w");
+
+	if ((!stdoutData)||(dup2(STDERR_FILENO, STDOUT_FILENO)<0))
+	{
+		fprintf(stderr, "Cannot redirect messages to standard error\n");
+		return -1;
+	}
+
+	return 1;
+}
+
+//Create the output file, "-" for standard output, and start the writer thread for an output of chunkNum chunks. Return NULL if failure
+OUT_WRITER_STRUCT *OutWriterOpen(const char *fileName, int chunkNum)
+{
+	OUT_WRITER_STRUCT *writer;
+
+	writer = (OUT_WRITER_STRUCT *)calloc(1, sizeof(OUT_WRITER_STRUCT));
+
+	if (!writer)
+	{
+		return NULL;
+	}
+
+	writer->chunkNum = chunkNum;
+	writer->status = 1;
+	writer->chunks = (OUT_BUFFER *)calloc(chunkNum>0?chunkNum:1, sizeof(OUT_BUFFER));
+	writer->ready = (char *)calloc(chunkNum>0?chunkNum:1, sizeof(char));
+	writer->fh = IsStdStream(fileName)?(stdoutData?stdoutData:stdout):(FILE *)fopen(fileName, "w");
+
+	if ((!writer->chunks)||(!writer->ready)||(!writer->fh))
+	{
+		if (!writer->fh)
+		{
+			printf("Cannot open %s.\n", fileName);
+		}
+		else
+		{
+			fclose(writer->fh);
+		}
+
+		free(writer->chunks);
+		free(writer->ready);
+		free(writer);
+		return NULL;
+	}
+
+	pthread_mutex_init(&(writer->mutex), NULL);
+	pthread_cond_init(&(writer->chunkReady), NULL);
+	pthread_cond_init(&(writer->chunkWritten), NULL);
+
+	if (pthread_create(&(writer->thread), NULL, WriterMain, writer)!=0)
+	{
+		printf("Cannot create writer thread\n");
+		fclose(writer->fh);
+		free(writer->chunks);
+		free(writer->ready);
+		free(writer);
+		return NULL;
+	}
+
+	return writer;
+}
+
+//Hand chunk chunkIndex to the writer thread. The writer takes the text of the buffer, which is left empty.
+//Chunks may be put in any order and from any thread; they are written in the order of their index. Return 1 if success, -1 if failure
+int OutWriterPut(OUT_WRITER_STRUCT *writer, int chunkIndex, OUT_BUFFER *buffer)
+{
+	if ((chunkIndex<0)||(chunkIndex>=writer->chunkNum))
+	{
+		OutBufferFree(buffer);
+		return -1;
+	}
+
+	pthread_mutex_lock(&(writer->mutex));
+
+	writer->chunks[chunkIndex] = *buffer;
+	writer->ready[chunkIndex] = 1;
+
+	pthread_cond_signal(&(writer->chunkReady));
+	pthread_mutex_unlock(&(writer->mutex));
+
+	OutBufferInit(buffer);
+
+	return 1;
+}
+
+//Format the rows of one chunk and put it. The task is freed
+static void FormatChunk(void *arg)
+{
+	FORMAT_TASK *task = (FORMAT_TASK *)arg;
+	OUT_BUFFER buffer;
+	int i;
+
+	TraceBegin("format chunk");
+
+	OutBufferInit(&buffer);
+
+	for (i=task->start;i<task->end;i++)
+	{
+		if (task->format(&buffer, task->data, i)<0)
+		{
+			//an empty chunk is still put so that the writer does not wait for it
+			OutBufferFree(&buffer);
+			task->writer->status = -1;
+			break;
+		}
+	}
+
+	OutWriterPut(task->writer, task->chunkIndex, &buffer);
+
+	TraceEnd("format chunk");
+
+	free(task);
+}
+
+//Format rowNum rows of data in chunks of rows set by SetOutChunkRows on the thread pool and put them as chunks firstChunk, firstChunk+1, ...
+//Return 1 if all tasks were submitted, -1 if failure. data must stay valid until the pool is idle
+int OutWriterFormat(OUT_WRITER_STRUCT *writer, THREAD_POOL_STRUCT *pool, int firstChunk, int rowNum, OUT_FORMAT_FUNC format, void *data)
+{
+	FORMAT_TASK *task;
+	OUT_BUFFER buffer;
+	int i, pendingNum;
+
+	pendingNum = OutPendingChunkNum(pool->threadNum);
+
+	for (i=0;i<OutChunkNum(rowNum);i++)
+	{
+		//the chunks before this one are all submitted, so the writer reaches it without waiting for this thread
+		pthread_mutex_lock(&(writer->mutex));
+
+		while (firstChunk+i>=writer->nextChunk+pendingNum)
+		{
+			pthread_cond_wait(&(writer->chunkWritten), &(writer->mutex));
+		}
+
+		pthread_mutex_unlock(&(writer->mutex));
+
+		task = (FORMAT_TASK *)malloc(sizeof(FORMAT_TASK));
+
+		if (!task)
+		{
+			break;
+		}
+
+		task->writer = writer;
+		task->format = format;
+		task->data = data;
+		task->chunkIndex = firstChunk+i;
+		task->start = i*outChunkRows;
+		task->end = (i+1)*outChunkRows<rowNum?(i+1)*outChunkRows:rowNum;
+
+		if (ThreadPoolSubmit(pool, FormatChunk, task)<0)
+		{
+			free(task);
+			break;
+		}
+	}
+
+	if (i<OutChunkNum(rowNum))
+	{
+		//put the chunks that will never be formatted, so that OutWriterClose does not wait for them
+		writer->status = -1;
+
+		for (;i<OutChunkNum(rowNum);i++)
+		{
+			OutBufferInit(&buffer);
+			OutWriterPut(writer, firstChunk+i, &buffer);
+		}
+
+		return -1;
+	}
+
+	return 1;
+}
+
+//Write the chunks in order until all are written
+static void *WriterMain(void *arg)
+{
+	OUT_WRITER_STRUCT *writer = (OUT_WRITER_STRUCT *)arg;
+	OUT_BUFFER chunk;
+
+	TraceSetThreadName("writer");
+
+	pthread_mutex_lock(&(writer->mutex));
+
+	while (writer->nextChunk<writer->chunkNum)
+	{
+		while (!writer->ready[writer->nextChunk])
+		{
+			pthread_cond_wait(&(writer->chunkReady), &(writer->mutex));
+		}
+
+		chunk = writer->chunks[writer->nextChunk];
+		OutBufferInit(writer->chunks+writer->nextChunk);
+		writer->nextChunk++;
+
+		pthread_cond_broadcast(&(writer->chunkWritten));
+
+		pthread_mutex_unlock(&(writer->mutex));
+
+		TraceBegin("write chunk");
+
+		if ((chunk.len>0)&&(fwrite(chunk.data, 1, chunk.len, writer->fh)!=(size_t)chunk.len))
+		{
+			printf("Cannot write output. Is the disk full?\n");
+			writer->status = -1;
+		}
+
+		TraceEnd("write chunk");
+
+		OutBufferFree(&chunk);
+
+		pthread_mutex_lock(&(writer->mutex));
+	}
+
+	pthread_mutex_unlock(&(writer->mutex));
+
+	PerfThreadExit();
+
+	return NULL;
+}
+
+//Wait until all chunks are written, stop the writer thread and close the file. Return 1 if success, -1 if any chunk failed
+int OutWriterClose(OUT_WRITER_STRUCT *writer)
+{
+	int status;
+
+	pthread_join(writer->thread, NULL);
+
+	if (fclose(writer->fh)!=0)
+	{
+		printf("Cannot write output. Is the disk full?\n");
+		writer->status = -1;
+	}
+
+	status = writer->status;
+
+	pthread_mutex_destroy(&(writer->mutex));
+	pthread_cond_destroy(&(writer->chunkReady));
+	pthread_cond_destroy(&(writer->chunkWritten));
+
+	free(writer->chunks);
+	free(writer->ready);
+	free(writer);
+
+	return status;
+}
@@ -0,0 +1,408 @@
+/*
+ *  perf_counters.c
+ *	Hardware performance counters around pipeline stages, collected with perf_event_open
+ *
+ *  Each thread opens one group of counters for itself: cycles, instructions, cache misses and
+ *  branch misses. When hardware counters cannot be opened, for example inside containers or on
+ *  virtual machines without a PMU, software counters of the kernel are used instead (task
+ *  clock, page faults, context switches, CPU migrations); when those fail too, only wall time is
+ *  recorded. The reason is printed once.
+ *
+ *  Stages are marked in the thread that submits tasks and waits for them. Workers of the thread
+ *  pool read their own counters around each task and add them to a sum over all tasks; a stage
+ *  takes the part of that sum that grew between its beginning and its end, so that the work of
+ *  a parallel stage is counted even though the stage itself is marked in one thread. The seconds
+ *  of the workers row are the summed wall time of the tasks, not elapsed time.
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "perf_counters.h"
+
+#define PERF_MODE_NONE 0           //counting is off
+#define PERF_MODE_HARDWARE 1       //hardware counters
+#define PERF_MODE_SOFTWARE 2       //software counters of the kernel
+#define PERF_MODE_WALL 3           //wall time only
+#define PERF_MAX_RECORD_NUM 256    //maximum number of (stage, thread) records
+#define PERF_WORKERS_THREAD -1     //thread index of the records of the tasks of worker threads
+
+typedef struct
+{
+	char stage[PERF_MAX_STAGE_LEN];  //name of the stage
+	int thread;                    //index of the thread
+	int mode;                      //counters in use
+	long calls;                    //number of times the stage ran
+	double seconds;                //wall time in seconds
+	unsigned long long values[PERF_EVENT_NUM];  //accumulated counts
+} PERF_RECORD;
+
+static const unsigned long long hardwareEvents[PERF_EVENT_NUM] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+static const unsigned long long softwareEvents[PERF_EVENT_NUM] = {PERF_COUNT_SW_TASK_CLOCK, PERF_COUNT_SW_PAGE_FAULTS, PERF_COUNT_SW_CONTEXT_SWITCHES, PERF_COUNT_SW_CPU_MIGRATIONS};
+
+static int perfEnabled = 0;                        //1 if collection is on
+static int perfThreadNum = 0;                      //number of threads that used the counters
+static int perfWarned = 0;                         //1 after the reason of falling back was printed
+static PERF_RECORD perfRecords[PERF_MAX_RECORD_NUM];
+static int perfRecordNum = 0;
+static int perfTaskMode = PERF_MODE_NONE;          //counters in use by the workers, PERF_MODE_NONE before the first task
+static double perfTaskSeconds = 0.0;               //wall time of all tasks of worker threads
+static unsigned long long perfTaskValues[PERF_EVENT_NUM];  //counts of all tasks of worker threads
+static pthread_mutex_t perfMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread int threadIndex = -1;              //index of the calling thread, -1 before first use
+static __thread int threadMode = PERF_MODE_NONE;   //counters opened by the calling thread
+static __thread int threadFds[PERF_EVENT_NUM];     //counter file descriptors, threadFds[0] leads the group
+
+//Open a group of counters of the given type for the calling thread. Return 1 if success, otherwise errno of the failure
+static int OpenCounterGroup(unsigned int type, const unsigned long long *events);
+
+//Open the counters of the calling thread if not opened yet
+static void OpenThreadCounters(void);
+
+//Read the counters of the calling thread, scaled for multiplexing
+static void ReadThreadCounters(unsigned long long *values);
+
+//Return the wall time in seconds
+static double WallTime(void);
+
+//Add counts to the record of stage and thread, creating it if needed. Call with perfMutex locked
+static void AddToRecord(const char *stage, int thread, int mode, double seconds, const unsigned long long *values);
+
+//Return the wall time in seconds
+static double WallTime(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return tv.tv_sec+tv.tv_usec*1E-6;
+}
+
+//Turn collection on or off. When on, each thread opens its counters on first use
+void PerfInit(int enabled)
+{
+	perfEnabled = enabled?1:0;
+}
+
+//Return 1 if collection is on
+int PerfEnabled(void)
+{
+	return perfEnabled;
+}
+
+//Open a group of counters of the given type for the calling thread. Return 1 if success, otherwise errno of the failure
+static int OpenCounterGroup(unsigned int type, const unsigned long long *events)
+{
+	struct perf_event_attr attr;
+	int i, err;
+
+	for (i=0;i<PERF_EVENT_NUM;i++)
+	{
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = type;
+		attr.config = events[i];
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP|PERF_FORMAT_TOTAL_TIME_ENABLED|PERF_FORMAT_TOTAL_TIME_RUNNING;
+		attr.disabled = (i==0)?1:0;
+
+		//pid 0 and cpu -1: count the calling thread on any CPU
+		threadFds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, (i==0)?-1:threadFds[0], 0);
+
+		if (threadFds[i]<0)
+		{
+			err = errno;
+
+			while (--i>=0)
+			{
+				close(threadFds[i]);
+			}
+
+			return err;
+		}
+	}
+
+	ioctl(threadFds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(threadFds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+	return 1;
+}
+
+//Open the counters of the calling thread if not opened yet
+static void OpenThreadCounters(void)
+{
+	int hardwareError, softwareError;
+
+	if (threadIndex<0)
+	{
+		threadIndex = __atomic_fetch_add(&perfThreadNum, 1, __ATOMIC_RELAXED);
+	}
+
+	if (threadMode!=PERF_MODE_NONE)
+	{
+		return;
+	}
+
+	hardwareError = OpenCounterGroup(PERF_TYPE_HARDWARE, hardwareEvents);
+
+	if (hardwareError==1)
+	{
+		threadMode = PERF_MODE_HARDWARE;
+		return;
+	}
+
+	softwareError = OpenCounterGroup(PERF_TYPE_SOFTWARE, softwareEvents);
+	threadMode = (softwareError==1)?PERF_MODE_SOFTWARE:PERF_MODE_WALL;
+
+	pthread_mutex_lock(&perfMutex);
+
+	if (!perfWarned)
+	{
+		perfWarned = 1;
+		printf("hardware counters unavailable (%s)%s\n", strerror(hardwareError),
+			   (threadMode==PERF_MODE_SOFTWARE)?"; using software counters":"; reporting wall time only");
+	}
+
+	pthread_mutex_unlock(&perfMutex);
+}
+
+//Read the counters of the calling thread, scaled for multiplexing
+static void ReadThreadCounters(unsigned long long *values)
+{
+	unsigned long long buffer[3+PERF_EVENT_NUM];
+	int i;
+	double scale;
+
+	memset(values, 0, PERF_EVENT_NUM*sizeof(unsigned long long));
+
+	if ((threadMode!=PERF_MODE_HARDWARE)&&(threadMode!=PERF_MODE_SOFTWARE))
+	{
+		return;
+	}
+
+	//layout of PERF_FORMAT_GROUP: number of counters, time enabled, time running, values
+	if (read(threadFds[0], buffer, sizeof(buffer))!=(ssize_t)sizeof(buffer))
+	{
+		return;
+	}
+
+	scale = (buffer[2]>0)?(double)buffer[1]/buffer[2]:1.0;
+
+	for (i=0;i<PERF_EVENT_NUM;i++)
+	{
+		values[i] = (unsigned long long)(buffer[3+i]*scale);
+	}
+}
+
+//Mark the beginning of a stage in the calling thread
+void PerfBegin(PERF_SAMPLE *sample)
+{
+	if (!perfEnabled)
+	{
+		sample->mode = PERF_MODE_NONE;
+		return;
+	}
+
+	OpenThreadCounters();
+
+	sample->mode = threadMode;
+
+	pthread_mutex_lock(&perfMutex);
+	sample->taskSeconds = perfTaskSeconds;
+	memcpy(sample->taskValues, perfTaskValues, PERF_EVENT_NUM*sizeof(unsigned long long));
+	pthread_mutex_unlock(&perfMutex);
+
+	sample->wallTime = WallTime();
+	ReadThreadCounters(sample->values);
+}
+
+//Add counts to the record of stage and thread, creating it if needed. Call with perfMutex locked
+static void AddToRecord(const char *stage, int thread, int mode, double seconds, const unsigned long long *values)
+{
+	int i, j;
+
+	for (i=0;i<perfRecordNum;i++)
+	{
+		if ((perfRecords[i].thread==thread)&&(!strcmp(perfRecords[i].stage, stage)))
+		{
+			break;
+		}
+	}
+
+	if ((i>=perfRecordNum)&&(perfRecordNum<PERF_MAX_RECORD_NUM))
+	{
+		memset(&(perfRecords[i]), 0, sizeof(PERF_RECORD));
+		strncpy(perfRecords[i].stage, stage, PERF_MAX_STAGE_LEN-1);
+		perfRecords[i].thread = thread;
+		perfRecords[i].mode = mode;
+		perfRecordNum++;
+	}
+
+	if (i<perfRecordNum)
+	{
+		perfRecords[i].calls++;
+		perfRecords[i].seconds += seconds;
+
+		for (j=0;j<PERF_EVENT_NUM;j++)
+		{
+			perfRecords[i].values[j] += values[j];
+		}
+	}
+}
+
+//Mark the end of a stage in the calling thread, and add the counts since PerfBegin to the stage
+void PerfEnd(PERF_SAMPLE *sample, const char *stage)
+{
+	unsigned long long values[PERF_EVENT_NUM];
+	double wallTime;
+	int j;
+
+	if (sample->mode==PERF_MODE_NONE)
+	{
+		return;
+	}
+
+	ReadThreadCounters(values);
+	wallTime = WallTime();
+
+	for (j=0;j<PERF_EVENT_NUM;j++)
+	{
+		values[j] -= sample->values[j];
+	}
+
+	pthread_mutex_lock(&perfMutex);
+
+	AddToRecord(stage, threadIndex, sample->mode, wallTime-sample->wallTime, values);
+
+	//tasks of worker threads finished during the stage. Without workers, tasks run in this thread and are already counted
+	if (perfTaskSeconds>sample->taskSeconds)
+	{
+		for (j=0;j<PERF_EVENT_NUM;j++)
+		{
+			values[j] = perfTaskValues[j]-sample->taskValues[j];
+		}
+
+		AddToRecord(stage, PERF_WORKERS_THREAD, perfTaskMode, perfTaskSeconds-sample->taskSeconds, values);
+	}
+
+	pthread_mutex_unlock(&perfMutex);
+}
+
+//Mark the beginning of a task in a worker thread
+void PerfTaskBegin(PERF_SAMPLE *sample)
+{
+	if (!perfEnabled)
+	{
+		sample->mode = PERF_MODE_NONE;
+		return;
+	}
+
+	OpenThreadCounters();
+
+	sample->mode = threadMode;
+	sample->wallTime = WallTime();
+	ReadThreadCounters(sample->values);
+}
+
+//Mark the end of a task in a worker thread, and add its counts to the tasks of all workers
+void PerfTaskEnd(PERF_SAMPLE *sample)
+{
+	unsigned long long values[PERF_EVENT_NUM];
+	double wallTime;
+	int j;
+
+	if (sample->mode==PERF_MODE_NONE)
+	{
+		return;
+	}
+
+	ReadThreadCounters(values);
+	wallTime = WallTime();
+
+	pthread_mutex_lock(&perfMutex);
+
+	perfTaskMode = (perfTaskMode==PERF_MODE_NONE)?sample->mode:perfTaskMode;
+	perfTaskSeconds += wallTime-sample->wallTime;
+
+	for (j=0;j<PERF_EVENT_NUM;j++)
+	{
+		perfTaskValues[j] += values[j]-sample->values[j];
+	}
+
+	pthread_mutex_unlock(&perfMutex);
+}
+
+//Close the counters of the calling thread. Call before a worker thread exits
+void PerfThreadExit(void)
+{
+	int i;
+
+	if ((threadMode==PERF_MODE_HARDWARE)||(threadMode==PERF_MODE_SOFTWARE))
+	{
+		for (i=0;i<PERF_EVENT_NUM;i++)
+		{
+			close(threadFds[i]);
+		}
+	}
+
+	threadMode = PERF_MODE_NONE;
+}
+
+//Print counts per stage and per thread, with IPC and misses per thousand instructions
+void PerfReport(FILE *fh)
+{
+	int i;
+	PERF_RECORD *r;
+
+	if (!perfEnabled)
+	{
+		return;
+	}
+
+	fprintf(fh, "performance counters:\n");
+	fprintf(fh, "stage\tthread\tcalls\tseconds\tcycles\tinstructions\tIPC\tcache_misses\tcache_MPKI\tbranch_misses\tbranch_MPKI\ttask_clock_ms\tpage_faults\tcontext_switches\n");
+
+	for (i=0;i<perfRecordNum;i++)
+	{
+		r = perfRecords+i;
+
+		if (r->thread==PERF_WORKERS_THREAD)
+		{
+			fprintf(fh, "%s\tworkers\t%ld\t%.3f", r->stage, r->calls, r->seconds);
+		}
+		else
+		{
+			fprintf(fh, "%s\t%d\t%ld\t%.3f", r->stage, r->thread, r->calls, r->seconds);
+		}
+
+		if (r->mode==PERF_MODE_HARDWARE)
+		{
+			fprintf(fh, "\t%llu\t%llu\t%.2f\t%llu\t%.2f\t%llu\t%.2f\tn/a\tn/a\tn/a\n",
+					r->values[0], r->values[1], r->values[0]>0?(double)r->values[1]/r->values[0]:0.0,
+					r->values[2], r->values[1]>0?1000.0*r->values[2]/r->values[1]:0.0,
+					r->values[3], r->values[1]>0?1000.0*r->values[3]/r->values[1]:0.0);
+		}
+		else if (r->mode==PERF_MODE_SOFTWARE)
+		{
+			fprintf(fh, "\tn/a\tn/a\tn/a\tn/a\tn/a\tn/a\tn/a\t%.1f\t%llu\t%llu\n",
+					r->values[0]/1E6, r->values[1], r->values[2]);
+		}
+		else
+		{
+			fprintf(fh, "\tn/a\tn/a\tn/a\tn/a\tn/a\tn/a\tn/a\tn/a\tn/a\tn/a\n");
+		}
+	}
+}
@@ -0,0 +1,535 @@
+/*
+ *  result_store.c
+ *	Indexed store of the results of many RRA runs, with a gene name index and metadata of each screen
+ *
+ *  Genes are numbered by a dictionary shared by all screens. Each screen has a segment of columns:
+ *  the gene, number of items, lo-value, false discovery rate and percentile of its rows in the order
+ *  of the RRA output, and the row of each gene of the dictionary, so that a gene is found in a screen
+ *  without a search. The hash table of the dictionary is stored as it is built by dict.c and probed in place.
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "result_store.h"
+#include "dict.h"
+#include "rra_core.h"
+#include "mem_acct.h"
+
+#define PAD8(x) (((x)+7)/8*8)      //bytes rounded up to a multiple of 8
+
+//Offsets of the columns in a segment of rowNum rows and geneNum genes, in the order of STORE_SEGMENT. Return the size of the segment
+static long SegmentLayout(int rowNum, int geneNum, long *offsets);
+
+//Read the catalog of an unmapped store into screens, allocated, and dict. Return 1 if success, -1 if failure
+static int ReadCatalog(int fd, const STORE_TRAILER *trailer, STORE_SCREEN **pScreens, DICT_STRUCT *dict);
+
+//Write count bytes at offset. Return 1 if success, -1 if failure
+static int WriteAt(int fd, const void *data, long count, long offset);
+
+//Offsets of the columns in a segment of rowNum rows and geneNum genes, in the order of STORE_SEGMENT. Return the size of the segment
+static long SegmentLayout(int rowNum, int geneNum, long *offsets)
+{
+	offsets[0] = 0;
+	offsets[1] = offsets[0]+PAD8((long)rowNum*sizeof(int));
+	offsets[2] = offsets[1]+PAD8((long)rowNum*sizeof(int));
+	offsets[3] = offsets[2]+(long)rowNum*sizeof(double);
+	offsets[4] = offsets[3]+(long)rowNum*sizeof(double);
+	offsets[5] = offsets[4]+(long)rowNum*sizeof(double);
+
+	return offsets[5]+PAD8((long)geneNum*sizeof(int));
+}
+
+//Write count bytes at offset. Return 1 if success, -1 if failure
+static int WriteAt(int fd, const void *data, long count, long offset)
+{
+	const char *p = (const char *)data;
+	long written;
+
+	while (count>0)
+	{
+		written = pwrite(fd, p, count, offset);
+
+		if (written<=0)
+		{
+			return -1;
+		}
+
+		p += written;
+		offset += written;
+		count -= written;
+	}
+
+	return 1;
+}
+
+//Read the catalog of an unmapped store into screens, allocated, and dict. Return 1 if success, -1 if failure
+static int ReadCatalog(int fd, const STORE_TRAILER *trailer, STORE_SCREEN **pScreens, DICT_STRUCT *dict)
+{
+	STORE_SCREEN *screens;
+	long *nameOffsets;
+	char *names;
+	long offset;
+	int i, flag;
+
+	screens = (STORE_SCREEN *)MemAlloc(MEM_OUTPUT, (trailer->screenNum+1)*sizeof(STORE_SCREEN));
+	nameOffsets = (long *)MemAlloc(MEM_OUTPUT, (trailer->geneNum+1)*sizeof(long));
+	names = (char *)MemAlloc(MEM_OUTPUT, trailer->nameBytes+1);
+
+	offset = trailer->catalogOffset;
+	flag = ((screens)&&(nameOffsets)&&(names))?1:-1;
+
+	if ((flag>0)&&(pread(fd, screens, trailer->screenNum*sizeof(STORE_SCREEN), offset)!=(long)(trailer->screenNum*sizeof(STORE_SCREEN))))
+	{
+		flag = -1;
+	}
+
+	offset += trailer->screenNum*sizeof(STORE_SCREEN);
+
+	if ((flag>0)&&(pread(fd, nameOffsets, (trailer->geneNum+1)*sizeof(long), offset)!=(long)((trailer->geneNum+1)*sizeof(long))))
+	{
+		flag = -1;
+	}
+
+	offset += (trailer->geneNum+1)*sizeof(long);
+
+	if ((flag>0)&&(pread(fd, names, trailer->nameBytes, offset)!=trailer->nameBytes))
+	{
+		flag = -1;
+	}
+
+	//genes are inserted in the order of their ids, so the dictionary gives them the same ids again
+	for (i=0;(i<trailer->geneNum)&&(flag>0);i++)
+	{
+		if ((nameOffsets[i]<0)||(nameOffsets[i]>=trailer->nameBytes)||(DictInsert(dict, names+nameOffsets[i])!=i))
+		{
+			flag = -1;
+		}
+	}
+
+	MemFree(nameOffsets);
+	MemFree(names);
+
+	if (flag<0)
+	{
+		MemFree(screens);
+		return -1;
+	}
+
+	*pScreens = screens;
+
+	return 1;
+}
+
+//Append the results of one screen, in order of lo-value, to a store, created if it does not exist. screen gives the name, source, maxPercentile, itemNum and listNum;
+//the other fields are filled. Appends are serialized by a lock on the file. Return 1 if success, -1 if failure
+int StoreAppend(const char *fileName, STORE_SCREEN *screen, const STORE_RESULT *results, int resultNum)
+{
+	int fd, i, geneId, flag;
+	struct stat fileStat;
+	STORE_TRAILER trailer;
+	STORE_SCREEN *screens, *tmpScreens;
+	DICT_STRUCT *dict;
+	char header[STORE_HEADER_SIZE];
+	char *segment;
+	long offsets[6], segmentBytes, nameBytes, *nameOffsets, offset;
+	int *rowOfGene;
+
+	fd = open(fileName, O_RDWR|O_CREAT, 0644);
+
+	if (fd<0)
+	{
+		printf("Cannot open result store %s\n", fileName);
+		return -1;
+	}
+
+	//runs appending to the same store wait for each other
+	if ((flock(fd, LOCK_EX)!=0)||(fstat(fd, &fileStat)!=0))
+	{
+		printf("Cannot lock result store %s\n", fileName);
+		close(fd);
+		return -1;
+	}
+
+	dict = DictCreate(resultNum);
+	screens = NULL;
+	flag = dict?1:-1;
+
+	memset(&trailer, 0, sizeof(STORE_TRAILER));
+	memset(header, 0, STORE_HEADER_SIZE);
+	memcpy(header, STORE_MAGIC, 8);
+	i = STORE_VERSION;
+	memcpy(header+8, &i, sizeof(int));
+
+	if ((flag>0)&&(fileStat.st_size==0))
+	{
+		//a new store: the header, and an empty catalog after it
+		trailer.catalogOffset = STORE_HEADER_SIZE;
+		flag = WriteAt(fd, header, STORE_HEADER_SIZE, 0);
+	}
+	else if (flag>0)
+	{
+		if ((fileStat.st_size<STORE_HEADER_SIZE+(long)sizeof(STORE_TRAILER))
+			||(pread(fd, &trailer, sizeof(STORE_TRAILER), fileStat.st_size-sizeof(STORE_TRAILER))!=sizeof(STORE_TRAILER))
+			||(memcmp(trailer.magic, STORE_MAGIC, 8)!=0)||(trailer.version!=STORE_VERSION))
+		{
+			printf("%s is not a result store of this version\n", fileName);
+			flag = -1;
+		}
+		else
+		{
+			flag = ReadCatalog(fd, &trailer, &screens, dict);
+
+			if (flag<0)
+			{
+				printf("result store %s is damaged\n", fileName);
+			}
+		}
+	}
+
+	for (i=0;(i<trailer.screenNum)&&(flag>0);i++)
+	{
+		if (strcmp(screens[i].name, screen->name)==0)
+		{
+			printf("screen %s is already in result store %s\n", screen->name, fileName);
+			flag = -1;
+		}
+	}
+
+	if (flag>0)
+	{
+		tmpScreens = (STORE_SCREEN *)MemRealloc(MEM_OUTPUT, screens, (trailer.screenNum+1)*sizeof(STORE_SCREEN));
+		flag = tmpScreens?1:-1;
+		screens = tmpScreens?tmpScreens:screens;
+	}
+
+	//genes of the screen join the dictionary; rows keep the order of the results
+	for (i=0;(i<resultNum)&&(flag>0);i++)
+	{
+		flag = DictInsert(dict, results[i].name)>=0?1:-1;
+	}
+
+	segment = NULL;
+
+	if (flag>0)
+	{
+		segmentBytes = SegmentLayout(resultNum, dict->num, offsets);
+		segment = (char *)MemCalloc(MEM_OUTPUT, segmentBytes, 1);
+		flag = segment?1:-1;
+	}
+
+	if (flag>0)
+	{
+		rowOfGene = (int *)(segment+offsets[5]);
+
+		for (i=0;i<dict->num;i++)
+		{
+			rowOfGene[i] = -1;
+		}
+
+		for (i=0;i<resultNum;i++)
+		{
+			geneId = DictLookup(dict, results[i].name);
+
+			((int *)(segment+offsets[0]))[i] = geneId;
+			((int *)(segment+offsets[1]))[i] = results[i].itemNum;
+			((double *)(segment+offsets[2]))[i] = results[i].loValue;
+			((double *)(segment+offsets[3]))[i] = results[i].fdr;
+
+			if (rowOfGene[geneId]<0)
+			{
+				rowOfGene[geneId] = i;
+			}
+
+			if ((i>0)&&(results[i].loValue<results[i-1].loValue))
+			{
+				flag = -1;
+			}
+		}
+
+		//percentiles of the rows are computed once here, as RRA computes the percentiles of items in a list
+		for (i=0;(i<resultNum)&&(flag>0);i++)
+		{
+			((double *)(segment+offsets[4]))[i] = ListPercentile(results[i].loValue, (double *)(segment+offsets[2]), resultNum);
+		}
+
+		if (flag<0)
+		{
+			printf("results of screen %s are not sorted by lo-value\n", screen->name);
+		}
+	}
+
+	if (flag>0)
+	{
+		screen->created = (long)time(NULL);
+		screen->groupNum = resultNum;
+		screen->geneNum = dict->num;
+		screen->offset = trailer.catalogOffset;
+		screens[trailer.screenNum] = *screen;
+
+		//the segment replaces the old catalog, which is written again after it
+		flag = WriteAt(fd, segment, segmentBytes, screen->offset);
+		offset = screen->offset+segmentBytes;
+	}
+
+	MemFree(segment);
+
+	nameOffsets = NULL;
+
+	if (flag>0)
+	{
+		nameOffsets = (long *)MemAlloc(MEM_OUTPUT, (dict->num+1)*sizeof(long));
+		flag = nameOffsets?1:-1;
+	}
+
+	if (flag>0)
+	{
+		nameBytes = 0;
+
+		for (i=0;i<dict->num;i++)
+		{
+			nameOffsets[i] = nameBytes;
+			nameBytes += strlen(dict->names[i])+1;
+		}
+
+		nameOffsets[dict->num] = nameBytes;
+
+		trailer.catalogOffset = offset;
+		trailer.nameBytes = nameBytes;
+		trailer.screenNum++;
+		trailer.geneNum = dict->num;
+		trailer.tableSize = dict->tableSize;
+		trailer.version = STORE_VERSION;
+		memcpy(trailer.magic, STORE_MAGIC, 8);
+
+		flag = WriteAt(fd, screens, trailer.screenNum*sizeof(STORE_SCREEN), offset);
+		offset += trailer.screenNum*sizeof(STORE_SCREEN);
+
+		if (flag>0)
+		{
+			flag = WriteAt(fd, nameOffsets, (dict->num+1)*sizeof(long), offset);
+			offset += (dict->num+1)*sizeof(long);
+		}
+
+		for (i=0;(i<dict->num)&&(flag>0);i++)
+		{
+			flag = WriteAt(fd, dict->names[i], strlen(dict->names[i])+1, offset+nameOffsets[i]);
+		}
+
+		offset += PAD8(nameBytes);
+
+		if (flag>0)
+		{
+			flag = WriteAt(fd, dict->table, dict->tableSize*sizeof(int), offset);
+			offset += PAD8((long)dict->tableSize*sizeof(int));
+		}
+
+		if (flag>0)
+		{
+			flag = WriteAt(fd, &trailer, sizeof(STORE_TRAILER), offset);
+			offset += sizeof(STORE_TRAILER);
+		}
+
+		if ((flag>0)&&(ftruncate(fd, offset)!=0))
+		{
+			flag = -1;
+		}
+
+		if (flag<0)
+		{
+			printf("Cannot write result store %s\n", fileName);
+		}
+	}
+
+	MemFree(nameOffsets);
+	MemFree(screens);
+	DictFree(dict);
+
+	flock(fd, LOCK_UN);
+	close(fd);
+
+	return flag;
+}
+
+//Map a store in memory for queries. Appends wait until it is closed. Return NULL if failure
+RESULT_STORE *StoreOpen(const char *fileName)
+{
+	RESULT_STORE *store;
+	struct stat fileStat;
+	const char *catalog;
+	long catalogBytes;
+
+	store = (RESULT_STORE *)calloc(1, sizeof(RESULT_STORE));
+
+	if (!store)
+	{
+		return NULL;
+	}
+
+	store->fd = open(fileName, O_RDONLY);
+
+	if ((store->fd<0)||(flock(store->fd, LOCK_SH)!=0)||(fstat(store->fd, &fileStat)!=0))
+	{
+		printf("Cannot open result store %s\n", fileName);
+		StoreClose(store);
+		return NULL;
+	}
+
+	store->size = (size_t)fileStat.st_size;
+
+	if (store->size<STORE_HEADER_SIZE+sizeof(STORE_TRAILER))
+	{
+		printf("%s is not a result store\n", fileName);
+		StoreClose(store);
+		return NULL;
+	}
+
+	store->map = (char *)mmap(NULL, store->size, PROT_READ, MAP_SHARED, store->fd, 0);
+
+	if (store->map==(char *)MAP_FAILED)
+	{
+		store->map = NULL;
+		printf("Cannot map result store %s\n", fileName);
+		StoreClose(store);
+		return NULL;
+	}
+
+	memcpy(&store->trailer, store->map+store->size-sizeof(STORE_TRAILER), sizeof(STORE_TRAILER));
+
+	catalogBytes = store->trailer.screenNum*sizeof(STORE_SCREEN)+(store->trailer.geneNum+1)*sizeof(long)
+				   +PAD8(store->trailer.nameBytes)+PAD8((long)store->trailer.tableSize*sizeof(int));
+
+	if ((memcmp(store->map, STORE_MAGIC, 8)!=0)||(memcmp(store->trailer.magic, STORE_MAGIC, 8)!=0)||(store->trailer.version!=STORE_VERSION)
+		||(store->trailer.catalogOffset+catalogBytes+sizeof(STORE_TRAILER)!=store->size))
+	{
+		printf("%s is not a result store of this version\n", fileName);
+		StoreClose(store);
+		return NULL;
+	}
+
+	catalog = store->map+store->trailer.catalogOffset;
+	store->screens = (const STORE_SCREEN *)catalog;
+	catalog += store->trailer.screenNum*sizeof(STORE_SCREEN);
+	store->nameOffsets = (const long *)catalog;
+	catalog += (store->trailer.geneNum+1)*sizeof(long);
+	store->names = catalog;
+	catalog += PAD8(store->trailer.nameBytes);
+	store->table = (const int *)catalog;
+
+	return store;
+}
+
+//Close a store
+void StoreClose(RESULT_STORE *store)
+{
+	if (!store)
+	{
+		return;
+	}
+
+	if (store->map)
+	{
+		munmap(store->map, store->size);
+	}
+
+	if (store->fd>=0)
+	{
+		close(store->fd);
+	}
+
+	free(store);
+}
+
+//Return the id of a gene, or -1 if the gene is in no screen
+int StoreFindGene(const RESULT_STORE *store, const char *name)
+{
+	unsigned int slot;
+	int mask = store->trailer.tableSize-1;
+
+	if (store->trailer.tableSize<=0)
+	{
+		return -1;
+	}
+
+	//the same probing as DictLookup
+	slot = DictHash(name)&mask;
+
+	while (store->table[slot])
+	{
+		if (!strcmp(store->names+store->nameOffsets[store->table[slot]-1], name))
+		{
+			return store->table[slot]-1;
+		}
+		slot = (slot+1)&mask;
+	}
+
+	return -1;
+}
+
+//Return the name of gene geneId
+const char *StoreGeneName(const RESULT_STORE *store, int geneId)
+{
+	return store->names+store->nameOffsets[geneId];
+}
+
+//Return the index of a screen, or -1 if there is no screen of this name
+int StoreFindScreen(const RESULT_STORE *store, const char *name)
+{
+	int i;
+
+	for (i=0;i<store->trailer.screenNum;i++)
+	{
+		if (strcmp(store->screens[i].name, name)==0)
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+//Locate the columns of screen screenIndex in the mapped file. Return 1 if success, -1 if failure
+int StoreSegment(const RESULT_STORE *store, int screenIndex, STORE_SEGMENT *segment)
+{
+	const STORE_SCREEN *screen = store->screens+screenIndex;
+	const char *base;
+	long offsets[6];
+
+	if ((screen->offset<STORE_HEADER_SIZE)
+		||(screen->offset+SegmentLayout(screen->groupNum, screen->geneNum, offsets)>store->trailer.catalogOffset))
+	{
+		return -1;
+	}
+
+	base = store->map+screen->offset;
+	segment->geneIds = (const int *)(base+offsets[0]);
+	segment->itemNums = (const int *)(base+offsets[1]);
+	segment->loValues = (const double *)(base+offsets[2]);
+	segment->fdrs = (const double *)(base+offsets[3]);
+	segment->percentiles = (const double *)(base+offsets[4]);
+	segment->rowOfGene = (const int *)(base+offsets[5]);
+
+	return 1;
+}
+
+//Return the row of gene geneId in a segment of screen screenIndex, or -1 if the gene is not in the screen
+int StoreGeneRow(const RESULT_STORE *store, int screenIndex, const STORE_SEGMENT *segment, int geneId)
+{
+	//genes added to the dictionary after the screen are not in it
+	if ((geneId<0)||(geneId>=store->screens[screenIndex].geneNum))
+	{
+		return -1;
+	}
+
+	return segment->rowOfGene[geneId];
+}
@@ -68,6 +68,51 @@ static int  initialized   = 0;          /* test for stream initialization */
 }
 
 
+   double RandomR(long *state)
+/* ----------------------------------------------------------------
+ * RandomR is Random with the state of the stream kept by the 
+ * caller, so that threads can draw from their own streams.
+ * The state must be in 0 < *state < MODULUS, as from JumpSeed.
+ * ----------------------------------------------------------------
+ */
+{
+  const long Q = MODULUS / MULTIPLIER;
+  const long R = MODULUS % MULTIPLIER;
+        long t;
+
+  t = MULTIPLIER * (*state % Q) - R * (*state / Q);
+  if (t > 0) 
+    *state = t;
+  else 
+    *state = t + MODULUS;
+  return ((double) *state / MODULUS);
+}
+
+
+   long JumpSeed(long x, int jumps)
+/* ---------------------------------------------------------------------
+ * JumpSeed returns the state that follows x after jumps jumps of 
+ * 8,367,782 calls to Random(), the separation of the streams planted
+ * by PlantSeeds. x is corrected as in PutSeed if x > 0.
+ * ---------------------------------------------------------------------
+ */
+{
+  const long Q = MODULUS / A256;
+  const long R = MODULUS % A256;
+        int  j;
+
+  x = x % MODULUS;
+  if (x == 0)
+    x = DEFAULT;
+  for (j = 0; j < jumps; j++) {
+    x = A256 * (x % Q) - R * (x / Q);
+    if (x <= 0)
+      x = x + MODULUS;
+  }
+  return (x);
+}
+
+
    void PlantSeeds(long x)
 /* ---------------------------------------------------------------------
  * Use this function to set the state of all the random number generator 
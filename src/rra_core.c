@@ -0,0 +1,518 @@
+/*
+ *  rra_core.c
+ *	Robust Rank Aggregation on arrays of values: percentiles in sorted lists, lo-values and false discovery rates
+ *
+ *  Shared by RRA and the embedding API, so that both compute the same statistics.
+ *
+ *  Lo-values of many groups are computed in batches: groups of the same size share the parameters
+ *  of the beta distribution of each rank, so the log of the beta function is computed once per
+ *  size, and the incomplete beta ratios of LO_BATCH_LANES groups run in lockstep lanes. Only the
+ *  percentiles up to the maximum percentile are sorted. Each lane performs the arithmetic of
+ *  ComputeLoValue in the same order, so the lo-values are identical.
+ *
+ *  The score of a batch is given by one of several aggregation kernels, selected when the batch is
+ *  created: the lo-value of RRA, alpha-RRA, which ignores the ranks beyond the maximum percentile,
+ *  the rank product, the second best percentile and the median percentile. Every kernel takes the
+ *  lanes of a size class, so that the same percentiles and null draws serve all of them.
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "rra_core.h"
+#include "math_api.h"
+#include "mem_acct.h"
+
+typedef struct
+{
+	const char *name;              //name of the aggregator
+	AGG_KERNEL_FUNC kernel;        //scores of the groups waiting in a size class
+	int betaLogs;                  //1 if the kernel uses the log beta function of each rank
+} AGG_KERNEL;
+
+//Sort num percentiles in ascending order
+static void SortPercentiles(double *p, int num);
+
+//Smallest incomplete beta ratio of the ranks up to maxPercentile, and of the first rank if keepFirst is 1, of each lane.
+//A lane with no rank to use scores 1
+static void RankKernel(LO_SIZE_CLASS *sizeClass, double maxPercentile, int keepFirst, double *scores);
+
+//Lo-values of RRA, which always use the first rank
+static void RRAKernel(LO_SIZE_CLASS *sizeClass, double maxPercentile, double *scores);
+
+//Lo-values of alpha-RRA, which use only the ranks up to maxPercentile
+static void AlphaRRAKernel(LO_SIZE_CLASS *sizeClass, double maxPercentile, double *scores);
+
+//Geometric mean of the percentiles of each lane. The lanes are summed together, item by item
+static void RankProductKernel(LO_SIZE_CLASS *sizeClass, double maxPercentile, double *scores);
+
+//Second smallest percentile of each lane, or the only one of a group of one item
+static void SecondBestKernel(LO_SIZE_CLASS *sizeClass, double maxPercentile, double *scores);
+
+//Median percentile of each lane, the mean of the two middle ones if the number is even
+static void MedianKernel(LO_SIZE_CLASS *sizeClass, double maxPercentile, double *scores);
+
+//Compute the scores of the groups waiting in a class, and empty it
+static void ComputeClassLoValues(LO_SIZE_CLASS *sizeClass, int aggregator, double maxPercentile);
+
+//kernel of each aggregator, in the order of the AGG_ ids
+static const AGG_KERNEL aggKernels[AGG_KERNEL_NUM] =
+{
+	{"rra", RRAKernel, 1},
+	{"alpha-rra", AlphaRRAKernel, 1},
+	{"rank-product", RankProductKernel, 0},
+	{"second-best", SecondBestKernel, 0},
+	{"median", MedianKernel, 0}
+};
+
+//Compute lo-value based on an array of percentiles. Return 1 if success, -1 if failure
+int ComputeLoValue(double *percentiles,     //array of percentiles
+				   int num,                 //length of array
+				   double *loValue,         //pointer to the output lo-value
+				   double maxPercentile)    //maximum percentile, computation stops when maximum percentile is reached
+{
+	int i;
+	double *tmpArray;
+	double tmpLoValue, tmpF;
+
+	if (num<=0)
+	{
+		return -1;
+	}
+
+	tmpArray = (double *)MemAlloc(MEM_WORK, num*sizeof(double));
+
+	if (!tmpArray)
+	{
+		return -1;
+	}
+
+	memcpy(tmpArray, percentiles, num*sizeof(double));
+
+	QuicksortF(tmpArray, 0, num-1);
+
+	tmpLoValue = 1.0;
+
+	for (i=0;i<num;i++)
+	{
+		if ((tmpArray[i]>maxPercentile)&&(i>0))
+		{
+			break;
+		}
+		tmpF = BetaNoncentralCdf((double)(i+1),(double)(num-i),0.0,tmpArray[i],CDF_MAX_ERROR);
+		if (tmpF<tmpLoValue)
+		{
+			tmpLoValue = tmpF;
+		}
+	}
+
+	*loValue = tmpLoValue;
+
+	MemFree(tmpArray);
+
+	return 1;
+}
+
+//Percentile of value in a list of num values sorted in ascending order. Tied values share their mid-rank
+double ListPercentile(double value, double *sortedValues, int num)
+{
+	int index1, index2;
+
+	index1 = bTreeSearchingF(value-0.000000001, sortedValues, 0, num-1);
+	index2 = bTreeSearchingF(value+0.000000001, sortedValues, 0, num-1);
+
+	return ((double)index1+index2+1)/(num*2);
+}
+
+//Fraction of nullNum null lo-values, sorted in ascending order, below loValue. Tied null lo-values count for half
+double NullPValue(double loValue, double *sortedNull, int nullNum)
+{
+	return (double)(bTreeSearchingF(loValue-0.000000001, sortedNull, 0, nullNum-1)
+					+bTreeSearchingF(loValue+0.000000001, sortedNull, 0, nullNum-1)+1)
+		   /2/nullNum;
+}
+
+//False discovery rate of the group of rank rank, from 0, among groupNum groups sorted by lo-value, given nullNum null lo-values
+//sorted in ascending order. Before the correction that makes the rates monotone
+double NullRankFDR(double loValue, int rank, int groupNum, double *sortedNull, int nullNum)
+{
+	return NullPValue(loValue, sortedNull, nullNum)/((double)rank+0.5)*groupNum;
+}
+
+//Sort num percentiles in ascending order
+static void SortPercentiles(double *p, int num)
+{
+	double tmpF;
+	int i, j;
+
+	if (num>LO_INSERTION_SORT_MAX)
+	{
+		QuicksortF(p, 0, num-1);
+		return;
+	}
+
+	for (i=1;i<num;i++)
+	{
+		tmpF = p[i];
+
+		for (j=i;(j>0)&&(p[j-1]>tmpF);j--)
+		{
+			p[j] = p[j-1];
+		}
+
+		p[j] = tmpF;
+	}
+}
+
+//Smallest incomplete beta ratio of the ranks up to maxPercentile, and of the first rank if keepFirst is 1, of each lane.
+//A lane with no rank to use scores 1
+static void RankKernel(LO_SIZE_CLASS *sizeClass, double maxPercentile, int keepFirst, double *scores)
+{
+	int num = sizeClass->num;
+	double x[LO_BATCH_LANES], cdf[LO_BATCH_LANES];
+	int lanes[LO_BATCH_LANES], rankNums[LO_BATCH_LANES];
+	double *p, tmpF;
+	int i, l, liveNum, maxRankNum;
+
+	maxRankNum = 0;
+
+	//only the ranks up to maxPercentile are used: they are moved to the front of the lane and sorted,
+	//which gives the same ranks as sorting the whole lane
+	for (l=0;l<sizeClass->laneNum;l++)
+	{
+		p = sizeClass->percentiles+l*num;
+		rankNums[l] = 0;
+
+		for (i=0;i<num;i++)
+		{
+			if (!(p[i]>maxPercentile))
+			{
+				tmpF = p[i];
+				p[i] = p[rankNums[l]];
+				p[rankNums[l]] = tmpF;
+				rankNums[l]++;
+			}
+		}
+
+		if ((rankNums[l]==0)&&(keepFirst))
+		{
+			for (i=1;i<num;i++)
+			{
+				if (p[i]<p[0])
+				{
+					tmpF = p[i];
+					p[i] = p[0];
+					p[0] = tmpF;
+				}
+			}
+
+			rankNums[l] = 1;
+		}
+		else
+		{
+			SortPercentiles(p, rankNums[l]);
+		}
+
+		maxRankNum = rankNums[l]>maxRankNum?rankNums[l]:maxRankNum;
+		scores[l] = 1.0;
+	}
+
+	for (i=0;i<maxRankNum;i++)
+	{
+		liveNum = 0;
+
+		for (l=0;l<sizeClass->laneNum;l++)
+		{
+			if (i<rankNums[l])
+			{
+				x[liveNum] = sizeClass->percentiles[l*num+i];
+				lanes[liveNum] = l;
+				liveNum++;
+			}
+		}
+
+		//BetaNoncentralCdf with lambda 0.0 is the incomplete beta ratio
+		BetaIncompleteLanes(x, liveNum, (double)(i+1), (double)(num-i), sizeClass->betaLogs[i], cdf);
+
+		for (l=0;l<liveNum;l++)
+		{
+			if (cdf[l]<scores[lanes[l]])
+			{
+				scores[lanes[l]] = cdf[l];
+			}
+		}
+	}
+}
+
+//Lo-values of RRA, which always use the first rank
+static void RRAKernel(LO_SIZE_CLASS *sizeClass, double maxPercentile, double *scores)
+{
+	RankKernel(sizeClass, maxPercentile, 1, scores);
+}
+
+//Lo-values of alpha-RRA, which use only the ranks up to maxPercentile
+static void AlphaRRAKernel(LO_SIZE_CLASS *sizeClass, double maxPercentile, double *scores)
+{
+	RankKernel(sizeClass, maxPercentile, 0, scores);
+}
+
+//Geometric mean of the percentiles of each lane. The lanes are summed together, item by item
+static void RankProductKernel(LO_SIZE_CLASS *sizeClass, double maxPercentile, double *scores)
+{
+	int num = sizeClass->num;
+	double sums[LO_BATCH_LANES];
+	int i, l;
+
+	for (l=0;l<sizeClass->laneNum;l++)
+	{
+		sums[l] = 0.0;
+	}
+
+	for (i=0;i<num;i++)
+	{
+		for (l=0;l<sizeClass->laneNum;l++)
+		{
+			sums[l] += log(sizeClass->percentiles[l*num+i]);
+		}
+	}
+
+	for (l=0;l<sizeClass->laneNum;l++)
+	{
+		scores[l] = exp(sums[l]/num);
+	}
+}
+
+//Second smallest percentile of each lane, or the only one of a group of one item
+static void SecondBestKernel(LO_SIZE_CLASS *sizeClass, double maxPercentile, double *scores)
+{
+	int num = sizeClass->num;
+	double best[LO_BATCH_LANES], second[LO_BATCH_LANES], value;
+	int i, l;
+
+	for (l=0;l<sizeClass->laneNum;l++)
+	{
+		best[l] = sizeClass->percentiles[l*num];
+		second[l] = best[l];
+	}
+
+	if (num>1)
+	{
+		for (l=0;l<sizeClass->laneNum;l++)
+		{
+			value = sizeClass->percentiles[l*num+1];
+			second[l] = value<best[l]?best[l]:value;
+			best[l] = value<best[l]?value:best[l];
+		}
+	}
+
+	for (i=2;i<num;i++)
+	{
+		for (l=0;l<sizeClass->laneNum;l++)
+		{
+			value = sizeClass->percentiles[l*num+i];
+
+			if (value<best[l])
+			{
+				second[l] = best[l];
+				best[l] = value;
+			}
+			else if (value<second[l])
+			{
+				second[l] = value;
+			}
+		}
+	}
+
+	for (l=0;l<sizeClass->laneNum;l++)
+	{
+		scores[l] = second[l];
+	}
+}
+
+//Median percentile of each lane, the mean of the two middle ones if the number is even
+static void MedianKernel(LO_SIZE_CLASS *sizeClass, double maxPercentile, double *scores)
+{
+	int num = sizeClass->num;
+	double *p;
+	int l;
+
+	for (l=0;l<sizeClass->laneNum;l++)
+	{
+		p = sizeClass->percentiles+l*num;
+		SortPercentiles(p, num);
+		scores[l] = (num%2)?p[num/2]:(p[num/2-1]+p[num/2])/2.0;
+	}
+}
+
+//Compute the scores of the groups waiting in a class, and empty it
+static void ComputeClassLoValues(LO_SIZE_CLASS *sizeClass, int aggregator, double maxPercentile)
+{
+	double scores[LO_BATCH_LANES];
+	int l;
+
+	aggKernels[aggregator].kernel(sizeClass, maxPercentile, scores);
+
+	for (l=0;l<sizeClass->laneNum;l++)
+	{
+		*(sizeClass->loValues[l]) = scores[l];
+	}
+
+	sizeClass->laneNum = 0;
+}
+
+//Return the aggregator of a name, or -1 if there is none of this name
+int ParseAggregator(const char *name)
+{
+	int i;
+
+	for (i=0;i<AGG_KERNEL_NUM;i++)
+	{
+		if (strcmp(name, aggKernels[i].name)==0)
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+//Return the name of an aggregator
+const char *AggregatorName(int aggregator)
+{
+	return aggKernels[aggregator].name;
+}
+
+//Create a batch of scores of aggregator for groups of at most maxNum percentiles. Return NULL if failure
+LO_BATCH_STRUCT *LoBatchCreate(int aggregator, int maxNum, double maxPercentile)
+{
+	LO_BATCH_STRUCT *batch;
+
+	if ((maxNum<=0)||(aggregator<0)||(aggregator>=AGG_KERNEL_NUM))
+	{
+		return NULL;
+	}
+
+	batch = (LO_BATCH_STRUCT *)MemAlloc(MEM_WORK, sizeof(LO_BATCH_STRUCT));
+
+	if (!batch)
+	{
+		return NULL;
+	}
+
+	batch->aggregator = aggregator;
+	batch->maxPercentile = maxPercentile;
+	batch->maxNum = maxNum;
+	batch->classes = (LO_SIZE_CLASS **)MemCalloc(MEM_WORK, maxNum+1, sizeof(LO_SIZE_CLASS *));
+
+	if (!batch->classes)
+	{
+		MemFree(batch);
+		return NULL;
+	}
+
+	return batch;
+}
+
+//Queue the score of a group of num percentiles, which are copied. Groups are bucketed by size, and the scores of
+//LO_BATCH_LANES groups of the same size are computed together, each lane holding the percentiles of one group. *loValue is
+//set when the batch of the group is computed, at the latest by LoBatchFlush; for AGG_RRA, to what ComputeLoValue gives. Return 1 if success, -1 if failure
+int LoBatchAdd(LO_BATCH_STRUCT *batch, const double *percentiles, int num, double *loValue)
+{
+	LO_SIZE_CLASS *sizeClass;
+	int i, flag;
+
+	if ((num<=0)||(num>batch->maxNum))
+	{
+		return -1;
+	}
+
+	sizeClass = batch->classes[num];
+
+	if (!sizeClass)
+	{
+		sizeClass = (LO_SIZE_CLASS *)MemCalloc(MEM_WORK, 1, sizeof(LO_SIZE_CLASS));
+
+		if (!sizeClass)
+		{
+			return -1;
+		}
+
+		sizeClass->num = num;
+		sizeClass->percentiles = (double *)MemAlloc(MEM_WORK, LO_BATCH_LANES*num*sizeof(double));
+		sizeClass->betaLogs = aggKernels[batch->aggregator].betaLogs?(double *)MemAlloc(MEM_WORK, num*sizeof(double)):NULL;
+
+		if ((!sizeClass->percentiles)||((aggKernels[batch->aggregator].betaLogs)&&(!sizeClass->betaLogs)))
+		{
+			MemFree(sizeClass->percentiles);
+			MemFree(sizeClass->betaLogs);
+			MemFree(sizeClass);
+			return -1;
+		}
+
+		//the same sum as BetaNoncentralCdf for the parameters of rank i
+		for (i=0;(sizeClass->betaLogs)&&(i<num);i++)
+		{
+			sizeClass->betaLogs[i] = LogGamma((double)(i+1), &flag)
+									 +LogGamma((double)(num-i), &flag)
+									 -LogGamma((double)(i+1)+(double)(num-i), &flag);
+		}
+
+		batch->classes[num] = sizeClass;
+	}
+
+	memcpy(sizeClass->percentiles+sizeClass->laneNum*num, percentiles, num*sizeof(double));
+	sizeClass->loValues[sizeClass->laneNum] = loValue;
+	sizeClass->laneNum++;
+
+	if (sizeClass->laneNum==LO_BATCH_LANES)
+	{
+		ComputeClassLoValues(sizeClass, batch->aggregator, batch->maxPercentile);
+	}
+
+	return 1;
+}
+
+//Compute the scores of all waiting groups. Return 1 if success, -1 if failure
+int LoBatchFlush(LO_BATCH_STRUCT *batch)
+{
+	int num;
+
+	for (num=1;num<=batch->maxNum;num++)
+	{
+		if ((batch->classes[num])&&(batch->classes[num]->laneNum>0))
+		{
+			ComputeClassLoValues(batch->classes[num], batch->aggregator, batch->maxPercentile);
+		}
+	}
+
+	return 1;
+}
+
+//Free a batch. Waiting groups are dropped
+void LoBatchFree(LO_BATCH_STRUCT *batch)
+{
+	int num;
+
+	if (!batch)
+	{
+		return;
+	}
+
+	for (num=1;num<=batch->maxNum;num++)
+	{
+		if (batch->classes[num])
+		{
+			MemFree(batch->classes[num]->percentiles);
+			MemFree(batch->classes[num]->betaLogs);
+			MemFree(batch->classes[num]);
+		}
+	}
+
+	MemFree(batch->classes);
+	MemFree(batch);
+}
@@ -0,0 +1,577 @@
+/*
+ *  rra_grouping.c
+ *	Scores of several groupings of the same ranked items, such as genes, exons and domains, in one run
+ *
+ *  The items are ranked once, into one array of percentiles. Each grouping is an index of its groups over
+ *  this array, as offsets and members, so that a grouping costs two integers per membership and no copy of
+ *  the items. The groups of all groupings are scored by chunks on the thread pool. Groups of the same size
+ *  share one null distribution across groupings, simulated in blocks that each draw from their own random
+ *  stream, and the p-value of a group is its fraction of this null, as in rra_meta. False discovery rates are
+ *  those of ComputeFDR: each group is ranked by score within its grouping, against the null of the grouping.
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rra_grouping.h"
+#include "rra_core.h"
+#include "math_api.h"
+#include "mem_acct.h"
+#include "trace.h"
+#include "rngs.h"
+#include "words.h"
+#include "block_reader.h"
+
+typedef struct
+{
+	const double *percentiles;       //percentile of each item
+	GROUPING *grouping;              //grouping of the chunk
+	int aggregator;                  //AGG_ id of the scores
+	double maxPercentile;            //maximum percentile
+	int start;                       //first group of the chunk
+	int end;                         //last group of the chunk plus one
+	int status;                      //1 if success, -1 if failure
+} GROUPING_TASK;
+
+typedef struct
+{
+	int size;                        //number of items of the null groups
+	long seed;                       //state of the random stream of the block
+	int num;                         //number of null scores of the block
+	int aggregator;                  //AGG_ id of the scores
+	double maxPercentile;            //maximum percentile
+	double *nullValues;              //null scores of the block
+	int status;                      //1 if success, -1 if failure
+} GROUPING_NULL_TASK;
+
+//Score the groups of one chunk
+static void ScoreGroupChunk(void *arg);
+
+//Simulate one block of null scores
+static void SimulateGroupingBlock(void *arg);
+
+//Return 1 if item n is in list list and input group inputGroup, each -1 for any, 0 otherwise
+static int GroupingRowMatches(const GROUPING_ITEMS *items, int n, int list, int inputGroup);
+
+//Read a grouping of items from a mapping file, "-" for standard input. File Format: <item id> <group id> [<list id> [<input group id>]], with a header.
+//An item id may be in several groups; a group holds the item of the id in each list and input group, or only in the list and the input group of the row
+//if the file has these columns. A row that matches two items of the same list cannot tell which one it groups, and fails the file. Rows whose id, list or
+//input group is not in the input are counted in unmatchedNum. Return the number of groups, or -1 if failure
+int ReadGrouping(const char *fileName, const GROUPING_ITEMS *items, GROUPING *grouping)
+{
+	READER_STRUCT *reader;
+	char **words, *line;
+	const char *base, *dot;
+	int *rowGroups, *rowIds, *rowLists, *rowInputGroups, *tmpRows, *next;
+	int i, j, k, g, id, list, inputGroup, wordNum, columnNum, rowNum, capacity, flag;
+
+	memset(grouping, 0, sizeof(GROUPING));
+
+	//the grouping is named after its file, so that its output can be named likewise
+	base = strrchr(fileName, '/');
+	base = base?base+1:fileName;
+	dot = strrchr(base, '.');
+	snprintf(grouping->name, GROUPING_NAME_LEN, "%.*s", (dot)&&(dot>base)?(int)(dot-base):(int)strlen(base), base);
+
+	words = AllocWords(4, GROUPING_ID_LEN+1);
+	reader = words?ReaderOpen(fileName):NULL;
+
+	if (!reader)
+	{
+		if (words)
+		{
+			FreeWords(words, 4);
+		}
+		printf("Cannot open mapping file %s\n", fileName);
+		return -1;
+	}
+
+	capacity = 1024;
+	rowNum = 0;
+	grouping->groupDict = DictCreate(1024);
+	rowGroups = (int *)MemAlloc(MEM_WORK, capacity*sizeof(int));
+	rowIds = (int *)MemAlloc(MEM_WORK, capacity*sizeof(int));
+	rowLists = (int *)MemAlloc(MEM_WORK, capacity*sizeof(int));
+	rowInputGroups = (int *)MemAlloc(MEM_WORK, capacity*sizeof(int));
+
+	flag = ((grouping->groupDict)&&(rowGroups)&&(rowIds)&&(rowLists)&&(rowInputGroups))?1:-1;
+
+	//the header gives the number of columns: a third one names the list of the item of each row, a fourth one its group in the input
+	line = flag>0?ReaderGetLine(reader):NULL;
+	columnNum = line?StringToWords(words, line, GROUPING_ID_LEN+1, 4, " \t\r\n\v\f"):0;
+	line = line?ReaderGetLine(reader):NULL;
+	wordNum = line?StringToWords(words, line, GROUPING_ID_LEN+1, 4, " \t\r\n\v\f"):0;
+
+	TraceBegin("read grouping");
+
+	//the loop ends on the line read, not on ReaderAtEnd, which a final line without newline already sets
+	while ((flag>0)&&(line)&&(columnNum>=2)&&(columnNum<=4)&&(wordNum==columnNum))
+	{
+		if (rowNum>=capacity)
+		{
+			tmpRows = (int *)MemRealloc(MEM_WORK, rowGroups, 2*(long)capacity*sizeof(int));
+			rowGroups = tmpRows?tmpRows:rowGroups;
+			flag = tmpRows?1:-1;
+			tmpRows = flag>0?(int *)MemRealloc(MEM_WORK, rowIds, 2*(long)capacity*sizeof(int)):NULL;
+			rowIds = tmpRows?tmpRows:rowIds;
+			flag = tmpRows?1:-1;
+			tmpRows = flag>0?(int *)MemRealloc(MEM_WORK, rowLists, 2*(long)capacity*sizeof(int)):NULL;
+			rowLists = tmpRows?tmpRows:rowLists;
+			flag = tmpRows?1:-1;
+			tmpRows = flag>0?(int *)MemRealloc(MEM_WORK, rowInputGroups, 2*(long)capacity*sizeof(int)):NULL;
+			rowInputGroups = tmpRows?tmpRows:rowInputGroups;
+			flag = tmpRows?1:-1;
+			capacity *= 2;
+		}
+
+		if (flag>0)
+		{
+			id = DictLookup(items->idDict, words[0]);
+			list = columnNum>=3?DictLookup(items->listDict, words[2]):-1;
+			inputGroup = columnNum==4?DictLookup(items->groupDict, words[3]):-1;
+			rowGroups[rowNum] = DictInsert(grouping->groupDict, words[1]);
+			rowIds[rowNum] = ((columnNum>=3)&&(list<0))||((columnNum==4)&&(inputGroup<0))?-1:id;
+			rowLists[rowNum] = list;
+			rowInputGroups[rowNum] = inputGroup;
+			flag = rowGroups[rowNum]>=0?1:-1;
+			grouping->unmatchedNum += rowIds[rowNum]<0?1:0;
+			id = rowIds[rowNum];
+
+			//an id repeated in a list, such as one guide of two genes, matches two items that the row cannot tell apart without the input group
+			for (j=id>=0?items->idStart[id]:0;(id>=0)&&(j<items->idStart[id+1])&&(flag>0);j++)
+			{
+				for (k=j+1;(k<items->idStart[id+1])&&(flag>0);k++)
+				{
+					if ((items->itemLists[items->idItems[j]]==items->itemLists[items->idItems[k]])
+						&&(GroupingRowMatches(items, items->idItems[j], list, inputGroup))&&(GroupingRowMatches(items, items->idItems[k], list, inputGroup)))
+					{
+						printf("item id %s of %s is in list %s of groups %s and %s, so the item of the row is ambiguous. Give its input group in a fourth column\n",
+							   words[0], fileName, items->listDict->names[items->itemLists[items->idItems[k]]],
+							   items->groupDict->names[items->itemGroups[items->idItems[j]]], items->groupDict->names[items->itemGroups[items->idItems[k]]]);
+						flag = -1;
+					}
+				}
+			}
+
+			rowNum++;
+		}
+
+		line = ReaderGetLine(reader);
+		wordNum = line?StringToWords(words, line, GROUPING_ID_LEN+1, 4, " \t\r\n\v\f"):0;
+	}
+
+	TraceEnd("read grouping");
+
+	if ((columnNum<2)||(columnNum>4))
+	{
+		printf("Mapping file format: <item id> <group id> [<list id> [<input group id>]], with a header\n");
+		flag = -1;
+	}
+
+	if ((ReaderClose(reader)<0)||(flag<0))
+	{
+		flag = -1;
+	}
+
+	FreeWords(words, 4);
+
+	//the members are placed group by group by a counting sort of the rows
+	grouping->groupNum = flag>0?grouping->groupDict->num:0;
+	grouping->groupStart = flag>0?(int *)MemCalloc(MEM_GROUPS, grouping->groupNum+1, sizeof(int)):NULL;
+	next = flag>0?(int *)MemAlloc(MEM_WORK, (grouping->groupNum+1)*sizeof(int)):NULL;
+	flag = ((grouping->groupStart)&&(next))?1:-1;
+
+	for (i=0;(i<rowNum)&&(flag>0);i++)
+	{
+		id = rowIds[i];
+
+		for (k=id>=0?items->idStart[id]:0;(id>=0)&&(k<items->idStart[id+1]);k++)
+		{
+			grouping->groupStart[rowGroups[i]+1] += GroupingRowMatches(items, items->idItems[k], rowLists[i], rowInputGroups[i]);
+		}
+	}
+
+	for (g=0;(g<grouping->groupNum)&&(flag>0);g++)
+	{
+		grouping->groupStart[g+1] += grouping->groupStart[g];
+		next[g] = grouping->groupStart[g];
+	}
+
+	grouping->members = flag>0?(int *)MemAlloc(MEM_GROUPS, ((long)grouping->groupStart[grouping->groupNum]+1)*sizeof(int)):NULL;
+	grouping->loValues = flag>0?(double *)MemAlloc(MEM_GROUPS, (grouping->groupNum+1)*sizeof(double)):NULL;
+	grouping->pValues = flag>0?(double *)MemAlloc(MEM_GROUPS, (grouping->groupNum+1)*sizeof(double)):NULL;
+	grouping->fdr = flag>0?(double *)MemAlloc(MEM_GROUPS, (grouping->groupNum+1)*sizeof(double)):NULL;
+	flag = ((grouping->members)&&(grouping->loValues)&&(grouping->pValues)&&(grouping->fdr))?1:-1;
+
+	for (i=0;(i<rowNum)&&(flag>0);i++)
+	{
+		id = rowIds[i];
+
+		for (k=id>=0?items->idStart[id]:0;(id>=0)&&(k<items->idStart[id+1]);k++)
+		{
+			if (GroupingRowMatches(items, items->idItems[k], rowLists[i], rowInputGroups[i]))
+			{
+				grouping->members[next[rowGroups[i]]++] = items->idItems[k];
+			}
+		}
+	}
+
+	MemFree(rowGroups);
+	MemFree(rowIds);
+	MemFree(rowLists);
+	MemFree(rowInputGroups);
+	MemFree(next);
+
+	if (flag<0)
+	{
+		printf("Cannot read mapping file %s\n", fileName);
+		FreeGrouping(grouping);
+		return -1;
+	}
+
+	return grouping->groupNum;
+}
+
+//Return 1 if item n is in list list and input group inputGroup, each -1 for any, 0 otherwise
+static int GroupingRowMatches(const GROUPING_ITEMS *items, int n, int list, int inputGroup)
+{
+	return ((list<0)||(items->itemLists[n]==list))&&((inputGroup<0)||(items->itemGroups[n]==inputGroup))?1:0;
+}
+
+//Score the groups of one chunk
+static void ScoreGroupChunk(void *arg)
+{
+	GROUPING_TASK *task = (GROUPING_TASK *)arg;
+	GROUPING *grouping = task->grouping;
+	LO_BATCH_STRUCT *batch;
+	double *percentiles;
+	int g, k, size, maxSize;
+
+	maxSize = 1;
+
+	for (g=task->start;g<task->end;g++)
+	{
+		size = grouping->groupStart[g+1]-grouping->groupStart[g];
+		maxSize = size>maxSize?size:maxSize;
+	}
+
+	percentiles = (double *)MemAlloc(MEM_WORK, maxSize*sizeof(double));
+	batch = LoBatchCreate(task->aggregator, maxSize, task->maxPercentile);
+
+	task->status = ((percentiles)&&(batch))?1:-1;
+
+	TraceBegin("grouping chunk");
+
+	for (g=task->start;(g<task->end)&&(task->status>0);g++)
+	{
+		size = grouping->groupStart[g+1]-grouping->groupStart[g];
+		grouping->loValues[g] = 1.0;
+
+		for (k=0;k<size;k++)
+		{
+			percentiles[k] = task->percentiles[grouping->members[grouping->groupStart[g]+k]];
+		}
+
+		if (size>0)
+		{
+			task->status = LoBatchAdd(batch, percentiles, size, grouping->loValues+g);
+		}
+	}
+
+	task->status = (task->status>0)&&(LoBatchFlush(batch)>0)?1:-1;
+
+	TraceEnd("grouping chunk");
+
+	MemFree(percentiles);
+	LoBatchFree(batch);
+}
+
+//Simulate one block of null scores
+static void SimulateGroupingBlock(void *arg)
+{
+	GROUPING_NULL_TASK *task = (GROUPING_NULL_TASK *)arg;
+	LO_BATCH_STRUCT *batch;
+	double *percentiles;
+	int i, j;
+
+	percentiles = (double *)MemAlloc(MEM_WORK, task->size*sizeof(double));
+	batch = LoBatchCreate(task->aggregator, task->size, task->maxPercentile);
+
+	task->status = ((percentiles)&&(batch))?1:-1;
+
+	TraceBegin("null block");
+
+	for (i=0;(i<task->num)&&(task->status>0);i++)
+	{
+		for (j=0;j<task->size;j++)
+		{
+			percentiles[j] = RandomR(&task->seed);
+		}
+
+		task->status = LoBatchAdd(batch, percentiles, task->size, task->nullValues+i);
+	}
+
+	task->status = (task->status>0)&&(LoBatchFlush(batch)>0)?1:-1;
+
+	TraceEnd("null block");
+
+	MemFree(percentiles);
+	LoBatchFree(batch);
+}
+
+//Score the groups of groupingNum groupings by aggregator, from the percentiles of the items, all groupings in the same tasks of the thread pool.
+//Groups of the same size share one null distribution across groupings, of RAND_PASS_NUM scores per group of this size in the grouping with most
+//of them, rounded up to blocks of GROUPING_NULL_BLOCK that each draw from their own random stream, so that results do not depend on the
+//number of threads. False discovery rates are computed as ComputeFDR does, against the null of the sizes of the groups of each grouping.
+//Return 1 if success, -1 if failure
+int ScoreGroupings(const double *percentiles, GROUPING *groupings, int groupingNum, int aggregator, double maxPercentile, THREAD_POOL_STRUCT *pool)
+{
+	GROUPING_TASK *tasks;
+	GROUPING_NULL_TASK *nullTasks;
+	double **nulls;
+	int *sizeCounts, *maxCounts, *nullNums, *sizes;
+	INDEXED_FLOAT *order;
+	double pooled;
+	int g, i, k, b, s, size, maxSize, maxGroupNum, taskNum, nullTaskNum, streamNum, scoredNum, sizeNum, flag;
+
+	maxSize = 0;
+	maxGroupNum = 0;
+	taskNum = 0;
+
+	for (k=0;k<groupingNum;k++)
+	{
+		for (g=0;g<groupings[k].groupNum;g++)
+		{
+			size = groupings[k].groupStart[g+1]-groupings[k].groupStart[g];
+			maxSize = size>maxSize?size:maxSize;
+		}
+
+		maxGroupNum = groupings[k].groupNum>maxGroupNum?groupings[k].groupNum:maxGroupNum;
+		taskNum += (groupings[k].groupNum+GROUPING_CHUNK-1)/GROUPING_CHUNK;
+	}
+
+	tasks = (GROUPING_TASK *)MemAlloc(MEM_WORK, (taskNum+1)*sizeof(GROUPING_TASK));
+	nulls = (double **)MemCalloc(MEM_NULL, maxSize+1, sizeof(double *));
+	sizeCounts = (int *)MemAlloc(MEM_WORK, (maxSize+1)*sizeof(int));
+	maxCounts = (int *)MemCalloc(MEM_WORK, maxSize+1, sizeof(int));
+	nullNums = (int *)MemCalloc(MEM_WORK, maxSize+1, sizeof(int));
+	sizes = (int *)MemAlloc(MEM_WORK, (maxSize+1)*sizeof(int));
+	order = (INDEXED_FLOAT *)MemAlloc(MEM_WORK, (maxGroupNum+1)*sizeof(INDEXED_FLOAT));
+	nullTasks = NULL;
+
+	flag = ((tasks)&&(nulls)&&(sizeCounts)&&(maxCounts)&&(nullNums)&&(sizes)&&(order))?1:-1;
+
+	//scores of the groups of all groupings, by chunks of groups
+	i = 0;
+
+	for (k=0;(k<groupingNum)&&(flag>0);k++)
+	{
+		for (g=0;g<groupings[k].groupNum;g+=GROUPING_CHUNK)
+		{
+			tasks[i].percentiles = percentiles;
+			tasks[i].grouping = groupings+k;
+			tasks[i].aggregator = aggregator;
+			tasks[i].maxPercentile = maxPercentile;
+			tasks[i].start = g;
+			tasks[i].end = g+GROUPING_CHUNK<groupings[k].groupNum?g+GROUPING_CHUNK:groupings[k].groupNum;
+			tasks[i].status = 0;
+
+			if ((!pool)||(ThreadPoolSubmit(pool, ScoreGroupChunk, tasks+i)<0))
+			{
+				ScoreGroupChunk(tasks+i);
+			}
+
+			i++;
+		}
+	}
+
+	//one null distribution for each size of group, as large as the grouping with most groups of this size needs
+	for (k=0;(k<groupingNum)&&(flag>0);k++)
+	{
+		memset(sizeCounts, 0, (maxSize+1)*sizeof(int));
+
+		for (g=0;g<groupings[k].groupNum;g++)
+		{
+			sizeCounts[groupings[k].groupStart[g+1]-groupings[k].groupStart[g]]++;
+		}
+
+		for (s=1;s<=maxSize;s++)
+		{
+			maxCounts[s] = sizeCounts[s]>maxCounts[s]?sizeCounts[s]:maxCounts[s];
+		}
+	}
+
+	nullTaskNum = 0;
+
+	for (s=1;(s<=maxSize)&&(flag>0);s++)
+	{
+		if (maxCounts[s]>0)
+		{
+			nullNums[s] = ((long)RAND_PASS_NUM*maxCounts[s]+GROUPING_NULL_BLOCK-1)/GROUPING_NULL_BLOCK*GROUPING_NULL_BLOCK;
+			nulls[s] = (double *)MemAlloc(MEM_NULL, (long)nullNums[s]*sizeof(double));
+			flag = nulls[s]?1:-1;
+			nullTaskNum += nullNums[s]/GROUPING_NULL_BLOCK;
+		}
+	}
+
+	if (flag>0)
+	{
+		nullTasks = (GROUPING_NULL_TASK *)MemAlloc(MEM_WORK, (nullTaskNum+1)*sizeof(GROUPING_NULL_TASK));
+		flag = nullTasks?1:-1;
+	}
+
+	streamNum = 0;
+
+	for (s=1,i=0;(s<=maxSize)&&(flag>0);s++)
+	{
+		for (b=0;b<nullNums[s]/GROUPING_NULL_BLOCK;b++)
+		{
+			//blocks draw from consecutive streams after RAND_SEED, in order of size, whatever the thread that runs them
+			streamNum++;
+			nullTasks[i].size = s;
+			nullTasks[i].seed = JumpSeed(RAND_SEED, streamNum);
+			nullTasks[i].num = GROUPING_NULL_BLOCK;
+			nullTasks[i].aggregator = aggregator;
+			nullTasks[i].maxPercentile = maxPercentile;
+			nullTasks[i].nullValues = nulls[s]+(long)b*GROUPING_NULL_BLOCK;
+			nullTasks[i].status = 0;
+
+			if ((!pool)||(ThreadPoolSubmit(pool, SimulateGroupingBlock, nullTasks+i)<0))
+			{
+				SimulateGroupingBlock(nullTasks+i);
+			}
+
+			i++;
+		}
+	}
+
+	if (pool)
+	{
+		ThreadPoolWait(pool);
+	}
+
+	for (i=0;(i<taskNum)&&(flag>0);i++)
+	{
+		flag = tasks[i].status>0?1:-1;
+	}
+
+	for (i=0;(i<nullTaskNum)&&(flag>0);i++)
+	{
+		flag = nullTasks[i].status>0?1:-1;
+	}
+
+	if (flag>0)
+	{
+		TraceBegin("sort null");
+
+		for (s=1;s<=maxSize;s++)
+		{
+			if (nulls[s])
+			{
+				QuicksortF(nulls[s], 0, nullNums[s]-1);
+			}
+		}
+
+		TraceEnd("sort null");
+	}
+
+	//p-values against the null of the same size. False discovery rates as ComputeFDR gives them, with the groups with items of each grouping ranked
+	//by score against the null of the whole grouping, which is the mix of the nulls of its sizes in proportion to its groups of each size. As in
+	//NullPValue, this null counts half a score more than those below, once for the mix and not once for each size
+	for (k=0;(k<groupingNum)&&(flag>0);k++)
+	{
+		scoredNum = 0;
+		sizeNum = 0;
+		memset(sizeCounts, 0, (maxSize+1)*sizeof(int));
+
+		for (g=0;g<groupings[k].groupNum;g++)
+		{
+			size = groupings[k].groupStart[g+1]-groupings[k].groupStart[g];
+			groupings[k].pValues[g] = size>0?NullPValue(groupings[k].loValues[g], nulls[size], nullNums[size]):1.0;
+			groupings[k].fdr[g] = 1.0;
+
+			if (size>0)
+			{
+				if (sizeCounts[size]==0)
+				{
+					sizes[sizeNum] = size;
+					sizeNum++;
+				}
+
+				sizeCounts[size]++;
+				order[scoredNum].value = groupings[k].loValues[g];
+				order[scoredNum].index = g;
+				scoredNum++;
+			}
+		}
+
+		if (scoredNum==0)
+		{
+			continue;
+		}
+
+		QuicksortIndexedArray(order, 0, scoredNum-1);
+
+		for (i=0;i<scoredNum;i++)
+		{
+			pooled = 0.5/RAND_PASS_NUM;
+
+			for (s=0;s<sizeNum;s++)
+			{
+				pooled += sizeCounts[sizes[s]]*(NullPValue(order[i].value, nulls[sizes[s]], nullNums[sizes[s]])-0.5/nullNums[sizes[s]]);
+			}
+
+			groupings[k].fdr[order[i].index] = pooled/((double)i+0.5);
+		}
+
+		if (groupings[k].fdr[order[scoredNum-1].index]>1.0)
+		{
+			groupings[k].fdr[order[scoredNum-1].index] = 1.0;
+		}
+
+		for (i=scoredNum-2;i>=0;i--)
+		{
+			if (groupings[k].fdr[order[i].index]>groupings[k].fdr[order[i+1].index])
+			{
+				groupings[k].fdr[order[i].index] = groupings[k].fdr[order[i+1].index];
+			}
+		}
+	}
+
+	for (s=0;(nulls)&&(s<=maxSize);s++)
+	{
+		MemFree(nulls[s]);
+	}
+
+	MemFree(nulls);
+	MemFree(tasks);
+	MemFree(nullTasks);
+	MemFree(sizeCounts);
+	MemFree(maxCounts);
+	MemFree(nullNums);
+	MemFree(sizes);
+	MemFree(order);
+
+	return flag;
+}
+
+//Free the index and the scores of a grouping
+void FreeGrouping(GROUPING *grouping)
+{
+	if (grouping->groupDict)
+	{
+		DictFree(grouping->groupDict);
+	}
+
+	MemFree(grouping->groupStart);
+	MemFree(grouping->members);
+	MemFree(grouping->loValues);
+	MemFree(grouping->pValues);
+	MemFree(grouping->fdr);
+
+	memset(grouping, 0, sizeof(GROUPING));
+}
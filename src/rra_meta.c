@@ -0,0 +1,338 @@
+/*
+ *  rra_meta.c
+ *	Meta-analysis of the screens of a result store by a second-level RRA of the ranks of each gene across screens
+ *
+ *  Screens take the place of lists and genes the place of groups: a gene has one percentile per screen
+ *  it is in, and its lo-value is computed by ComputeLoValue. Genes are read from the mapped store
+ *  through the row of each gene of the dictionary in each segment, and their percentiles from the
+ *  column stored with the segment, so that no screen is copied or searched.
+ *  Genes in the same number of screens share one null distribution, simulated in blocks that each
+ *  draw from their own random stream, so that results are the same for any number of threads.
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rra_meta.h"
+#include "rra_core.h"
+#include "math_api.h"
+#include "mem_acct.h"
+#include "trace.h"
+#include "rngs.h"
+
+typedef struct
+{
+	const RESULT_STORE *store;       //store of the screens
+	const STORE_SEGMENT *segments;   //segment of each screen
+	double maxPercentile;            //maximum percentile
+	int start;                       //first gene of the chunk
+	int end;                         //last gene of the chunk plus one
+	META_RESULT *results;            //results of all genes
+	int status;                      //1 if success, -1 if failure
+} GENE_TASK;
+
+typedef struct
+{
+	int screenNum;                   //number of screens of the null distribution
+	long seed;                       //state of the random stream of the block
+	int num;                         //number of null lo-values of the block
+	double maxPercentile;            //maximum percentile
+	double *nullValues;              //null lo-values of the block
+	int status;                      //1 if success, -1 if failure
+} NULL_TASK;
+
+//Compute the lo-value of the genes of one chunk
+static void AggregateGeneChunk(void *arg);
+
+//Simulate one block of null lo-values
+static void SimulateNullBlock(void *arg);
+
+//Compute the lo-value of the genes of one chunk
+static void AggregateGeneChunk(void *arg)
+{
+	GENE_TASK *task = (GENE_TASK *)arg;
+	const RESULT_STORE *store = task->store;
+	int screenNum = store->trailer.screenNum;
+	int geneNum = task->end-task->start;
+	double *percentiles;
+	int i, j, row;
+
+	percentiles = (double *)MemAlloc(MEM_WORK, (long)geneNum*screenNum*sizeof(double));
+
+	if (!percentiles)
+	{
+		task->status = -1;
+		return;
+	}
+
+	TraceBegin("meta chunk");
+
+	for (i=0;i<geneNum;i++)
+	{
+		task->results[task->start+i].screenNum = 0;
+	}
+
+	//screens are visited in the outer loop, so that the columns of a screen stay in cache for all genes of the chunk.
+	//The percentile of each row was computed when the screen was appended
+	for (j=0;j<screenNum;j++)
+	{
+		for (i=0;i<geneNum;i++)
+		{
+			row = StoreGeneRow(store, j, task->segments+j, task->start+i);
+
+			if (row>=0)
+			{
+				percentiles[(long)i*screenNum+task->results[task->start+i].screenNum] = task->segments[j].percentiles[row];
+				task->results[task->start+i].screenNum++;
+			}
+		}
+	}
+
+	task->status = 1;
+
+	for (i=0;(i<geneNum)&&(task->status>0);i++)
+	{
+		task->results[task->start+i].loValue = 1.0;
+
+		if (task->results[task->start+i].screenNum>0)
+		{
+			task->status = ComputeLoValue(percentiles+(long)i*screenNum, task->results[task->start+i].screenNum,
+										  &task->results[task->start+i].loValue, task->maxPercentile);
+		}
+	}
+
+	TraceEnd("meta chunk");
+
+	MemFree(percentiles);
+}
+
+//Simulate one block of null lo-values
+static void SimulateNullBlock(void *arg)
+{
+	NULL_TASK *task = (NULL_TASK *)arg;
+	double *percentiles;
+	int i, j;
+
+	percentiles = (double *)MemAlloc(MEM_WORK, task->screenNum*sizeof(double));
+
+	if (!percentiles)
+	{
+		task->status = -1;
+		return;
+	}
+
+	TraceBegin("null block");
+
+	task->status = 1;
+
+	for (i=0;(i<task->num)&&(task->status>0);i++)
+	{
+		for (j=0;j<task->screenNum;j++)
+		{
+			percentiles[j] = RandomR(&task->seed);
+		}
+
+		task->status = ComputeLoValue(percentiles, task->screenNum, task->nullValues+i, task->maxPercentile);
+	}
+
+	TraceEnd("null block");
+
+	MemFree(percentiles);
+}
+
+//Aggregate each gene of a store over the screens it is in. The percentile of a gene in a screen is the mid-rank of its lo-value
+//among the groups of the screen; the lo-value of the percentiles is computed as ComputeLoValue does for items in lists.
+//One null distribution of nullNum lo-values, rounded up to blocks of META_NULL_BLOCK, is simulated for each number of screens that genes have, and shared by these genes.
+//Genes and null blocks run on the thread pool; results do not depend on the number of threads. results has one entry per gene
+//of the store dictionary. Return 1 if success, -1 if failure
+int MetaAggregate(const RESULT_STORE *store, double maxPercentile, int nullNum, THREAD_POOL_STRUCT *pool, META_RESULT *results)
+{
+	int screenNum = store->trailer.screenNum;
+	int geneNum = store->trailer.geneNum;
+	STORE_SEGMENT *segments;
+	GENE_TASK *geneTasks;
+	NULL_TASK *nullTasks;
+	double **nulls;
+	INDEXED_FLOAT *order;
+	int i, k, b, geneTaskNum, nullTaskNum, blockNum, flag;
+
+	if ((screenNum<=0)||(geneNum<=0)||(nullNum<=0))
+	{
+		return -1;
+	}
+
+	//nullNum is rounded up to whole blocks
+	blockNum = (nullNum+META_NULL_BLOCK-1)/META_NULL_BLOCK;
+	nullNum = blockNum*META_NULL_BLOCK;
+	geneTaskNum = (geneNum+META_GENE_CHUNK-1)/META_GENE_CHUNK;
+
+	segments = (STORE_SEGMENT *)MemAlloc(MEM_WORK, screenNum*sizeof(STORE_SEGMENT));
+	geneTasks = (GENE_TASK *)MemAlloc(MEM_WORK, geneTaskNum*sizeof(GENE_TASK));
+	nulls = (double **)MemCalloc(MEM_NULL, screenNum+1, sizeof(double *));
+	nullTasks = NULL;
+	order = NULL;
+
+	flag = ((segments)&&(geneTasks)&&(nulls))?1:-1;
+
+	for (i=0;(i<screenNum)&&(flag>0);i++)
+	{
+		if (StoreSegment(store, i, segments+i)<0)
+		{
+			printf("screen %s of the result store is damaged\n", store->screens[i].name);
+			flag = -1;
+		}
+	}
+
+	//lo-values of the genes, by chunks of genes
+	for (i=0;(i<geneTaskNum)&&(flag>0);i++)
+	{
+		geneTasks[i].store = store;
+		geneTasks[i].segments = segments;
+		geneTasks[i].maxPercentile = maxPercentile;
+		geneTasks[i].start = i*META_GENE_CHUNK;
+		geneTasks[i].end = (i+1)*META_GENE_CHUNK<geneNum?(i+1)*META_GENE_CHUNK:geneNum;
+		geneTasks[i].results = results;
+		geneTasks[i].status = 0;
+
+		if ((!pool)||(ThreadPoolSubmit(pool, AggregateGeneChunk, geneTasks+i)<0))
+		{
+			AggregateGeneChunk(geneTasks+i);
+		}
+	}
+
+	if (pool)
+	{
+		ThreadPoolWait(pool);
+	}
+
+	for (i=0;(i<geneTaskNum)&&(flag>0);i++)
+	{
+		flag = geneTasks[i].status>0?1:-1;
+	}
+
+	//one null distribution for each number of screens that genes have
+	nullTaskNum = 0;
+
+	for (i=0;(i<geneNum)&&(flag>0);i++)
+	{
+		k = results[i].screenNum;
+
+		if ((k>0)&&(!nulls[k]))
+		{
+			nulls[k] = (double *)MemAlloc(MEM_NULL, (long)nullNum*sizeof(double));
+			flag = nulls[k]?1:-1;
+			nullTaskNum += blockNum;
+		}
+	}
+
+	if (flag>0)
+	{
+		nullTasks = (NULL_TASK *)MemAlloc(MEM_WORK, (nullTaskNum+1)*sizeof(NULL_TASK));
+		flag = nullTasks?1:-1;
+	}
+
+	if (flag>0)
+	{
+		i = 0;
+
+		for (k=1;k<=screenNum;k++)
+		{
+			for (b=0;(nulls[k])&&(b<blockNum);b++)
+			{
+				//block b of k screens draws from the stream numbered (k-1)*blockNum+b after RAND_SEED, whatever the other blocks
+				nullTasks[i].screenNum = k;
+				nullTasks[i].seed = JumpSeed(RAND_SEED, (k-1)*blockNum+b+1);
+				nullTasks[i].num = META_NULL_BLOCK;
+				nullTasks[i].maxPercentile = maxPercentile;
+				nullTasks[i].nullValues = nulls[k]+(long)b*META_NULL_BLOCK;
+				nullTasks[i].status = 0;
+
+				if ((!pool)||(ThreadPoolSubmit(pool, SimulateNullBlock, nullTasks+i)<0))
+				{
+					SimulateNullBlock(nullTasks+i);
+				}
+
+				i++;
+			}
+		}
+
+		if (pool)
+		{
+			ThreadPoolWait(pool);
+		}
+
+		for (i=0;(i<nullTaskNum)&&(flag>0);i++)
+		{
+			flag = nullTasks[i].status>0?1:-1;
+		}
+	}
+
+	//p-values against the null of the same number of screens, then false discovery rates over all genes in order of p-value
+	if (flag>0)
+	{
+		TraceBegin("sort null");
+
+		for (k=1;k<=screenNum;k++)
+		{
+			if (nulls[k])
+			{
+				QuicksortF(nulls[k], 0, nullNum-1);
+			}
+		}
+
+		TraceEnd("sort null");
+
+		order = (INDEXED_FLOAT *)MemAlloc(MEM_WORK, geneNum*sizeof(INDEXED_FLOAT));
+		flag = order?1:-1;
+	}
+
+	if (flag>0)
+	{
+		for (i=0;i<geneNum;i++)
+		{
+			results[i].pValue = results[i].screenNum>0?NullPValue(results[i].loValue, nulls[results[i].screenNum], nullNum):1.0;
+			order[i].value = results[i].pValue;
+			order[i].index = i;
+		}
+
+		QuicksortIndexedArray(order, 0, geneNum-1);
+
+		for (i=0;i<geneNum;i++)
+		{
+			results[order[i].index].fdr = order[i].value*geneNum/(i+1);
+		}
+
+		if (results[order[geneNum-1].index].fdr>1.0)
+		{
+			results[order[geneNum-1].index].fdr = 1.0;
+		}
+
+		for (i=geneNum-2;i>=0;i--)
+		{
+			if (results[order[i].index].fdr>results[order[i+1].index].fdr)
+			{
+				results[order[i].index].fdr = results[order[i+1].index].fdr;
+			}
+		}
+	}
+
+	for (k=0;k<=screenNum;k++)
+	{
+		if ((nulls)&&(nulls[k]))
+		{
+			MemFree(nulls[k]);
+		}
+	}
+
+	MemFree(nulls);
+	MemFree(segments);
+	MemFree(geneTasks);
+	MemFree(nullTasks);
+	MemFree(order);
+
+	return flag;
+}
@@ -0,0 +1,286 @@
+/*
+ *  thread_pool.c
+ *	Fixed pool of worker threads running submitted tasks
+ *
+ *  Tasks are kept in a circular queue protected by a mutex, which grows when full. Workers
+ *  name themselves in the trace, are pinned by the execution context, count each task with
+ *  their performance counters for the stage waiting for it, and close the counters when they exit.
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "thread_pool.h"
+#include "perf_counters.h"
+#include "trace.h"
+#include "exec_ctx.h"
+
+#define INIT_TASK_CAPACITY 256     //initial size of the task queue
+
+//Run queued tasks until the pool stops
+static void *WorkerMain(void *arg);
+
+//Return the number of online CPUs, at least 1
+int GetCPUNum(void)
+{
+	long cpuNum;
+
+	cpuNum = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return cpuNum>0?(int)cpuNum:1;
+}
+
+//Create a pool of threadNum workers. With threadNum<=1 no thread is created and tasks run when submitted. Return NULL if failure
+THREAD_POOL_STRUCT *ThreadPoolCreate(int threadNum)
+{
+	THREAD_POOL_STRUCT *pool;
+	int i;
+
+	pool = (THREAD_POOL_STRUCT *)calloc(1, sizeof(THREAD_POOL_STRUCT));
+
+	if (!pool)
+	{
+		return NULL;
+	}
+
+	pthread_mutex_init(&(pool->mutex), NULL);
+	pthread_cond_init(&(pool->taskReady), NULL);
+	pthread_cond_init(&(pool->taskDone), NULL);
+
+	if (threadNum<=1)
+	{
+		return pool;
+	}
+
+	pool->taskCapacity = INIT_TASK_CAPACITY;
+	pool->tasks = (TASK_STRUCT *)malloc(pool->taskCapacity*sizeof(TASK_STRUCT));
+	pool->threads = (pthread_t *)malloc(threadNum*sizeof(pthread_t));
+
+	if ((!pool->tasks)||(!pool->threads))
+	{
+		ThreadPoolDestroy(pool);
+		return NULL;
+	}
+
+	for (i=0;i<threadNum;i++)
+	{
+		if (pthread_create(pool->threads+i, NULL, WorkerMain, pool)!=0)
+		{
+			printf("Cannot create thread %d\n", i);
+			ThreadPoolDestroy(pool);
+			return NULL;
+		}
+
+		pool->threadNum++;
+	}
+
+	return pool;
+}
+
+//Queue a task. Return 1 if success, -1 if failure
+int ThreadPoolSubmit(THREAD_POOL_STRUCT *pool, TASK_FUNC func, void *arg)
+{
+	TASK_STRUCT *tmpTasks;
+	int i;
+
+	if (pool->threadNum==0)
+	{
+		func(arg);
+		return 1;
+	}
+
+	pthread_mutex_lock(&(pool->mutex));
+
+	if (pool->taskNum>=pool->taskCapacity)
+	{
+		tmpTasks = (TASK_STRUCT *)malloc(2*pool->taskCapacity*sizeof(TASK_STRUCT));
+
+		if (!tmpTasks)
+		{
+			pthread_mutex_unlock(&(pool->mutex));
+			return -1;
+		}
+
+		for (i=0;i<pool->taskNum;i++)
+		{
+			tmpTasks[i] = pool->tasks[(pool->taskHead+i)%pool->taskCapacity];
+		}
+
+		free(pool->tasks);
+		pool->tasks = tmpTasks;
+		pool->taskHead = 0;
+		pool->taskCapacity *= 2;
+	}
+
+	pool->tasks[(pool->taskHead+pool->taskNum)%pool->taskCapacity].func = func;
+	pool->tasks[(pool->taskHead+pool->taskNum)%pool->taskCapacity].arg = arg;
+	pool->taskNum++;
+
+	pthread_cond_signal(&(pool->taskReady));
+	pthread_mutex_unlock(&(pool->mutex));
+
+	return 1;
+}
+
+//Run func once on every worker, each with its own index, and wait until all have finished. Without workers func runs
+//in the calling thread as worker 0 of 1. Used to give each worker its own state for the tasks it runs
+void ThreadPoolBroadcast(THREAD_POOL_STRUCT *pool, BROADCAST_FUNC func, void *arg)
+{
+	if (pool->threadNum==0)
+	{
+		func(arg, 0, 1);
+		return;
+	}
+
+	ThreadPoolWait(pool);
+
+	pthread_mutex_lock(&(pool->mutex));
+
+	pool->broadcastFunc = func;
+	pool->broadcastArg = arg;
+	pool->broadcastLeft = pool->threadNum;
+	pool->broadcastRound++;
+
+	pthread_cond_broadcast(&(pool->taskReady));
+
+	while (pool->broadcastLeft>0)
+	{
+		pthread_cond_wait(&(pool->taskDone), &(pool->mutex));
+	}
+
+	pthread_mutex_unlock(&(pool->mutex));
+}
+
+//Wait until all submitted tasks have finished
+void ThreadPoolWait(THREAD_POOL_STRUCT *pool)
+{
+	pthread_mutex_lock(&(pool->mutex));
+
+	while ((pool->taskNum>0)||(pool->activeNum>0))
+	{
+		pthread_cond_wait(&(pool->taskDone), &(pool->mutex));
+	}
+
+	pthread_mutex_unlock(&(pool->mutex));
+}
+
+//Wait for the submitted tasks, stop the workers and free the pool
+void ThreadPoolDestroy(THREAD_POOL_STRUCT *pool)
+{
+	int i;
+
+	if (!pool)
+	{
+		return;
+	}
+
+	ThreadPoolWait(pool);
+
+	pthread_mutex_lock(&(pool->mutex));
+	pool->stopping = 1;
+	pthread_cond_broadcast(&(pool->taskReady));
+	pthread_mutex_unlock(&(pool->mutex));
+
+	for (i=0;i<pool->threadNum;i++)
+	{
+		pthread_join(pool->threads[i], NULL);
+	}
+
+	pthread_mutex_destroy(&(pool->mutex));
+	pthread_cond_destroy(&(pool->taskReady));
+	pthread_cond_destroy(&(pool->taskDone));
+
+	free(pool->threads);
+	free(pool->tasks);
+	free(pool);
+}
+
+//Run queued tasks until the pool stops
+static void *WorkerMain(void *arg)
+{
+	THREAD_POOL_STRUCT *pool = (THREAD_POOL_STRUCT *)arg;
+	TASK_STRUCT task;
+	PERF_SAMPLE perf;
+	int workerIndex, round;
+
+	TraceSetThreadName("worker");
+
+	pthread_mutex_lock(&(pool->mutex));
+
+	workerIndex = pool->startedNum;
+	pool->startedNum++;
+
+	//a broadcast made before this worker started is still run, as round starts from 0
+	round = 0;
+
+	pthread_mutex_unlock(&(pool->mutex));
+
+	ExecPinWorker(workerIndex);
+
+	pthread_mutex_lock(&(pool->mutex));
+
+	while (1)
+	{
+		while ((pool->taskNum==0)&&(!pool->stopping)&&(round==pool->broadcastRound))
+		{
+			pthread_cond_wait(&(pool->taskReady), &(pool->mutex));
+		}
+
+		if (round!=pool->broadcastRound)
+		{
+			//every worker runs the broadcast function once
+			round = pool->broadcastRound;
+
+			pthread_mutex_unlock(&(pool->mutex));
+
+			pool->broadcastFunc(pool->broadcastArg, workerIndex, pool->threadNum);
+
+			pthread_mutex_lock(&(pool->mutex));
+
+			pool->broadcastLeft--;
+
+			if (pool->broadcastLeft==0)
+			{
+				pthread_cond_broadcast(&(pool->taskDone));
+			}
+
+			continue;
+		}
+
+		if (pool->taskNum==0)
+		{
+			break;
+		}
+
+		task = pool->tasks[pool->taskHead];
+		pool->taskHead = (pool->taskHead+1)%pool->taskCapacity;
+		pool->taskNum--;
+		pool->activeNum++;
+
+		pthread_mutex_unlock(&(pool->mutex));
+
+		PerfTaskBegin(&perf);
+		task.func(task.arg);
+		PerfTaskEnd(&perf);
+
+		pthread_mutex_lock(&(pool->mutex));
+
+		pool->activeNum--;
+
+		if ((pool->taskNum==0)&&(pool->activeNum==0))
+		{
+			pthread_cond_broadcast(&(pool->taskDone));
+		}
+	}
+
+	pthread_mutex_unlock(&(pool->mutex));
+
+	PerfThreadExit();
+
+	return NULL;
+}
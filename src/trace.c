@@ -0,0 +1,227 @@
+/*
+ *  trace.c
+ *	Timeline of spans recorded in per-thread ring buffers and exported as Chrome/Perfetto trace JSON
+ *
+ *  Each thread appends events to its own ring buffer, so recording takes no lock and costs a clock
+ *  read and a few stores. A buffer is allocated on the first event of a thread and published on a
+ *  lock-free list with compare-and-swap. The write index is stored with release order, so the
+ *  exporter sees complete events. When a ring is full the oldest events are overwritten and counted.
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "trace.h"
+
+typedef struct
+{
+	const char *name;              //name of the span
+	long long time;                //nanoseconds since TraceInit
+	char phase;                    //'B' for begin, 'E' for end
+} TRACE_EVENT;
+
+typedef struct TRACE_BUFFER
+{
+	TRACE_EVENT events[TRACE_BUFFER_EVENTS];  //ring of events
+	unsigned long long writeNum;   //number of events written, including overwritten ones
+	int thread;                    //index of the thread
+	const char *threadName;        //name of the thread, NULL if not named
+	struct TRACE_BUFFER *next;     //next buffer in the list of all threads
+} TRACE_BUFFER;
+
+static int traceEnabled = 0;                       //1 if recording is on
+static char traceFileName[1000];                   //file written at exit
+static long long traceStart = 0;                   //time of TraceInit in nanoseconds
+static int traceThreadNum = 0;                     //number of threads that recorded events
+static TRACE_BUFFER *traceBuffers = NULL;          //list of the buffers of all threads
+static __thread TRACE_BUFFER *threadBuffer = NULL; //buffer of the calling thread
+
+//Return a monotonic time in nanoseconds
+static long long TraceClock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (long long)ts.tv_sec*1000000000LL+ts.tv_nsec;
+}
+
+//Return the buffer of the calling thread, allocating and publishing it on first use. Return NULL if failure
+static TRACE_BUFFER *GetThreadBuffer(void)
+{
+	TRACE_BUFFER *buffer, *head;
+
+	if (threadBuffer)
+	{
+		return threadBuffer;
+	}
+
+	buffer = (TRACE_BUFFER *)calloc(1, sizeof(TRACE_BUFFER));
+
+	if (!buffer)
+	{
+		return NULL;
+	}
+
+	buffer->thread = __atomic_fetch_add(&traceThreadNum, 1, __ATOMIC_RELAXED);
+
+	head = __atomic_load_n(&traceBuffers, __ATOMIC_RELAXED);
+
+	do
+	{
+		buffer->next = head;
+	} while (!__atomic_compare_exchange_n(&traceBuffers, &head, buffer, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+	threadBuffer = buffer;
+
+	return buffer;
+}
+
+//Append an event to the ring of the calling thread
+static void TraceRecord(const char *name, char phase)
+{
+	TRACE_BUFFER *buffer;
+	TRACE_EVENT *event;
+	unsigned long long writeNum;
+
+	buffer = GetThreadBuffer();
+
+	if (!buffer)
+	{
+		return;
+	}
+
+	writeNum = buffer->writeNum;
+	event = buffer->events+(writeNum%TRACE_BUFFER_EVENTS);
+	event->name = name;
+	event->time = TraceClock()-traceStart;
+	event->phase = phase;
+
+	__atomic_store_n(&(buffer->writeNum), writeNum+1, __ATOMIC_RELEASE);
+}
+
+//Write the trace when the program exits
+static void WriteTraceAtExit(void)
+{
+	traceEnabled = 0;
+	TraceWrite(traceFileName);
+}
+
+//Turn recording on and write the trace to fileName when the program exits. Recording stays off if fileName is NULL
+void TraceInit(const char *fileName)
+{
+	if ((!fileName)||(traceEnabled))
+	{
+		return;
+	}
+
+	strncpy(traceFileName, fileName, sizeof(traceFileName)-1);
+	traceStart = TraceClock();
+	traceEnabled = 1;
+
+	TraceSetThreadName("main");
+
+	atexit(WriteTraceAtExit);
+}
+
+//Return 1 if recording is on
+int TraceEnabled(void)
+{
+	return traceEnabled;
+}
+
+//Begin a span in the calling thread. name must be a string constant
+void TraceBegin(const char *name)
+{
+	if (traceEnabled)
+	{
+		TraceRecord(name, 'B');
+	}
+}
+
+//End the span begun last with the same name in the calling thread
+void TraceEnd(const char *name)
+{
+	if (traceEnabled)
+	{
+		TraceRecord(name, 'E');
+	}
+}
+
+//Name the calling thread in the timeline. name must be a string constant
+void TraceSetThreadName(const char *name)
+{
+	TRACE_BUFFER *buffer;
+
+	if (!traceEnabled)
+	{
+		return;
+	}
+
+	buffer = GetThreadBuffer();
+
+	if (buffer)
+	{
+		buffer->threadName = name;
+	}
+}
+
+//Write the events of all threads to a Chrome/Perfetto trace file. Return 1 if success, -1 if failure
+int TraceWrite(const char *fileName)
+{
+	FILE *fh;
+	TRACE_BUFFER *buffer;
+	TRACE_EVENT *event;
+	unsigned long long writeNum, first, i;
+	unsigned long long droppedNum;
+	int eventNum;
+
+	fh = (FILE *)fopen(fileName, "w");
+
+	if (!fh)
+	{
+		printf("Cannot open %s.\n", fileName);
+		return -1;
+	}
+
+	fprintf(fh, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+	eventNum = 0;
+	droppedNum = 0;
+
+	for (buffer=__atomic_load_n(&traceBuffers, __ATOMIC_ACQUIRE);buffer;buffer=buffer->next)
+	{
+		fprintf(fh, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+				eventNum>0?",\n":"", buffer->thread,
+				buffer->threadName?buffer->threadName:"thread");
+		eventNum++;
+
+		writeNum = __atomic_load_n(&(buffer->writeNum), __ATOMIC_ACQUIRE);
+		first = writeNum>TRACE_BUFFER_EVENTS?writeNum-TRACE_BUFFER_EVENTS:0;
+		droppedNum += first;
+
+		for (i=first;i<writeNum;i++)
+		{
+			event = buffer->events+(i%TRACE_BUFFER_EVENTS);
+
+			fprintf(fh, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d}",
+					event->name, event->phase, event->time/1000.0, buffer->thread);
+			eventNum++;
+		}
+	}
+
+	fprintf(fh, "\n],\"otherData\":{\"dropped_events\":%llu}}\n", droppedNum);
+
+	if (fclose(fh)!=0)
+	{
+		printf("Cannot write %s.\n", fileName);
+		return -1;
+	}
+
+	return 1;
+}
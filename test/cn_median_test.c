@@ -0,0 +1,132 @@
+/*
+ *  cn_median_test.c
+ *	CorrectCopyNumber against the median of each window taken by a plain sort
+ *
+ *  Created by Han Xu on 18/10/26.
+ *  Copyright 2026 Dana Farber Cancer Institute. All rights reserved.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "norm_core.h"
+#include "thread_pool.h"
+#include "rngs.h"
+
+#define TEST_ITEM_NUM 5000         //number of items
+#define TEST_CHROM_NUM 4           //number of chromosomes
+#define TEST_HALF_WINDOW 20000     //half width of the window in bp
+
+//Order doubles in ascending order
+static int CompareDouble(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x>y)-(x<y);
+}
+
+//Lower median of the items of the chromosome of item i within halfWindow of its position, by a sort of the window
+static double WindowMedian(const double *r, const int *chromosomes, const long *positions, int itemNum, long halfWindow, int i, double *work)
+{
+	int j, n;
+
+	for (j=0,n=0;j<itemNum;j++)
+	{
+		if ((chromosomes[j]==chromosomes[i])&&(positions[j]>=positions[i]-halfWindow)&&(positions[j]<=positions[i]+halfWindow))
+		{
+			work[n] = r[j];
+			n++;
+		}
+	}
+
+	qsort(work, n, sizeof(double), CompareDouble);
+
+	return work[(n-1)/2];
+}
+
+//Correct random log-ratios, with ties and items without position, with threadNum threads, 0 for none. Return the number of wrong items
+static int TestCorrection(int threadNum)
+{
+	THREAD_POOL_STRUCT *pool;
+	double *r, *correctedR, *work, expected;
+	int *chromosomes;
+	long *positions;
+	int i, errorNum;
+
+	r = (double *)malloc(TEST_ITEM_NUM*sizeof(double));
+	correctedR = (double *)malloc(TEST_ITEM_NUM*sizeof(double));
+	work = (double *)malloc(TEST_ITEM_NUM*sizeof(double));
+	chromosomes = (int *)malloc(TEST_ITEM_NUM*sizeof(int));
+	positions = (long *)malloc(TEST_ITEM_NUM*sizeof(long));
+	pool = threadNum>0?ThreadPoolCreate(threadNum):NULL;
+
+	if ((!r)||(!correctedR)||(!work)||(!chromosomes)||(!positions)||((threadNum>0)&&(!pool)))
+	{
+		printf("Cannot allocate memory\n");
+		return TEST_ITEM_NUM;
+	}
+
+	PlantSeeds(12345);
+
+	for (i=0;i<TEST_ITEM_NUM;i++)
+	{
+		//one item in ten has no position; values on a grid of 1/1000 give ties, and their offsets are finer than any histogram bin
+		chromosomes[i] = Random()<0.1?-1:(int)(Random()*TEST_CHROM_NUM);
+		positions[i] = (long)(Random()*1000000);
+		r[i] = (int)(Random()*4000-2000)/1000.0+(chromosomes[i]>0?chromosomes[i]*0.3:0);
+	}
+
+	errorNum = 0;
+
+	if (CorrectCopyNumber(r, chromosomes, positions, TEST_ITEM_NUM, TEST_HALF_WINDOW, pool, correctedR)<0)
+	{
+		printf("CorrectCopyNumber failed\n");
+		errorNum = TEST_ITEM_NUM;
+	}
+
+	for (i=0;(i<TEST_ITEM_NUM)&&(errorNum<TEST_ITEM_NUM);i++)
+	{
+		expected = chromosomes[i]<0?r[i]:r[i]-WindowMedian(r, chromosomes, positions, TEST_ITEM_NUM, TEST_HALF_WINDOW, i, work);
+
+		if (correctedR[i]!=expected)
+		{
+			if (errorNum<5)
+			{
+				printf("item %d: corrected ratio %f, expected %f\n", i, correctedR[i], expected);
+			}
+
+			errorNum++;
+		}
+	}
+
+	if (pool)
+	{
+		ThreadPoolDestroy(pool);
+	}
+
+	free(r);
+	free(correctedR);
+	free(work);
+	free(chromosomes);
+	free(positions);
+
+	return errorNum;
+}
+
+int main(int argc, const char *argv[])
+{
+	int errorNum;
+
+	errorNum = TestCorrection(0)+TestCorrection(3);
+
+	if (errorNum>0)
+	{
+		printf("cn_median_test: %d items differ from the median by sort\n", errorNum);
+		return 1;
+	}
+
+	printf("cn_median_test: passed\n");
+
+	return 0;
+}
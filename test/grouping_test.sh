@@ -0,0 +1,37 @@
+#!/bin/bash
+#
+#  grouping_test.sh
+#	--group-file on the sample data of bin/, where some guides are in two genes of the same list
+#
+#  Run from the top directory by make test.
+#
+
+RRA=./bin/RRA
+INPUT=./bin/WANG_HL60_KBM7_norm_4col.txt
+TMP=$(mktemp -d)
+trap 'rm -rf $TMP' EXIT
+
+fail()
+{
+	echo "grouping_test: $1"
+	exit 1
+}
+
+#a grouping that repeats the genes of the input, each guide with its list and input gene, scores every gene as the input groups do
+awk 'NR==1{print "sgRNA\tgene\tlist\tinput_gene";next}{print $1"\t"$2"\t"$3"\t"$2}' $INPUT > $TMP/genes.txt
+$RRA -i $INPUT -o $TMP/out.txt -p 0.1 --group-file $TMP/genes.txt > $TMP/log.txt || fail "run with a mapping by input group failed"
+cut -f1-3 $TMP/out.txt | sort > $TMP/main.txt
+cut -f1-3 $TMP/out.genes.txt | sort > $TMP/grouping.txt
+cmp -s $TMP/main.txt $TMP/grouping.txt || fail "lo-values of the grouping differ from those of the input groups"
+
+#without the input gene, a guide of two genes cannot be told apart
+awk 'NR==1{print "sgRNA\tgene";next}{print $1"\t"$2}' $INPUT > $TMP/ids.txt
+$RRA -i $INPUT -o $TMP/out.txt -p 0.1 --group-file $TMP/ids.txt > $TMP/log.txt && fail "an ambiguous mapping row was accepted"
+grep -q "m29236553 .* ambiguous" $TMP/log.txt || fail "the ambiguous guide is not reported"
+
+#the last row is read without a trailing newline
+printf "sgRNA\tgene\tlist\tinput_gene\nm52595977\tLAST\tlist\tA1CF" > $TMP/last.txt
+$RRA -i $INPUT -o $TMP/out.txt -p 0.1 --group-file $TMP/last.txt > $TMP/log.txt || fail "run with a mapping without a final newline failed"
+grep -q "^LAST	1	" $TMP/out.last.txt || fail "the last row of the mapping is dropped"
+
+echo "grouping_test: passed"